@@ -0,0 +1,20 @@
+/* $Id$ */
+
+#include <sys/epoll.h>
+
+#include <stdlib.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct epoll_event ev;
+	int fd;
+
+	(void)argc;
+	(void)argv;
+	fd = epoll_create1(EPOLL_CLOEXEC);
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.fd = 0;
+	epoll_ctl(fd, EPOLL_CTL_ADD, 0, &ev);
+	exit(0);
+}
@@ -0,0 +1,26 @@
+/* $Id$ */
+
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct io_uring_params p;
+	struct io_uring_probe pr;
+	int op = IORING_OP_READ_FIXED, rop = IORING_OP_READ;
+
+	(void)argc;
+	(void)argv;
+	(void)op;
+	(void)rop;
+	(void)pr;
+	p.sq_entries = 0;
+	syscall(__NR_io_uring_setup, 1, &p);
+	syscall(__NR_io_uring_enter, -1, 0, 0, IORING_ENTER_GETEVENTS,
+	    NULL, 0);
+	exit(0);
+}
@@ -0,0 +1,25 @@
+/* $Id$ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <linux/errqueue.h>
+#include <stdlib.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct sock_extended_err serr;
+	int fd, on = 1;
+
+	(void)argc;
+	(void)argv;
+	serr.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr.ee_code = SO_EE_CODE_ZEROCOPY_COPIED;
+	(void)serr;
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+	send(fd, "", 0, MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+	recv(fd, NULL, 0, MSG_ERRQUEUE | MSG_DONTWAIT);
+	exit(0);
+}
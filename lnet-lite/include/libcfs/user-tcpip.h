@@ -80,6 +80,9 @@ int libcfs_sock_set_keepalive(int, int, int, int, int);
 int libcfs_sock_set_nagle(int fd, int nagle);
 int libcfs_sock_set_maxseg(int fd, int maxseg);
 int libcfs_sock_set_bufsiz(int fd, int bufsiz);
+int libcfs_sock_set_linger(int fd, int secs);
+int libcfs_sock_set_zerocopy(int fd);
+int libcfs_sock_zc_reap(int fd, __u32 *lo, __u32 *hi, int *copied);
 int libcfs_sock_create(int *fdp, __u64);
 int libcfs_sock_bind_to_port(int fd, __u64, __u32, __u16 port);
 
@@ -93,6 +96,7 @@ struct lnet_xport_int {
 	ssize_t		(*lxi_read)(struct lnet_xport *, void *, size_t, int);
 	ssize_t		(*lxi_readv)(struct lnet_xport *, const struct iovec *, int);
 	ssize_t		(*lxi_writev)(struct lnet_xport *, const struct iovec *, int);
+	ssize_t		(*lxi_writev_zc)(struct lnet_xport *, const struct iovec *, int, int *);
 };
 
 struct lnet_xport {
@@ -134,6 +138,11 @@ void	lx_destroy(struct lnet_xport *);
 #define lx_read(lx, buf, sz, t)	(lx)->lx_tab->lxi_read((lx), (buf), (sz), (t))
 #define lx_readv(lx, iov, n)	(lx)->lx_tab->lxi_readv((lx), (iov), (n))
 #define lx_writev(lx, iov, n)	(lx)->lx_tab->lxi_writev((lx), (iov), (n))
+#define lx_writev_zc(lx, iov, n, zcp)					\
+	(lx)->lx_tab->lxi_writev_zc((lx), (iov), (n), (zcp))
+
+/* transport can send straight from user pages (not e.g. SSL) */
+#define lx_can_zerocopy(lx)	((lx)->lx_tab->lxi_writev_zc != NULL)
 
 extern struct lnet_xport_int libcfs_ssl_lxi;
 extern struct lnet_xport_int libcfs_sock_lxi;
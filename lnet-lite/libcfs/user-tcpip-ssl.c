@@ -181,5 +181,6 @@ struct lnet_xport_int libcfs_ssl_lxi = {
 	libcfs_ssl_sock_init,
 	libcfs_ssl_sock_read,
 	libcfs_ssl_sock_readv,
-	libcfs_ssl_sock_writev
+	libcfs_ssl_sock_writev,
+	NULL			/* encrypts, so never zero-copy */
 };
@@ -67,6 +67,10 @@
 #include <ifaddrs.h>
 #endif
 
+#ifdef HAVE_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
 #include "sdp_inet.h"
 #include "pfl/thread.h"
 
@@ -617,6 +621,94 @@ libcfs_sock_set_bufsiz(int fd, int bufsiz)
 	return 0;
 }
 
+/*
+ * Have close(2) reset the connection instead of draining unsent data,
+ * e.g. because the pages backing that data are about to be reused.
+ */
+int
+libcfs_sock_set_linger(int fd, int secs)
+{
+	struct linger option;
+	int rc;
+
+	option.l_onoff = 1;
+	option.l_linger = secs;
+	rc = setsockopt(fd, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+	if (rc != 0) {
+		rc = -errno;
+		CERROR ("Cannot set LINGER socket option\n");
+		return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Allow MSG_ZEROCOPY sends on a socket.  Fails quietly so the caller
+ * can fall back to copying sends on kernels without support.
+ */
+int
+libcfs_sock_set_zerocopy(int fd)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+	int option = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &option,
+	    sizeof(option)) != 0)
+		return -errno;
+	return 0;
+#else
+	(void)fd;
+	return -EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Dequeue one MSG_ZEROCOPY completion from the socket error queue.
+ * On success, [*lo, *hi] is the range of send calls whose pages the
+ * kernel has released and *copied is set if the kernel fell back to
+ * copying them.  Returns 1 if a completion was read, 0 if the queue is
+ * empty, or a negative errno for a real socket error.
+ */
+int
+libcfs_sock_zc_reap(int fd, __u32 *lo, __u32 *hi, int *copied)
+{
+#ifdef HAVE_MSG_ZEROCOPY
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct sock_extended_err *serr;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+		return (errno == EAGAIN ? 0 : -errno);
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (cm == NULL ||
+	    !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+	      (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+		return -EIO;
+
+	serr = (struct sock_extended_err *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		return (serr->ee_errno ? -(int)serr->ee_errno : -EIO);
+
+	*lo = serr->ee_info;
+	*hi = serr->ee_data;
+	*copied = (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+	return 1;
+#else
+	(void)fd;
+	(void)lo;
+	(void)hi;
+	(void)copied;
+	return 0;
+#endif
+}
+
 int
 libcfs_sock_create(int *fdp, lnet_nid_t nid)
 {
@@ -717,6 +809,46 @@ libcfs_sock_writev(struct lnet_xport *lx, const struct iovec *vector,
 	return rc;
 }
 
+#ifdef HAVE_MSG_ZEROCOPY
+/*
+ * Like libcfs_sock_writev() but let the kernel transmit straight from
+ * the caller's pages.  The pages must be left alone until the matching
+ * completion is returned by libcfs_sock_zc_reap().  *zcp is set if the
+ * data went out zero-copy and so consumed a completion ID; if the
+ * kernel cannot take a zero-copy send right now, this falls back to a
+ * plain copying send.
+ */
+ssize_t
+libcfs_sock_writev_zc(struct lnet_xport *lx, const struct iovec *vector,
+    int count, int *zcp)
+{
+	struct msghdr msg;
+	ssize_t rc;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *)vector;
+	msg.msg_iovlen = count;
+
+	*zcp = 0;
+	rc = sendmsg(lx->lx_fd, &msg, MSG_ZEROCOPY | MSG_DONTWAIT);
+	if (rc > 0) {
+		*zcp = 1;
+		return rc;
+	}
+	if (rc < 0 && errno == ENOBUFS) /* out of notification memory */
+		return libcfs_sock_writev(lx, vector, count);
+
+	if (rc == 0) /* write nothing */
+		return 0;
+
+	if (errno == EAGAIN ||   /* write nothing   */
+	    errno == EPIPE ||    /* non-fatal error */
+	    errno == ECONNRESET) /* non-fatal error */
+		return 0;
+	return -errno;
+}
+#endif
+
 ssize_t
 libcfs_sock_readv(struct lnet_xport *lx, const struct iovec *vector,
     int count)
@@ -762,7 +894,12 @@ struct lnet_xport_int libcfs_sock_lxi = {
 	NULL,
 	libcfs_sock_read,
 	libcfs_sock_readv,
-	libcfs_sock_writev
+	libcfs_sock_writev,
+#ifdef HAVE_MSG_ZEROCOPY
+	libcfs_sock_writev_zc
+#else
+	NULL
+#endif
 };
 
 #endif /* !__KERNEL__ || !defined(REDSTORM) */
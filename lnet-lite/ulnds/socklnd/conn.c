@@ -271,6 +271,7 @@ usocklnd_create_passive_conn(lnet_ni_t *ni, struct lnet_xport *lx,
         conn->uc_ni = ni;
         CFS_INIT_LIST_HEAD (&conn->uc_tx_list);
         CFS_INIT_LIST_HEAD (&conn->uc_zcack_list);
+        CFS_INIT_LIST_HEAD (&conn->uc_zc_list);
         pthread_mutex_init(&conn->uc_lock, NULL);
         cfs_atomic_set(&conn->uc_refcount, 1); /* 1 ref for me */
 
@@ -332,6 +333,7 @@ usocklnd_create_active_conn(usock_peer_t *peer, int type,
         usocklnd_peer_addref(peer);
         CFS_INIT_LIST_HEAD (&conn->uc_tx_list);
         CFS_INIT_LIST_HEAD (&conn->uc_zcack_list);
+        CFS_INIT_LIST_HEAD (&conn->uc_zc_list);
         pthread_mutex_init(&conn->uc_lock, NULL);
         cfs_atomic_set(&conn->uc_refcount, 1); /* 1 ref for me */
 
@@ -699,6 +701,23 @@ usocklnd_destroy_conn(usock_conn_t *conn)
 			fprintf(stderr, "usocklnd_destroy_conn(): NULL uc_peer.\n");
         }
 
+        /* Fully sent txs still waiting for zero-copy completion.  The
+         * socket was reset on close, so the peer may not have got them.
+         * Partially sent ones are also on uc_tx_list and go below. */
+        while (!list_empty(&conn->uc_zc_list)) {
+                usock_tx_t *tx;
+
+                tx = list_entry(conn->uc_zc_list.next, usock_tx_t,
+                                tx_zc_list);
+                list_del(&tx->tx_zc_list);
+                if (!tx->tx_zc_sent)
+                        continue;
+
+                LASSERT (conn->uc_peer != NULL);
+                tx->tx_resid = tx->tx_nob; /* fail with -EIO */
+                usocklnd_destroy_tx(conn->uc_peer->up_ni, tx);
+        }
+
         if (!list_empty(&conn->uc_tx_list)) {
 		/*
 		 * 04/04/2017: Hit NULL assert below.
@@ -725,6 +744,23 @@ usocklnd_destroy_conn(usock_conn_t *conn)
         usocklnd_conn_free(conn);
 }
 
+/* Called before the socket is closed: if the kernel may still be
+ * transmitting from pages handed over with MSG_ZEROCOPY, reset the
+ * connection rather than letting it drain from pages that are about
+ * to be given back to their owners */
+void
+usocklnd_zc_linger(usock_conn_t *conn)
+{
+        int pending;
+
+        pthread_mutex_lock(&conn->uc_lock);
+        pending = !list_empty(&conn->uc_zc_list);
+        pthread_mutex_unlock(&conn->uc_lock);
+
+        if (pending)
+                libcfs_sock_set_linger(conn->uc_lx->lx_fd, 0);
+}
+
 int
 usocklnd_get_conn_type(lnet_msg_t *lntmsg)
 {
@@ -693,12 +693,12 @@ usocklnd_write_handler(usock_conn_t *conn)
 			break;
 		}
 		if (rc < 0) { /* real error */
-			usocklnd_destroy_tx(ni, tx);
+			usocklnd_complete_tx(conn, ni, tx);
 			break;
 		}
 
 		/* rc == 1: tx was sent completely */
-		usocklnd_destroy_tx(ni, tx);
+		usocklnd_complete_tx(conn, ni, tx);
 
 		pthread_mutex_lock(&conn->uc_lock);
 		conn->uc_sending = 0;
@@ -936,28 +936,151 @@ usocklnd_passiveconn_hellosent(usock_conn_t *conn)
  * non-fatal errors. An error should be considered as non-fatal if:
  * 1) it still makes sense to continue reading &&
  * 2) anyway, poll() will set up POLLHUP|POLLERR flags */
+/* Decide whether to send a tx straight from the caller's pages.  Only
+ * LNET payloads of at least USOCK_ZEROCOPY_MIN bytes qualify: below
+ * that, pinning pages and reaping completions costs more than the copy.
+ * SO_ZEROCOPY is enabled on the socket the first time it is needed */
+static int
+usocklnd_tx_zerocopy(usock_conn_t *conn, usock_tx_t *tx)
+{
+	if (usock_tuns.ut_zc_min == 0 || tx->tx_lnetmsg == NULL ||
+	    tx->tx_nob < usock_tuns.ut_zc_min || conn->uc_zc < 0)
+		return 0;
+
+	if (conn->uc_zc == 0) {
+		if (!lx_can_zerocopy(conn->uc_lx) ||
+		    libcfs_sock_set_zerocopy(conn->uc_lx->lx_fd)) {
+			conn->uc_zc = -1;
+			return 0;
+		}
+		conn->uc_zc = 1;
+	}
+	return 1;
+}
+
+/* Release a tx that was sent completely or failed.  A tx sent with
+ * MSG_ZEROCOPY is parked on uc_zc_list until the kernel has released
+ * its pages, since lnet_finalize() lets the owner of the payload reuse
+ * the buffer */
+void
+usocklnd_complete_tx(usock_conn_t *conn, lnet_ni_t *ni, usock_tx_t *tx)
+{
+	if (tx->tx_zc_nsend) {
+		pthread_mutex_lock(&conn->uc_lock);
+		if (tx->tx_resid == 0 && tx->tx_zc_left) {
+			tx->tx_zc_sent = 1;
+			pthread_mutex_unlock(&conn->uc_lock);
+			return;
+		}
+		list_del(&tx->tx_zc_list);
+		pthread_mutex_unlock(&conn->uc_lock);
+	}
+	usocklnd_destroy_tx(ni, tx);
+}
+
+/* Drain MSG_ZEROCOPY completions from the socket error queue and
+ * finalize parked txs whose pages the kernel no longer needs.  Returns
+ * the number of completions consumed or <0 on a real socket error */
+int
+usocklnd_zc_reap(usock_conn_t *conn)
+{
+	struct list_head  done;
+	usock_tx_t       *tx;
+	usock_tx_t       *tmp;
+	__u64             first;
+	__u64             last;
+	__u64             lo;
+	__u64             hi;
+	__u32             zlo;
+	__u32             zhi;
+	int               copied;
+	int               rc;
+	int               n = 0;
+
+	if (conn->uc_zc <= 0)
+		return 0;
+
+	CFS_INIT_LIST_HEAD(&done);
+
+	pthread_mutex_lock(&conn->uc_lock);
+	while ((rc = libcfs_sock_zc_reap(conn->uc_lx->lx_fd, &zlo, &zhi,
+	    &copied)) > 0) {
+		n++;
+		if (copied)
+			pfl_opstat_incr(usock_zc_copied);
+
+		/* widen the 32-bit IDs relative to the next one to issue */
+		first = conn->uc_zc_seq - (__u32)((__u32)conn->uc_zc_seq - zlo);
+		last = first + (__u32)(zhi - zlo);
+
+		list_for_each_entry_safe(tx, tmp, &conn->uc_zc_list,
+		    tx_zc_list) {
+			lo = tx->tx_zc_first;
+			hi = lo + tx->tx_zc_nsend - 1;
+			if (last < lo || first > hi)
+				continue;
+
+			tx->tx_zc_left -= (last < hi ? last : hi) -
+			    (first > lo ? first : lo) + 1;
+			LASSERT (tx->tx_zc_left >= 0);
+			if (tx->tx_zc_left == 0 && tx->tx_zc_sent)
+				list_move_tail(&tx->tx_zc_list, &done);
+		}
+	}
+	pthread_mutex_unlock(&conn->uc_lock);
+
+	list_for_each_entry_safe(tx, tmp, &done, tx_zc_list) {
+		LASSERT (conn->uc_peer != NULL);
+		usocklnd_destroy_tx(conn->uc_peer->up_ni, tx);
+	}
+
+	return rc < 0 ? rc : n;
+}
+
 int
 usocklnd_send_tx(usock_conn_t *conn, usock_tx_t *tx)
 {
 	struct iovec *iov;
 	int           nob;
+	int           zc;
+	int           use_zc;
 	struct lnet_xport *lx = conn->uc_lx;
 	struct pfl_opstat *opst;
 	cfs_time_t    t;
 
 	LASSERT (tx->tx_resid != 0);
 
+	use_zc = usocklnd_tx_zerocopy(conn, tx);
+
 	do {
 		usock_peer_t *peer = conn->uc_peer;
 
 		LASSERT (tx->tx_niov > 0);
 
-		nob = lx_writev(lx, tx->tx_iov, tx->tx_niov);
+		zc = 0;
+		if (use_zc)
+			nob = lx_writev_zc(lx, tx->tx_iov, tx->tx_niov, &zc);
+		else
+			nob = lx_writev(lx, tx->tx_iov, tx->tx_niov);
 		if (nob < 0)
 			conn->uc_errored = 1;
 		if (nob <= 0) /* write queue is flow-controlled or error */
 			return nob;
 
+		if (zc) {
+			/* the kernel numbers each zero-copy send call */
+			pthread_mutex_lock(&conn->uc_lock);
+			if (tx->tx_zc_nsend++ == 0) {
+				tx->tx_zc_first = conn->uc_zc_seq;
+				list_add_tail(&tx->tx_zc_list,
+				    &conn->uc_zc_list);
+			}
+			tx->tx_zc_left++;
+			conn->uc_zc_seq++;
+			pthread_mutex_unlock(&conn->uc_lock);
+			pfl_opstat_add(usock_zc_snd, nob);
+		}
+
 		if (peer && peer->up_ni)
 			opst = peer->up_ni->ni_iostats.wr;
 		else if (conn->uc_ni)
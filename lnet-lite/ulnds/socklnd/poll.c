@@ -48,6 +48,91 @@
 #include "pfl/pool.h"
 #include "pfl/thread.h"
 
+#ifdef HAVE_EPOLL
+static __inline uint32_t
+usocklnd_poll2epoll(short events)
+{
+        uint32_t ev = EPOLLET;
+
+        if (events & POLLIN)
+                ev |= EPOLLIN;
+        if (events & POLLOUT)
+                ev |= EPOLLOUT;
+        return ev;
+}
+
+static __inline short
+usocklnd_epoll2poll(uint32_t ev)
+{
+        short revents = 0;
+
+        if (ev & EPOLLIN)
+                revents |= POLLIN;
+        if (ev & EPOLLOUT)
+                revents |= POLLOUT;
+        if (ev & EPOLLERR)
+                revents |= POLLERR;
+        if (ev & EPOLLHUP)
+                revents |= POLLHUP;
+        return revents;
+}
+#endif
+
+/* Mirror a poll request into the epoll instance of the poll thread.
+ * Any EPOLL_CTL_MOD re-arms the edge trigger, so readiness which
+ * arose while interest was masked off is reported again.
+ * Returns 0 on success (or for the poll(2) backend), <0 else */
+static int
+usocklnd_epoll_update(usock_pollthread_t *pt_data, int type, int fd,
+                      short events)
+{
+#ifdef HAVE_EPOLL
+        struct epoll_event ev;
+        int                op;
+
+        if (pt_data->upt_epfd == -1)
+                return 0;
+
+        switch (type) {
+        case POLL_ADD_REQUEST:
+                op = EPOLL_CTL_ADD;
+                break;
+        case POLL_DEL_REQUEST:
+                op = EPOLL_CTL_DEL;
+                break;
+        default:
+                op = EPOLL_CTL_MOD;
+                break;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = usocklnd_poll2epoll(events);
+        ev.data.fd = fd;
+        if (epoll_ctl(pt_data->upt_epfd, op, fd, &ev) == -1)
+                return -errno;
+#else
+        (void)pt_data;
+        (void)type;
+        (void)fd;
+        (void)events;
+#endif
+        return 0;
+}
+
+/* Forget pending events of an fd that is going away */
+static void
+usocklnd_ready_remove(usock_pollthread_t *pt_data, int fd)
+{
+        int i;
+
+        for (i = 0; i < pt_data->upt_nready; i++)
+                if (pt_data->upt_ready[i] == fd) {
+                        pt_data->upt_ready[i] =
+                            pt_data->upt_ready[--pt_data->upt_nready];
+                        break;
+                }
+}
+
 void
 usocklnd_process_stale_list(usock_pollthread_t *pt_data)
 {
@@ -119,9 +204,12 @@ usocklnd_poll_thread(void *arg)
 
                 /* Actual polling for events */
 		thr->pscthr_waitq = "poll";
-                rc = poll(pt_data->upt_pollfd,
-                          pt_data->upt_nfds,
-                          usock_tuns.ut_poll_timeout * 1000);
+                if (pt_data->upt_epfd != -1)
+                        rc = usocklnd_epoll_wait(pt_data);
+                else
+                        rc = poll(pt_data->upt_pollfd,
+                                  pt_data->upt_nfds,
+                                  usock_tuns.ut_poll_timeout * 1000);
 		thr->pscthr_waitq = NULL;
 
                 if (rc < 0 && errno != EINTR) {
@@ -129,8 +217,12 @@ usocklnd_poll_thread(void *arg)
                         break;
                 }
 
-                if (rc > 0)
-                        usocklnd_execute_handlers(pt_data);
+                if (rc > 0) {
+                        if (pt_data->upt_epfd != -1)
+                                usocklnd_execute_ready_handlers(pt_data);
+                        else
+                                usocklnd_execute_handlers(pt_data);
+                }
 
                 current_time = cfs_time_current();
 
@@ -212,6 +304,7 @@ usocklnd_poll_thread(void *arg)
                         usock_conn_t *conn = pt_data->upt_idx2conn[idx];
                         LASSERT(conn != NULL);
 
+                        usocklnd_zc_linger(conn);
                         lx = conn->uc_lx;
                         conn->uc_lx = NULL;
                         lx_close(lx);
@@ -305,6 +398,7 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
         struct lnet_xport *lx;
 
         int            idx = 0;
+        int            rc;
 
         struct pollfd *pollfd   = pt_data->upt_pollfd;
         int           *fd2idx   = pt_data->upt_fd2idx;
@@ -358,6 +452,7 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                         int            new_npollfd = pt_data->upt_npollfd * 2;
                         usock_conn_t **new_idx2conn;
                         int           *new_skip;
+                        int           *new_ready;
 
                         new_pollfd = LIBCFS_REALLOC(pollfd, new_npollfd *
                                                      sizeof(struct pollfd));
@@ -375,7 +470,13 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                                                   sizeof(int));
                         if (new_skip == NULL)
                                 goto process_pollrequest_enomem;
-                        pt_data->upt_skip = new_skip;
+                        pt_data->upt_skip = skip = new_skip;
+
+                        new_ready = LIBCFS_REALLOC(pt_data->upt_ready,
+                                                   new_npollfd * sizeof(int));
+                        if (new_ready == NULL)
+                                goto process_pollrequest_enomem;
+                        pt_data->upt_ready = new_ready;
 
                         pt_data->upt_npollfd = new_npollfd;
                 }
@@ -402,6 +503,14 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
 
                 LASSERT(fd2idx[conn->uc_lx->lx_fd] == 0);
 
+                rc = usocklnd_epoll_update(pt_data, type,
+                                           conn->uc_lx->lx_fd, value);
+                if (rc) {
+                        CERROR("Cannot add fd %d to epoll set: rc=%d\n",
+                               conn->uc_lx->lx_fd, rc);
+                        goto process_pollrequest_failed;
+                }
+
                 idx = pt_data->upt_nfds++;
                 idx2conn[idx] = conn;
                 fd2idx[conn->uc_lx->lx_fd] = idx;
@@ -411,6 +520,12 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                 pollfd[idx].revents = 0;
                 break;
         case POLL_DEL_REQUEST:
+                if (pt_data->upt_epfd != -1) {
+                        usocklnd_epoll_update(pt_data, type,
+                                              conn->uc_lx->lx_fd, 0);
+                        usocklnd_ready_remove(pt_data, conn->uc_lx->lx_fd);
+                }
+
                 fd2idx[conn->uc_lx->lx_fd] = 0; /* invalidate this entry */
                 
                 --pt_data->upt_nfds;
@@ -422,6 +537,7 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                         fd2idx[pollfd[idx].fd] = idx;                        
                 }
 
+                usocklnd_zc_linger(conn);
                 lx = conn->uc_lx;
                 conn->uc_lx = NULL;
                 lx_close(lx);
@@ -443,6 +559,16 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                 LBUG(); /* unknown type */                
         }
 
+        if (type != POLL_ADD_REQUEST && type != POLL_DEL_REQUEST) {
+                rc = usocklnd_epoll_update(pt_data, type, pollfd[idx].fd,
+                                           pollfd[idx].events);
+                if (rc) {
+                        CERROR("Cannot modify fd %d in epoll set: rc=%d\n",
+                               pollfd[idx].fd, rc);
+                        usocklnd_conn_kill(conn);
+                }
+        }
+
         /* In the case of POLL_ADD_REQUEST, idx2conn[idx] takes the
          * reference that poll request possesses */
         if (type != POLL_ADD_REQUEST)
@@ -453,6 +579,10 @@ usocklnd_process_pollrequest(usock_pollrequest_t *pr,
   process_pollrequest_enomem:
         usocklnd_conn_decref(conn);
         return -ENOMEM;
+
+  process_pollrequest_failed:
+        usocklnd_conn_decref(conn);
+        return rc;
 }
 
 /* Loop on poll data executing handlers repeatedly until
@@ -488,6 +618,12 @@ usocklnd_execute_handlers(usock_pollthread_t *pt_data)
                         else /* later passes... */
                                 next = skip[i]; /* skip unready pollfds */
 
+                        /* POLLERR may only signal zero-copy completions */
+                        if ((pollfd[i].revents & POLLERR) != 0 &&
+                            (pollfd[i].revents & POLLHUP) == 0 &&
+                            usocklnd_zc_reap(conn) > 0)
+                                pollfd[i].revents &= ~POLLERR;
+
                         /* kill connection if it's closed by peer and
                          * there is no data pending for reading */
                         if ((pollfd[i].revents & POLLERR) != 0 ||
@@ -517,6 +653,124 @@ usocklnd_execute_handlers(usock_pollthread_t *pt_data)
         }
 }
 
+/* Wait for events on the epoll instance and merge them into the
+ * revents of the matching pollfd[] entries, queueing each newly
+ * signalled fd on the ready list.  Conns still on the ready list
+ * from a previous pass make the wait non-blocking: being
+ * edge-triggered, their pending data will not be reported again.
+ * Returns # of fds needing attention, 0 on timeout, <0 on error */
+int
+usocklnd_epoll_wait(usock_pollthread_t *pt_data)
+{
+#ifdef HAVE_EPOLL
+        struct pollfd      *pollfd = pt_data->upt_pollfd;
+        struct epoll_event *ev;
+        short               revents;
+        int                 timeout;
+        int                 idx;
+        int                 i;
+        int                 n;
+
+        timeout = pt_data->upt_nready ? 0 :
+            usock_tuns.ut_poll_timeout * 1000;
+
+        n = epoll_wait(pt_data->upt_epfd, pt_data->upt_events,
+                       UPT_NEVENTS, timeout);
+        if (n < 0)
+                return n;
+
+        for (i = 0, ev = pt_data->upt_events; i < n; i++, ev++) {
+                if (ev->data.fd == pollfd[0].fd) {
+                        pollfd[0].revents = POLLIN;
+                        continue;
+                }
+
+                revents = usocklnd_epoll2poll(ev->events);
+                idx = pt_data->upt_fd2idx[ev->data.fd];
+                if (revents == 0 || idx <= 0 || idx >= pt_data->upt_nfds)
+                        continue;
+
+                if (pollfd[idx].revents == 0)
+                        pt_data->upt_ready[pt_data->upt_nready++] =
+                            ev->data.fd;
+                pollfd[idx].revents |= revents;
+        }
+
+        return pt_data->upt_nready + (pollfd[0].revents != 0);
+#else
+        (void)pt_data;
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+/* Edge-triggered counterpart of usocklnd_execute_handlers(): only
+ * conns on the ready list are visited, so the cost of a pass does not
+ * grow with the number of idle conns.  A conn whose handlers have not
+ * yet run dry when fair_limit is reached stays on the list and is
+ * resumed on the next loop iteration */
+void
+usocklnd_execute_ready_handlers(usock_pollthread_t *pt_data)
+{
+        struct pollfd *pollfd   = pt_data->upt_pollfd;
+        usock_conn_t **idx2conn = pt_data->upt_idx2conn;
+        int           *fd2idx   = pt_data->upt_fd2idx;
+        int           *ready    = pt_data->upt_ready;
+        int            i;
+        int            j;
+        int            n;
+
+        if (pollfd[0].revents & POLLIN)
+                while (usocklnd_notifier_handler(pollfd[0].fd) > 0)
+                        ;
+        pollfd[0].revents = 0;
+
+        for (j = 0; j < usock_tuns.ut_fair_limit &&
+            pt_data->upt_nready > 0; j++) {
+                for (i = n = 0; i < pt_data->upt_nready; i++) {
+                        int            idx  = fd2idx[ready[i]];
+                        struct pollfd *pfd  = &pollfd[idx];
+                        usock_conn_t  *conn = idx2conn[idx];
+
+                        LASSERT(idx > 0 && idx < pt_data->upt_nfds);
+
+                        /* interest may have been dropped meanwhile */
+                        pfd->revents &= pfd->events | POLLERR | POLLHUP;
+
+                        /* POLLERR may only signal zero-copy completions */
+                        if ((pfd->revents & POLLERR) != 0 &&
+                            (pfd->revents & POLLHUP) == 0 &&
+                            usocklnd_zc_reap(conn) > 0)
+                                pfd->revents &= ~POLLERR;
+
+                        /* kill connection if it's closed by peer and
+                         * there is no data pending for reading */
+                        if ((pfd->revents & POLLERR) != 0 ||
+                            (pfd->revents & POLLHUP) != 0) {
+                                if ((pfd->events & POLLIN) != 0 &&
+                                    (pfd->revents & POLLIN) == 0)
+                                        usocklnd_conn_kill(conn);
+                                else
+                                        usocklnd_exception_handler(conn);
+                        }
+
+                        if ((pfd->revents & POLLIN) != 0 &&
+                            usocklnd_read_handler(conn) <= 0)
+                                pfd->revents &= ~POLLIN;
+
+                        if ((pfd->revents & POLLOUT) != 0 &&
+                            usocklnd_write_handler(conn) <= 0)
+                                pfd->revents &= ~POLLOUT;
+
+                        if ((pfd->revents & (POLLIN | POLLOUT)) == 0)
+                                pfd->revents = 0;
+                        else
+                                ready[n++] = ready[i];
+                }
+                pt_data->upt_nready = n;
+        }
+}
+
 int
 usocklnd_calculate_chunk_size(int num)
 {
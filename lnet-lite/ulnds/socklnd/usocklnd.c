@@ -52,6 +52,8 @@
 
 struct pfl_iostats_rw	usock_pasv_iostats;	/* passive interface */
 struct pfl_iostats_rw	usock_aggr_iostats;	/* aggregate across all interfaces */
+struct pfl_opstat	*usock_zc_snd;		/* bytes sent with MSG_ZEROCOPY */
+struct pfl_opstat	*usock_zc_copied;	/* zero-copy sends the kernel copied */
 
 struct psc_poolmaster usk_peer_poolmaster;
 struct psc_poolmaster usk_conn_poolmaster;
@@ -104,6 +106,9 @@ usock_tunables_t usock_tuns = {
         .ut_keepalive_cnt   = 0,
         .ut_keepalive_idle  = 0,
         .ut_keepalive_intv  = 0,
+#ifdef HAVE_EPOLL
+        .ut_epoll           = 1,
+#endif
 };
 
 #define MAX_REASONABLE_TIMEOUT 36000 /* 10 hours */
@@ -179,6 +184,19 @@ usocklnd_validate_tunables()
                 return -1;
         }
 
+        if (usock_tuns.ut_epoll != 0 &&
+            usock_tuns.ut_epoll != 1) {
+                CERROR("USOCK_EPOLL: %d should be 0 or 1\n",
+                       usock_tuns.ut_epoll);
+                return -1;
+        }
+
+        if (usock_tuns.ut_zc_min < 0) {
+                CERROR("USOCK_ZEROCOPY_MIN: %d should be >= 0\n",
+                       usock_tuns.ut_zc_min);
+                return -1;
+        }
+
         return 0;
 }
 
@@ -192,6 +210,8 @@ usocklnd_release_poll_states(int n)
 
                 close(pt->upt_notifier_fd);
                 close(pt->upt_pollfd[0].fd);
+                if (pt->upt_epfd != -1)
+                        close(pt->upt_epfd);
 
                 pthread_mutex_destroy(&pt->upt_pollrequests_lock);
                 cfs_fini_completion(&pt->upt_completion);
@@ -204,6 +224,12 @@ usocklnd_release_poll_states(int n)
                               sizeof(usock_conn_t *) * pt->upt_npollfd);
                 LIBCFS_FREE (pt->upt_fd2idx,
                               sizeof(int) * pt->upt_nfd2idx);
+                LIBCFS_FREE (pt->upt_ready,
+                             sizeof(int) * pt->upt_npollfd);
+#ifdef HAVE_EPOLL
+                LIBCFS_FREE (pt->upt_events,
+                             sizeof(struct epoll_event) * UPT_NEVENTS);
+#endif
         }
 }
 
@@ -289,6 +315,16 @@ usocklnd_update_tunables()
         if (rc)
                 return rc;
 
+        rc = cfs_parse_int_tunable(&usock_tuns.ut_epoll,
+                                      "USOCK_EPOLL");
+        if (rc)
+                return rc;
+
+        rc = cfs_parse_int_tunable(&usock_tuns.ut_zc_min,
+                                      "USOCK_ZEROCOPY_MIN");
+        if (rc)
+                return rc;
+
 	INIT_PSCLIST_HEAD(&usock_tuns.ut_maxsegs);
 	p = getenv("USOCK_MAXSEG");
 	if (p) {
@@ -326,6 +362,21 @@ usocklnd_update_tunables()
         if (usocklnd_validate_tunables())
                 return -EINVAL;
 
+#ifndef HAVE_EPOLL
+        if (usock_tuns.ut_epoll) {
+                CWARN("USOCK_EPOLL: epoll(7) unavailable, using poll(2)\n");
+                usock_tuns.ut_epoll = 0;
+        }
+#endif
+
+#ifndef HAVE_MSG_ZEROCOPY
+        if (usock_tuns.ut_zc_min) {
+                CWARN("USOCK_ZEROCOPY_MIN: MSG_ZEROCOPY unavailable, "
+                      "using copying sends\n");
+                usock_tuns.ut_zc_min = 0;
+        }
+#endif
+
         if (usock_tuns.ut_npollthreads == 0) {
 		struct rlimit rlim;
 
@@ -402,11 +453,25 @@ usocklnd_base_startup(void)
                 if (pt->upt_skip == NULL)
                         goto base_startup_failed_3;
 
+                LIBCFS_ALLOC (pt->upt_ready,
+                              sizeof(int) * UPT_START_SIZ);
+                if (pt->upt_ready == NULL)
+                        goto base_startup_failed_4;
+
+#ifdef HAVE_EPOLL
+                LIBCFS_ALLOC (pt->upt_events,
+                              sizeof(struct epoll_event) * UPT_NEVENTS);
+                if (pt->upt_events == NULL)
+                        goto base_startup_failed_5;
+#endif
+
                 pt->upt_npollfd = pt->upt_nfd2idx = UPT_START_SIZ;
+                pt->upt_nready = 0;
+                pt->upt_epfd = -1;
 
                 rc = libcfs_socketpair(notifier);
                 if (rc != 0)
-                        goto base_startup_failed_4;
+                        goto base_startup_failed_6;
 
                 pt->upt_notifier_fd = notifier[0];
 
@@ -417,6 +482,28 @@ usocklnd_base_startup(void)
                 pt->upt_nfds = 1;
                 pt->upt_idx2conn[0] = NULL;
 
+#ifdef HAVE_EPOLL
+                if (usock_tuns.ut_epoll) {
+                        struct epoll_event ev;
+
+                        /* the notifier stays level-triggered */
+                        memset(&ev, 0, sizeof(ev));
+                        ev.events = EPOLLIN;
+                        ev.data.fd = notifier[1];
+
+                        pt->upt_epfd = epoll_create1(EPOLL_CLOEXEC);
+                        if (pt->upt_epfd == -1 ||
+                            epoll_ctl(pt->upt_epfd, EPOLL_CTL_ADD,
+                                      notifier[1], &ev) == -1) {
+                                CWARN("Cannot set up epoll(7) (errno=%d), "
+                                      "falling back to poll(2)\n", errno);
+                                if (pt->upt_epfd != -1)
+                                        close(pt->upt_epfd);
+                                pt->upt_epfd = -1;
+                        }
+                }
+#endif
+
                 pt->upt_errno = 0;
                 CFS_INIT_LIST_HEAD (&pt->upt_pollrequests);
                 CFS_INIT_LIST_HEAD (&pt->upt_stale_list);
@@ -434,6 +521,8 @@ usocklnd_base_startup(void)
 	usock_pasv_iostats.rd = pfl_opstat_init("lusklnd-pasv-rcv");
 	usock_aggr_iostats.wr = pfl_opstat_init("lusklnd-aggr-snd");
 	usock_aggr_iostats.rd = pfl_opstat_init("lusklnd-aggr-rcv"); 
+	usock_zc_snd = pfl_opstat_init("lusklnd-zc-snd");
+	usock_zc_copied = pfl_opstat_init("lusklnd-zc-copied");
 
 	psc_poolmaster_init(&usk_peer_poolmaster, usock_peer_t,
 	    up_lentry, PPMF_AUTO, 32, 32, 0, NULL, "usk-peer");
@@ -462,6 +551,13 @@ usocklnd_base_startup(void)
 
         return 0;
 
+  base_startup_failed_6:
+#ifdef HAVE_EPOLL
+        LIBCFS_FREE (pt->upt_events,
+                     sizeof(struct epoll_event) * UPT_NEVENTS);
+  base_startup_failed_5:
+#endif
+        LIBCFS_FREE (pt->upt_ready, sizeof(int) * UPT_START_SIZ);
   base_startup_failed_4:
         LIBCFS_FREE (pt->upt_skip, sizeof(int) * UPT_START_SIZ);
   base_startup_failed_3:
@@ -503,6 +599,8 @@ usocklnd_base_shutdown(int n)
 	pfl_opstat_destroy(usock_pasv_iostats.rd);
 	pfl_opstat_destroy(usock_aggr_iostats.wr);
 	pfl_opstat_destroy(usock_aggr_iostats.rd); 
+	pfl_opstat_destroy(usock_zc_snd);
+	pfl_opstat_destroy(usock_zc_copied);
 
 	pfl_poolmaster_destroy(&usk_peer_poolmaster);
 	pfl_poolmaster_destroy(&usk_conn_poolmaster);
@@ -43,6 +43,9 @@
 
 #include <pthread.h>
 #include <poll.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include <lnet/lib-lnet.h>
 #include <lnet/socklnd.h>
 
@@ -57,6 +60,11 @@ typedef struct {
         int              tx_size;    /* size of this descriptor */
         struct iovec    *tx_iov;     /* points to tx_iova[i] */
         int              tx_niov;    /* # of packet iovec frags */
+        struct list_head tx_zc_list; /* on uc_zc_list while pages pinned */
+        __u64            tx_zc_first; /* first MSG_ZEROCOPY send ID */
+        int              tx_zc_nsend; /* # of MSG_ZEROCOPY sends */
+        int              tx_zc_left; /* # of those not yet completed */
+        int              tx_zc_sent; /* all bytes handed to the kernel */
         struct iovec     tx_iova[1]; /* iov for header */
 } usock_tx_t;
 
@@ -99,6 +107,11 @@ typedef struct {
         int                uc_tx_flag;       /* deadline valid? */
         int                uc_sending;       /* send op is in progress */
         usock_tx_t        *uc_tx_hello;      /* fake tx with hello */
+        int                uc_zc;            /* MSG_ZEROCOPY: 0 untried,
+                                              * 1 enabled, -1 unusable */
+        __u64              uc_zc_seq;        /* next MSG_ZEROCOPY send ID */
+        struct list_head   uc_zc_list;       /* txs awaiting zero-copy
+                                              * completion */
 
         cfs_atomic_t       uc_refcount;      /* # of users */
         pthread_mutex_t    uc_lock;          /* serialize */
@@ -156,6 +169,14 @@ typedef struct {
                                                   * by fd */
         int               upt_nfd2idx;           /* # of allocated elements
                                                   * of upt_fd2idx[] */
+        int               upt_epfd;              /* epoll(7) instance or -1
+                                                  * for the poll(2) backend */
+        int              *upt_ready;             /* fds with pending events
+                                                  * (epoll backend only) */
+        int               upt_nready;            /* # of fds in upt_ready[] */
+#ifdef HAVE_EPOLL
+        struct epoll_event *upt_events;          /* epoll_wait(2) results */
+#endif
         struct list_head  upt_stale_list;        /* list of orphaned conns */
         struct list_head  upt_pollrequests;      /* list of poll requests */
         pthread_mutex_t   upt_pollrequests_lock; /* serialize */
@@ -168,6 +189,9 @@ typedef struct {
  * at initialization time. Will be resized on demand */
 #define UPT_START_SIZ 32
 
+/* Max # of events collected by one epoll_wait(2) call */
+#define UPT_NEVENTS 128
+
 /* # peer lists */
 #define UD_PEER_HASH_SIZE  101
 
@@ -219,6 +243,8 @@ typedef struct {
 	int ut_keepalive_cnt; 
 	int ut_keepalive_idle;
 	int ut_keepalive_intv;
+	int ut_epoll;         /* use epoll(7) instead of poll(2) */
+	int ut_zc_min;        /* smallest tx sent with MSG_ZEROCOPY, 0=off */
 	struct psclist_head ut_maxsegs;
 } usock_tunables_t;
 
@@ -279,9 +305,14 @@ usocklnd_peer_decref(usock_peer_t *peer)
                 usocklnd_destroy_peer(peer);
 }
 
+/*
+ * Map a peer to its poll thread.  All connections to one peer land on
+ * the same thread; the multiplicative hash spreads peers from a single
+ * subnet evenly instead of clustering on the low address bits.
+ */
 static inline int
 usocklnd_ip2pt_idx(__u32 ip) {
-        return ip % usock_data.ud_npollthreads;
+        return ((ip * 0x9e3779b1U) >> 16) % usock_data.ud_npollthreads;
 }
 
 static inline struct list_head *
@@ -306,6 +337,8 @@ void usocklnd_add_killrequest(usock_conn_t *conn);
 int usocklnd_process_pollrequest(usock_pollrequest_t *pr,
                                  usock_pollthread_t *pt_data);
 void usocklnd_execute_handlers(usock_pollthread_t *pt_data);
+void usocklnd_execute_ready_handlers(usock_pollthread_t *pt_data);
+int usocklnd_epoll_wait(usock_pollthread_t *pt_data);
 int usocklnd_calculate_chunk_size(int num);
 void usocklnd_wakeup_pollthread(int i);
 
@@ -323,6 +356,8 @@ usock_tx_t * usocklnd_try_piggyback(struct list_head *tx_list_p,
 int usocklnd_activeconn_hellosent(usock_conn_t *conn);
 int usocklnd_passiveconn_hellosent(usock_conn_t *conn);
 int usocklnd_send_tx(usock_conn_t *conn, usock_tx_t *tx);
+void usocklnd_complete_tx(usock_conn_t *conn, lnet_ni_t *ni, usock_tx_t *tx);
+int usocklnd_zc_reap(usock_conn_t *conn);
 int usocklnd_read_data(usock_conn_t *conn);
 
 void usocklnd_release_poll_states(int n);
@@ -339,6 +374,7 @@ void usocklnd_conn_kill_locked(usock_conn_t *conn);
 usock_conn_t *usocklnd_conn_allocate();
 void usocklnd_conn_free(usock_conn_t *conn);
 void usocklnd_tear_peer_conn(usock_conn_t *conn);
+void usocklnd_zc_linger(usock_conn_t *conn);
 void usocklnd_check_peer_stale(lnet_ni_t *ni, lnet_process_id_t id);
 int usocklnd_create_passive_conn(lnet_ni_t *ni, struct lnet_xport *, usock_conn_t **connp);
 int usocklnd_create_active_conn(usock_peer_t *peer, int type,
@@ -386,6 +422,8 @@ void usocklnd_rx_skipping_state_transition(usock_conn_t *conn);
 
 extern struct pfl_iostats_rw	usock_pasv_iostats;
 extern struct pfl_iostats_rw	usock_aggr_iostats;
+extern struct pfl_opstat	*usock_zc_snd;
+extern struct pfl_opstat	*usock_zc_copied;
 
 extern struct psc_poolmgr *usk_peer_pool;
 extern struct psc_poolmgr *usk_conn_pool;
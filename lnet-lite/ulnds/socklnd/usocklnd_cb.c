@@ -65,7 +65,7 @@ usocklnd_send_tx_immediately(usock_conn_t *conn, usock_tx_t *tx)
                 pthread_mutex_unlock(&conn->uc_lock);
                 partial_send = 1;
         } else {                
-                usocklnd_destroy_tx(peer->up_ni, tx);
+                usocklnd_complete_tx(conn, peer->up_ni, tx);
                 /* NB: lnetmsg was finalized, so we *must* return 0 */
 
                 if (rc < 0) { /* real error */                       
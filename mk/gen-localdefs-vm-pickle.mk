@@ -0,0 +1,46 @@
+# generated by root from vm on Sat Oct 17 20:44:35 UTC 2026
+PICKLE_HAVE_AIO=1
+PICKLE_HAVE_ASM_TYPES_H=1
+PICKLE_HAVE_ATSYSCALLS=1
+PICKLE_HAVE_BACKTRACE=1
+PICKLE_HAVE_BLKSIZE_T=1
+PICKLE_HAVE_CFLAGS_WERROR=1
+PICKLE_HAVE_CLOCK_GETTIME=1
+PICKLE_HAVE_ENDIAN_H=1
+PICKLE_HAVE_EPOLL=1
+PICKLE_HAVE_FALLOC_FL_PUNCH_HOLE=1
+PICKLE_HAVE_FSANITIZE=1
+PICKLE_HAVE_FUTEX=1
+PICKLE_HAVE_FUTIMENS=1
+PICKLE_HAVE_GETHOSTBYNAME=1
+PICKLE_HAVE_GETIFADDRS=1
+PICKLE_HAVE_GETLOADAVG=1
+PICKLE_HAVE_GETXATTR=1
+PICKLE_HAVE_I386_CMPXCHG8B=1
+PICKLE_HAVE_INOTIFY=1
+PICKLE_HAVE_IO_URING=1
+PICKLE_HAVE_LP64=1
+PICKLE_HAVE_MSG_ZEROCOPY=1
+PICKLE_HAVE_POSIX_MEMALIGN=1
+PICKLE_HAVE_PTHREAD_BARRIER=1
+PICKLE_HAVE_PTHREAD_MUTEX_TIMEDLOCK=1
+PICKLE_HAVE_PTHREAD_RWLOCK_TIMEDRDLOCK=1
+PICKLE_HAVE_PTHREAD_SETSCHEDPRIO=1
+PICKLE_HAVE_PTHREAD_YIELD=1
+PICKLE_HAVE_QSORT_R=1
+PICKLE_HAVE_RTNETLINK=1
+PICKLE_HAVE_SETRESUID=1
+PICKLE_HAVE_SGIO=1
+PICKLE_HAVE_SRAND48_R=1
+PICKLE_HAVE_STB_TIM=1
+PICKLE_HAVE_STRNLEN=1
+PICKLE_HAVE_ST_INO_64BIT=1
+PICKLE_HAVE_SYNC_FILE_RANGE=1
+PICKLE_HAVE_SYS_CDEFS_H=1
+PICKLE_HAVE_TLS=1
+PICKLE_HAVE_TUNE_NATIVE=1
+PICKLE_HAVE_YYERRLAB=1
+PICKLE_HAVE_YYERRLAB_ERROR=1
+PICKLE_HAVE_YYSYNTAX_ERROR=1
+PICKLE_HAVE_YYSYNTAX_ERROR_ERROR=1
+PICKLE_DONE=1
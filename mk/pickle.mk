@@ -124,6 +124,22 @@ ifeq ($(filter $(realpath ${ROOTDIR})/compat/%,${CURDIR}),)
   DEFINES+=						-DHAVE_INOTIFY
  endif
 
+ ifdef PICKLE_HAVE_EPOLL
+  DEFINES+=						-DHAVE_EPOLL
+ endif
+
+ ifdef PICKLE_HAVE_IO_URING
+  DEFINES+=						-DHAVE_IO_URING
+ endif
+
+ ifdef PICKLE_HAVE_MSG_ZEROCOPY
+  DEFINES+=						-DHAVE_MSG_ZEROCOPY
+ endif
+
+ ifdef PICKLE_HAVE_FUTEX
+  DEFINES+=						-DHAVE_FUTEX
+ endif
+
  ifdef PICKLE_HAVE_ATSYSCALLS
   DEFINES+=						-DHAVE_ATSYSCALLS
  endif
@@ -20,9 +20,14 @@
  * PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
  */
 
+#include <sys/param.h>
+
 #include <stdint.h>
+#include <string.h>
 
+#include "pfl/cdefs.h"
 #include "pfl/crc.h"
+#include "pfl/log.h"
 
 const uint64_t psc_crc64_table[] = {
 	UINT64_C(0x0000000000000000), UINT64_C(0x42F0E1EBA9EA3693),
@@ -156,13 +161,67 @@ const uint64_t psc_crc64_table[] = {
 };
 
 /*
- * psc_crc64_add - Accumulate bytes into a 64-bit CRC buffer.
+ * Slicing tables: psc_crc64_stable[k][b] is the CRC contribution of
+ * byte b followed by k zero bytes.  Row 0 is psc_crc64_table.  These
+ * are derived at startup from psc_crc64_table by psc_crc64_kernel_init().
+ */
+static uint64_t psc_crc64_stable[16][256];
+
+/*
+ * Slicing tables for the reflected CRC32 (the zlib and IEEE 802.3
+ * polynomial), laid out the same way.  Built by
+ * psc_crc64_kernel_init().
+ */
+#define PSC_CRC32R_POLY	0xedb88320U
+
+static uint32_t psc_crc32r_stable[8][256];
+
+/*
+ * Reflected CLMUL folding constants, bit reversed into a 64-bit lane.
+ * The product of two reflected operands comes out one degree high, so
+ * each holds x^(n-1) mod P rather than x^n mod P.
+ */
+static uint64_t psc_crc32r_k128;
+static uint64_t psc_crc32r_k192;
+static uint64_t psc_crc32r_k512;
+static uint64_t psc_crc32r_k576;
+
+/* x^(8 * 2^n) mod P, reflected */
+static uint32_t psc_crc32r_x2n[32];
+
+static void (*psc_crc32r_func)(uint32_t *, const void *, int) =
+    psc_crc32r_add_slice8;
+
+/*
+ * CLMUL folding constants, x^n mod P for the polynomial above.  Also
+ * computed at startup so nothing beyond psc_crc64_table is hardcoded.
+ */
+static uint64_t psc_crc64_k128;		/* x^128 mod P */
+static uint64_t psc_crc64_k192;		/* x^192 mod P */
+static uint64_t psc_crc64_k512;		/* x^512 mod P */
+static uint64_t psc_crc64_k576;		/* x^576 mod P */
+
+/* x^(8 * 2^n) mod P, for shifting a CRC over 2^n zero bytes */
+static uint64_t psc_crc64_x2n[64];
+
+#define PSC_CRC64_POLY	psc_crc64_table[1]
+
+#define PSC_CRC64_LOAD_BE64(p)						\
+	(((uint64_t)(p)[0] << 56) | ((uint64_t)(p)[1] << 48) |		\
+	 ((uint64_t)(p)[2] << 40) | ((uint64_t)(p)[3] << 32) |		\
+	 ((uint64_t)(p)[4] << 24) | ((uint64_t)(p)[5] << 16) |		\
+	 ((uint64_t)(p)[6] <<  8) |  (uint64_t)(p)[7])
+
+/*
+ * psc_crc64_add_bytewise - Accumulate bytes into a 64-bit CRC buffer
+ *	one byte at a time.  This is the reference implementation which
+ *	all other kernels must match bit for bit.
  * @cp: pointer to an initialized CRC buffer.
  * @datap: data region to add to CRC over.
  * @len: amount of data.
  */
-__inline void
-psc_crc64_add(uint64_t *cp, const void *datap, int len)
+void
+psc_crc64_add_bytewise(uint64_t *cp, const void *datap, int len)
 {
 	const uint8_t *data = datap;
 	uint64_t crc0 = *cp;
@@ -175,6 +234,478 @@ psc_crc64_add(uint64_t *cp, const void *datap, int len)
 	*cp = crc0;
 }
 
+#define PSC_CRC64_SLICE8(v, t)					\
+	(psc_crc64_stable[(t) + 7][(v) >> 56]			^	\
+	 psc_crc64_stable[(t) + 6][((v) >> 48) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 5][((v) >> 40) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 4][((v) >> 32) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 3][((v) >> 24) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 2][((v) >> 16) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 1][((v) >>  8) & 0xff]	^	\
+	 psc_crc64_stable[(t) + 0][ (v)        & 0xff])
+
+/*
+ * psc_crc64_add_slice8 - Accumulate bytes into a 64-bit CRC buffer
+ *	eight bytes per step using slicing tables.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc64_add_slice8(uint64_t *cp, const void *datap, int len)
+{
+	const uint8_t *data = datap;
+	uint64_t crc0 = *cp, v;
+
+	for (; len >= 8; data += 8, len -= 8) {
+		v = crc0 ^ PSC_CRC64_LOAD_BE64(data);
+		crc0 = PSC_CRC64_SLICE8(v, 0);
+	}
+	*cp = crc0;
+	psc_crc64_add_bytewise(cp, data, len);
+}
+
+/*
+ * psc_crc64_add_slice16 - Accumulate bytes into a 64-bit CRC buffer
+ *	sixteen bytes per step using slicing tables.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc64_add_slice16(uint64_t *cp, const void *datap, int len)
+{
+	const uint8_t *data = datap;
+	uint64_t crc0 = *cp, v0, v1;
+
+	for (; len >= 16; data += 16, len -= 16) {
+		v0 = crc0 ^ PSC_CRC64_LOAD_BE64(data);
+		v1 = PSC_CRC64_LOAD_BE64(data + 8);
+		crc0 = PSC_CRC64_SLICE8(v0, 8) ^
+		    PSC_CRC64_SLICE8(v1, 0);
+	}
+	*cp = crc0;
+	psc_crc64_add_slice8(cp, data, len);
+}
+
+#define PSC_CRC32R_LOAD_LE32(p)						\
+	((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) |			\
+	 ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+/*
+ * psc_crc32r_add_slice8 - Accumulate bytes into a reflected 32-bit CRC
+ *	register eight bytes per step using slicing tables.
+ * @cp: pointer to the CRC register.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc32r_add_slice8(uint32_t *cp, const void *datap, int len)
+{
+	const uint8_t *data = datap;
+	uint32_t crc0 = *cp, lo, hi;
+
+	for (; len >= 8; data += 8, len -= 8) {
+		lo = crc0 ^ PSC_CRC32R_LOAD_LE32(data);
+		hi = PSC_CRC32R_LOAD_LE32(data + 4);
+		crc0 = psc_crc32r_stable[7][lo & 0xff] ^
+		    psc_crc32r_stable[6][(lo >> 8) & 0xff] ^
+		    psc_crc32r_stable[5][(lo >> 16) & 0xff] ^
+		    psc_crc32r_stable[4][lo >> 24] ^
+		    psc_crc32r_stable[3][hi & 0xff] ^
+		    psc_crc32r_stable[2][(hi >> 8) & 0xff] ^
+		    psc_crc32r_stable[1][(hi >> 16) & 0xff] ^
+		    psc_crc32r_stable[0][hi >> 24];
+	}
+	while (len-- > 0)
+		crc0 = psc_crc32r_stable[0][(crc0 ^ *data++) & 0xff] ^
+		    (crc0 >> 8);
+	*cp = crc0;
+}
+
+#if defined(__x86_64__) && __GNUC_PREREQ__(4, 9)
+
+#include <immintrin.h>
+
+#define PSC_CRC64_HAVE_CLMUL
+
+#define PSC_CRC64_CLMUL_TARGET	__attribute__((__target__("pclmul,ssse3")))
+
+/*
+ * Fold a 128-bit accumulator forward over n bits and add in the next
+ * block: a' = hi(a) * (x^(n+64) mod P) + lo(a) * (x^n mod P) + b.
+ * The products are at most 127 bits wide so no reduction is needed
+ * until the very end.
+ */
+#define PSC_CRC64_FOLD(a, k, b)						\
+	_mm_xor_si128(_mm_xor_si128(					\
+	    _mm_clmulepi64_si128((a), (k), 0x11),			\
+	    _mm_clmulepi64_si128((a), (k), 0x00)), (b))
+
+PSC_CRC64_CLMUL_TARGET
+static __inline __m128i
+psc_crc64_clmul_load(const uint8_t *p, __m128i bswap)
+{
+	return (_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),
+	    bswap));
+}
+
+/*
+ * psc_crc64_add_clmul - Accumulate bytes into a 64-bit CRC buffer by
+ *	folding 64-byte stripes with carry-less multiplication.
+ *	Inputs shorter than the folding width are handed to the
+ *	slicing kernel.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+PSC_CRC64_CLMUL_TARGET
+void
+psc_crc64_add_clmul(uint64_t *cp, const void *datap, int len)
+{
+	const uint8_t *data = datap;
+	__m128i a0, a1, a2, a3, k, bswap;
+	uint8_t buf[16];
+	uint64_t crc0;
+
+	if (len < 128) {
+		psc_crc64_add_slice16(cp, datap, len);
+		return;
+	}
+
+	/*
+	 * Loaded big-endian, bit i of each 128-bit lane is the
+	 * coefficient of x^i, which is what PCLMULQDQ operates on
+	 * for a non-reflected CRC.
+	 */
+	bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+	    13, 14, 15);
+
+	/* The running CRC lines up with the first eight bytes. */
+	a0 = _mm_xor_si128(psc_crc64_clmul_load(data, bswap),
+	    _mm_set_epi64x((long long)*cp, 0));
+	a1 = psc_crc64_clmul_load(data + 16, bswap);
+	a2 = psc_crc64_clmul_load(data + 32, bswap);
+	a3 = psc_crc64_clmul_load(data + 48, bswap);
+	data += 64;
+	len -= 64;
+
+	k = _mm_set_epi64x((long long)psc_crc64_k576,
+	    (long long)psc_crc64_k512);
+	for (; len >= 64; data += 64, len -= 64) {
+		a0 = PSC_CRC64_FOLD(a0, k,
+		    psc_crc64_clmul_load(data, bswap));
+		a1 = PSC_CRC64_FOLD(a1, k,
+		    psc_crc64_clmul_load(data + 16, bswap));
+		a2 = PSC_CRC64_FOLD(a2, k,
+		    psc_crc64_clmul_load(data + 32, bswap));
+		a3 = PSC_CRC64_FOLD(a3, k,
+		    psc_crc64_clmul_load(data + 48, bswap));
+	}
+
+	/* Collapse the four lanes into one. */
+	k = _mm_set_epi64x((long long)psc_crc64_k192,
+	    (long long)psc_crc64_k128);
+	a0 = PSC_CRC64_FOLD(a0, k, a1);
+	a0 = PSC_CRC64_FOLD(a0, k, a2);
+	a0 = PSC_CRC64_FOLD(a0, k, a3);
+	for (; len >= 16; data += 16, len -= 16)
+		a0 = PSC_CRC64_FOLD(a0, k,
+		    psc_crc64_clmul_load(data, bswap));
+
+	/*
+	 * The remaining 128-bit value a satisfies CRC = a * x^64 mod P,
+	 * which is exactly what the table kernels compute for the
+	 * sixteen bytes of a starting from a zero CRC.
+	 */
+	_mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(a0, bswap));
+	crc0 = 0;
+	psc_crc64_add_slice16(&crc0, buf, sizeof(buf));
+	psc_crc64_add_slice8(&crc0, data, len);
+	*cp = crc0;
+}
+
+__static int
+psc_crc64_avail_clmul(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("ssse3"));
+}
+
+/*
+ * psc_crc32r_add_clmul - Accumulate bytes into a reflected 32-bit CRC
+ *	register by folding 64-byte stripes with carry-less
+ *	multiplication.  Same scheme as psc_crc64_add_clmul() except
+ *	that reflected data is used as loaded and the low quadword of
+ *	each lane holds the high order coefficients.
+ * @cp: pointer to the CRC register.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+PSC_CRC64_CLMUL_TARGET
+void
+psc_crc32r_add_clmul(uint32_t *cp, const void *datap, int len)
+{
+	const uint8_t *data = datap;
+	__m128i a0, a1, a2, a3, k;
+	uint8_t buf[16];
+	uint32_t crc0;
+
+	if (len < 128) {
+		psc_crc32r_add_slice8(cp, datap, len);
+		return;
+	}
+
+	/* The running CRC lines up with the first four bytes. */
+	a0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data),
+	    _mm_cvtsi32_si128((int)*cp));
+	a1 = _mm_loadu_si128((const __m128i *)(data + 16));
+	a2 = _mm_loadu_si128((const __m128i *)(data + 32));
+	a3 = _mm_loadu_si128((const __m128i *)(data + 48));
+	data += 64;
+	len -= 64;
+
+	k = _mm_set_epi64x((long long)psc_crc32r_k512,
+	    (long long)psc_crc32r_k576);
+	for (; len >= 64; data += 64, len -= 64) {
+		a0 = PSC_CRC64_FOLD(a0, k,
+		    _mm_loadu_si128((const __m128i *)data));
+		a1 = PSC_CRC64_FOLD(a1, k,
+		    _mm_loadu_si128((const __m128i *)(data + 16)));
+		a2 = PSC_CRC64_FOLD(a2, k,
+		    _mm_loadu_si128((const __m128i *)(data + 32)));
+		a3 = PSC_CRC64_FOLD(a3, k,
+		    _mm_loadu_si128((const __m128i *)(data + 48)));
+	}
+
+	k = _mm_set_epi64x((long long)psc_crc32r_k128,
+	    (long long)psc_crc32r_k192);
+	a0 = PSC_CRC64_FOLD(a0, k, a1);
+	a0 = PSC_CRC64_FOLD(a0, k, a2);
+	a0 = PSC_CRC64_FOLD(a0, k, a3);
+	for (; len >= 16; data += 16, len -= 16)
+		a0 = PSC_CRC64_FOLD(a0, k,
+		    _mm_loadu_si128((const __m128i *)data));
+
+	/* As in the CRC64 kernel, finish the last lane with tables. */
+	_mm_storeu_si128((__m128i *)buf, a0);
+	crc0 = 0;
+	psc_crc32r_add_slice8(&crc0, buf, sizeof(buf));
+	psc_crc32r_add_slice8(&crc0, data, len);
+	*cp = crc0;
+}
+
+#endif
+
+__static int
+psc_crc64_avail_always(void)
+{
+	return (1);
+}
+
+/* Ordered from most to least preferred. */
+const struct psc_crc64_kernel psc_crc64_kernels[] = {
+#ifdef PSC_CRC64_HAVE_CLMUL
+	{ "clmul",	psc_crc64_add_clmul,	psc_crc64_avail_clmul },
+#endif
+	{ "slice16",	psc_crc64_add_slice16,	psc_crc64_avail_always },
+	{ "slice8",	psc_crc64_add_slice8,	psc_crc64_avail_always },
+	{ "bytewise",	psc_crc64_add_bytewise,	psc_crc64_avail_always },
+	{ NULL,		NULL,			NULL }
+};
+
+const struct psc_crc64_kernel *psc_crc64_kernel = &psc_crc64_kernels[
+    nitems(psc_crc64_kernels) - 2];
+
+/*
+ * Compute x^n mod P by shifting a single bit through the LFSR.
+ */
+__static uint64_t
+psc_crc64_xpow(int n)
+{
+	uint64_t r = 1;
+
+	while (n-- > 0)
+		r = (r << 1) ^ (r & (UINT64_C(1) << 63) ?
+		    PSC_CRC64_POLY : 0);
+	return (r);
+}
+
+/*
+ * Multiply two polynomials modulo P.
+ */
+__static uint64_t
+psc_crc64_mulmod(uint64_t a, uint64_t b)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 63; i >= 0; i--) {
+		r = (r << 1) ^ (r & (UINT64_C(1) << 63) ?
+		    PSC_CRC64_POLY : 0);
+		if (a & (UINT64_C(1) << i))
+			r ^= b;
+	}
+	return (r);
+}
+
+/*
+ * psc_crc64_combine - Compute the CRC of the concatenation of two
+ *	buffers from the CRCs of each, without touching the data.
+ * @crc1: finalized CRC of the first buffer.
+ * @crc2: finalized CRC of the second buffer.
+ * @len2: length of the second buffer.
+ */
+uint64_t
+psc_crc64_combine(uint64_t crc1, uint64_t crc2, uint64_t len2)
+{
+	int n;
+
+	for (n = 0; len2; n++, len2 >>= 1)
+		if (len2 & 1)
+			crc1 = psc_crc64_mulmod(crc1, psc_crc64_x2n[n]);
+	return (crc1 ^ crc2);
+}
+
+/*
+ * Compute x^n mod P for the reflected CRC32 polynomial.
+ */
+__static uint32_t
+psc_crc32r_xpow(int n)
+{
+	uint32_t r = 1U << 31;
+
+	while (n-- > 0)
+		r = r & 1 ? (r >> 1) ^ PSC_CRC32R_POLY : r >> 1;
+	return (r);
+}
+
+/*
+ * Multiply two reflected polynomials modulo P.
+ */
+__static uint32_t
+psc_crc32r_mulmod(uint32_t a, uint32_t b)
+{
+	uint32_t r = 0;
+	int i;
+
+	for (i = 31; i >= 0; i--) {
+		if (a & (1U << i))
+			r ^= b;
+		b = b & 1 ? (b >> 1) ^ PSC_CRC32R_POLY : b >> 1;
+	}
+	return (r);
+}
+
+/*
+ * psc_crc32r_combine - Compute the reflected CRC32 of the
+ *	concatenation of two buffers from the CRCs of each.
+ * @crc1: CRC register after the first buffer.
+ * @crc2: CRC register after the second buffer, started from zero.
+ * @len2: length of the second buffer.
+ */
+uint32_t
+psc_crc32r_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+	int n;
+
+	for (n = 0; len2; n++, len2 >>= 1)
+		if (len2 & 1)
+			crc1 = psc_crc32r_mulmod(psc_crc32r_x2n[n & 31],
+			    crc1);
+	return (crc1 ^ crc2);
+}
+
+/*
+ * psc_crc64_kernel_init - Build derived tables and pick the fastest
+ *	CRC64 kernel the CPU supports.
+ * @name: name of a kernel to force, or NULL for automatic selection.
+ */
+void
+psc_crc64_kernel_init(const char *name)
+{
+	const struct psc_crc64_kernel *k;
+	uint32_t r;
+	int i, j;
+
+	for (i = 0; i < 256; i++)
+		psc_crc64_stable[0][i] = psc_crc64_table[i];
+	for (j = 1; j < 16; j++)
+		for (i = 0; i < 256; i++)
+			psc_crc64_stable[j][i] =
+			    (psc_crc64_stable[j - 1][i] << 8) ^
+			    psc_crc64_table[psc_crc64_stable[j - 1][i] >>
+			    56];
+
+	psc_crc64_k128 = psc_crc64_xpow(128);
+	psc_crc64_k192 = psc_crc64_xpow(192);
+	psc_crc64_k512 = psc_crc64_xpow(512);
+	psc_crc64_k576 = psc_crc64_xpow(576);
+
+	for (i = 0; i < 256; i++) {
+		r = i;
+		for (j = 0; j < 8; j++)
+			r = r & 1 ? (r >> 1) ^ PSC_CRC32R_POLY : r >> 1;
+		psc_crc32r_stable[0][i] = r;
+	}
+	for (j = 1; j < 8; j++)
+		for (i = 0; i < 256; i++)
+			psc_crc32r_stable[j][i] =
+			    (psc_crc32r_stable[j - 1][i] >> 8) ^
+			    psc_crc32r_stable[0][psc_crc32r_stable[j - 1][i] &
+			    0xff];
+
+	psc_crc32r_k128 = (uint64_t)psc_crc32r_xpow(127) << 32;
+	psc_crc32r_k192 = (uint64_t)psc_crc32r_xpow(191) << 32;
+	psc_crc32r_k512 = (uint64_t)psc_crc32r_xpow(511) << 32;
+	psc_crc32r_k576 = (uint64_t)psc_crc32r_xpow(575) << 32;
+
+	psc_crc32r_x2n[0] = psc_crc32r_xpow(8);
+	for (i = 1; i < nitems(psc_crc32r_x2n); i++)
+		psc_crc32r_x2n[i] = psc_crc32r_mulmod(
+		    psc_crc32r_x2n[i - 1], psc_crc32r_x2n[i - 1]);
+
+#ifdef PSC_CRC64_HAVE_CLMUL
+	if (psc_crc64_avail_clmul())
+		psc_crc32r_func = psc_crc32r_add_clmul;
+#endif
+
+	psc_crc64_x2n[0] = psc_crc64_xpow(8);
+	for (i = 1; i < nitems(psc_crc64_x2n); i++)
+		psc_crc64_x2n[i] = psc_crc64_mulmod(psc_crc64_x2n[i - 1],
+		    psc_crc64_x2n[i - 1]);
+
+	for (k = psc_crc64_kernels; k->pck_name; k++) {
+		if (name && strcmp(name, k->pck_name))
+			continue;
+		if (!k->pck_avail()) {
+			if (name)
+				psclog_warnx("CRC64 kernel %s not supported "
+				    "on this CPU", name);
+			continue;
+		}
+		psc_crc64_kernel = k;
+		break;
+	}
+	if (k->pck_name == NULL && name)
+		psclog_warnx("unknown CRC64 kernel %s; using %s", name,
+		    psc_crc64_kernel->pck_name);
+	psclog_diag("CRC64 kernel %s", psc_crc64_kernel->pck_name);
+}
+
+/*
+ * psc_crc64_add - Accumulate bytes into a 64-bit CRC buffer.
+ * @cp: pointer to an initialized CRC buffer.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc64_add(uint64_t *cp, const void *datap, int len)
+{
+	psc_crc64_kernel->pck_func(cp, datap, len);
+}
+
 __inline int
 psc_crc64_verify(uint64_t c, const void *datap, int len)
 {
@@ -184,6 +715,52 @@ psc_crc64_verify(uint64_t c, const void *datap, int len)
 	return (tc == c);
 }
 
+/*
+ * psc_crc32r_add - Accumulate bytes into a reflected 32-bit CRC
+ *	register.  This is the raw register update with no pre- or
+ *	post-conditioning, so starting from zero it computes the
+ *	RFC 1510 variant and starting from ~0 (and inverting the
+ *	result) the zlib one.
+ * @cp: pointer to the CRC register.
+ * @datap: data region to add to CRC over.
+ * @len: amount of data.
+ */
+void
+psc_crc32r_add(uint32_t *cp, const void *datap, int len)
+{
+	psc_crc32r_func(cp, datap, len);
+}
+
+/*
+ * psc_crc_copy - Copy a buffer while accumulating CRCs over it.  The
+ *	copy proceeds in chunks small enough to stay in L1 cache so the
+ *	CRC kernels read back the destination without another trip to
+ *	memory; the source is only read once.
+ * @dst: destination buffer.
+ * @src: source buffer.
+ * @len: amount of data.
+ * @crc64p: initialized 64-bit CRC buffer, or NULL.
+ * @crc32rp: reflected 32-bit CRC register (see psc_crc32r_add()), or
+ *	NULL.
+ */
+void
+psc_crc_copy(void *dst, const void *src, int len, uint64_t *crc64p,
+    uint32_t *crc32rp)
+{
+	const char *s = src;
+	char *d = dst;
+	int n;
+
+	for (; len > 0; d += n, s += n, len -= n) {
+		n = MIN(len, PSC_CRC_COPY_CHUNK);
+		memcpy(d, s, n);
+		if (crc64p)
+			psc_crc64_add(crc64p, d, n);
+		if (crc32rp)
+			psc_crc32r_add(crc32rp, d, n);
+	}
+}
+
 /*
  * psc_crc32_add - Accumulate bytes into a 32-bit CRC buffer.
  * @cp: pointer to an initialized CRC buffer.
@@ -55,6 +55,19 @@
 		psc_crc32_fini(cp);					\
 	} while (0)
 
+/*
+ * An implementation of psc_crc64_add().  All kernels produce identical
+ * results; they differ only in speed and CPU requirements.
+ */
+struct psc_crc64_kernel {
+	const char	 *pck_name;
+	void		(*pck_func)(uint64_t *, const void *, int);
+	int		(*pck_avail)(void);
+};
+
+/* bytes copied per step by psc_crc_copy(); must fit in L1 */
+#define PSC_CRC_COPY_CHUNK	2048
+
 __BEGIN_DECLS
 
 void	psc_crc32_add(uint32_t *, const void *, int);
@@ -73,6 +86,26 @@ void	psc_crc64_fini(uint64_t *);
 
 #else
 
+void	psc_crc64_add_bytewise(uint64_t *, const void *, int);
+void	psc_crc64_add_slice8(uint64_t *, const void *, int);
+void	psc_crc64_add_slice16(uint64_t *, const void *, int);
+void	psc_crc64_add_clmul(uint64_t *, const void *, int);
+
+void	psc_crc64_kernel_init(const char *);
+
+uint64_t psc_crc64_combine(uint64_t, uint64_t, uint64_t);
+
+void	psc_crc32r_add(uint32_t *, const void *, int);
+void	psc_crc32r_add_slice8(uint32_t *, const void *, int);
+void	psc_crc32r_add_clmul(uint32_t *, const void *, int);
+
+uint32_t psc_crc32r_combine(uint32_t, uint32_t, uint64_t);
+
+void	psc_crc_copy(void *, const void *, int, uint64_t *, uint32_t *);
+
+extern const struct psc_crc64_kernel	 psc_crc64_kernels[];
+extern const struct psc_crc64_kernel	*psc_crc64_kernel;
+
 #define psc_crc32_init(cp)	(*(cp) = 0xffffffff)
 #define psc_crc64_init(cp)	(*(cp) = UINT64_C(0xffffffffffffffff))
 
@@ -76,10 +76,20 @@ struct psc_ctlmsg_hashtable {
 	char			pcht_name[PSC_HTNAME_MAX];
 };
 
+/*
+ * Spelled out instead of embedding struct pfl_opstat so the message
+ * keeps its layout whatever bookkeeping the in-memory opstat carries.
+ */
 #define OPST_NAME_MAX 64
 struct psc_ctlmsg_opstat {
 	char			pco_name[OPST_NAME_MAX];
-	struct pfl_opstat	pco_opst;
+	int32_t			pco_flags;
+	int32_t			_pad;
+	int64_t			pco_lifetime;
+	int64_t			pco_last;
+	int64_t			pco_intv;
+	double			pco_avg;
+	double			pco_max;
 };
 
 #define PCI_NAME_ALL		"all"
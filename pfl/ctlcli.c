@@ -625,19 +625,22 @@ psc_ctlmsg_opstat_prdat(__unusedx const struct psc_ctlmsghdr *mh,
     const void *m)
 {
 	const struct psc_ctlmsg_opstat *pco = m;
-	const struct pfl_opstat *opst = &pco->pco_opst;
 	int base10 = 0;
 
-	if (opst->opst_flags & OPSTF_BASE10 || psc_ctl_inhuman)
+	if (pco->pco_flags & OPSTF_BASE10 || psc_ctl_inhuman)
 		base10 = 1;
 
 	printf("%-42s ", pco->pco_name);
 
 	// 11.2
-	psc_ctl_prnumber(base10, opst->opst_avg, 11, "/s ");
-	psc_ctl_prnumber(base10, opst->opst_max, 11, "/s ");
-	psc_ctl_prnumber(base10, opst->opst_intv, 11, "/s ");
-	psc_ctl_prnumber(base10, psc_atomic64_read(&opst->opst_lifetime), 13, "");
+	if (pco->pco_flags & OPSTF_GAUGE)
+		printf("%11s   %11s   %11s   ", "-", "-", "-");
+	else {
+		psc_ctl_prnumber(base10, pco->pco_avg, 11, "/s ");
+		psc_ctl_prnumber(base10, pco->pco_max, 11, "/s ");
+		psc_ctl_prnumber(base10, pco->pco_intv, 11, "/s ");
+	}
+	psc_ctl_prnumber(base10, pco->pco_lifetime, 13, "");
 	printf("\n");
 }
 
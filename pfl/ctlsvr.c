@@ -2002,11 +2002,11 @@ psc_ctlparam_opstats(int fd, struct psc_ctlmsghdr *mh,
 					goto out;
 				}
 				opst->opst_last = val;
-				psc_atomic64_set(&opst->opst_lifetime, val);
+				pfl_opstat_set(opst, val);
 			} else {
 				levels[1] = (char *)opst->opst_name;
 				snprintf(buf, sizeof(buf), "%"PRId64,
-				    psc_atomic64_read(&opst->opst_lifetime));
+				    pfl_opstat_read(opst));
 				rc = psc_ctlmsg_param_send(fd, mh, pcp,
 				    PCTHRNAME_EVERYONE, levels, 2, buf);
 			}
@@ -2056,7 +2056,12 @@ psc_ctlrep_getopstat(int fd, struct psc_ctlmsghdr *mh, void *m)
 		if (all || fnmatch(name, opst->opst_name, 0) == 0) {
 			found = 1;
 
-			pcop->pco_opst = *opst;
+			pcop->pco_flags = opst->opst_flags;
+			pcop->pco_lifetime = pfl_opstat_read(opst);
+			pcop->pco_last = opst->opst_last;
+			pcop->pco_intv = opst->opst_intv;
+			pcop->pco_avg = opst->opst_avg;
+			pcop->pco_max = opst->opst_max;
 			strlcpy(pcop->pco_name, opst->opst_name,
 			    sizeof(pcop->pco_name));
 			rc = psc_ctlmsg_sendv(fd, mh, pcop, NULL);
@@ -278,5 +278,6 @@ extern struct psc_lockedlist		pflfs_requests;
 
 extern double				pscfs_entry_timeout;
 extern double				pscfs_attr_timeout;
+extern int				pscfs_fuse_mq;
 
 #endif /* _PFL_FS_H_ */
@@ -29,10 +29,19 @@
 #include <sys/select.h>
 #endif
 
+#ifdef __linux
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#endif
+
 #include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <pthread.h>
 #include <pwd.h>
+#ifdef __linux
+#include <sched.h>
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -61,6 +70,10 @@
 #define MAX_FILESYSTEMS			5
 #define MAX_FDS				(MAX_FILESYSTEMS + 1)
 
+#if defined(__linux) && !defined(FUSE_DEV_IOC_CLONE)
+#  define FUSE_DEV_IOC_CLONE		_IOR(229, 0, uint32_t)
+#endif
+
 /*
  *
  */
@@ -129,6 +142,7 @@ struct psc_lockedlist pflfs_filehandles = PLL_INIT(
     &pflfs_filehandles, struct pflfs_filehandle, pfh_lentry);
 
 int				 pscfs_exit_fuse_listener;
+int				 pscfs_fuse_mq;		/* per-thread /dev/fuse clones */
 int				 newfs_fd[2];
 int				 pflfs_nfds;
 struct pollfd			 pflfs_fds[MAX_FDS];
@@ -292,8 +306,158 @@ pscfs_fuse_destroy(int i)
 	PSCFREE(mountpoints[i]);
 }
 
+#ifdef FUSE_DEV_IOC_CLONE
+/*
+ * Channel operations for a cloned /dev/fuse descriptor.  The channel
+ * is not attached to the session (libfuse allows only one per
+ * session); its private data is the master channel instead.
+ */
+static int
+pscfs_fuse_mqchan_receive(struct fuse_chan **chp, char *buf,
+    size_t size)
+{
+	struct fuse_session *se;
+	struct fuse_chan *ch = *chp;
+	ssize_t res;
+	int error;
+
+	se = fuse_chan_session(fuse_chan_data(ch));
+ restart:
+	res = read(fuse_chan_fd(ch), buf, size);
+	error = errno;
+
+	if (fuse_session_exited(se))
+		return (0);
+	if (res == -1) {
+		/* ENOENT means the request was interrupted */
+		if (error == ENOENT || error == EINTR)
+			goto restart;
+		if (error == ENODEV) {
+			fuse_session_exit(se);
+			return (0);
+		}
+		if (error != EAGAIN)
+			psclog_errorx("read /dev/fuse clone: %s",
+			    strerror(error));
+		return (-error);
+	}
+	return (res);
+}
+
+static int
+pscfs_fuse_mqchan_send(struct fuse_chan *ch, const struct iovec iov[],
+    size_t count)
+{
+	struct fuse_session *se;
+	int error;
+
+	if (iov == NULL)
+		return (0);
+	if (writev(fuse_chan_fd(ch), iov, count) == -1) {
+		error = errno;
+		se = fuse_chan_session(fuse_chan_data(ch));
+		/* ENOENT means the request was interrupted */
+		if (!fuse_session_exited(se) && error != ENOENT)
+			psclog_errorx("write /dev/fuse clone: %s",
+			    strerror(error));
+		return (-error);
+	}
+	return (0);
+}
+
+static void
+pscfs_fuse_mqchan_destroy(struct fuse_chan *ch)
+{
+	close(fuse_chan_fd(ch));
+}
+
+static void
+pscfs_fuse_mq_pin(int idx)
+{
+	cpu_set_t cs;
+	long ncpu;
+	int rc;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 0)
+		return;
+	CPU_ZERO(&cs);
+	CPU_SET(idx % ncpu, &cs);
+	rc = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+	if (rc)
+		psclog_warnx("unable to pin to CPU %ld: %s", idx % ncpu,
+		    strerror(rc));
+}
+
+/*
+ * Multi-queue listener: receive requests on a private clone of the
+ * /dev/fuse descriptor of the first file system into a private buffer
+ * and process them, without any handoff between listener threads.
+ * The kernel feeds requests to whichever clone is read next.
+ *
+ * Returns when the file system goes away, or with -1 if the clone
+ * could not be set up so the caller can fall back to the shared loop.
+ */
+static int
+pscfs_fuse_mq_loop(struct psc_thread *thr)
+{
+	static psc_atomic32_t cpuidx = PSC_ATOMIC32_INIT(0);
+	struct fuse_chan_ops op = {
+		.receive	= pscfs_fuse_mqchan_receive,
+		.send		= pscfs_fuse_mqchan_send,
+		.destroy	= pscfs_fuse_mqchan_destroy,
+	};
+	fuse_fs_info_t *fs = &pflfs_fsinfo[1];
+	struct pfl_opstat *opst;
+	struct fuse_chan *ch;
+	uint32_t masterfd;
+	char *buf;
+	int fd, res;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd == -1) {
+		psclog_warn("open /dev/fuse");
+		return (-1);
+	}
+	masterfd = fs->fd;
+	if (ioctl(fd, FUSE_DEV_IOC_CLONE, &masterfd) == -1) {
+		psclog_warn("clone /dev/fuse");
+		close(fd);
+		return (-1);
+	}
+	ch = fuse_chan_new(&op, fd, fs->bufsize, fs->ch);
+	if (ch == NULL) {
+		close(fd);
+		return (-1);
+	}
+
+	pscfs_fuse_mq_pin(psc_atomic32_inc_getnew(&cpuidx) - 1);
+
+	buf = PSCALLOC(fs->bufsize);
+	opst = pfl_opstat_initf(OPSTF_BASE10, "fuse.mq-rq:%s",
+	    thr->pscthr_name);
+
+	while (!pscfs_exit_fuse_listener) {
+		res = fuse_chan_recv(&ch, buf, fs->bufsize);
+		if (fuse_session_exited(fs->se))
+			break;
+		if (res == -EINTR || res == -EAGAIN || res == 0)
+			continue;
+		if (res < 0)
+			break;
+
+		pfl_opstat_incr(opst);
+		fuse_session_process(fs->se, buf, res, ch);
+	}
+
+	PSCFREE(buf);
+	fuse_chan_destroy(ch);
+	return (0);
+}
+#endif
+
 void
-pscfs_fuse_listener_loop(__unusedx struct psc_thread *thr)
+pscfs_fuse_listener_loop(struct psc_thread *thr)
 {
 	static psc_spinlock_t lock = SPINLOCK_INIT;
 	static struct psc_waitq wq = PSC_WAITQ_INIT("fuse-loop");
@@ -301,6 +465,7 @@ pscfs_fuse_listener_loop(__unusedx struct psc_thread *thr)
 
 	size_t bufsize = 0;
 	char *buf = NULL;
+	int mq = 0;
 
 	spinlock(&lock);
 	while (busy) {
@@ -313,6 +478,40 @@ pscfs_fuse_listener_loop(__unusedx struct psc_thread *thr)
 	while (!pscfs_exit_fuse_listener) {
 		int i;
 
+#ifdef FUSE_DEV_IOC_CLONE
+		/*
+		 * Once multi-queue mode is enabled, each thread passes
+		 * the baton on and leaves the rotation for good.
+		 */
+		if (pscfs_fuse_mq && !mq && pflfs_nfds > 1) {
+			mq = 1;
+
+			spinlock(&lock);
+			busy = 0;
+			psc_waitq_wakeone(&wq);
+			freelock(&lock);
+
+			if (pscfs_fuse_mq_loop(thr) == -1) {
+				psclog_warnx("multi-queue FUSE dispatch "
+				    "unavailable; reverting to shared "
+				    "listener");
+				pscfs_fuse_mq = 0;
+			}
+
+			spinlock(&lock);
+			while (busy) {
+				psc_waitq_wait(&wq, &lock);
+				spinlock(&lock);
+			}
+			busy = 1;
+			freelock(&lock);
+			continue;
+		}
+#else
+		(void)mq;
+		(void)thr;
+#endif
+
 #ifdef HAVE_NO_POLL_DEV
 		struct timeval tv = { 1, 0 };
 
@@ -1676,6 +1875,9 @@ pflfs_inval_getprivate(struct pscfs_req *pfr)
 
 #ifdef HAVE_FUSE_REQ_GETCHANNEL
 	ch = fuse_req_getchannel(pfr->pfr_ufsi_req);
+	/* notifications need the master channel, not a clone */
+	if (ch && fuse_chan_session(ch) == NULL)
+		ch = fuse_chan_data(ch);
 #else
 	(void)pfr;
 	ch = NULL;
@@ -24,11 +24,14 @@
 
 #include <sys/param.h>
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "pfl/alloc.h"
+#include "pfl/cdefs.h"
 #include "pfl/hashtbl.h"
 #include "pfl/list.h"
 #include "pfl/lock.h"
@@ -43,15 +46,190 @@ struct psc_lockedlist psc_hashtbls =
 # include <math.h>
 #endif
 
+#define PHT_LOAD(v)		__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define PHT_STORE(v, x)		__atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+
+/* Bracket a change that lock-free readers must notice (PHTF_RCU). */
+#define PHT_WRITE_BEGIN(seq)	__atomic_fetch_add(&(seq), 1, __ATOMIC_SEQ_CST)
+#define PHT_WRITE_END(seq)	__atomic_fetch_add(&(seq), 1, __ATOMIC_SEQ_CST)
+
+/*
+ * Lock-free lookups on PHTF_RCU tables run in a read-side section.
+ * Each thread advertises the epoch it entered in; psc_hashtbl_sync()
+ * advances the epoch and waits for every reader still in an older one.
+ */
+struct pfl_hashrdr {
+	struct psc_listentry	 phr_lentry;
+	uint64_t		 phr_epoch;	/* 0 when not reading */
+	int			 phr_nest;
+};
+
+struct psc_lockedlist pfl_hashrdrs =
+    PLL_INIT_NOLOG(&pfl_hashrdrs, struct pfl_hashrdr, phr_lentry);
+
+uint64_t			 pfl_hash_epoch = 1;
+__threadx struct pfl_hashrdr	*pfl_hashrdr;
+
+pthread_key_t			 pfl_hashrdr_key;
+pthread_once_t			 pfl_hashrdr_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Thread exit: drop the reader record so psc_hashtbl_sync() does not
+ * keep walking records of threads long gone.
+ */
+__static void
+pfl_hashrdr_destroy(void *p)
+{
+	struct pfl_hashrdr *r = p;
+
+	psc_assert(r->phr_nest == 0);
+	pll_remove(&pfl_hashrdrs, r);
+	pfl_hashrdr = NULL;
+	PSCFREE(r);
+}
+
+__static void
+pfl_hashrdr_initkey(void)
+{
+	int rc;
+
+	rc = pthread_key_create(&pfl_hashrdr_key, pfl_hashrdr_destroy);
+	if (rc)
+		psc_fatalx("pthread_key_create: %s", strerror(rc));
+}
+
+__static void
+pfl_hashtbl_rdenter(void)
+{
+	struct pfl_hashrdr *r;
+
+	r = pfl_hashrdr;
+	if (r == NULL) {
+		pthread_once(&pfl_hashrdr_once, pfl_hashrdr_initkey);
+		r = PSCALLOC(sizeof(*r));
+		INIT_PSC_LISTENTRY(&r->phr_lentry);
+		pll_add(&pfl_hashrdrs, r);
+		pthread_setspecific(pfl_hashrdr_key, r);
+		pfl_hashrdr = r;
+	}
+	if (r->phr_nest++)
+		return;
+	__atomic_store_n(&r->phr_epoch,
+	    __atomic_load_n(&pfl_hash_epoch, __ATOMIC_RELAXED),
+	    __ATOMIC_RELAXED);
+	/* publish our epoch before reading any chain */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+__static void
+pfl_hashtbl_rdexit(void)
+{
+	struct pfl_hashrdr *r = pfl_hashrdr;
+
+	if (--r->phr_nest == 0)
+		PHT_STORE(r->phr_epoch, 0);
+}
+
+/*
+ * Wait until no lock-free reader can still see an item unlinked from a
+ * PHTF_RCU table before this call.  Must not be called with a bucket
+ * locked.
+ * @t: the hash table.
+ */
+void
+psc_hashtbl_sync(struct psc_hashtbl *t)
+{
+	struct pfl_hashrdr *r;
+	uint64_t epoch, e;
+
+	if ((t->pht_flags & PHTF_RCU) == 0)
+		return;
+
+	psc_assert(pfl_hashrdr == NULL || pfl_hashrdr->phr_nest == 0);
+	epoch = __atomic_add_fetch(&pfl_hash_epoch, 1,
+	    __ATOMIC_SEQ_CST);
+	PLL_LOCK(&pfl_hashrdrs);
+	PLL_FOREACH(r, &pfl_hashrdrs)
+		while ((e = PHT_LOAD(r->phr_epoch)) && e < epoch)
+			sched_yield();
+	PLL_ULOCK(&pfl_hashrdrs);
+}
+
 void
 _psc_hashbkt_init(struct psc_hashtbl *t, struct psc_hashbkt *b)
 {
-	INIT_PSCLIST_HEAD(&b->phb_listhd);
+	if (t->pht_flags & PHTF_RCU)
+		psc_lentry_next(&b->phb_listhd) =
+		    psc_lentry_prev(&b->phb_listhd) = NULL;
+	else
+		INIT_PSCLIST_HEAD(&b->phb_listhd);
 	INIT_SPINLOCK_NOLOG(&b->phb_lock);
 	psc_atomic32_set(&b->phb_nitems, 0);
+	b->phb_seq = 0;
+	b->phb_moved = 0;
 	b->phb_gen = t->pht_gen;
 }
 
+/*
+ * Link an item at the head of a PHTF_RCU bucket chain.  The item is
+ * fully formed before the store that makes it reachable.
+ */
+__static void
+_psc_hashbkt_rcu_link(const struct psc_hashtbl *t,
+    struct psc_hashbkt *b, void *p)
+{
+	struct psclist_head *e, *first;
+
+	e = psc_hashent_getlentry(t, p);
+	first = psc_lentry_next(&b->phb_listhd);
+	psc_lentry_next(e) = first;
+	psc_lentry_prev(e) = (void *)&psc_lentry_next(&b->phb_listhd);
+	if (first)
+		psc_lentry_prev(first) = (void *)&psc_lentry_next(e);
+	PHT_STORE(psc_lentry_next(&b->phb_listhd), e);
+}
+
+/*
+ * Unlink an item from a PHTF_RCU bucket chain.  Its next pointer is
+ * left intact for any reader currently standing on it.
+ */
+__static void
+_psc_hashbkt_rcu_unlink(const struct psc_hashtbl *t, void *p)
+{
+	struct psclist_head *e, *next, **pprev;
+
+	e = psc_hashent_getlentry(t, p);
+	pprev = (void *)psc_lentry_prev(e);
+	psc_assert(pprev);
+	next = psc_lentry_next(e);
+	PHT_STORE(*pprev, next);
+	if (next)
+		psc_lentry_prev(next) = (void *)pprev;
+	psc_lentry_prev(e) = NULL;
+}
+
+__static uint64_t
+_psc_hashtbl_hash(const struct psc_hashtbl *t, const void *key)
+{
+	return (t->pht_flags & PHTF_STR ? psc_str_hashify(key) :
+	    *(const uint64_t *)key);
+}
+
+__static int
+_psc_hashent_match(const struct psc_hashtbl *t, const void *p,
+    const void *key)
+{
+	const void *pk;
+
+	pk = (const char *)p + t->pht_idoff;
+	if (t->pht_flags & PHTF_STR) {
+		if (t->pht_flags & PHTF_STRP)
+			pk = *(char * const *)pk;
+		return (strcmp(key, pk) == 0);
+	}
+	return (*(const uint64_t *)key == *(const uint64_t *)pk);
+}
+
 int
 _psc_hashtbl_getmemflags(struct psc_hashtbl *t)
 {
@@ -83,6 +261,10 @@ _psc_hashtbl_init(struct psc_hashtbl *t, int flags,
 	t->pht_nbuckets = nb;
 	if (flags & PHTF_STRP)
 		flags |= PHTF_STR;
+#ifndef HAVE_TLS
+	/* readers are tracked per thread */
+	flags &= ~PHTF_RCU;
+#endif
 	t->pht_flags = flags;
 	t->pht_buckets = psc_alloc(nb * sizeof(*t->pht_buckets),
 	    _psc_hashtbl_getmemflags(t));
@@ -179,8 +361,141 @@ psc_hashbkt_put(struct psc_hashtbl *t, struct psc_hashbkt *b)
 }
 
 #define GETBKT(t, bv, nb, key)						\
-	&(bv)[ ( (t)->pht_flags & PHTF_STR ? psc_str_hashify(key) :	\
-	    *(uint64_t *)(key) ) % (nb) ]
+	&(bv)[ _psc_hashtbl_hash((t), (key)) % (nb) ]
+
+/*
+ * Find the bucket holding a key in a PHTF_RCU table: the old bucket
+ * while a resize has not migrated it yet, else the one in the current
+ * array.  Must be called in a read-side section.
+ * @t: table to search.
+ * @key: search key.
+ * @seqp: value-result table sequence the choice was made under.
+ * @bseqp: value-result bucket sequence, sampled before the bucket was
+ *	judged not migrated so a migration racing the caller's walk
+ *	shows up as a sequence change.
+ */
+__static struct psc_hashbkt *
+_psc_hashtbl_rcu_getbkt(struct psc_hashtbl *t, const void *key,
+    unsigned *seqp, unsigned *bseqp)
+{
+	struct psc_hashbkt *b, *ob, *nb;
+	unsigned seq, bseq;
+	int onbkt, nbkt;
+	uint64_t h;
+
+	h = _psc_hashtbl_hash(t, key);
+
+	/*
+	 * Take a consistent snapshot of both arrays before using any
+	 * of it: a torn read could pair an array with the wrong size.
+	 * Both stay valid for the read-side section even if a resize
+	 * moves on in the meantime.
+	 */
+	for (;;) {
+		seq = PHT_LOAD(t->pht_seq);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		ob = PHT_LOAD(t->pht_obuckets);
+		onbkt = PHT_LOAD(t->pht_onbuckets);
+		nb = PHT_LOAD(t->pht_buckets);
+		nbkt = PHT_LOAD(t->pht_nbuckets);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (PHT_LOAD(t->pht_seq) == seq)
+			break;
+	}
+
+	b = NULL;
+	if (ob) {
+		b = &ob[h % onbkt];
+		bseq = PHT_LOAD(b->phb_seq);
+		if (PHT_LOAD(b->phb_moved))
+			b = NULL;
+	}
+	if (b == NULL) {
+		b = &nb[h % nbkt];
+		bseq = PHT_LOAD(b->phb_seq);
+	}
+	if (seqp)
+		*seqp = seq;
+	if (bseqp)
+		*bseqp = bseq;
+	return (b);
+}
+
+/*
+ * Lock and reference the bucket for a key in a PHTF_RCU table.  The
+ * bucket is only trusted once locked and found not migrated away.
+ */
+__static struct psc_hashbkt *
+_psc_hashbkt_rcu_get(struct psc_hashtbl *t, const void *key)
+{
+	struct psc_hashbkt *b;
+	int locked;
+
+	for (;;) {
+		pfl_hashtbl_rdenter();
+		b = _psc_hashtbl_rcu_getbkt(t, key, NULL, NULL);
+		if (!tryreqlock(&b->phb_lock, &locked)) {
+			/* old array may go away once we leave */
+			pfl_hashtbl_rdexit();
+			sched_yield();
+			continue;
+		}
+		pfl_hashtbl_rdexit();
+		if (!b->phb_moved)
+			break;
+		psc_hashbkt_unlock(b);
+	}
+	b->phb_refcnt++;
+	return (b);
+}
+
+/*
+ * Search a PHTF_RCU table without locking.  An item found is returned
+ * regardless of concurrent changes since its memory stays valid for the
+ * duration of the read-side section, but a miss is only believed if
+ * neither the bucket nor the table array changed during the walk.
+ * Returns zero if the caller must fall back to a locked search.
+ */
+__static int
+_psc_hashtbl_rcu_search(struct psc_hashtbl *t,
+    int (*cmpf)(const void *, const void *), const void *cmp,
+    void (*cbf)(void *, void *), void *arg, const void *key, void **pp)
+{
+	struct psc_hashbkt *b;
+	unsigned tseq, bseq;
+	int tries, rc = 0;
+	void *p;
+
+	pfl_hashtbl_rdenter();
+	for (tries = 0; tries < 4; tries++) {
+		b = _psc_hashtbl_rcu_getbkt(t, key, &tseq, &bseq);
+		if (bseq & 1)
+			continue;
+		PSC_HASHBKT_FOREACH_ENTRY(t, p, b)
+			if (_psc_hashent_match(t, p, key) &&
+			    (cmpf == NULL || cmpf(cmp, p)))
+				break;
+		if (p) {
+			if (cbf)
+				cbf(p, arg);
+			*pp = p;
+			rc = 1;
+			break;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (PHT_LOAD(b->phb_seq) == bseq &&
+		    PHT_LOAD(t->pht_seq) == tseq) {
+			*pp = NULL;
+			rc = 1;
+			break;
+		}
+	}
+	pfl_hashtbl_rdexit();
+	return (rc);
+}
 
 /*
  * Locate the bucket containing an item with the given ID.
@@ -193,6 +508,9 @@ psc_hashbkt_get(struct psc_hashtbl *t, const void *key)
 	struct psc_hashbkt *b;
 	int locked;
 
+	if (t->pht_flags & PHTF_RCU)
+		return (_psc_hashbkt_rcu_get(t, key));
+
  retry: 
 	b = GETBKT(t, t->pht_buckets, t->pht_nbuckets, key);
 
@@ -225,6 +543,14 @@ _psc_hashtbl_search(struct psc_hashtbl *t, int flags,
 	struct psc_hashbkt *b;
 	void *p;
 
+	if (t->pht_flags & PHTF_RCU && (flags & PHLF_DEL) == 0) {
+		if (cmpf == NULL)
+			cmpf = t->pht_cmpf;
+		if (_psc_hashtbl_rcu_search(t, cmpf, cmp, cbf, arg, key,
+		    &p))
+			return (p);
+	}
+
 	b = psc_hashbkt_get(t, key);
 	p = _psc_hashbkt_search(t, b, flags, cmpf, cmp, cbf, arg, key);
 	psc_hashbkt_put(t, b);
@@ -236,8 +562,8 @@ _psc_hashbkt_search(struct psc_hashtbl *t, struct psc_hashbkt *b,
     int flags, int (*cmpf)(const void *, const void *), const void *cmp,
     void (*cbf)(void *, void *), void *arg, const void *key)
 {
-	void *p, *pk;
 	int locked;
+	void *p;
 
 	if (cmpf == NULL)
 		cmpf = t->pht_cmpf;
@@ -248,13 +574,7 @@ _psc_hashbkt_search(struct psc_hashtbl *t, struct psc_hashbkt *b,
 
 	locked = reqlock(&b->phb_lock);
 	PSC_HASHBKT_FOREACH_ENTRY(t, p, b) {
-		pk = (char *)p + t->pht_idoff;
-		if (t->pht_flags & PHTF_STR) {
-			if (t->pht_flags & PHTF_STRP)
-				pk = *(char **)pk;
-			if (strcmp(key, pk))
-				continue;
-		} else if (*(uint64_t *)key != *(uint64_t *)pk)
+		if (!_psc_hashent_match(t, p, key))
 			continue;
 		if (cmpf == NULL || cmpf(cmp, p)) {
 			if (cbf)
@@ -262,11 +582,8 @@ _psc_hashbkt_search(struct psc_hashtbl *t, struct psc_hashbkt *b,
 			break;
 		}
 	}
-	if (p && (flags & PHLF_DEL)) {
-		psclist_del(psc_hashent_getlentry(t, p),
-		    &b->phb_listhd);
-		psc_atomic32_dec(&b->phb_nitems);
-	}
+	if (p && (flags & PHLF_DEL))
+		psc_hashbkt_del_item(t, b, p);
 	ureqlock(&b->phb_lock, locked);
 	return (p);
 }
@@ -278,15 +595,37 @@ _psc_hashbkt_search(struct psc_hashtbl *t, struct psc_hashbkt *b,
  */
 void
 psc_hashent_remove(struct psc_hashtbl *t, void *p)
+{
+	psc_hashent_removev(t, &p, 1);
+}
+
+/*
+ * Remove several items from the hash table they are in, waiting out
+ * lock-free readers once for all of them.
+ * @t: the hash table.
+ * @pv: the items to remove from hash table.
+ * @n: number of items.
+ */
+void
+psc_hashent_removev(struct psc_hashtbl *t, void **pv, int n)
 {
 	struct psc_hashbkt *b;
 	void *pk;
+	int i;
 
-	psc_assert(p);
-	pk = PSC_AGP(p, t->pht_idoff);
-	b = psc_hashbkt_get(t, pk);
-	psc_hashbkt_del_item(t, b, p);
-	psc_hashbkt_put(t, b);
+	for (i = 0; i < n; i++) {
+		psc_assert(pv[i]);
+		pk = PSC_AGP(pv[i], t->pht_idoff);
+		b = psc_hashbkt_get(t, pk);
+		psc_hashbkt_del_item(t, b, pv[i]);
+		psc_hashbkt_put(t, b);
+	}
+
+	if (n && t->pht_flags & PHTF_RCU) {
+		psc_hashtbl_sync(t);
+		for (i = 0; i < n; i++)
+			psc_hashent_init(t, pv[i]);
+	}
 }
 
 struct psc_hashbkt *
@@ -312,7 +651,13 @@ psc_hashbkt_del_item(struct psc_hashtbl *t, struct psc_hashbkt *b,
 	int locked;
 
 	locked = reqlock(&b->phb_lock);
-	psclist_del(psc_hashent_getlentry(t, p), &b->phb_listhd);
+	if (t->pht_flags & PHTF_RCU) {
+		PHT_WRITE_BEGIN(b->phb_seq);
+		_psc_hashbkt_rcu_unlink(t, p);
+		PHT_WRITE_END(b->phb_seq);
+	} else
+		psclist_del(psc_hashent_getlentry(t, p),
+		    &b->phb_listhd);
 	psc_assert(psc_atomic32_read(&b->phb_nitems) > 0);
 	psc_atomic32_dec(&b->phb_nitems);
 	ureqlock(&b->phb_lock, locked);
@@ -330,7 +675,13 @@ psc_hashbkt_add_item(const struct psc_hashtbl *t, struct psc_hashbkt *b,
 	int locked;
 
 	locked = reqlock(&b->phb_lock);
-	psclist_add(psc_hashent_getlentry(t, p), &b->phb_listhd);
+	if (t->pht_flags & PHTF_RCU) {
+		PHT_WRITE_BEGIN(b->phb_seq);
+		_psc_hashbkt_rcu_link(t, b, p);
+		PHT_WRITE_END(b->phb_seq);
+	} else
+		psclist_add(psc_hashent_getlentry(t, p),
+		    &b->phb_listhd);
 	psc_atomic32_inc(&b->phb_nitems);
 	ureqlock(&b->phb_lock, locked);
 }
@@ -363,8 +714,11 @@ psc_hashent_conjoint(struct psc_hashtbl *t, void *p)
 	psc_assert(p);
 	pk = PSC_AGP(p, t->pht_idoff);
 	b = psc_hashbkt_get(t, pk);
-	conjoint = psclist_conjoint(psc_hashent_getlentry(t, p),
-	    &b->phb_listhd);
+	if (t->pht_flags & PHTF_RCU)
+		conjoint = !psc_hashent_disjoint(t, p);
+	else
+		conjoint = psclist_conjoint(psc_hashent_getlentry(t, p),
+		    &b->phb_listhd);
 	psc_hashbkt_put(t, b);
 	return (conjoint);
 }
@@ -450,6 +804,73 @@ psc_hashtbl_estnbuckets(int n)
 	return (t);
 }
 
+/*
+ * Resize a PHTF_RCU table.  The new array is published right away and
+ * old buckets are migrated one at a time, each locked only while its
+ * own items move, so lookups and updates proceed throughout.
+ */
+__static void
+_psc_hashtbl_rcu_resize(struct psc_hashtbl *t, struct psc_hashbkt *bnew,
+    int nb)
+{
+	struct psc_hashbkt *b, *bn, *obuckets;
+	int i, oldnb;
+	void *p;
+
+	for (b = bnew, i = 0; i < nb; i++, b++)
+		_psc_hashbkt_init(t, b);
+
+	PSC_HASHTBL_LOCK(t);
+	while (t->pht_obuckets) {
+		psc_waitq_wait(&t->pht_waitq, &t->pht_lock);
+		PSC_HASHTBL_LOCK(t);
+	}
+	PHT_WRITE_BEGIN(t->pht_seq);
+	t->pht_obuckets = obuckets = t->pht_buckets;
+	t->pht_onbuckets = oldnb = t->pht_nbuckets;
+	t->pht_buckets = bnew;
+	t->pht_nbuckets = nb;
+	PHT_WRITE_END(t->pht_seq);
+	PSC_HASHTBL_ULOCK(t);
+
+	for (i = 0, b = obuckets; i < oldnb; i++, b++) {
+		psc_hashbkt_lock(b);
+		while (b->phb_refcnt) {
+			psc_hashbkt_unlock(b);
+			sched_yield();
+			psc_hashbkt_lock(b);
+		}
+
+		PHT_WRITE_BEGIN(b->phb_seq);
+		while ((p = psc_hashbkt_first(t, b))) {
+			bn = GETBKT(t, bnew, nb,
+			    PSC_AGP(p, t->pht_idoff));
+			psc_hashbkt_lock(bn);
+			PHT_WRITE_BEGIN(bn->phb_seq);
+			_psc_hashbkt_rcu_unlink(t, p);
+			_psc_hashbkt_rcu_link(t, bn, p);
+			PHT_WRITE_END(bn->phb_seq);
+			psc_atomic32_inc(&bn->phb_nitems);
+			psc_hashbkt_unlock(bn);
+			psc_atomic32_dec(&b->phb_nitems);
+		}
+		PHT_STORE(b->phb_moved, 1);
+		PHT_WRITE_END(b->phb_seq);
+		psc_hashbkt_unlock(b);
+	}
+
+	PSC_HASHTBL_LOCK(t);
+	PHT_WRITE_BEGIN(t->pht_seq);
+	t->pht_obuckets = NULL;
+	t->pht_onbuckets = 0;
+	PHT_WRITE_END(t->pht_seq);
+	PSC_HASHTBL_ULOCK(t);
+
+	psc_hashtbl_sync(t);
+	psc_free(obuckets, _psc_hashtbl_getmemflags(t));
+	psc_waitq_wakeall(&t->pht_waitq);
+}
+
 void
 psc_hashtbl_resize(struct psc_hashtbl *t, int nb)
 {
@@ -459,6 +880,11 @@ psc_hashtbl_resize(struct psc_hashtbl *t, int nb)
 
 	bnew = psc_alloc(nb * sizeof(*b), _psc_hashtbl_getmemflags(t));
 
+	if (t->pht_flags & PHTF_RCU) {
+		_psc_hashtbl_rcu_resize(t, bnew, nb);
+		return;
+	}
+
 	PSC_HASHTBL_LOCK(t);
 	while (t->pht_flags & PHTF_RESIZING) {
 		psc_waitq_wait(&t->pht_waitq, &t->pht_lock);
@@ -43,6 +43,8 @@ struct psc_hashbkt {
 	struct psclist_head	  phb_listhd;
 	psc_spinlock_t		  phb_lock;
 	psc_atomic32_t		  phb_nitems;
+	unsigned		  phb_seq;	/* odd while chain changes (PHTF_RCU) */
+	int			  phb_moved;	/* migrated by resize (PHTF_RCU) */
 	int			  phb_refcnt:16;
 	int			  phb_gen:16;
 	int			  phb_died:1;
@@ -58,6 +60,8 @@ struct psc_hashtbl {
 	int			  pht_gen;	/* generation # */
 	int			  pht_nbuckets;
 	int			  pht_ocntr;	/* # free buckets (when resizing) */
+	int			  pht_onbuckets;/* # old buckets (PHTF_RCU resize) */
+	unsigned		  pht_seq;	/* odd while arrays change (PHTF_RCU) */
 	struct psc_waitq	  pht_waitq;
 	struct psc_hashbkt	 *pht_buckets;
 	struct psc_hashbkt	 *pht_obuckets;	/* old buckets (when resizing */
@@ -72,6 +76,7 @@ struct psc_hashtbl {
 #define PHTF_NOMEMGUARD	(1 << 2)	/* disable memalloc guard */
 #define PHTF_NOLOG	(1 << 3)	/* do not psclog */
 #define PHTF_RESIZING	(1 << 4)
+#define PHTF_RCU	(1 << 5)	/* lock-free lookups, see below */
 
 /* Lookup flags. */
 #define PHLF_NONE	0		/* no lookup flags specified */
@@ -83,10 +88,28 @@ struct psc_hashtbl {
 	    (b)++)
 
 #define PSC_HASHBKT_FOREACH_ENTRY(t, p, b)				\
-	psclist_for_each_entry2((p), &(b)->phb_listhd, (t)->pht_hentoff)
+	for ((p) = psc_hashbkt_first((t), (b)); (p);			\
+	    (p) = psc_hashbkt_next((t), (b), (p)))
 
 #define PSC_HASHBKT_FOREACH_ENTRY_SAFE(t, p, pn, b)			\
-	psclist_for_each_entry2_safe((p), (pn), &(b)->phb_listhd, (t)->pht_hentoff)
+	for ((p) = psc_hashbkt_first((t), (b)),				\
+	    (pn) = (p) ? psc_hashbkt_next((t), (b), (p)) : NULL; (p);	\
+	    (p) = (pn), (pn) = (pn) ? psc_hashbkt_next((t), (b), (pn)) : NULL)
+
+/*
+ * Tables created with PHTF_RCU are searched without taking any lock.
+ * Their bucket chains are NULL-terminated and modified under the bucket
+ * lock in an order that lets a concurrent reader walk them safely, with
+ * a per-bucket sequence count telling a reader when a miss may be stale.
+ * psc_hashtbl_resize() migrates such a table one bucket at a time while
+ * lookups and updates go on.
+ *
+ * In return, memory of an item removed from a PHTF_RCU table must not
+ * be reused until psc_hashtbl_sync() has waited out the readers that
+ * may still hold it.  psc_hashent_remove() does so itself; callers of
+ * psc_hashbkt_del_item() must call psc_hashtbl_sync() afterwards, with
+ * no bucket locked.  Search callbacks run without the bucket lock.
+ */
 
 /*
  * Initialize a hash table.
@@ -153,7 +176,9 @@ void	  psc_hashtbl_add_item(struct psc_hashtbl *, void *);
 void	  psc_hashtbl_prstats(const struct psc_hashtbl *);
 void	  psc_hashtbl_getstats(const struct psc_hashtbl *, int *, int *, int *, int *);
 void	  psc_hashtbl_destroy(struct psc_hashtbl *);
+int	  psc_hashtbl_estnbuckets(int);
 void	  psc_hashtbl_resize(struct psc_hashtbl *, int);
+void	  psc_hashtbl_sync(struct psc_hashtbl *);
 void	*_psc_hashtbl_search(struct psc_hashtbl *, int,
 	    int (*)(const void *, const void *), const void *,
 	    void (*)(void *, void *), void *, const void *);
@@ -227,12 +252,12 @@ struct pfl_hashentry {
 
 void	 psc_hashent_init(const struct psc_hashtbl *, void *);
 void	 psc_hashent_remove(struct psc_hashtbl *, void *);
+void	 psc_hashent_removev(struct psc_hashtbl *, void **, int);
 int	 psc_hashent_conjoint(struct psc_hashtbl *, void *);
 struct psc_hashbkt *
 	 psc_hashent_getbucket(struct psc_hashtbl *, void *);
 
-#define psc_hashent_disjoint(t, p)	psclist_disjoint(			\
-					    psc_hashent_getlentry((t), (p)))
+#define psc_hashent_disjoint(t, p)	_psc_hashent_disjoint((t), (p))
 #define psc_hashent_init(t, p)		INIT_PSC_LISTENTRY(			\
 					    psc_hashent_getlentry((t), (p)))
 
@@ -255,4 +280,48 @@ psc_hashent_getid(const struct psc_hashtbl *t, const void *p)
 	return ((const char *)p + t->pht_idoff);
 }
 
+static __inline int
+_psc_hashent_disjoint(const struct psc_hashtbl *t, void *p)
+{
+	struct psclist_head *e;
+
+	e = psc_hashent_getlentry(t, p);
+	if (t->pht_flags & PHTF_RCU)
+		return (psc_lentry_prev(e) == NULL);
+	return (psclist_disjoint(e));
+}
+
+/*
+ * Bucket iteration.  On PHTF_RCU tables, psc_lentry_next() of a
+ * hashed item points to the next item in the chain or is NULL and
+ * psc_lentry_prev() points to whatever points to the item.
+ */
+static __inline void *
+psc_hashbkt_first(const struct psc_hashtbl *t, struct psc_hashbkt *b)
+{
+	struct psclist_head *e;
+
+	if (t->pht_flags & PHTF_RCU) {
+		e = __atomic_load_n(&psc_lentry_next(&b->phb_listhd),
+		    __ATOMIC_ACQUIRE);
+		return (e ? (char *)e - t->pht_hentoff : NULL);
+	}
+	return (psc_listhd_first_obj2(&b->phb_listhd, char,
+	    t->pht_hentoff));
+}
+
+static __inline void *
+psc_hashbkt_next(const struct psc_hashtbl *t, struct psc_hashbkt *b,
+    void *p)
+{
+	struct psclist_head *e;
+
+	if (t->pht_flags & PHTF_RCU) {
+		e = __atomic_load_n(&psc_lentry_next(
+		    psc_hashent_getlentry(t, p)), __ATOMIC_ACQUIRE);
+		return (e ? (char *)e - t->pht_hentoff : NULL);
+	}
+	return (psclist_next_obj2(&b->phb_listhd, p, t->pht_hentoff));
+}
+
 #endif /* _PFL_HASHTBL_H_ */
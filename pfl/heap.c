@@ -75,10 +75,23 @@ pfl_heap_remove(struct pfl_heap *ph, void *p)
 
 	psc_assert(p);
 	phe = PSC_AGP(p, ph->ph_entoff);
-	p = ph->ph_base[idx = phe->phe_idx] =
-	    ph->ph_base[--ph->ph_nitems];
+	idx = phe->phe_idx;
+	if (idx == --ph->ph_nitems)
+		return;
+	p = ph->ph_base[idx] = ph->ph_base[ph->ph_nitems];
 	phe = PSC_AGP(p, ph->ph_entoff);
 	phe->phe_idx = idx;
+	/*
+	 * The last item may belong above the hole if it came from
+	 * another subtree.
+	 */
+	while (phe->phe_idx > 0) {
+		c = ph->ph_base[(phe->phe_idx - 1) / 2];
+		if (ph->ph_cmpf(c, p) != 1)
+			break;
+		che = PSC_AGP(c, ph->ph_entoff);
+		_pfl_heap_swap(ph, che, phe);
+	}
 	/* bubble down */
 	for (;;) {
 		for (minc = p, idx = phe->phe_idx * 2 + 1, i = 0;
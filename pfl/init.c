@@ -35,6 +35,7 @@
 #include "pfl/alloc.h"
 #include "pfl/atomic.h"
 #include "pfl/cdefs.h"
+#include "pfl/crc.h"
 #include "pfl/err.h"
 #include "pfl/lock.h"
 #include "pfl/log.h"
@@ -175,6 +176,11 @@ pfl_init(void)
 	pfl_subsys_register(PSS_LNET, "lnet");
 	pfl_subsys_register(PSS_RPC, "rpc");
 
+#ifndef USE_GCRCUTIL
+	/* logs the kernel chosen, so subsystems must exist */
+	psc_crc64_kernel_init(getenv("PSC_CRC64_KERNEL"));
+#endif
+
 	p = getenv("PSC_DUMPSTACK");
 	if (p && strcmp(p, "0"))
 		if (signal(SIGSEGV, pfl_dump_stack1) == SIG_ERR ||
@@ -184,6 +190,10 @@ pfl_init(void)
 	if (p && strcmp(p, "0"))
 		atexit(pfl_dump_stack);
 
+	p = getenv("PSC_LOCKPROF");
+	if (p && strcmp(p, "0"))
+		pfl_lockprof = 1;
+
 	p = getenv("PSC_TIMEOUT");
 	if (p) {
 		struct itimerval it;
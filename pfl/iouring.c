@@ -0,0 +1,264 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/iouring.h"
+
+#define RING_LOAD_ACQUIRE(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RING_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+__static int
+_pfl_iouring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags)
+{
+	int rc;
+
+	rc = syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, NULL, 0);
+	return (rc == -1 ? -errno : rc);
+}
+
+/*
+ * Check that the kernel supports the opcodes the ring will be used
+ * for.  Setup alone only proves io_uring exists (5.1); plain
+ * IORING_OP_READ/WRITE and the probe itself only came in 5.6, and
+ * unsupported opcodes would otherwise fail each I/O at completion
+ * with EINVAL.  Returns zero or -EOPNOTSUPP.
+ */
+__static int
+_pfl_iouring_probe(struct pfl_iouring *piu)
+{
+	static const int ops[] = { IORING_OP_READ, IORING_OP_WRITE };
+	struct io_uring_probe *pr;
+	size_t len;
+	int i, rc;
+
+	len = sizeof(*pr) + 256 * sizeof(struct io_uring_probe_op);
+	pr = calloc(1, len);
+	if (pr == NULL)
+		return (-ENOMEM);
+	rc = syscall(__NR_io_uring_register, piu->piu_fd,
+	    IORING_REGISTER_PROBE, pr, 256);
+	if (rc == -1)
+		rc = -EOPNOTSUPP;
+	for (i = 0; rc == 0 && i < nitems(ops); i++)
+		if (ops[i] > pr->last_op || ops[i] >= pr->ops_len ||
+		    !(pr->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+			rc = -EOPNOTSUPP;
+	free(pr);
+	return (rc);
+}
+
+/*
+ * Set up a ring with room for @entries submissions.
+ * Returns zero on success or a negative errno; -EOPNOTSUPP if the
+ * kernel lacks the opcodes needed for plain reads and writes.
+ */
+int
+pfl_iouring_init(struct pfl_iouring *piu, unsigned entries)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+	int rc;
+
+	memset(piu, 0, sizeof(*piu));
+	memset(&p, 0, sizeof(p));
+	piu->piu_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (piu->piu_fd == -1)
+		return (-errno);
+
+	piu->piu_sq_entries = p.sq_entries;
+	piu->piu_cq_entries = p.cq_entries;
+
+	piu->piu_sq_ringsz = p.sq_off.array +
+	    p.sq_entries * sizeof(unsigned);
+	piu->piu_cq_ringsz = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	piu->piu_sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	sq = mmap(NULL, piu->piu_sq_ringsz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, piu->piu_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto error;
+	piu->piu_sq_ring = sq;
+
+	cq = mmap(NULL, piu->piu_cq_ringsz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, piu->piu_fd, IORING_OFF_CQ_RING);
+	if (cq == MAP_FAILED)
+		goto error;
+	piu->piu_cq_ring = cq;
+
+	piu->piu_sqes = mmap(NULL, piu->piu_sqesz, PROT_READ |
+	    PROT_WRITE, MAP_SHARED | MAP_POPULATE, piu->piu_fd,
+	    IORING_OFF_SQES);
+	if (piu->piu_sqes == MAP_FAILED) {
+		piu->piu_sqes = NULL;
+		goto error;
+	}
+
+	piu->piu_sq_khead = (void *)(sq + p.sq_off.head);
+	piu->piu_sq_ktail = (void *)(sq + p.sq_off.tail);
+	piu->piu_sq_kmask = (void *)(sq + p.sq_off.ring_mask);
+	piu->piu_sq_karray = (void *)(sq + p.sq_off.array);
+	piu->piu_sq_tail = *piu->piu_sq_ktail;
+
+	piu->piu_cq_khead = (void *)(cq + p.cq_off.head);
+	piu->piu_cq_ktail = (void *)(cq + p.cq_off.tail);
+	piu->piu_cq_kmask = (void *)(cq + p.cq_off.ring_mask);
+	piu->piu_cqes = (void *)(cq + p.cq_off.cqes);
+
+	rc = _pfl_iouring_probe(piu);
+	if (rc) {
+		pfl_iouring_destroy(piu);
+		return (rc);
+	}
+	return (0);
+
+ error:
+	rc = -errno;
+	pfl_iouring_destroy(piu);
+	return (rc);
+}
+
+void
+pfl_iouring_destroy(struct pfl_iouring *piu)
+{
+	if (piu->piu_sqes)
+		munmap(piu->piu_sqes, piu->piu_sqesz);
+	if (piu->piu_cq_ring)
+		munmap(piu->piu_cq_ring, piu->piu_cq_ringsz);
+	if (piu->piu_sq_ring)
+		munmap(piu->piu_sq_ring, piu->piu_sq_ringsz);
+	if (piu->piu_fd != -1)
+		close(piu->piu_fd);
+	memset(piu, 0, sizeof(*piu));
+	piu->piu_fd = -1;
+}
+
+/*
+ * Grab the next free submission slot.  The entry becomes visible to
+ * the kernel as soon as it is returned, so it must be filled in before
+ * the next pfl_iouring_submit().  Returns NULL if the queue is full.
+ */
+struct io_uring_sqe *
+pfl_iouring_get_sqe(struct pfl_iouring *piu)
+{
+	unsigned head, idx;
+
+	head = RING_LOAD_ACQUIRE(piu->piu_sq_khead);
+	if (piu->piu_sq_tail - head >= piu->piu_sq_entries)
+		return (NULL);
+	idx = piu->piu_sq_tail & *piu->piu_sq_kmask;
+	piu->piu_sq_karray[idx] = idx;
+	piu->piu_sq_tail++;
+	return (&piu->piu_sqes[idx]);
+}
+
+/*
+ * Return the number of entries filled in but not yet consumed by the
+ * kernel.
+ */
+unsigned
+pfl_iouring_sq_ready(struct pfl_iouring *piu)
+{
+	return (piu->piu_sq_tail - RING_LOAD_ACQUIRE(piu->piu_sq_khead));
+}
+
+/*
+ * Publish filled entries and hand them to the kernel.
+ * Returns the number consumed or a negative errno.
+ */
+int
+pfl_iouring_submit(struct pfl_iouring *piu)
+{
+	unsigned n;
+
+	RING_STORE_RELEASE(piu->piu_sq_ktail, piu->piu_sq_tail);
+	n = pfl_iouring_sq_ready(piu);
+	if (n == 0)
+		return (0);
+	return (_pfl_iouring_enter(piu->piu_fd, n, 0, 0));
+}
+
+/*
+ * Copy out up to @max completions.  If @wait is set, block until at
+ * least one is available.  Returns the number copied or a negative
+ * errno.
+ */
+int
+pfl_iouring_reap(struct pfl_iouring *piu, struct io_uring_cqe *cqes,
+    int max, int wait)
+{
+	unsigned head, tail;
+	int n, rc;
+
+	for (;;) {
+		head = *piu->piu_cq_khead;
+		tail = RING_LOAD_ACQUIRE(piu->piu_cq_ktail);
+		for (n = 0; head != tail && n < max; head++, n++)
+			cqes[n] = piu->piu_cqes[head & *piu->piu_cq_kmask];
+		if (n) {
+			RING_STORE_RELEASE(piu->piu_cq_khead, head);
+			return (n);
+		}
+		if (!wait)
+			return (0);
+		rc = _pfl_iouring_enter(piu->piu_fd, 0, 1,
+		    IORING_ENTER_GETEVENTS);
+		if (rc < 0 && rc != -EINTR)
+			return (rc);
+	}
+}
+
+/*
+ * Register buffers so IORING_OP_READ_FIXED/WRITE_FIXED can skip the
+ * per-I/O page pinning.  Returns zero or a negative errno.
+ */
+int
+pfl_iouring_register_buffers(struct pfl_iouring *piu,
+    const struct iovec *iov, int n)
+{
+	int rc;
+
+	rc = syscall(__NR_io_uring_register, piu->piu_fd,
+	    IORING_REGISTER_BUFFERS, iov, n);
+	if (rc == -1)
+		return (-errno);
+	piu->piu_nbufs = n;
+	return (0);
+}
+
+#endif /* HAVE_IO_URING */
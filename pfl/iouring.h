@@ -0,0 +1,98 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Minimal io_uring(7) submission/completion ring, driven through the
+ * raw system calls so no extra library is needed.  The submission side
+ * must be serialized by the caller; the completion side may be drained
+ * concurrently by one other thread.
+ */
+
+#ifndef _PFL_IOURING_H_
+#define _PFL_IOURING_H_
+
+#ifdef HAVE_IO_URING
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct pfl_iouring {
+	int			 piu_fd;
+	unsigned		 piu_sq_entries;
+	unsigned		 piu_cq_entries;
+
+	/* submission queue */
+	unsigned		*piu_sq_khead;
+	unsigned		*piu_sq_ktail;
+	unsigned		*piu_sq_kmask;
+	unsigned		*piu_sq_karray;
+	unsigned		 piu_sq_tail;	/* next slot to fill */
+	struct io_uring_sqe	*piu_sqes;
+
+	/* completion queue */
+	unsigned		*piu_cq_khead;
+	unsigned		*piu_cq_ktail;
+	unsigned		*piu_cq_kmask;
+	struct io_uring_cqe	*piu_cqes;
+
+	void			*piu_sq_ring;
+	size_t			 piu_sq_ringsz;
+	void			*piu_cq_ring;
+	size_t			 piu_cq_ringsz;
+	size_t			 piu_sqesz;
+	int			 piu_nbufs;	/* registered buffers */
+};
+
+int	pfl_iouring_init(struct pfl_iouring *, unsigned);
+void	pfl_iouring_destroy(struct pfl_iouring *);
+struct io_uring_sqe *
+	pfl_iouring_get_sqe(struct pfl_iouring *);
+unsigned pfl_iouring_sq_ready(struct pfl_iouring *);
+int	pfl_iouring_submit(struct pfl_iouring *);
+int	pfl_iouring_reap(struct pfl_iouring *, struct io_uring_cqe *, int,
+	    int);
+int	pfl_iouring_register_buffers(struct pfl_iouring *,
+	    const struct iovec *, int);
+
+static __inline void
+pfl_iouring_prep_rw(struct io_uring_sqe *sqe, int op, int fd,
+    const void *buf, unsigned len, off_t off, void *data)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = (uintptr_t)data;
+}
+
+#endif /* HAVE_IO_URING */
+
+#endif /* _PFL_IOURING_H_ */
@@ -24,6 +24,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <err.h>
 #include <errno.h>
@@ -85,6 +86,47 @@ struct psc_lockedlist	pfl_journals = PLL_INIT(&pfl_journals,
 struct psc_poolmaster	 pfl_xidhndl_poolmaster;
 struct psc_poolmgr	*pfl_xidhndl_pool;
 
+/*
+ * Flush a range of the journal store that was just written.
+ * @pj: the journal.
+ * @len: length of the write.
+ * @off: offset into backing store.
+ * @wtime: time spent in the write itself, for diagnostics.
+ */
+__static int
+psc_journal_sync(struct psc_journal *pj, size_t len, off_t off,
+    const struct timespec *wtime)
+{
+	struct timespec ts[2], synctime;
+	int rc;
+
+	PFL_GETTIMESPEC(&ts[0]);
+	if (pj->pj_flags & PJF_ISBLKDEV) {
+#ifdef HAVE_SYNC_FILE_RANGE
+		rc = sync_file_range(pj->pj_fd, off, len,
+		    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+		rc = fdatasync(pj->pj_fd);
+#endif
+	} else
+		rc = fsync(pj->pj_fd);
+
+	PFL_GETTIMESPEC(&ts[1]);
+	timespecsub(&ts[1], &ts[0], &synctime);
+
+	psclog_diag("wtime="PSCPRI_TIMESPEC" "
+	    "synctime="PSCPRI_TIMESPEC,
+	    PFLPRI_PTIMESPEC_ARGS(wtime),
+	    PFLPRI_PTIMESPEC_ARGS(&synctime));
+
+	if (rc) {
+		rc = errno;
+		psclog_error("sync_file_range failed "
+		    "(len=%zd, off=%"PSCPRIdOFFT")", len, off);
+	}
+	return (rc);
+}
+
 /*
  * Perform a low-level I/O operation on the journal store.
  * @pj: the journal.
@@ -97,7 +139,7 @@ __static int
 psc_journal_io(struct psc_journal *pj, void *p, size_t len, off_t off,
     int rw)
 {
-	struct timespec ts[2], wtime = { 0, 0 }, synctime;
+	struct timespec ts[2], wtime = { 0, 0 };
 	ssize_t nb;
 	int rc;
 
@@ -130,34 +172,50 @@ psc_journal_io(struct psc_journal *pj, void *p, size_t len, off_t off,
 		pfl_opstat_add(rw == JIO_READ ?
 		    pj->pj_iostats.rd : pj->pj_iostats.wr, nb);
 
-		if (rw == JIO_WRITE) {
-			PFL_GETTIMESPEC(&ts[0]);
-			if (pj->pj_flags & PJF_ISBLKDEV) {
-#ifdef HAVE_SYNC_FILE_RANGE
-				rc = sync_file_range(pj->pj_fd, off,
-				    len, SYNC_FILE_RANGE_WRITE |
-				    SYNC_FILE_RANGE_WAIT_AFTER);
-#else
-				rc = fdatasync(pj->pj_fd);
-#endif
-			} else
-				rc = fsync(pj->pj_fd);
+		if (rw == JIO_WRITE)
+			rc = psc_journal_sync(pj, len, off, &wtime);
+	}
+	return (rc);
+}
 
-			PFL_GETTIMESPEC(&ts[1]);
-			timespecsub(&ts[1], &ts[0], &synctime);
+/*
+ * Write a run of contiguous journal slots with a single vectored write
+ * followed by a single flush.
+ * @pj: the journal.
+ * @iov: entry buffers, one per slot.
+ * @n: number of entries.
+ * @off: offset into backing store of the first entry.
+ */
+__static int
+psc_journal_writev(struct psc_journal *pj, const struct iovec *iov,
+    int n, off_t off)
+{
+	struct timespec ts[2], wtime;
+	size_t len = 0;
+	ssize_t nb;
+	int i;
 
-			psclog_diag("wtime="PSCPRI_TIMESPEC" "
-			    "synctime="PSCPRI_TIMESPEC,
-			    PFLPRI_PTIMESPEC_ARGS(&wtime),
-			    PFLPRI_PTIMESPEC_ARGS(&synctime));
+	for (i = 0; i < n; i++)
+		len += iov[i].iov_len;
 
-			if (rc)
-				psclog_error("sync_file_range failed "
-				    "(len=%zd, off=%"PSCPRIdOFFT")",
-				    len, off);
-		}
+	PFL_GETTIMESPEC(&ts[0]);
+	nb = pwritev(pj->pj_fd, iov, n, off);
+	PFL_GETTIMESPEC(&ts[1]);
+	timespecsub(&ts[1], &ts[0], &wtime);
+
+	if (nb == -1) {
+		psclog_error("journal writev (pj=%p, len=%zd, "
+		    "off=%"PSCPRIdOFFT")", pj, len, off);
+		return (errno);
 	}
-	return (rc);
+	if ((size_t)nb != len) {
+		psclog_errorx("journal writev (pj=%p, len=%zd, "
+		    "off=%"PSCPRIdOFFT", nb=%zd): short I/O",
+		    pj, len, off, nb);
+		return (ENOSPC);
+	}
+	pfl_opstat_add(pj->pj_iostats.wr, nb);
+	return (psc_journal_sync(pj, len, off, &wtime));
 }
 
 void
@@ -232,13 +290,18 @@ pjournal_assign_xid(struct psc_journal *pj,
 /*
  * Determine where to write the transaction's log.  Because we have
  * already reserved a slot for it, we can simply write at the next slot.
+ * @xh: the transaction.
+ * @pje: if non-NULL, the log entry to queue for group commit.
+ * Returns: the commit sequence number to wait for, if queued.
  */
-__static void
-pjournal_next_slot(struct psc_journal_xidhndl *xh)
+__static uint64_t
+pjournal_next_slot(struct psc_journal_xidhndl *xh,
+    struct psc_journal_enthdr *pje)
 {
 	uint32_t slot, tail_slot;
 	struct psc_journal_xidhndl *t;
 	struct psc_journal *pj;
+	uint64_t seq = 0;
 
 	tail_slot = PJX_SLOT_ANY;
 	pj = xh->pjx_pj;
@@ -267,11 +330,23 @@ pjournal_next_slot(struct psc_journal_xidhndl *xh)
 	xh->pjx_slot = slot;
 	pll_addtail(&pj->pj_pendingxids, xh);
 
+	/*
+	 * Queue the entry while still holding the lock so the commit
+	 * thread always sees slots filled in the order assigned.
+	 */
+	if (pje) {
+		psc_assert(pj->pj_cmtring[slot] == NULL);
+		pj->pj_cmtring[slot] = pje;
+		seq = ++pj->pj_cmtqueued;
+		psc_waitq_wakeone(&pj->pj_cmtwaitq);
+	}
+
 	psclog_info("writing a log entry xid=%#"PRIx64
 	    ": slot=%d, next=%d, tail=%d",
 	    xh->pjx_xid, xh->pjx_slot, pj->pj_nextwrite, tail_slot);
 
 	PJ_ULOCK(pj);
+	return (seq);
 }
 
 /*
@@ -466,6 +541,23 @@ pjournal_put_buf(struct psc_journal *pj, void *buf)
 	PJ_ULOCK(pj);
 }
 
+/*
+ * Calculate the CRC checksum of a log entry, excluding the checksum
+ * field itself.
+ */
+__static void
+pjournal_chksum(struct psc_journal_enthdr *pje)
+{
+	uint64_t chksum;
+
+	psc_crc64_init(&chksum);
+	psc_crc64_add(&chksum, pje, offsetof(struct psc_journal_enthdr,
+	    pje_chksum));
+	psc_crc64_add(&chksum, pje->pje_data, pje->pje_len);
+	psc_crc64_fini(&chksum);
+	pje->pje_chksum = chksum;
+}
+
 /*
  * Write a new log entry for a transaction.
  * @pj: the journal.
@@ -477,20 +569,8 @@ __static int
 pjournal_logwrite_internal(struct psc_journal *pj,
     struct psc_journal_enthdr *pje, uint32_t slot)
 {
-	uint64_t chksum;
 	int rc, ntries;
 
-	/*
-	 * Calculate the CRC checksum, excluding the checksum field
-	 * itself.
-	 */
-	psc_crc64_init(&chksum);
-	psc_crc64_add(&chksum, pje, offsetof(struct psc_journal_enthdr,
-	    pje_chksum));
-	psc_crc64_add(&chksum, pje->pje_data, pje->pje_len);
-	psc_crc64_fini(&chksum);
-	pje->pje_chksum = chksum;
-
 	/* commit the log entry on disk before we can return */
 	ntries = PJ_MAX_TRY;
 	while (ntries > 0) {
@@ -520,6 +600,92 @@ pjournal_logwrite_internal(struct psc_journal *pj,
 	return (0);
 }
 
+/*
+ * Write out a run of contiguous slots queued for group commit.
+ * @pj: the journal.
+ * @iov: queued log entries.
+ * @n: number of entries.
+ * @slot: slot of the first entry.
+ */
+__static void
+pjournal_commit(struct psc_journal *pj, const struct iovec *iov,
+    int n, uint32_t slot)
+{
+	int rc, ntries;
+
+	ntries = PJ_MAX_TRY;
+	while (ntries > 0) {
+		psclog_vdebug("io_start slot=%u n=%d", slot, n);
+		rc = psc_journal_writev(pj, iov, n,
+		    PJ_GETENTOFF(pj, slot));
+		psclog_vdebug("io_done slot=%u n=%d (rc=%d)", slot, n,
+		    rc);
+		if (rc == EAGAIN) {
+			ntries--;
+			usleep(100);
+			continue;
+		}
+		break;
+	}
+	if (rc)
+		psc_fatalx("failed writing %d journal log entries at "
+		    "slot %d, tries=%d: %s", n, slot, ntries,
+		    strerror(rc));
+
+	pfl_opstat_incr(pj->pj_opst_gcommits);
+	pfl_opstat_add(pj->pj_opst_gcommit_ents, n);
+	pfl_opstat_hist_add(pj->pj_opsth_gcommit, n);
+}
+
+/*
+ * Journal group commit thread: gather the longest run of queued
+ * entries starting at the next slot to commit, stopping at wraparound,
+ * and make them durable with one write and one flush.  Writers that
+ * queue while this is in progress are picked up by the next run.
+ */
+__static void
+pjournal_commit_thr_main(struct psc_thread *thr)
+{
+	struct iovec iov[PJ_MAX_COMMIT];
+	struct psc_journal_enthdr *pje;
+	struct psc_journalthr *pjt;
+	struct psc_journal *pj;
+	uint32_t slot;
+	int i, n;
+
+	pjt = thr->pscthr_private;
+	pj = pjt->pjt_pj;
+	while (pscthr_run(thr)) {
+		PJ_LOCK(pj);
+		slot = pj->pj_cmtnext;
+		for (n = 0; n < PJ_MAX_COMMIT &&
+		    slot + n < pj->pj_total; n++) {
+			pje = pj->pj_cmtring[slot + n];
+			if (pje == NULL)
+				break;
+			iov[n].iov_base = pje;
+			iov[n].iov_len = PJ_PJESZ(pj);
+		}
+		if (n == 0) {
+			psc_waitq_wait(&pj->pj_cmtwaitq, &pj->pj_lock);
+			continue;
+		}
+		PJ_ULOCK(pj);
+
+		pjournal_commit(pj, iov, n, slot);
+
+		PJ_LOCK(pj);
+		for (i = 0; i < n; i++)
+			pj->pj_cmtring[slot + i] = NULL;
+		pj->pj_cmtnext = slot + n;
+		if (pj->pj_cmtnext == pj->pj_total)
+			pj->pj_cmtnext = 0;
+		pj->pj_cmtdone += n;
+		psc_waitq_wakeall(&pj->pj_cmtdonewaitq);
+		PJ_ULOCK(pj);
+	}
+}
+
 /*
  * Store a new entry in a journal transaction.
  * @xh: the transaction to receive the log entry.
@@ -533,6 +699,7 @@ pjournal_logwrite(struct psc_journal_xidhndl *xh, int type,
 {
 	static psc_spinlock_t writelock = SPINLOCK_INIT;
 	struct psc_journal *pj;
+	uint64_t seq;
 
 	pj = xh->pjx_pj;
 
@@ -548,11 +715,30 @@ pjournal_logwrite(struct psc_journal_xidhndl *xh, int type,
 	pje->pje_xid = xh->pjx_xid;
 	pje->pje_txg = xh->pjx_txg;
 
-	/* paranoid: make sure that an earlier slot is written first. */
-	spinlock(&writelock);
-	pjournal_next_slot(xh);
-	pjournal_logwrite_internal(pj, pje, xh->pjx_slot);
-	freelock(&writelock);
+	pjournal_chksum(pje);
+
+	if (pj->pj_cmtring) {
+		/*
+		 * Hand the entry to the commit thread and wait until
+		 * the run containing it is on disk.  Slots are queued
+		 * and committed in order, so a sequence number is
+		 * enough to tell when ours is done.
+		 */
+		seq = pjournal_next_slot(xh, pje);
+		PJ_LOCK(pj);
+		while (pj->pj_cmtdone < seq) {
+			psc_waitq_wait(&pj->pj_cmtdonewaitq,
+			    &pj->pj_lock);
+			PJ_LOCK(pj);
+		}
+		PJ_ULOCK(pj);
+	} else {
+		/* paranoid: make sure that an earlier slot is written first. */
+		spinlock(&writelock);
+		pjournal_next_slot(xh, NULL);
+		pjournal_logwrite_internal(pj, pje, xh->pjx_slot);
+		freelock(&writelock);
+	}
 
 	/*
 	 * If this log entry needs further processing, hand it
@@ -774,6 +960,12 @@ pjournal_open(const char *name, const char *fn)
 	    basefn);
 	pj->pj_opst_distills = pfl_opstat_init("jrnl.%s.distills",
 	    basefn);
+	pj->pj_opst_gcommits = pfl_opstat_init("jrnl.%s.group-commits",
+	    basefn);
+	pj->pj_opst_gcommit_ents = pfl_opstat_init(
+	    "jrnl.%s.group-commit-ents", basefn);
+	pj->pj_opsth_gcommit = pfl_opstat_hist_initf(OPSTF_BASE10,
+	    "jrnl.%s.ents-per-commit", basefn);
 
 	/*
 	 * O_DIRECT may impose alignment restrictions so align the
@@ -837,6 +1029,8 @@ pjournal_open(const char *name, const char *fn)
 	    pjx_dstl_lentry, NULL);
 
 	psc_waitq_init(&pj->pj_waitq, "journal");
+	psc_waitq_init(&pj->pj_cmtwaitq, "journal-commit");
+	psc_waitq_init(&pj->pj_cmtdonewaitq, "journal-commit-done");
 	psc_dynarray_init(&pj->pj_bufs);
 
 	pll_add(&pfl_journals, pj);
@@ -868,6 +1062,8 @@ pjournal_release(struct psc_journal *pj)
 	DYNARRAY_FOREACH(pje, n, &pj->pj_bufs)
 		psc_free(pje, PAF_LOCK | PAF_PAGEALIGN, PJ_PJESZ(pj));
 	psc_dynarray_free(&pj->pj_bufs);
+	if (pj->pj_cmtring)
+		PSCFREE(pj->pj_cmtring);
 	psc_free(pj->pj_hdr, PAF_LOCK | PAF_PAGEALIGN,
 	    pj->pj_hdr->pjh_iolen);
 	PSCFREE(pj);
@@ -1084,6 +1280,17 @@ pjournal_replay(struct psc_journal *pj, int thrtype,
 
 	pj->pj_distill_handler = distill_handler;
 
+	/* from now on, log writes go through the group commit thread */
+	pj->pj_cmtnext = 0;
+	pj->pj_cmtring = PSCALLOC(pj->pj_total *
+	    sizeof(*pj->pj_cmtring));
+
+	thr = pscthr_init(thrtype, pjournal_commit_thr_main,
+	    sizeof(*pjt), "%scmt", thrname);
+	pjt = thr->pscthr_private;
+	pjt->pjt_pj = pj;
+	pscthr_setready(thr);
+
 	thr = pscthr_init(thrtype, pjournal_thr_main, sizeof(*pjt), thrname);
 	pjt = thr->pscthr_private;
 	pjt->pjt_pj = pj;
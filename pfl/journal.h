@@ -38,6 +38,7 @@ struct psc_ctlop;
 
 #define	PJ_MAX_TRY			3		/* number of retry before giving up */
 #define	PJ_MAX_BUF			16384		/* number of journal buffers to keep around */
+#define	PJ_MAX_COMMIT			256		/* max log entries written by one group commit */
 
 #define PJH_MAGIC			UINT64_C(0x45678912aabbccff)
 #define PJH_VERSION			0x02
@@ -147,10 +148,24 @@ struct psc_journal {
 	psc_distill_handler_t		 pj_distill_handler;
 	int				 pj_fd;			/* file descriptor to backing disk file */
 
+	/*
+	 * Group commit: log entries are queued by slot and written out
+	 * in contiguous runs by the commit thread, one flush per run.
+	 */
+	struct psc_journal_enthdr	**pj_cmtring;		/* queued entries, indexed by slot */
+	uint32_t			 pj_cmtnext;		/* next slot to be committed */
+	uint64_t			 pj_cmtqueued;		/* #entries ever queued */
+	uint64_t			 pj_cmtdone;		/* #entries ever made durable */
+	struct psc_waitq		 pj_cmtwaitq;		/* commit thread waits for entries */
+	struct psc_waitq		 pj_cmtdonewaitq;	/* writers wait for their commit */
+
 	struct pfl_iostats_rw		 pj_iostats;		/* read/write I/O stats */
 	struct pfl_opstat		*pj_opst_reserves;
 	struct pfl_opstat		*pj_opst_commits;
 	struct pfl_opstat		*pj_opst_distills;
+	struct pfl_opstat		*pj_opst_gcommits;	/* group commits issued */
+	struct pfl_opstat		*pj_opst_gcommit_ents;	/* entries written by group commits */
+	struct pfl_opstat_hist		*pj_opsth_gcommit;	/* entries per group commit */
 };
 
 #define PJF_NONE			0
@@ -0,0 +1,268 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2006-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Spinlock slow path and contention profiling.
+ *
+ * A thread that fails to grab a spinlock first polls the lock word
+ * without writing to it, so the cache line stays shared while the
+ * holder finishes.  If that does not pay off, the waiter marks the
+ * lock PSL_CONTENDED and sleeps on it with futex(2); freelock() only
+ * makes the wake syscall when it sees that marking.
+ *
+ * With profiling enabled (PSC_LOCKPROF or the "sys.lockprof" control
+ * parameter), each lock site that has to wait accumulates the number
+ * of waits and the total time spent waiting.  Sites are kept in a
+ * fixed table so the accounting never allocates or takes another lock;
+ * the opstats timer thread publishes them as
+ * "lock.<file>:<line>.waits" and "lock.<file>:<line>.wait-usecs".
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_FUTEX
+#  include <sys/syscall.h>
+
+#  include <linux/futex.h>
+#endif
+
+#include "pfl/atomic.h"
+#include "pfl/cdefs.h"
+#include "pfl/lock.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/time.h"
+
+#define PFL_LOCKPROF_NSITES	1024		/* must be a power of two */
+
+#define PLSS_FREE		0
+#define PLSS_BUSY		1		/* being claimed */
+#define PLSS_READY		2
+
+struct pfl_locksite {
+	psc_atomic32_t		 pls_state;
+	int			 pls_lineno;
+	const char		*pls_file;
+	psc_atomic64_t		 pls_waits;
+	psc_atomic64_t		 pls_usecs;
+	struct pfl_opstat	*pls_opst_waits;
+	struct pfl_opstat	*pls_opst_usecs;
+};
+
+int			 pfl_lockprof;
+__static psc_atomic32_t	 pfl_lockprof_nsites;
+__static struct pfl_locksite
+			 pfl_locksites[PFL_LOCKPROF_NSITES];
+
+static __inline void
+_psc_spin_pause(void)
+{
+#if defined(__amd64) || defined(__i386)
+	__asm__ __volatile__("pause" : : : "memory");
+#else
+	__asm__ __volatile__("" : : : "memory");
+#endif
+}
+
+/*
+ * Find or claim the profiling slot for a lock site.  Returns NULL if
+ * the table is full.
+ */
+__static struct pfl_locksite *
+_pfl_lockprof_getsite(const char *fn, int lineno)
+{
+	struct pfl_locksite *pls;
+	uintptr_t h;
+	int i, st;
+
+	h = ((uintptr_t)fn >> 3) * 31 + lineno;
+	for (i = 0; i < PFL_LOCKPROF_NSITES; i++, h++) {
+		pls = &pfl_locksites[h & (PFL_LOCKPROF_NSITES - 1)];
+		st = psc_atomic32_read(&pls->pls_state);
+		if (st == PLSS_FREE) {
+			st = psc_atomic32_cmpxchg(&pls->pls_state,
+			    PLSS_FREE, PLSS_BUSY);
+			if (st == PLSS_FREE) {
+				pls->pls_file = fn;
+				pls->pls_lineno = lineno;
+				psc_atomic32_xchg(&pls->pls_state,
+				    PLSS_READY);
+				psc_atomic32_inc(&pfl_lockprof_nsites);
+				return (pls);
+			}
+		}
+		/* another thread is filling in this slot */
+		while (st == PLSS_BUSY) {
+			_psc_spin_pause();
+			st = psc_atomic32_read(&pls->pls_state);
+		}
+		if (pls->pls_file == fn && pls->pls_lineno == lineno)
+			return (pls);
+	}
+	return (NULL);
+}
+
+__static void
+_pfl_lockprof_record(const char *fn, int lineno,
+    const struct timespec *start)
+{
+	struct pfl_locksite *pls;
+	struct timespec now;
+
+	pls = _pfl_lockprof_getsite(fn, lineno);
+	if (pls == NULL)
+		return;
+
+	PFL_GETTIMESPEC_MONO(&now);
+	timespecsub(&now, start, &now);
+	psc_atomic64_inc(&pls->pls_waits);
+	psc_atomic64_add(&pls->pls_usecs,
+	    now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+/*
+ * Acquire a spinlock after the inline fast path in spinlock() failed.
+ * The caller does the owner bookkeeping once this returns.
+ * @psl: the spinlock.
+ * @fn: file name of the lock site, for profiling.
+ * @lineno: line number of the lock site, for profiling.
+ */
+void
+_psc_spin_wait(struct psc_spinlock *psl, const char *fn, int lineno)
+{
+	psc_atomic32_t *v = _SPIN_GETATOM(psl);
+	struct timespec start;
+	int i, prof, error;
+#ifndef HAVE_FUTEX
+	struct timespec ts;
+#endif
+
+	/* callers may be holding on to errno, e.g. to log it */
+	error = errno;
+	prof = pfl_lockprof;
+	if (prof)
+		PFL_GETTIMESPEC_MONO(&start);
+
+	/* brief poll in case the holder is about to release */
+	for (i = 0; i < PSL_SPIN_NTRIES; i++) {
+		_psc_spin_pause();
+		if (psc_atomic32_read(v) == PSL_UNLOCKED &&
+		    psc_atomic32_cmpxchg(v, PSL_UNLOCKED,
+		    PSL_LOCKED) == PSL_UNLOCKED)
+			goto out;
+	}
+
+#ifdef HAVE_FUTEX
+	/*
+	 * Once we have marked the lock contended we must keep it that
+	 * way when we finally get it, since there may be other sleepers
+	 * we cannot see.
+	 */
+	while (PSC_ATOMIC32_XCHG(v, PSL_CONTENDED) != PSL_UNLOCKED)
+		if (syscall(SYS_futex, &v->value32, FUTEX_WAIT_PRIVATE,
+		    PSL_CONTENDED, NULL, NULL, 0) == -1 &&
+		    errno != EAGAIN && errno != EINTR)
+			psc_fatal("futex wait on lock %p", psl);
+#else
+	for (i = 0;; i++) {
+		if (psc_atomic32_read(v) == PSL_UNLOCKED &&
+		    psc_atomic32_cmpxchg(v, PSL_UNLOCKED,
+		    PSL_LOCKED) == PSL_UNLOCKED)
+			break;
+		if (i >= PSL_SLEEP_NTRIES) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = PSL_SLEEP_NSEC;
+			nanosleep(&ts, NULL);
+			i = 0;
+		} else
+			pscthr_yield();
+	}
+#endif
+
+ out:
+	if (prof)
+		_pfl_lockprof_record(fn, lineno, &start);
+	errno = error;
+}
+
+/*
+ * Wake one thread sleeping in _psc_spin_wait().  Called by freelock()
+ * after releasing a lock that was marked contended.
+ * @psl: the spinlock.
+ */
+void
+_psc_spin_wake(struct psc_spinlock *psl)
+{
+#ifdef HAVE_FUTEX
+	int error = errno;
+
+	if (syscall(SYS_futex, &_SPIN_GETATOM(psl)->value32,
+	    FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0) == -1)
+		psc_fatal("futex wake on lock %p", psl);
+	errno = error;
+#else
+	(void)psl;
+#endif
+}
+
+/*
+ * Publish lock site contention counters as opstats.  Called once a
+ * second from the opstats timer thread, outside of pfl_opstats_lock.
+ */
+void
+pfl_lockprof_update(void)
+{
+	struct pfl_locksite *pls;
+	const char *fn;
+	int i;
+
+	if (psc_atomic32_read(&pfl_lockprof_nsites) == 0)
+		return;
+
+	for (i = 0, pls = pfl_locksites; i < PFL_LOCKPROF_NSITES;
+	    i++, pls++) {
+		if (psc_atomic32_read(&pls->pls_state) != PLSS_READY)
+			continue;
+		if (pls->pls_opst_waits == NULL) {
+			fn = strrchr(pls->pls_file, '/');
+			fn = fn ? fn + 1 : pls->pls_file;
+			pls->pls_opst_waits = pfl_opstat_initf(
+			    OPSTF_BASE10, "lock.%s:%d.waits", fn,
+			    pls->pls_lineno);
+			pls->pls_opst_usecs = pfl_opstat_initf(
+			    OPSTF_BASE10, "lock.%s:%d.wait-usecs", fn,
+			    pls->pls_lineno);
+		}
+		psc_atomic64_set(&pls->pls_opst_waits->opst_lifetime,
+		    psc_atomic64_read(&pls->pls_waits));
+		psc_atomic64_set(&pls->pls_opst_usecs->opst_lifetime,
+		    psc_atomic64_read(&pls->pls_usecs));
+	}
+}
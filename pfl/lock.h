@@ -23,8 +23,9 @@
  */
 
 /*
- * Spinlock routines: busy wait until another thread is done with a
- * critical section.
+ * Spinlock routines: wait until another thread is done with a critical
+ * section.  Waiters briefly poll the lock word and then, where futexes
+ * are available, park in the kernel until the holder releases it.
  *
  * Note: these routines depend on 32-bit atomic operations and may
  * supply higher precision (64-bit) atomic operations on some
@@ -57,7 +58,8 @@
 
 enum psc_spinlock_val {
 	PSL_UNLOCKED = 2,
-	PSL_LOCKED = 3
+	PSL_LOCKED = 3,
+	PSL_CONTENDED = 4	/* locked and there may be sleepers */
 };
 
 typedef struct psc_spinlock {
@@ -74,6 +76,7 @@ typedef struct psc_spinlock {
 #define PSLF_NOLOG		(1 << 0)	/* don't psclog locks/unlocks */
 #define PSLF_LOGTMP		(1 << 1)	/* psclog to tmp subsystem */
 
+#define PSL_SPIN_NTRIES		100	/* polls before sleeping */
 #define PSL_SLEEP_NTRIES	32
 #define PSL_SLEEP_NSEC		5001
 
@@ -113,7 +116,8 @@ typedef struct psc_spinlock {
 	do {								\
 		enum psc_spinlock_val _val = _SPIN_GETVAL(psl);		\
 									\
-		if (_val != PSL_LOCKED && _val != PSL_UNLOCKED)		\
+		if (_val != PSL_LOCKED && _val != PSL_UNLOCKED &&	\
+		    _val != PSL_CONTENDED)				\
 			psc_fatalx("%s: lock %p has invalid value %#x",	\
 			    (name), (psl), _val);			\
 	} while (0)
@@ -131,14 +135,29 @@ typedef struct psc_spinlock {
 			    (psl), (psl)->psl_owner, pthread_self());	\
 	} while (0)
 
+#define _SPIN_SETOWNER(pci, psl)					\
+	do {								\
+		psc_assert((psl)->psl_owner == 0);			\
+		(psl)->psl_owner = pthread_self();			\
+		(psl)->psl_owner_file = __FILE__;			\
+		(psl)->psl_owner_lineno = __LINE__;			\
+		if (((psl)->psl_flags & PSLF_NOLOG) == 0)		\
+			_psclog_pci((pci), PLL_VDEBUG, 0,		\
+			    "lock %p acquired",	(psl));			\
+	} while (0)
+
+/*
+ * Note: this must not blindly exchange in PSL_LOCKED as that would
+ * lose a PSL_CONTENDED marking and leave sleepers parked forever.
+ */
 #define _SPIN_TEST_AND_SET(pci, name, psl)				\
 	{								\
 		enum psc_spinlock_val _val;				\
 		int _lrc;						\
 									\
-		_val = PSC_ATOMIC32_XCHG(_SPIN_GETATOM(psl),		\
-		    PSL_LOCKED);					\
-		if ((_val) == PSL_LOCKED) {				\
+		_val = psc_atomic32_cmpxchg(_SPIN_GETATOM(psl),		\
+		    PSL_UNLOCKED, PSL_LOCKED);				\
+		if ((_val) == PSL_LOCKED || (_val) == PSL_CONTENDED) {	\
 			if ((psl)->psl_owner == pthread_self())		\
 				_psclog_pci((pci), PLL_FATAL, 0,	\
 				    "%s %p: already locked", (name),	\
@@ -146,13 +165,7 @@ typedef struct psc_spinlock {
 			/* PFL_GETTIMEVAL(&(psl)->psl_time); */		\
 			_lrc = 0;					\
 		} else if ((_val) == PSL_UNLOCKED) {			\
-			psc_assert((psl)->psl_owner == 0);		\
-			(psl)->psl_owner = pthread_self();		\
-			(psl)->psl_owner_file = __FILE__;		\
-			(psl)->psl_owner_lineno = __LINE__;		\
-			if (((psl)->psl_flags & PSLF_NOLOG) == 0)	\
-				_psclog_pci((pci), PLL_VDEBUG, 0,	\
-				    "lock %p acquired",	(psl));		\
+			_SPIN_SETOWNER((pci), (psl));			\
 			_lrc = 1;					\
 		} else							\
 			_psclog_pci((pci), PLL_FATAL, 0,		\
@@ -174,18 +187,10 @@ typedef struct psc_spinlock {
  */
 #define spinlock_pci(pci, psl)						\
 	do {								\
-		struct timespec _tm;					\
-		int _i;							\
-									\
-		for (_i = 0;						\
-		    !(_SPIN_TEST_AND_SET((pci), "spinlock", (psl)));	\
-		    pscthr_yield(), _i++)				\
-			if (_i >= PSL_SLEEP_NTRIES) {			\
-				_tm.tv_sec  = 0;			\
-				_tm.tv_nsec = PSL_SLEEP_NSEC;		\
-				nanosleep(&_tm, 0);			\
-				_i = 0;					\
-			}						\
+		if (!(_SPIN_TEST_AND_SET((pci), "spinlock", (psl)))) {	\
+			_psc_spin_wait((psl), __FILE__, __LINE__);	\
+			_SPIN_SETOWNER((pci), (psl));			\
+		}							\
 	} while (0)
 
 /*
@@ -203,7 +208,9 @@ typedef struct psc_spinlock {
 		(psl)->psl_owner_lineno = __LINE__;			\
 		if (((psl)->psl_flags & PSLF_NOLOG) == 0)		\
 			_dolog = 1;					\
-		psc_atomic32_set(_SPIN_GETATOM(psl), PSL_UNLOCKED);	\
+		if (PSC_ATOMIC32_XCHG(_SPIN_GETATOM(psl),		\
+		    PSL_UNLOCKED) == PSL_CONTENDED)			\
+			_psc_spin_wake(psl);				\
 		if (_dolog)						\
 			_psclog_pci((pci), PLL_VDEBUG, 0,		\
 			    "lock %p released", (psl));			\
@@ -262,6 +269,12 @@ typedef struct psc_spinlock {
 static __inline void _psc_spin_checktime_impl(struct psc_spinlock *);
 #endif
 
+void	_psc_spin_wait(struct psc_spinlock *, const char *, int);
+void	_psc_spin_wake(struct psc_spinlock *);
+void	 pfl_lockprof_update(void);
+
+extern int pfl_lockprof;
+
 #ifndef _PFL_ATOMIC_H_
 #  include "pfl/atomic.h"
 #endif
@@ -312,7 +325,7 @@ psc_spin_haslock(psc_spinlock_t *psl)
 	 * This code is thread safe because even if psl_owner changes,
 	 * it won't be set to us.
 	 */
-	return (_SPIN_GETVAL(psl) == PSL_LOCKED &&
+	return (_SPIN_GETVAL(psl) != PSL_UNLOCKED &&
 	    psl->psl_owner == pthread_self());
 }
 
@@ -59,6 +59,7 @@
 #include "pfl/fs.h"
 #include "pfl/hashtbl.h"
 #include "pfl/log.h"
+#include "pfl/logasync.h"
 #include "pfl/pfl.h"
 #include "pfl/str.h"
 #include "pfl/thread.h"
@@ -254,6 +255,8 @@ psc_log_init(void)
 	if (!isatty(fileno(stderr)))
 		pflog_ttyfp = fopen(_PATH_TTY, "w");
 
+	pflog_async_init();
+
 	if (gethostname(psc_hostname, sizeof(psc_hostname)) == -1)
 		err(1, "gethostname");
 	strlcpy(psc_hostshort, psc_hostname, sizeof(psc_hostshort));
@@ -415,65 +418,58 @@ pflog_get_stacktrace()
 #endif
 }
 
-void
-_psclogv(const struct pfl_callerinfo *pci, int level, int options,
-    const char *fmt, va_list ap)
+/*
+ * Format the log message prefix according to psc_logfmt.
+ * Returns the length of the prefix.
+ */
+size_t
+pflog_fmtprefix(char *buf, size_t siz, const struct pflog_ctx *ctx)
 {
-	char bufp[LINE_MAX];
-	char *p, buf[BUFSIZ];
 	extern const char *__progname;
-	struct psc_thread *thr;
-	struct timeval tv;
-	const char *thrname;
-	int rc, save_errno;
-	pid_t thrid;
-	size_t len;
-
-	save_errno = errno;
-
-	thr = pscthr_get();
-	/*
-	 * XXX Set log level 5 crashes right away.
-	 */
-	if (!thr)
-		return;
-	thrid = thr->pscthr_thrid;
-	thrname = thr->pscthr_name;
+	char bufp[LINE_MAX];
 
-	gettimeofday(&tv, NULL);
-	(void)FMTSTR(buf, sizeof(buf), psc_logfmt,
-		FMTSTRCASE('A', "s", pflog_get_peer_addr(thr))
-		FMTSTRCASE('B', "s", pfl_basename(pci->pci_filename))
-		FMTSTRCASE('D', "s", pfl_fmtlogdate(&tv, &_t, bufp))
-		FMTSTRCASE('F', "s", pci->pci_func)
-		FMTSTRCASE('f', "s", pci->pci_filename)
+	(void)FMTSTR(buf, siz, psc_logfmt,
+		FMTSTRCASE('A', "s", ctx->plc_peer)
+		FMTSTRCASE('B', "s", pfl_basename(ctx->plc_file))
+		FMTSTRCASE('D', "s", pfl_fmtlogdate(ctx->plc_tv, &_t, bufp))
+		FMTSTRCASE('F', "s", ctx->plc_func)
+		FMTSTRCASE('f', "s", ctx->plc_file)
 		FMTSTRCASE('H', "s", psc_hostname)
 		FMTSTRCASE('h', "s", psc_hostshort)
-		FMTSTRCASE('I', PSCPRI_PTHRT, pthread_self())
-		FMTSTRCASE('i', "d", thrid)
-		FMTSTRCASE('L', "d", level)
-		FMTSTRCASE('l', "d", pci->pci_lineno)
+		FMTSTRCASE('I', PSCPRI_PTHRT, (pthread_t)ctx->plc_pthread)
+		FMTSTRCASE('i', "d", ctx->plc_thrid)
+		FMTSTRCASE('L', "d", ctx->plc_level)
+		FMTSTRCASE('l', "d", ctx->plc_lineno)
 		FMTSTRCASE('N', "s", __progname)
-		FMTSTRCASE('n', "s", thrname)
-		FMTSTRCASE('P', "d", pflog_get_fsctx_pid(thr))
-		FMTSTRCASE('S', "s", pflog_get_stacktrace())
-		FMTSTRCASE('s', "lu", tv.tv_sec)
-		FMTSTRCASE('T', "s", pfl_subsys_name(pci->pci_subsys))
-		FMTSTRCASE('t', "d", pci->pci_subsys)
-		FMTSTRCASE('U', "d", pflog_get_fsctx_uid(thr))
-		FMTSTRCASE('u', "lu", tv.tv_usec)
+		FMTSTRCASE('n', "s", ctx->plc_thrname)
+		FMTSTRCASE('P', "d", ctx->plc_fsctx_pid)
+		FMTSTRCASE('S', "s", ctx->plc_stack ?
+		    pflog_get_stacktrace() : "")
+		FMTSTRCASE('s', "lu", ctx->plc_tv->tv_sec)
+		FMTSTRCASE('T', "s", ctx->plc_subsys)
+		FMTSTRCASE('t', "d", ctx->plc_subsysid)
+		FMTSTRCASE('U', "d", ctx->plc_fsctx_uid)
+		FMTSTRCASE('u', "lu", ctx->plc_tv->tv_usec)
 	);
+	return (strlen(buf));
+}
 
-	len = strlen(buf);
-	rc = vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
-	if (rc != -1)
-		len = strlen(buf);
-	/* trim newline if present, since we add our own */
-	if (len && buf[len - 1] == '\n')
-		buf[--len] = '\0';
-	if (options & PLO_ERRNO)
-		snprintf(buf + len, sizeof(buf) - len,
-		    ": %s", pfl_strerror(save_errno));
+/*
+ * Write a formatted log message to the log file and any other
+ * configured destinations.
+ * @buf: message.
+ * @len: length of message.
+ * @level: log level.
+ * @subsys: subsystem ID.
+ * @flush: whether to flush stderr; the async drainer flushes once per
+ *	batch instead.
+ */
+void
+pflog_emit(char *buf, __unusedx size_t len, int level, int subsys,
+    int flush)
+{
+	char *p;
+	int rc;
 
 	PSCLOG_LOCK();
 	psc_should_rotate_log();
@@ -482,13 +478,14 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 	rc = fprintf(stderr, "%s%s", buf, psclog_eol);
 	if (rc < 0)
 		pfl_abort();
-		
-	
-	rc = fflush(stderr);
-	if (rc)
-		pfl_abort();
 
-	if (pfl_syslog && pfl_syslog[pci->pci_subsys] &&
+	if (flush) {
+		rc = fflush(stderr);
+		if (rc)
+			pfl_abort();
+	}
+
+	if (pfl_syslog && pfl_syslog[subsys] &&
 	    level >= 0 && level < (int)nitems(pfl_syslog_map))
 		syslog(pfl_syslog_map[level], "%s", buf);
 
@@ -508,6 +505,82 @@ _psclogv(const struct pfl_callerinfo *pci, int level, int options,
 	}
 
 	PSCLOG_UNLOCK();
+}
+
+void
+_psclogv(const struct pfl_callerinfo *pci, int level, int options,
+    const char *fmt, va_list ap)
+{
+	struct pflog_ctx ctx;
+	struct psc_thread *thr;
+	struct timeval tv;
+	int rc, save_errno;
+	char buf[BUFSIZ];
+	size_t len;
+
+	save_errno = errno;
+
+	thr = pscthr_get();
+	/*
+	 * XXX Set log level 5 crashes right away.
+	 *
+	 * The async log drainer is not a pscthr but must still be able
+	 * to report its own failures.
+	 */
+	if (!thr && !pflog_async_draining())
+		return;
+
+	if (pflog_async) {
+		/*
+		 * Fatal messages are written synchronously but only
+		 * after everything queued before them.
+		 */
+		if (level == PLL_FATAL)
+			pflog_async_flush();
+		else if (pflog_async_enqueue(thr, pci, level, options,
+		    fmt, ap, save_errno) == 0) {
+			errno = save_errno;
+			return;
+		}
+	}
+
+	gettimeofday(&tv, NULL);
+
+	ctx.plc_file = pci->pci_filename;
+	ctx.plc_func = pci->pci_func;
+	ctx.plc_lineno = pci->pci_lineno;
+	ctx.plc_level = level;
+	ctx.plc_subsys = pfl_subsys_name(pci->pci_subsys);
+	ctx.plc_subsysid = pci->pci_subsys;
+	ctx.plc_tv = &tv;
+	ctx.plc_pthread = (uint64_t)pthread_self();
+	if (thr) {
+		ctx.plc_thrname = thr->pscthr_name;
+		ctx.plc_thrid = thr->pscthr_thrid;
+		ctx.plc_fsctx_pid = pflog_get_fsctx_pid(thr);
+		ctx.plc_fsctx_uid = pflog_get_fsctx_uid(thr);
+		ctx.plc_peer = pflog_get_peer_addr(thr);
+	} else {
+		ctx.plc_thrname = "pflogdrainthr";
+		ctx.plc_thrid = pfl_getsysthrid();
+		ctx.plc_fsctx_pid = -1;
+		ctx.plc_fsctx_uid = -1;
+		ctx.plc_peer = "";
+	}
+	ctx.plc_stack = 1;
+	len = pflog_fmtprefix(buf, sizeof(buf), &ctx);
+
+	rc = vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+	if (rc != -1)
+		len = strlen(buf);
+	/* trim newline if present, since we add our own */
+	if (len && buf[len - 1] == '\n')
+		buf[--len] = '\0';
+	if (options & PLO_ERRNO)
+		snprintf(buf + len, sizeof(buf) - len,
+		    ": %s", pfl_strerror(save_errno));
+
+	pflog_emit(buf, len, level, pci->pci_subsys, 1);
 
 	/*
 	 * Restore in case app needs it after our printf()'s may have
@@ -0,0 +1,876 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2007-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Asynchronous binary logging: capture of printf(3)-style arguments
+ * into per-thread rings, and the background thread that drains them.
+ * See pfl/logasync.h for an overview.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/dynarray.h"
+#include "pfl/err.h"
+#include "pfl/list.h"
+#include "pfl/lock.h"
+#include "pfl/log.h"
+#include "pfl/logasync.h"
+#include "pfl/pfl.h"
+#include "pfl/str.h"
+#include "pfl/subsys.h"
+#include "pfl/thread.h"
+
+#define PFLOG_DRAIN_USEC	10000			/* idle drainer poll interval */
+
+int				 pflog_async = PFLOG_ASYNC_OFF;
+
+__static FILE			*pflog_async_fp;	/* binary sink */
+__static int			 pflog_want_peer;
+__static int			 pflog_want_stack;
+__static const char		*pflog_checked_fmt;
+
+__static psc_spinlock_t		 pflog_rings_lock = SPINLOCK_INIT_NOLOG;
+__static struct psclist_head	 pflog_rings = PSCLIST_HEAD_INIT(pflog_rings);
+
+__static pthread_mutex_t	 pflog_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+__static pthread_cond_t		 pflog_drain_cond = PTHREAD_COND_INITIALIZER;
+__static pthread_once_t		 pflog_drain_once = PTHREAD_ONCE_INIT;
+__static __threadx int		 pflog_drain_held;	/* we hold pflog_drain_lock */
+__static struct psc_dynarray	 pflog_drain_rings = DYNARRAY_INIT_NOLOG;
+__static uint64_t		 pflog_ndrop;		/* messages dropped on overflow */
+__static uint64_t		 pflog_ndrop_reported;
+
+enum {
+	PLEN_NONE,
+	PLEN_HH,
+	PLEN_H,
+	PLEN_L,
+	PLEN_LL,
+	PLEN_J,
+	PLEN_Z,
+	PLEN_T,
+	PLEN_LD
+};
+
+/*
+ * One parsed printf(3) conversion specification.
+ */
+struct pflog_spec {
+	const char	*ps_body;		/* flags, width, precision */
+	int		 ps_bodylen;
+	int		 ps_nstar;		/* '*' width/precision args */
+	int		 ps_prec;		/* literal precision or -1 */
+	int		 ps_precstar;		/* precision comes from an arg */
+	int		 ps_len;		/* PLEN_* */
+	char		 ps_conv;
+};
+
+/*
+ * Parse a conversion specification.
+ * @p: pointer just past the '%'.
+ * @sp: value-result specification.
+ * Returns a pointer past the conversion character or NULL if the
+ * specification cannot be captured (positional or wide arguments).
+ */
+__static const char *
+pflog_parsespec(const char *p, struct pflog_spec *sp)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->ps_prec = -1;
+	sp->ps_body = p;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		sp->ps_nstar++;
+		p++;
+	} else
+		while (*p >= '0' && *p <= '9')
+			p++;
+	if (*p == '$')
+		return (NULL);
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			sp->ps_nstar++;
+			sp->ps_precstar = 1;
+			p++;
+		} else {
+			sp->ps_prec = 0;
+			while (*p >= '0' && *p <= '9')
+				sp->ps_prec = sp->ps_prec * 10 + *p++ - '0';
+		}
+	}
+	sp->ps_bodylen = p - sp->ps_body;
+
+	switch (*p) {
+	case 'h':
+		if (*++p == 'h') {
+			sp->ps_len = PLEN_HH;
+			p++;
+		} else
+			sp->ps_len = PLEN_H;
+		break;
+	case 'l':
+		if (*++p == 'l') {
+			sp->ps_len = PLEN_LL;
+			p++;
+		} else
+			sp->ps_len = PLEN_L;
+		break;
+	case 'q':
+		sp->ps_len = PLEN_LL;
+		p++;
+		break;
+	case 'j':
+		sp->ps_len = PLEN_J;
+		p++;
+		break;
+	case 'z':
+		sp->ps_len = PLEN_Z;
+		p++;
+		break;
+	case 't':
+		sp->ps_len = PLEN_T;
+		p++;
+		break;
+	case 'L':
+		sp->ps_len = PLEN_LD;
+		p++;
+		break;
+	}
+
+	sp->ps_conv = *p;
+	switch (sp->ps_conv) {
+	case 'c':
+	case 's':
+		if (sp->ps_len != PLEN_NONE)
+			return (NULL);
+		break;
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		if (sp->ps_len == PLEN_LD)
+			return (NULL);
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+	case 'p': case 'n': case 'm': case '%':
+		break;
+	default:
+		return (NULL);
+	}
+	return (p + 1);
+}
+
+/*
+ * Copy the arguments of a log message into a record without
+ * formatting them.
+ * @r: record, whose plr_data already holds the format string.
+ * @fmt: format string.
+ * @ap: arguments.
+ * Returns zero on success or -1 if the message cannot be captured.
+ */
+__static int
+pflog_rec_capture(struct pflog_rec *r, const char *fmt, va_list ap)
+{
+	union pflog_arg *a;
+	struct pflog_spec sp;
+	const char *p, *s;
+	size_t len;
+	int i, prec;
+
+	for (p = fmt; (p = strchr(p, '%')) != NULL; ) {
+		p = pflog_parsespec(p + 1, &sp);
+		if (p == NULL)
+			return (-1);
+		if (r->plr_nargs + sp.ps_nstar + 1 > PFLOG_MAXARGS)
+			return (-1);
+
+		prec = sp.ps_prec;
+		for (i = 0; i < sp.ps_nstar; i++) {
+			a = &r->plr_args[r->plr_nargs++];
+			a->pla_i = va_arg(ap, int);
+			if (sp.ps_precstar && i == sp.ps_nstar - 1)
+				prec = a->pla_i;
+		}
+
+		a = &r->plr_args[r->plr_nargs];
+		switch (sp.ps_conv) {
+		case 'd':
+		case 'i':
+			switch (sp.ps_len) {
+			case PLEN_HH:
+				a->pla_i = (signed char)va_arg(ap, int);
+				break;
+			case PLEN_H:
+				a->pla_i = (short)va_arg(ap, int);
+				break;
+			case PLEN_L:
+				a->pla_i = va_arg(ap, long);
+				break;
+			case PLEN_LL:
+				a->pla_i = va_arg(ap, long long);
+				break;
+			case PLEN_J:
+				a->pla_i = va_arg(ap, intmax_t);
+				break;
+			case PLEN_Z:
+				a->pla_i = va_arg(ap, ssize_t);
+				break;
+			case PLEN_T:
+				a->pla_i = va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				a->pla_i = va_arg(ap, int);
+				break;
+			}
+			r->plr_nargs++;
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (sp.ps_len) {
+			case PLEN_HH:
+				a->pla_u = (unsigned char)va_arg(ap, int);
+				break;
+			case PLEN_H:
+				a->pla_u = (unsigned short)va_arg(ap, int);
+				break;
+			case PLEN_L:
+				a->pla_u = va_arg(ap, unsigned long);
+				break;
+			case PLEN_LL:
+				a->pla_u = va_arg(ap, unsigned long long);
+				break;
+			case PLEN_J:
+				a->pla_u = va_arg(ap, uintmax_t);
+				break;
+			case PLEN_Z:
+				a->pla_u = va_arg(ap, size_t);
+				break;
+			case PLEN_T:
+				a->pla_u = (size_t)va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				a->pla_u = va_arg(ap, unsigned);
+				break;
+			}
+			r->plr_nargs++;
+			break;
+		case 'c':
+			a->pla_i = va_arg(ap, int);
+			r->plr_nargs++;
+			break;
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			if (sp.ps_len == PLEN_LD)
+				a->pla_d = va_arg(ap, long double);
+			else
+				a->pla_d = va_arg(ap, double);
+			r->plr_nargs++;
+			break;
+		case 'p':
+			a->pla_p = (uintptr_t)va_arg(ap, void *);
+			r->plr_nargs++;
+			break;
+		case 's':
+			s = va_arg(ap, const char *);
+			if (s == NULL)
+				s = "(null)";
+			len = prec >= 0 ? strnlen(s, prec) : strlen(s);
+			if (r->plr_datalen >= PFLOG_DATA_MAX)
+				return (-1);
+			if (len > PFLOG_DATA_MAX - r->plr_datalen - 1)
+				len = PFLOG_DATA_MAX - r->plr_datalen - 1;
+			a->pla_off = r->plr_datalen;
+			memcpy(r->plr_data + r->plr_datalen, s, len);
+			r->plr_data[r->plr_datalen + len] = '\0';
+			r->plr_datalen += len + 1;
+			r->plr_nargs++;
+			break;
+		case 'n':
+			(void)va_arg(ap, void *);
+			break;
+		}
+	}
+	return (0);
+}
+
+#define PFLOG_SNPRINTF(buf, siz, spec, star, nstar, v)			\
+	((nstar) == 0 ? snprintf((buf), (siz), (spec), (v)) :		\
+	 (nstar) == 1 ? snprintf((buf), (siz), (spec), (star)[0], (v)) :	\
+	 snprintf((buf), (siz), (spec), (star)[0], (star)[1], (v)))
+
+/*
+ * Format the message body of a captured record, as vsnprintf(3)
+ * would have at the time it was logged.
+ * @r: record.
+ * @buf: output buffer.
+ * @siz: size of @buf.
+ * Returns the length of the output.
+ */
+int
+pflog_rec_render(const struct pflog_rec *r, char *buf, size_t siz)
+{
+	char spec[32], *out = buf, *end = buf + siz;
+	const union pflog_arg *a = r->plr_args;
+	struct pflog_spec sp;
+	const char *p, *q;
+	int i, n, star[2];
+
+	if (siz == 0)
+		return (0);
+	*out = '\0';
+
+	if (r->plr_options & PFLOG_PREFMT)
+		strlcpy(buf, r->plr_data, siz);
+	else
+		for (p = r->plr_data; *p && out < end - 1; p = q) {
+			if (*p != '%') {
+				q = strchr(p, '%');
+				if (q == NULL)
+					q = p + strlen(p);
+				n = MIN(q - p, end - out - 1);
+				memcpy(out, p, n);
+				out += n;
+				*out = '\0';
+				continue;
+			}
+			q = pflog_parsespec(p + 1, &sp);
+			if (q == NULL || sp.ps_bodylen + 4 >
+			    (int)sizeof(spec))
+				break;
+			for (i = 0; i < sp.ps_nstar; i++)
+				star[i] = a++->pla_i;
+
+			n = 0;
+			spec[0] = '%';
+			memcpy(spec + 1, sp.ps_body, sp.ps_bodylen);
+			i = sp.ps_bodylen + 1;
+			switch (sp.ps_conv) {
+			case 'd': case 'i':
+				spec[i++] = 'l';
+				spec[i++] = 'l';
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar, (long long)a++->pla_i);
+				break;
+			case 'o': case 'u': case 'x': case 'X':
+				spec[i++] = 'l';
+				spec[i++] = 'l';
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar,
+				    (unsigned long long)a++->pla_u);
+				break;
+			case 'c':
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar, (int)a++->pla_i);
+				break;
+			case 'e': case 'E': case 'f': case 'F':
+			case 'g': case 'G': case 'a': case 'A':
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar, a++->pla_d);
+				break;
+			case 'p':
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar,
+				    (void *)(uintptr_t)a++->pla_p);
+				break;
+			case 's':
+				spec[i++] = sp.ps_conv;
+				spec[i] = '\0';
+				n = PFLOG_SNPRINTF(out, end - out, spec,
+				    star, sp.ps_nstar,
+				    r->plr_data + a++->pla_off);
+				break;
+			case 'm':
+				n = snprintf(out, end - out, "%s",
+				    pfl_strerror(r->plr_errno));
+				break;
+			case '%':
+				n = snprintf(out, end - out, "%%");
+				break;
+			}
+			if (n < 0)
+				break;
+			out += MIN(n, end - out - 1);
+		}
+	n = strlen(buf);
+
+	/* trim newline if present, since we add our own */
+	if (n && buf[n - 1] == '\n')
+		buf[--n] = '\0';
+	if (r->plr_options & PLO_ERRNO)
+		snprintf(buf + n, siz - n, ": %s",
+		    pfl_strerror(r->plr_errno));
+	return (strlen(buf));
+}
+
+/*
+ * Determine which parts of the log prefix need per-message state that
+ * must be captured up front.  %S (stack trace) can only be produced
+ * by the logging thread itself so it forces synchronous logging.
+ */
+__static void
+pflog_async_checkfmt(void)
+{
+	const char *p;
+
+	if (pflog_checked_fmt == psc_logfmt)
+		return;
+	pflog_want_peer = pflog_want_stack = 0;
+	for (p = psc_logfmt; (p = strchr(p, '%')) != NULL; ) {
+		for (p++; *p && strchr("-+ #0123456789.", *p); p++)
+			;
+		if (*p == 'A')
+			pflog_want_peer = 1;
+		else if (*p == 'S')
+			pflog_want_stack = 1;
+		if (*p)
+			p++;
+	}
+	pflog_checked_fmt = psc_logfmt;
+}
+
+__static void
+pflog_drain_write_bin(const struct pflog_ring *g, struct pflog_rec *r)
+{
+	struct pflog_rec hdr;
+	const char *strs[4];
+	size_t len[4];
+	int i;
+
+	strs[0] = pfl_basename(r->plr_file);
+	strs[1] = r->plr_func;
+	strs[2] = g->plr_thrname;
+	strs[3] = pfl_subsys_name(r->plr_subsys);
+
+	hdr = *r;
+	hdr.plr_file = NULL;
+	hdr.plr_func = NULL;
+	hdr.plr_reclen = sizeof(hdr) + hdr.plr_datalen;
+	for (i = 0; i < 4; i++) {
+		if (strs[i] == NULL)
+			strs[i] = "";
+		len[i] = strlen(strs[i]) + 1;
+		hdr.plr_reclen += len[i];
+	}
+
+	fwrite(&hdr, sizeof(hdr), 1, pflog_async_fp);
+	for (i = 0; i < 4; i++)
+		fwrite(strs[i], len[i], 1, pflog_async_fp);
+	fwrite(r->plr_data, r->plr_datalen, 1, pflog_async_fp);
+}
+
+__static void
+pflog_drain_write_text(const struct pflog_ring *g,
+    const struct pflog_rec *r)
+{
+	struct pflog_ctx ctx;
+	struct timeval tv;
+	char buf[BUFSIZ];
+	size_t len;
+
+	tv.tv_sec = r->plr_sec;
+	tv.tv_usec = r->plr_usec;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.plc_file = r->plr_file;
+	ctx.plc_func = r->plr_func;
+	ctx.plc_lineno = r->plr_lineno;
+	ctx.plc_level = r->plr_level;
+	ctx.plc_subsys = pfl_subsys_name(r->plr_subsys);
+	ctx.plc_subsysid = r->plr_subsys;
+	ctx.plc_tv = &tv;
+	ctx.plc_thrname = g->plr_thrname;
+	ctx.plc_thrid = g->plr_thrid;
+	ctx.plc_pthread = r->plr_pthread;
+	ctx.plc_fsctx_pid = r->plr_fsctx_pid;
+	ctx.plc_fsctx_uid = r->plr_fsctx_uid;
+	ctx.plc_peer = r->plr_peeroff ? r->plr_data + r->plr_peeroff : "";
+
+	len = pflog_fmtprefix(buf, sizeof(buf), &ctx);
+	len += pflog_rec_render(r, buf + len, sizeof(buf) - len);
+	pflog_emit(buf, len, r->plr_level, r->plr_subsys, 0);
+}
+
+/*
+ * Drain all thread rings, writing out records in timestamp order.
+ * Must be called with pflog_drain_lock held.
+ * Returns the number of records written.
+ */
+__static int
+pflog_drain(void)
+{
+	struct pflog_ring *g, *best, *tmp;
+	struct pflog_rec *r, *rbest;
+	char buf[LINE_MAX];
+	uint64_t ndrop;
+	int i, n = 0;
+
+	psc_dynarray_reset(&pflog_drain_rings);
+	spinlock(&pflog_rings_lock);
+	psclist_for_each_entry_safe(g, tmp, &pflog_rings, plr_lentry) {
+		if (__atomic_load_n(&g->plr_dead, __ATOMIC_ACQUIRE) &&
+		    g->plr_tail == __atomic_load_n(&g->plr_head,
+		    __ATOMIC_ACQUIRE)) {
+			psclist_del(&g->plr_lentry, &pflog_rings);
+			free(g->plr_recs);
+			free(g);
+			continue;
+		}
+		psc_dynarray_add(&pflog_drain_rings, g);
+	}
+	freelock(&pflog_rings_lock);
+
+	DYNARRAY_FOREACH(g, i, &pflog_drain_rings)
+		g->plr_snaphead = __atomic_load_n(&g->plr_head,
+		    __ATOMIC_ACQUIRE);
+
+	for (;;) {
+		best = NULL;
+		rbest = NULL;
+		DYNARRAY_FOREACH(g, i, &pflog_drain_rings) {
+			if (g->plr_tail == g->plr_snaphead)
+				continue;
+			r = PFLOG_RING_REC(g, g->plr_tail);
+			if (rbest == NULL ||
+			    r->plr_sec < rbest->plr_sec ||
+			    (r->plr_sec == rbest->plr_sec &&
+			     r->plr_usec < rbest->plr_usec)) {
+				best = g;
+				rbest = r;
+			}
+		}
+		if (best == NULL)
+			break;
+
+		if (pflog_async_fp)
+			pflog_drain_write_bin(best, rbest);
+		else
+			pflog_drain_write_text(best, rbest);
+		__atomic_store_n(&best->plr_tail, best->plr_tail + 1,
+		    __ATOMIC_RELEASE);
+		n++;
+	}
+
+	ndrop = __atomic_load_n(&pflog_ndrop, __ATOMIC_RELAXED);
+	if (ndrop > pflog_ndrop_reported) {
+		i = snprintf(buf, sizeof(buf), "[pflog] %"PRIu64" log "
+		    "messages dropped on overflow",
+		    ndrop - pflog_ndrop_reported);
+		pflog_emit(buf, i, PLL_WARN, PSS_DEF, 0);
+		pflog_ndrop_reported = ndrop;
+		n++;
+	}
+
+	if (n) {
+		if (pflog_async_fp)
+			fflush(pflog_async_fp);
+		PSCLOG_LOCK();
+		fflush(stderr);
+		PSCLOG_UNLOCK();
+	}
+	return (n);
+}
+
+__static void *
+pflog_drain_main(__unusedx void *arg)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&pflog_drain_lock);
+	pflog_drain_held = 1;
+	for (;;) {
+		if (pflog_drain())
+			continue;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += PFLOG_DRAIN_USEC * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pflog_drain_held = 0;
+		pthread_cond_timedwait(&pflog_drain_cond,
+		    &pflog_drain_lock, &ts);
+		pflog_drain_held = 1;
+	}
+	return (NULL);
+}
+
+__static void
+pflog_drain_start(void)
+{
+	pthread_t pthr;
+	int rc;
+
+	rc = pthread_create(&pthr, NULL, pflog_drain_main, NULL);
+	if (rc) {
+		warnx("pflog: unable to start drain thread: %s",
+		    strerror(rc));
+		pflog_async = PFLOG_ASYNC_OFF;
+		return;
+	}
+	pthread_detach(pthr);
+}
+
+__static struct pflog_ring *
+pflog_ring_new(struct psc_thread *thr)
+{
+	struct pflog_ring *g;
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL)
+		return (NULL);
+	g->plr_recs = malloc(PFLOG_RING_NRECS * PFLOG_REC_SZ);
+	if (g->plr_recs == NULL) {
+		free(g);
+		return (NULL);
+	}
+	INIT_PSC_LISTENTRY(&g->plr_lentry);
+	g->plr_thrid = thr->pscthr_thrid;
+	strlcpy(g->plr_thrname, thr->pscthr_name,
+	    sizeof(g->plr_thrname));
+
+	spinlock(&pflog_rings_lock);
+	psclist_add_tail(&g->plr_lentry, &pflog_rings);
+	freelock(&pflog_rings_lock);
+
+	thr->pscthr_logring = g;
+	return (g);
+}
+
+/*
+ * Capture a log message into the calling thread's ring.
+ * Returns zero if the message was queued or dropped per the overflow
+ * policy, or -1 if it must be logged synchronously instead.
+ */
+int
+pflog_async_enqueue(struct psc_thread *thr,
+    const struct pfl_callerinfo *pci, int level, int options,
+    const char *fmt, va_list ap, int errnum)
+{
+	struct pflog_ring *g;
+	struct pflog_rec *r;
+	struct timeval tv;
+	uint64_t h, t;
+	const char *peer;
+	size_t len;
+	va_list apc;
+	int rc;
+
+	/* the drainer would wait on itself for room in its ring */
+	if (pflog_drain_held)
+		return (-1);
+
+	pflog_async_checkfmt();
+	if (pflog_want_stack)
+		return (-1);
+
+	pthread_once(&pflog_drain_once, pflog_drain_start);
+	if (pflog_async == PFLOG_ASYNC_OFF)
+		return (-1);
+
+	g = thr->pscthr_logring;
+	if (g == NULL && (g = pflog_ring_new(thr)) == NULL)
+		return (-1);
+
+	h = g->plr_head;
+	t = __atomic_load_n(&g->plr_tail, __ATOMIC_ACQUIRE);
+	if (h - t >= PFLOG_RING_NRECS) {
+		if (pflog_async == PFLOG_ASYNC_DROP) {
+			__atomic_add_fetch(&pflog_ndrop, 1,
+			    __ATOMIC_RELAXED);
+			return (0);
+		}
+		do {
+			pthread_cond_signal(&pflog_drain_cond);
+			usleep(100);
+			t = __atomic_load_n(&g->plr_tail,
+			    __ATOMIC_ACQUIRE);
+		} while (h - t >= PFLOG_RING_NRECS);
+	}
+
+	gettimeofday(&tv, NULL);
+
+	r = PFLOG_RING_REC(g, h);
+	r->plr_magic = PFLOG_REC_MAGIC;
+	r->plr_reclen = PFLOG_REC_SZ;
+	r->plr_sec = tv.tv_sec;
+	r->plr_usec = tv.tv_usec;
+	r->plr_file = pci->pci_filename;
+	r->plr_func = pci->pci_func;
+	r->plr_lineno = pci->pci_lineno;
+	r->plr_subsys = pci->pci_subsys;
+	r->plr_level = level;
+	r->plr_options = options;
+	r->plr_errno = errnum;
+	r->plr_thrid = g->plr_thrid;
+	r->plr_fsctx_pid = pflog_get_fsctx_pid(thr);
+	r->plr_fsctx_uid = pflog_get_fsctx_uid(thr);
+	r->plr_pthread = (uint64_t)pthread_self();
+	r->plr_nargs = 0;
+	r->plr_peeroff = 0;
+
+	len = strlen(fmt) + 1;
+	rc = -1;
+	if (len < PFLOG_DATA_MAX) {
+		memcpy(r->plr_data, fmt, len);
+		r->plr_fmtlen = len;
+		r->plr_datalen = len;
+		va_copy(apc, ap);
+		rc = pflog_rec_capture(r, fmt, apc);
+		va_end(apc);
+	}
+	if (rc) {
+		/*
+		 * Not representable (e.g. positional arguments): format
+		 * it here so per-thread ordering is still preserved.
+		 */
+		r->plr_options |= PFLOG_PREFMT;
+		r->plr_nargs = 0;
+		r->plr_fmtlen = 0;
+		vsnprintf(r->plr_data, PFLOG_DATA_MAX, fmt, ap);
+		r->plr_datalen = strlen(r->plr_data) + 1;
+	}
+
+	if (pflog_want_peer) {
+		peer = pflog_get_peer_addr(thr);
+		len = strlen(peer) + 1;
+		if (len <= PFLOG_DATA_MAX - r->plr_datalen) {
+			r->plr_peeroff = r->plr_datalen;
+			memcpy(r->plr_data + r->plr_datalen, peer, len);
+			r->plr_datalen += len;
+		}
+	}
+
+	__atomic_store_n(&g->plr_head, h + 1, __ATOMIC_RELEASE);
+
+	/* nudge the drainer before the ring gets close to full */
+	if (h + 1 - t == PFLOG_RING_NRECS / 2)
+		pthread_cond_signal(&pflog_drain_cond);
+	return (0);
+}
+
+/*
+ * Determine whether the calling thread is in the middle of draining,
+ * i.e. is the drainer or a thread flushing.
+ */
+int
+pflog_async_draining(void)
+{
+	return (pflog_drain_held);
+}
+
+/*
+ * Synchronously write out everything queued so far.  Used before a
+ * fatal message and at exit.  A no-op when called while draining, e.g.
+ * for a fatal error raised by the drain itself: the lock is already
+ * ours and the rings are mid-walk, so what is left stays queued.
+ */
+void
+pflog_async_flush(void)
+{
+	if (pflog_async == PFLOG_ASYNC_OFF || pflog_drain_held)
+		return;
+	pthread_mutex_lock(&pflog_drain_lock);
+	pflog_drain_held = 1;
+	pflog_drain();
+	pflog_drain_held = 0;
+	pthread_mutex_unlock(&pflog_drain_lock);
+}
+
+/*
+ * Called when a thread exits; its ring is released by the drainer
+ * once it has been emptied.
+ */
+void
+pflog_async_thrdone(struct psc_thread *thr)
+{
+	struct pflog_ring *g = thr->pscthr_logring;
+
+	if (g == NULL)
+		return;
+	thr->pscthr_logring = NULL;
+	__atomic_store_n(&g->plr_dead, 1, __ATOMIC_RELEASE);
+}
+
+void
+pflog_async_init(void)
+{
+	struct pflog_filehdr fh;
+	char *p;
+
+	p = getenv("PSC_LOG_ASYNC");
+	if (p == NULL || strcmp(p, "0") == 0)
+		return;
+	if (strcmp(p, "block") == 0)
+		pflog_async = PFLOG_ASYNC_BLOCK;
+	else if (strcmp(p, "drop") == 0 || strcmp(p, "1") == 0)
+		pflog_async = PFLOG_ASYNC_DROP;
+	else
+		errx(1, "invalid PSC_LOG_ASYNC: %s", p);
+
+	p = getenv("PSC_LOG_ASYNC_FILE");
+	if (p) {
+		pflog_async_fp = fopen(p, "w");
+		if (pflog_async_fp == NULL)
+			err(1, "%s", p);
+		memset(&fh, 0, sizeof(fh));
+		memcpy(fh.plfh_magic, PFLOG_FILE_MAGIC,
+		    sizeof(fh.plfh_magic));
+		fh.plfh_version = PFLOG_FILE_VERSION;
+		fh.plfh_recsz = sizeof(struct pflog_rec);
+		if (fwrite(&fh, sizeof(fh), 1, pflog_async_fp) != 1)
+			err(1, "%s", p);
+	}
+
+	/*
+	 * This runs from psc_log_init() before any subsystem is
+	 * registered, so avoid pfl_atexit(), whose allocation and
+	 * locking would log.  Fatal paths flush explicitly.
+	 */
+	atexit(pflog_async_flush);
+}
@@ -0,0 +1,173 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2007-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Asynchronous binary logging.
+ *
+ * When enabled (PSC_LOG_ASYNC), non-fatal log messages are not
+ * formatted by the calling thread.  Instead, the caller information,
+ * timestamp, level, format string and raw arguments are copied into a
+ * fixed-size record in a single-producer/single-consumer ring owned by
+ * the calling thread.  A background thread drains all rings in
+ * timestamp order and either formats the records exactly as
+ * _psclogv() would or, if PSC_LOG_ASYNC_FILE is set, appends them in
+ * binary form to that file for later decoding with pflogdec(1).
+ *
+ * Fatal messages drain all rings and are then written synchronously so
+ * nothing logged before the failure is lost.  Anything the drainer
+ * itself logs is written synchronously, since it cannot wait for
+ * itself.
+ */
+
+#ifndef _PFL_LOGASYNC_H_
+#define _PFL_LOGASYNC_H_
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "pfl/list.h"
+#include "pfl/pfl.h"
+#include "pfl/thread.h"
+
+#define PFLOG_REC_SZ		512			/* bytes per ring record */
+#define PFLOG_RING_NRECS	512			/* records per thread ring */
+#define PFLOG_MAXARGS		16			/* max arguments captured */
+
+#define PFLOG_PREFMT		(1 << 6)		/* plr_data is the formatted message */
+
+/* overflow policies */
+#define PFLOG_ASYNC_OFF		0
+#define PFLOG_ASYNC_DROP	1			/* discard and count */
+#define PFLOG_ASYNC_BLOCK	2			/* wait for the drainer */
+
+union pflog_arg {
+	int64_t			 pla_i;
+	uint64_t		 pla_u;
+	double			 pla_d;
+	uint64_t		 pla_p;			/* %p, as integer */
+	uint32_t		 pla_off;		/* %s, offset into plr_data */
+};
+
+/*
+ * A captured log message.  plr_data holds the format string followed
+ * by copies of any string arguments.  The record is laid out the same
+ * in a ring slot and in the binary log file so the decoder can share
+ * the rendering code.
+ */
+struct pflog_rec {
+	uint32_t		 plr_magic;
+	uint16_t		 plr_reclen;		/* on-disk: total record length */
+	uint16_t		 plr_datalen;		/* bytes used in plr_data */
+	int64_t			 plr_sec;
+	int32_t			 plr_usec;
+	int32_t			 plr_lineno;
+	int16_t			 plr_subsys;
+	int8_t			 plr_level;
+	int8_t			 plr_options;
+	int32_t			 plr_errno;
+	int32_t			 plr_thrid;
+	int32_t			 plr_fsctx_pid;
+	int32_t			 plr_fsctx_uid;
+	uint64_t		 plr_pthread;
+	uint16_t		 plr_nargs;
+	uint16_t		 plr_fmtlen;		/* incl. NUL */
+	uint16_t		 plr_peeroff;		/* peer address, 0 if none */
+	uint16_t		 _plr_pad;
+	const char		*plr_file;		/* in-memory only */
+	const char		*plr_func;		/* in-memory only */
+	union pflog_arg		 plr_args[PFLOG_MAXARGS];
+	char			 plr_data[0];
+};
+
+#define PFLOG_REC_MAGIC		UINT32_C(0x504c4f47)	/* "PLOG" */
+#define PFLOG_DATA_MAX		(PFLOG_REC_SZ - sizeof(struct pflog_rec))
+
+#define PFLOG_FILE_MAGIC	"PFLOGBIN"
+#define PFLOG_FILE_VERSION	1
+
+/*
+ * Binary log file layout: a struct pflog_filehdr, then for each
+ * message a struct pflog_rec (with the in-memory-only pointers
+ * zeroed) followed by NUL-terminated file, function, thread and
+ * subsystem names and finally plr_datalen bytes of plr_data.
+ * plr_reclen covers all of it.
+ */
+struct pflog_filehdr {
+	char			 plfh_magic[8];
+	uint32_t		 plfh_version;
+	uint32_t		 plfh_recsz;		/* sizeof(struct pflog_rec) */
+};
+
+/* per-thread ring */
+struct pflog_ring {
+	struct psclist_head	 plr_lentry;
+	uint64_t		 plr_head;		/* written by owner */
+	uint64_t		 plr_tail;		/* written by drainer */
+	uint64_t		 plr_snaphead;		/* drainer private */
+	int			 plr_dead;		/* owner has exited */
+	pid_t			 plr_thrid;
+	char			 plr_thrname[PSC_THRNAME_MAX];
+	char			*plr_recs;
+};
+
+#define PFLOG_RING_REC(r, i)						\
+	((struct pflog_rec *)((r)->plr_recs +				\
+	    ((i) % PFLOG_RING_NRECS) * PFLOG_REC_SZ))
+
+struct pflog_ctx {
+	const char		*plc_file;
+	const char		*plc_func;
+	int			 plc_lineno;
+	int			 plc_level;
+	const char		*plc_subsys;
+	int			 plc_subsysid;
+	const struct timeval	*plc_tv;
+	const char		*plc_thrname;
+	pid_t			 plc_thrid;
+	uint64_t		 plc_pthread;
+	pid_t			 plc_fsctx_pid;
+	uid_t			 plc_fsctx_uid;
+	const char		*plc_peer;
+	int			 plc_stack;		/* %S allowed */
+};
+
+int	 pflog_async_enqueue(struct psc_thread *,
+	    const struct pfl_callerinfo *, int, int, const char *,
+	    va_list, int);
+int	 pflog_async_draining(void);
+void	 pflog_async_flush(void);
+void	 pflog_async_init(void);
+void	 pflog_async_thrdone(struct psc_thread *);
+
+int	 pflog_rec_render(const struct pflog_rec *, char *, size_t);
+
+size_t	 pflog_fmtprefix(char *, size_t, const struct pflog_ctx *);
+void	 pflog_emit(char *, size_t, int, int, int);
+
+extern int	 pflog_async;
+
+#endif /* _PFL_LOGASYNC_H_ */
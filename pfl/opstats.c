@@ -36,7 +36,57 @@
 int			pfl_opstats_sum;
 struct psc_spinlock	pfl_opstats_lock = SPINLOCK_INIT;
 struct psc_dynarray	pfl_opstats = DYNARRAY_INIT;
+struct psc_dynarray	pfl_opstat_hists = DYNARRAY_INIT;
 __static char		pfl_opstat_name[128];
+__threadx int		pfl_opstat_myshard;
+__static psc_atomic32_t	pfl_opstat_nextshard = PSC_ATOMIC32_INIT(0);
+
+__static const int	pfl_opstat_hist_pctls[PFL_OPSTAT_HIST_NPCTL] = {
+	500, 990, 999		/* per mille */
+};
+__static const char	*pfl_opstat_hist_pctl_names[PFL_OPSTAT_HIST_NPCTL] = {
+	"p50", "p99", "p999"
+};
+
+/*
+ * Hand out counter slots round-robin as threads first touch a sharded
+ * opstat.  Returns the slot number plus one.
+ */
+int
+_pfl_opstat_shard_assign(void)
+{
+	return ((psc_atomic32_inc_getnew(&pfl_opstat_nextshard) - 1) %
+	    PFL_OPSTAT_NSHARDS + 1);
+}
+
+int64_t
+pfl_opstat_read(const struct pfl_opstat *opst)
+{
+	int64_t val;
+	int i;
+
+	val = psc_atomic64_read(&opst->opst_lifetime);
+	if (opst->opst_shards)
+		for (i = 0; i < PFL_OPSTAT_NSHARDS; i++)
+			val += psc_atomic64_read(
+			    &opst->opst_shards[i].os_val);
+	return (val);
+}
+
+/*
+ * Reset an opstat value.  Updates racing with this on other threads
+ * may or may not be reflected afterwards.
+ */
+void
+pfl_opstat_set(struct pfl_opstat *opst, int64_t val)
+{
+	int i;
+
+	if (opst->opst_shards)
+		for (i = 0; i < PFL_OPSTAT_NSHARDS; i++)
+			psc_atomic64_set(&opst->opst_shards[i].os_val, 0);
+	psc_atomic64_set(&opst->opst_lifetime, val);
+}
 
 int
 _pfl_opstat_cmp(const void *a, const void *b)
@@ -51,9 +101,10 @@ struct pfl_opstat *
 pfl_opstat_initf(int flags, const char *namefmt, ...)
 {
 	struct pfl_opstat *opst;
-	int sz, pos;
+	int sz, pos, shardsz = 0;
 	va_list ap;
 	char *name = pfl_opstat_name;
+	uintptr_t p;
 
 	spinlock(&pfl_opstats_lock);
 
@@ -72,9 +123,23 @@ pfl_opstat_initf(int flags, const char *namefmt, ...)
 		}
 	}
 	pfl_opstats_sum++;
-	opst = PSCALLOC(sizeof(*opst) + sz);
+
+	/*
+	 * Shards live in the same allocation, past the name, rounded
+	 * up to a cache line boundary.
+	 */
+	if (flags & OPSTF_SHARDED)
+		shardsz = PFL_CACHELINE_SIZE +
+		    PFL_OPSTAT_NSHARDS * sizeof(struct pfl_opstat_shard);
+	opst = PSCALLOC(sizeof(*opst) + sz + shardsz);
 	strlcpy(opst->opst_name, name, 128);
 	opst->opst_flags = flags;
+	if (shardsz) {
+		p = (uintptr_t)opst->opst_name + sz;
+		p = (p + PFL_CACHELINE_SIZE - 1) &
+		    ~(uintptr_t)(PFL_CACHELINE_SIZE - 1);
+		opst->opst_shards = (void *)p;
+	}
 	psc_dynarray_splice(&pfl_opstats, pos, 0, &opst, 1);
 	freelock(&pfl_opstats_lock);
 	return (opst);
@@ -104,6 +169,144 @@ pfl_opstat_destroy(struct pfl_opstat *opst)
 	freelock(&pfl_opstats_lock);
 }
 
+/*
+ * Map a sample to its log-linear bucket.  Values below NSUB get a
+ * bucket each; above that, the top SUBBITS bits after the leading one
+ * select the linear sub-bucket within the value's power-of-two range.
+ */
+__static int
+_pfl_opstat_hist_bucket(int64_t val)
+{
+	int e;
+
+	if (val < PFL_OPSTAT_HIST_NSUB)
+		return (val < 0 ? 0 : val);
+	e = 63 - __builtin_clzll((uint64_t)val);
+	return (((e - PFL_OPSTAT_HIST_SUBBITS + 1) <<
+	    PFL_OPSTAT_HIST_SUBBITS) + ((val >> (e -
+	    PFL_OPSTAT_HIST_SUBBITS)) & (PFL_OPSTAT_HIST_NSUB - 1)));
+}
+
+/*
+ * Return the largest value that maps to a bucket.
+ */
+__static int64_t
+_pfl_opstat_hist_bucket_max(int idx)
+{
+	int e, sub;
+
+	if (idx < PFL_OPSTAT_HIST_NSUB)
+		return (idx);
+	e = (idx >> PFL_OPSTAT_HIST_SUBBITS) +
+	    PFL_OPSTAT_HIST_SUBBITS - 1;
+	sub = idx & (PFL_OPSTAT_HIST_NSUB - 1);
+	if (e == 62 && sub == PFL_OPSTAT_HIST_NSUB - 1)
+		return (INT64_MAX);
+	return ((((int64_t)PFL_OPSTAT_HIST_NSUB + sub + 1) <<
+	    (e - PFL_OPSTAT_HIST_SUBBITS)) - 1);
+}
+
+__static struct pfl_opstat_hist *
+_pfl_opstat_hist_lookup(const char *name)
+{
+	struct pfl_opstat_hist *oh;
+	int i;
+
+	LOCK_ENSURE(&pfl_opstats_lock);
+	DYNARRAY_FOREACH(oh, i, &pfl_opstat_hists)
+		if (strcmp(oh->oh_sum->opst_name, name) == 0)
+			return (oh);
+	return (NULL);
+}
+
+/*
+ * Create a histogram, or return the existing one of the same name.
+ */
+struct pfl_opstat_hist *
+pfl_opstat_hist_initf(int flags, const char *namefmt, ...)
+{
+	struct pfl_opstat_hist *oh, *t;
+	char name[128];
+	va_list ap;
+	int i;
+
+	va_start(ap, namefmt);
+	vsnprintf(name, sizeof(name), namefmt, ap);
+	va_end(ap);
+
+	spinlock(&pfl_opstats_lock);
+	oh = _pfl_opstat_hist_lookup(name);
+	freelock(&pfl_opstats_lock);
+	if (oh)
+		return (oh);
+
+	oh = PSCALLOC(sizeof(*oh));
+	oh->oh_sum = pfl_opstat_initf(flags | OPSTF_SHARDED, "%s",
+	    name);
+	for (i = 0; i < PFL_OPSTAT_HIST_NPCTL; i++)
+		oh->oh_pctl[i] = pfl_opstat_initf(flags | OPSTF_GAUGE,
+		    "%s:%s", name, pfl_opstat_hist_pctl_names[i]);
+
+	spinlock(&pfl_opstats_lock);
+	t = _pfl_opstat_hist_lookup(name);
+	if (t == NULL)
+		psc_dynarray_add(&pfl_opstat_hists, oh);
+	freelock(&pfl_opstats_lock);
+	if (t) {
+		/* lost a race; the opstats are shared by name */
+		PSCFREE(oh);
+		oh = t;
+	}
+	return (oh);
+}
+
+void
+pfl_opstat_hist_add(struct pfl_opstat_hist *oh, int64_t val)
+{
+	psc_atomic64_inc(&oh->oh_buckets[_pfl_opstat_hist_bucket(val)]);
+	pfl_opstat_add(oh->oh_sum, val);
+}
+
+/*
+ * Decay the recent view of a histogram, fold in the samples added
+ * since the last call, and recompute the published percentiles from
+ * it.  Called once a second from the timer thread.  If there have been
+ * no samples for a long time, the last percentiles stay published.
+ */
+void
+pfl_opstat_hist_update(struct pfl_opstat_hist *oh)
+{
+	int64_t *counts = oh->oh_recent, cur, total = 0, cum, want;
+	int i, j;
+
+	for (i = 0; i < PFL_OPSTAT_HIST_NBUCKETS; i++) {
+		cur = psc_atomic64_read(&oh->oh_buckets[i]);
+		counts[i] -= counts[i] >> PFL_OPSTAT_HIST_DECAY;
+		if (counts[i] >> PFL_OPSTAT_HIST_DECAY == 0)
+			counts[i] = 0;
+		counts[i] += (cur - oh->oh_last[i]) <<
+		    PFL_OPSTAT_HIST_SCALE;
+		oh->oh_last[i] = cur;
+		total += counts[i];
+	}
+	if (total == 0)
+		return;
+
+	for (j = 0; j < PFL_OPSTAT_HIST_NPCTL; j++) {
+		/* rank of the sample at this percentile, rounded up */
+		want = (total * pfl_opstat_hist_pctls[j] + 999) / 1000;
+		if (want == 0)
+			want = 1;
+		for (i = 0, cum = 0; i < PFL_OPSTAT_HIST_NBUCKETS; i++) {
+			cum += counts[i];
+			if (cum >= want)
+				break;
+		}
+		psc_atomic64_set(&oh->oh_pctl[j]->opst_lifetime,
+		    _pfl_opstat_hist_bucket_max(i));
+	}
+}
+
 __static const char *
 _pfl_opstats_base2_suffix(int64_t *val)
 {
@@ -55,16 +55,33 @@ struct pfl_opstat {
 	double			 opst_avg;	/* running average */
 	double			 opst_max;	/* max running average */
 
+	/*
+	 * OPSTF_SHARDED opstats spread updates across cache-line sized
+	 * slots so hot counters do not bounce a single line between
+	 * CPUs.  The slots are only summed when the value is read; use
+	 * pfl_opstat_read() instead of touching opst_lifetime directly.
+	 */
+	struct pfl_opstat_shard	*opst_shards;
+
 	char			 opst_name[0];
 };
 
+#define PFL_OPSTAT_NSHARDS	16
+#define PFL_CACHELINE_SIZE	64
+
+struct pfl_opstat_shard {
+	psc_atomic64_t		 os_val;
+} __aligned(PFL_CACHELINE_SIZE);
+
 #define OPSTF_BASE10		(1 << 0)	/* use base-10 numbering instead of default of base-2 */
 #define OPSTF_EXCL		(1 << 1)	/* like O_EXCL: when creating, opstat must not exist  */
+#define OPSTF_SHARDED		(1 << 2)	/* per-thread counter slots */
+#define OPSTF_GAUGE		(1 << 3)	/* value is a level, not a count: no rates */
 
-#define pfl_opstat_add(opst, n)	psc_atomic64_add(&(opst)->opst_lifetime, (n))
+#define pfl_opstat_add(opst, n)	_pfl_opstat_add((opst), (n))
 #define	pfl_opstat_incr(opst)	pfl_opstat_add((opst), 1)
 
-#define pfl_opstat_dec(opst, n)	psc_atomic64_sub(&(opst)->opst_lifetime, (n))
+#define pfl_opstat_dec(opst, n)	_pfl_opstat_add((opst), -(n))
 #define	pfl_opstat_decr(opst)	pfl_opstat_dec((opst), 1)
 
 /*
@@ -89,13 +106,63 @@ struct pfl_opstat {
 		pfl_opstat_dec(_opst, (n));				\
 	} while (0)
 
-#define	OPSTAT_INCR(name)	OPSTATF_ADD(OPSTF_BASE10, (name), 1)
-#define	OPSTAT_ADD(name, n)	OPSTATF_ADD(OPSTF_BASE10, (name), (n))
+#define	OPSTAT_INCR(name)	OPSTATF_ADD(OPSTF_BASE10 | OPSTF_SHARDED, (name), 1)
+#define	OPSTAT_ADD(name, n)	OPSTATF_ADD(OPSTF_BASE10 | OPSTF_SHARDED, (name), (n))
+
+#define	OPSTAT_DECR(name)	OPSTATF_SUB(OPSTF_BASE10 | OPSTF_SHARDED, (name), 1)
+#define	OPSTAT_SUB(name, n)	OPSTATF_SUB(OPSTF_BASE10 | OPSTF_SHARDED, (name), (n))
 
-#define	OPSTAT_DECR(name)	OPSTATF_SUB(OPSTF_BASE10, (name), 1)
-#define	OPSTAT_SUB(name, n)	OPSTATF_SUB(OPSTF_BASE10, (name), (n))
+#define	OPSTAT2_ADD(name, n)	OPSTATF_ADD(OPSTF_SHARDED, (name), (n))
 
-#define	OPSTAT2_ADD(name, n)	OPSTATF_ADD(0, (name), (n))
+/*
+ * Log-linear histogram: each power-of-two range of values is split
+ * into 2^PFL_OPSTAT_HIST_SUBBITS equal-width buckets, which bounds the
+ * relative error of any reported percentile to 1/2^SUBBITS while
+ * covering the whole int64 range in a fixed ~4KB table.
+ *
+ * The sum of all samples is kept in an ordinary opstat under the
+ * histogram's name, so existing "total"/rate output is unchanged, and
+ * percentiles are published by the timer thread as gauge opstats named
+ * "<name>:p50", "<name>:p99", and "<name>:p999".
+ *
+ * Percentiles reflect recent behavior: every update, the timer thread
+ * folds the samples added since the last one into an exponentially
+ * decayed copy of the table, which loses 1/2^PFL_OPSTAT_HIST_DECAY of
+ * its weight per second, and ranks samples in that copy.
+ */
+#define PFL_OPSTAT_HIST_SUBBITS	3
+#define PFL_OPSTAT_HIST_NSUB	(1 << PFL_OPSTAT_HIST_SUBBITS)
+#define PFL_OPSTAT_HIST_NBUCKETS						\
+	((63 - PFL_OPSTAT_HIST_SUBBITS + 1) * PFL_OPSTAT_HIST_NSUB)
+
+#define PFL_OPSTAT_HIST_NPCTL	3
+#define PFL_OPSTAT_HIST_DECAY	4	/* ~16 second time constant */
+#define PFL_OPSTAT_HIST_SCALE	8	/* fixed point bits of oh_recent */
+
+struct pfl_opstat_hist {
+	struct pfl_opstat	*oh_sum;
+	struct pfl_opstat	*oh_pctl[PFL_OPSTAT_HIST_NPCTL];
+	psc_atomic64_t		 oh_buckets[PFL_OPSTAT_HIST_NBUCKETS];
+
+	/* timer thread only */
+	int64_t			 oh_last[PFL_OPSTAT_HIST_NBUCKETS];
+	int64_t			 oh_recent[PFL_OPSTAT_HIST_NBUCKETS];
+};
+
+/*
+ * pfl_opstat_hist_initf() returns the existing histogram of the same
+ * name, so threads racing to set _oh all end up with the same one.
+ */
+#define	OPSTATF_HIST(flags, name, n)					\
+	do {								\
+		static struct pfl_opstat_hist *_oh;			\
+									\
+		if (_oh == NULL)					\
+			_oh = pfl_opstat_hist_initf((flags), (name));	\
+		pfl_opstat_hist_add(_oh, (n));				\
+	} while (0)
+
+#define	OPSTAT_HIST(name, n)	OPSTATF_HIST(OPSTF_BASE10, (name), (n))
 
 /* read/write counters */
 struct pfl_iostats_rw {
@@ -123,6 +190,15 @@ void	pfl_opstat_destroy_pos(int);
 struct pfl_opstat *
 	pfl_opstat_initf(int, const char *, ...);
 
+int64_t	pfl_opstat_read(const struct pfl_opstat *);
+void	pfl_opstat_set(struct pfl_opstat *, int64_t);
+int	_pfl_opstat_shard_assign(void);
+
+struct pfl_opstat_hist *
+	pfl_opstat_hist_initf(int, const char *, ...);
+void	pfl_opstat_hist_add(struct pfl_opstat_hist *, int64_t);
+void	pfl_opstat_hist_update(struct pfl_opstat_hist *);
+
 void	pfl_opstats_grad_init(struct pfl_opstats_grad *, int, int64_t *,
 	    int, const char *, ...);
 void	pfl_opstats_grad_destroy(struct pfl_opstats_grad *);
@@ -137,7 +213,26 @@ void	pfl_opstats_grad_destroy(struct pfl_opstats_grad *);
 
 extern int			pfl_opstats_sum;
 extern struct psc_dynarray	pfl_opstats;
+extern struct psc_dynarray	pfl_opstat_hists;
 extern struct psc_spinlock	pfl_opstats_lock;
+extern __threadx int		pfl_opstat_myshard;
+
+static __inline void
+_pfl_opstat_add(struct pfl_opstat *opst, int64_t n)
+{
+	int idx;
+
+	if (opst->opst_shards == NULL) {
+		psc_atomic64_add(&opst->opst_lifetime, n);
+		return;
+	}
+
+	/* slot numbers are stored off by one so zero means unassigned */
+	idx = pfl_opstat_myshard;
+	if (idx == 0)
+		idx = pfl_opstat_myshard = _pfl_opstat_shard_assign();
+	psc_atomic64_add(&opst->opst_shards[idx - 1].os_val, n);
+}
 
 static __inline int
 pfl_opstats_grad_cmp(const void *key, const void *item)
@@ -22,37 +22,239 @@
  * %END_LICENSE%
  */
 
+#include <sys/param.h>
+
+#include <err.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define RDTSC()	__rdtsc()
+#else
+#  define RDTSC()	0
+#endif
+
+#include "pfl/alloc.h"
 #include "pfl/cdefs.h"
 #include "pfl/crc.h"
 #include "pfl/pfl.h"
+#include "pfl/time.h"
 #include "pfl/types.h"
 
+/* buffer sizes to benchmark */
+int sizes[] = {
+	64, 512, 4096, 32768, 1024 * 1024
+};
+
 __dead void
 usage(void)
 {
 	extern const char *__progname;
 
-	fprintf(stderr, "usage: %s\n", __progname);
+	fprintf(stderr, "usage: %s [-b] [-t MiB]\n", __progname);
 	exit(1);
 }
 
+/*
+ * Ensure every kernel agrees with the bytewise reference over a range
+ * of lengths and alignments.
+ */
+void
+check_kernels(const unsigned char *buf)
+{
+	const struct psc_crc64_kernel *k;
+	uint64_t ref, crc;
+	int len, off;
+
+	for (len = 0; len < 1024; len++)
+		for (off = 0; off < 8; off++) {
+			ref = UINT64_C(0x0123456789abcdef);
+			psc_crc64_add_bytewise(&ref, buf + off, len);
+			for (k = psc_crc64_kernels; k->pck_name; k++) {
+				if (!k->pck_avail())
+					continue;
+				crc = UINT64_C(0x0123456789abcdef);
+				k->pck_func(&crc, buf + off, len);
+				if (crc != ref)
+					errx(1, "%s: len=%d off=%d: "
+					    "%"PSCPRIxCRC64" != "
+					    "%"PSCPRIxCRC64, k->pck_name,
+					    len, off, crc, ref);
+			}
+		}
+}
+
+/*
+ * Check the reflected CRC32 against the well-known zlib check value,
+ * its kernels and combine against the slicing reference, and the fused
+ * copy against separate copy and CRC passes.
+ */
+void
+check_copy(const unsigned char *buf, unsigned char *dst)
+{
+	uint64_t c64, r64;
+	uint32_t c32, r32, h32;
+	int len, off;
+
+	c32 = 0xffffffff;
+	psc_crc32r_add(&c32, "123456789", 9);
+	if ((c32 ^ 0xffffffff) != 0xcbf43926)
+		errx(1, "crc32r: %"PSCPRIxCRC32" != 0xcbf43926",
+		    c32 ^ 0xffffffff);
+
+	for (len = 0; len < 3 * PSC_CRC_COPY_CHUNK; len += 7)
+		for (off = 0; off < 8; off++) {
+			r64 = c64 = UINT64_C(0x0123456789abcdef);
+			r32 = c32 = 0x01234567;
+			psc_crc64_add(&r64, buf + off, len);
+			psc_crc32r_add_slice8(&r32, buf + off, len);
+			memset(dst, 0, len);
+			psc_crc_copy(dst, buf + off, len, &c64, &c32);
+			if (memcmp(dst, buf + off, len))
+				errx(1, "copy: len=%d off=%d: data "
+				    "mismatch", len, off);
+			if (c64 != r64 || c32 != r32)
+				errx(1, "copy: len=%d off=%d: crc "
+				    "mismatch", len, off);
+
+			c32 = 0x01234567;
+			psc_crc32r_add(&c32, buf + off, len / 3);
+			h32 = 0;
+			psc_crc32r_add(&h32, buf + off + len / 3,
+			    len - len / 3);
+			c32 = psc_crc32r_combine(c32, h32, len - len / 3);
+			if (c32 != r32)
+				errx(1, "crc32r combine: len=%d off=%d",
+				    len, off);
+		}
+}
+
+/*
+ * Compare psc_crc_copy() against a copy followed by separate CRC64 and
+ * CRC32 passes.  The largest size does not fit in cache, which is
+ * where the single pass pays off.
+ */
+void
+bench_copy(int mib)
+{
+	int csizes[] = { 4096, 32768, 1024 * 1024, 64 * 1024 * 1024 };
+	struct timespec ts0, ts1, d;
+	uint64_t c64, total, tsc0, tsc1;
+	unsigned char *buf, *dst;
+	uint32_t c32;
+	double secs;
+	int fused, i, n;
+
+	buf = PSCALLOC(csizes[nitems(csizes) - 1]);
+	dst = PSCALLOC(csizes[nitems(csizes) - 1]);
+	for (i = 0; i < csizes[nitems(csizes) - 1]; i++)
+		buf[i] = random();
+
+	printf("\n%-10s %8s %12s %10s\n", "copy+crc", "bufsz", "MiB/s",
+	    "B/cycle");
+	for (fused = 0; fused < 2; fused++)
+		for (i = 0; i < nitems(csizes); i++) {
+			total = (uint64_t)mib * 1024 * 1024;
+			n = MAX(total / csizes[i], 1);
+			total = (uint64_t)n * csizes[i];
+			c64 = c32 = 0;
+			PFL_GETTIMESPEC_MONO(&ts0);
+			tsc0 = RDTSC();
+			while (n--)
+				if (fused)
+					psc_crc_copy(dst, buf, csizes[i],
+					    &c64, &c32);
+				else {
+					memcpy(dst, buf, csizes[i]);
+					psc_crc64_add(&c64, dst,
+					    csizes[i]);
+					psc_crc32r_add(&c32, dst,
+					    csizes[i]);
+				}
+			tsc1 = RDTSC();
+			PFL_GETTIMESPEC_MONO(&ts1);
+			timespecsub(&ts1, &ts0, &d);
+			secs = d.tv_sec + d.tv_nsec * 1e-9;
+			printf("%-10s %8d %12.1f %10.3f\n",
+			    fused ? "fused" : "separate", csizes[i],
+			    secs ? total / 1048576. / secs : 0.,
+			    tsc1 > tsc0 ? (double)total / (tsc1 - tsc0) :
+			    0.);
+		}
+	PSCFREE(buf);
+	PSCFREE(dst);
+}
+
+void
+bench_kernels(const unsigned char *buf, int mib)
+{
+	const struct psc_crc64_kernel *k;
+	struct timespec ts0, ts1, d;
+	uint64_t crc, total;
+	double secs;
+	int i, n;
+
+	printf("%-10s %8s %12s\n", "kernel", "bufsz", "MiB/s");
+	for (k = psc_crc64_kernels; k->pck_name; k++) {
+		if (!k->pck_avail())
+			continue;
+		for (i = 0; i < nitems(sizes); i++) {
+			total = (uint64_t)mib * 1024 * 1024;
+			n = total / sizes[i];
+			crc = 0;
+			PFL_GETTIMESPEC_MONO(&ts0);
+			while (n--)
+				k->pck_func(&crc, buf, sizes[i]);
+			PFL_GETTIMESPEC_MONO(&ts1);
+			timespecsub(&ts1, &ts0, &d);
+			secs = d.tv_sec + d.tv_nsec * 1e-9;
+			printf("%-10s %8d %12.1f\n", k->pck_name,
+			    sizes[i], secs ? mib / secs : 0.);
+		}
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
+	int c, i, bench = 0, mib = 256;
+	unsigned char *buf, *dst;
 	uint64_t crc;
 
 	pfl_init();
-	if (getopt(argc, argv, "") != -1)
-		usage();
+	while ((c = getopt(argc, argv, "bt:")) != -1)
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 't':
+			mib = atoi(optarg);
+			if (mib <= 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
 	argc -= optind;
 	if (argc)
 		usage();
 
 	psc_crc64_calc(&crc, "LER*##kdj3m-=z{]]]e3\\=O$I3llf0934", 24);
 	printf("%"PSCPRIxCRC64"\n", crc);
+
+	buf = PSCALLOC(sizes[nitems(sizes) - 1] + 8);
+	for (i = 0; i < sizes[nitems(sizes) - 1] + 8; i++)
+		buf[i] = random();
+	dst = PSCALLOC(sizes[nitems(sizes) - 1] + 8);
+	check_kernels(buf);
+	check_copy(buf, dst);
+	if (bench) {
+		bench_kernels(buf, mib);
+		bench_copy(mib);
+	}
 	exit(0);
 }
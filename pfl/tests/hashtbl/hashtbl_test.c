@@ -22,67 +22,145 @@
  * %END_LICENSE%
  */
 
+#include <sys/time.h>
+
+#include <err.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "pfl/alloc.h"
+#include "pfl/atomic.h"
 #include "pfl/cdefs.h"
 #include "pfl/hashtbl.h"
+#include "pfl/lockedlist.h"
 #include "pfl/pfl.h"
+#include "pfl/random.h"
+
+#define NTHRS_MAX	64
 
 struct item {
 	struct pfl_hashentry	hentry;
 	uint64_t		id;
 };
 
+struct psc_hashtbl	 t;
+struct item		**items;
+int			 nitems = 100000;
+int			 nlookups = 1000000;
+int			 nthr = 4;
+int			 churn;
+psc_atomic32_t		 nrunning = PSC_ATOMIC32_INIT(0);
+
+extern struct psc_lockedlist pfl_hashrdrs;
+
 __dead void
 usage(void)
 {
 	extern const char *__progname;
 
-	fprintf(stderr, "usage: %s\n", __progname);
+	fprintf(stderr,
+	    "usage: %s [-CR] [-i lookups] [-n items] [-t threads]\n",
+	    __progname);
 	exit(1);
 }
 
+struct item *
+item_new(uint64_t id)
+{
+	struct item *i;
+
+	i = PSCALLOC(sizeof(*i));
+	psc_hashent_init(&t, i);
+	i->id = id;
+	return (i);
+}
+
+/*
+ * Look up random items that are always present.  Odd IDs belong to the
+ * churn thread and come and go.
+ */
+void *
+lookup_main(__unusedx void *arg)
+{
+	struct item *i;
+	uint64_t key;
+	int n;
+
+	for (n = 0; n < nlookups; n++) {
+		key = psc_random32u(nitems) * 2;
+		i = psc_hashtbl_search(&t, &key);
+		if (i == NULL || i->id != key)
+			errx(1, "item %"PRIu64" not found", key);
+	}
+	psc_atomic32_dec(&nrunning);
+	return (NULL);
+}
+
+/* Remove and reinsert items while lookups run. */
+void *
+churn_main(__unusedx void *arg)
+{
+	struct item *i;
+	uint64_t key;
+
+	while (psc_atomic32_read(&nrunning)) {
+		key = psc_random32u(nitems) * 2 + 1;
+		i = psc_hashtbl_searchdel(&t, &key);
+		if (i) {
+			psc_hashtbl_sync(&t);
+			psc_hashent_init(&t, i);
+			psc_hashtbl_add_item(&t, i);
+		}
+	}
+	return (NULL);
+}
+
 int
 main(int argc, char *argv[])
 {
-	struct psc_hashtbl t;
-	struct item *i;
+	pthread_t pthr[NTHRS_MAX], cthr;
+	struct timeval tv0, tv1, tvd;
+	int c, flags = 0, n;
+	struct item *i, *iv[4];
 	uint64_t key;
-	int c;
+	double secs;
 
 	pfl_init();
-	if ((c = getopt(argc, argv, "")) != -1)
-		usage();
+	while ((c = getopt(argc, argv, "Ci:n:Rt:")) != -1)
+		switch (c) {
+		case 'C':
+			churn = 1;
+			break;
+		case 'i':
+			nlookups = atoi(optarg);
+			break;
+		case 'n':
+			nitems = atoi(optarg);
+			break;
+		case 'R':
+			flags |= PHTF_RCU;
+			break;
+		case 't':
+			nthr = atoi(optarg);
+			if (nthr < 1 || nthr > NTHRS_MAX)
+				errx(1, "invalid argument: %s", optarg);
+			break;
+		default:
+			usage();
+		}
 	argc -= optind;
-	if (argc)
+	if (argc || nitems < 1)
 		usage();
 
-	psc_hashtbl_init(&t, 0, struct item,
+	psc_hashtbl_init(&t, flags, struct item,
 	    id, hentry, 97, NULL, "t");
 
-	i = PSCALLOC(sizeof(*i));
-	psc_hashent_init(&t, i);
-	i->id = 1;
-	psc_hashtbl_add_item(&t, i);
-
-	i = PSCALLOC(sizeof(*i));
-	psc_hashent_init(&t, i);
-	i->id = 2;
-	psc_hashtbl_add_item(&t, i);
-
-	i = PSCALLOC(sizeof(*i));
-	psc_hashent_init(&t, i);
-	i->id = 3;
-	psc_hashtbl_add_item(&t, i);
-
-	i = PSCALLOC(sizeof(*i));
-	psc_hashent_init(&t, i);
-	i->id = 4;
-	psc_hashtbl_add_item(&t, i);
+	for (key = 1; key <= 4; key++)
+		psc_hashtbl_add_item(&t, item_new(key));
 
 	key = 3;
 	i = psc_hashtbl_search(&t, &key);
@@ -94,5 +172,63 @@ main(int argc, char *argv[])
 	i = psc_hashtbl_search(&t, &key);
 	printf("%"PRId64"\n", i->id);
 
+	for (key = 1; key <= 4; key++) {
+		i = psc_hashtbl_searchdel(&t, &key);
+		psc_assert(i && i->id == key);
+		psc_hashtbl_sync(&t);
+		PSCFREE(i);
+	}
+
+	for (n = 0; n < 4; n++) {
+		iv[n] = item_new(n + 1);
+		psc_hashtbl_add_item(&t, iv[n]);
+	}
+	psc_hashent_removev(&t, (void **)iv, 4);
+	for (n = 0; n < 4; n++) {
+		key = n + 1;
+		psc_assert(psc_hashtbl_search(&t, &key) == NULL);
+		psc_assert(psc_hashent_disjoint(&t, iv[n]));
+		PSCFREE(iv[n]);
+	}
+
+	/* benchmark */
+	psc_hashtbl_resize(&t, psc_hashtbl_estnbuckets(nitems / 4));
+	if ((flags & PHTF_RCU) == 0)
+		psc_hashtbl_resize(&t, psc_hashtbl_estnbuckets(nitems * 2));
+	items = PSCALLOC(sizeof(*items) * nitems * 2);
+	for (key = 0; key < (uint64_t)nitems * 2; key++) {
+		items[key] = item_new(key);
+		psc_hashtbl_add_item(&t, items[key]);
+	}
+
+	psc_atomic32_set(&nrunning, nthr);
+	gettimeofday(&tv0, NULL);
+	for (n = 0; n < nthr; n++)
+		if (pthread_create(&pthr[n], NULL, lookup_main, NULL))
+			err(1, "pthread_create");
+	if (churn &&
+	    pthread_create(&cthr, NULL, churn_main, NULL))
+		err(1, "pthread_create");
+
+	/* grow the table underneath the lookups */
+	if (flags & PHTF_RCU)
+		psc_hashtbl_resize(&t,
+		    psc_hashtbl_estnbuckets(nitems * 2));
+
+	for (n = 0; n < nthr; n++)
+		pthread_join(pthr[n], NULL);
+	gettimeofday(&tv1, NULL);
+	if (churn)
+		pthread_join(cthr, NULL);
+
+	/* exited readers are gone; only ours may remain */
+	psc_assert(pll_nitems(&pfl_hashrdrs) <= 1);
+
+	timersub(&tv1, &tv0, &tvd);
+	secs = tvd.tv_sec + tvd.tv_usec * 1e-6;
+	printf("%s: %d threads, %d lookups in %.3fs, %.0f lookups/s\n",
+	    flags & PHTF_RCU ? "rcu" : "locked", nthr, nthr * nlookups,
+	    secs, nthr * nlookups / secs);
+
 	exit(0);
 }
@@ -85,7 +85,7 @@ add(int v)
 int
 main(__unusedx int argc, __unusedx char *argv[])
 {
-	struct a *p;
+	struct a *p, *v[100];
 	int i, last;
 
 	pfl_init();
@@ -103,5 +103,28 @@ main(__unusedx int argc, __unusedx char *argv[])
 		PSCFREE(p);
 	}
 
+	/* remove items from the middle */
+	for (i = 0; i < 1000; i++)
+		add(psc_random32u(1 << 20));
+	for (i = 0; i < nitems(v); i++)
+		v[i] = pfl_heap_peekidx(&hp,
+		    psc_random32u(pfl_heap_nitems(&hp)));
+	for (i = 0; i < nitems(v); i++) {
+		if (v[i] == NULL)
+			continue;
+		pfl_heap_remove(&hp, v[i]);
+		for (last = i + 1; last < nitems(v); last++)
+			if (v[last] == v[i])
+				v[last] = NULL;
+		PSCFREE(v[i]);
+	}
+
+	last = -1;
+	while ((p = pfl_heap_shift(&hp))) {
+		psc_assert(p->val >= last);
+		last = p->val;
+		PSCFREE(p);
+	}
+
 	exit(0);
 }
@@ -0,0 +1,163 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/iouring.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+
+__dead void
+usage(void)
+{
+	extern const char *__progname;
+
+	fprintf(stderr, "usage: %s\n", __progname);
+	exit(1);
+}
+
+#ifdef HAVE_IO_URING
+
+#define BUFSZ	8192
+
+/*
+ * Submit everything queued and wait for @n completions, checking that
+ * each one matches the expected result for its tag.
+ */
+void
+runq(struct pfl_iouring *piu, int n, const int *want)
+{
+	struct io_uring_cqe cqes[8];
+	int i, rc, got = 0;
+
+	psc_assert(pfl_iouring_submit(piu) == n);
+	while (got < n) {
+		rc = pfl_iouring_reap(piu, cqes, nitems(cqes), 1);
+		psc_assert(rc > 0);
+		for (i = 0; i < rc; i++)
+			psc_assert(cqes[i].res ==
+			    want[cqes[i].user_data]);
+		got += rc;
+	}
+	psc_assert(pfl_iouring_reap(piu, cqes, nitems(cqes), 0) == 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char fn[] = "/tmp/iouring_test.XXXXXX", *wbuf, *rbuf;
+	struct io_uring_sqe *sqe;
+	struct pfl_iouring piu;
+	struct iovec iov;
+	int fd, rc, want[3];
+
+	pfl_init();
+	if (getopt(argc, argv, "") != -1)
+		usage();
+	argc -= optind;
+	if (argc)
+		usage();
+
+	rc = pfl_iouring_init(&piu, 4);
+	if (rc == -ENOSYS || rc == -EPERM || rc == -EOPNOTSUPP) {
+		warnx("io_uring unavailable; skipping");
+		exit(0);
+	}
+	psc_assert(rc == 0);
+
+	fd = mkstemp(fn);
+	psc_assert(fd != -1);
+	unlink(fn);
+
+	wbuf = PSCALLOC(BUFSZ);
+	rbuf = PSCALLOC(BUFSZ);
+	memset(wbuf, 'x', BUFSZ);
+
+	/* plain write and fsync in one batch */
+	sqe = pfl_iouring_get_sqe(&piu);
+	pfl_iouring_prep_rw(sqe, IORING_OP_WRITE, fd, wbuf, BUFSZ, 0,
+	    (void *)0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe = pfl_iouring_get_sqe(&piu);
+	pfl_iouring_prep_rw(sqe, IORING_OP_FSYNC, fd, NULL, 0, 0,
+	    (void *)1);
+	want[0] = BUFSZ;
+	want[1] = 0;
+	runq(&piu, 2, want);
+
+	/* fixed buffer reads in two halves, plus one past EOF */
+	iov.iov_base = rbuf;
+	iov.iov_len = BUFSZ;
+	psc_assert(pfl_iouring_register_buffers(&piu, &iov, 1) == 0);
+	sqe = pfl_iouring_get_sqe(&piu);
+	pfl_iouring_prep_rw(sqe, IORING_OP_READ_FIXED, fd, rbuf,
+	    BUFSZ / 2, 0, (void *)0);
+	sqe->buf_index = 0;
+	sqe = pfl_iouring_get_sqe(&piu);
+	pfl_iouring_prep_rw(sqe, IORING_OP_READ_FIXED, fd,
+	    rbuf + BUFSZ / 2, BUFSZ / 2, BUFSZ / 2, (void *)1);
+	sqe->buf_index = 0;
+	sqe = pfl_iouring_get_sqe(&piu);
+	pfl_iouring_prep_rw(sqe, IORING_OP_READ, fd, wbuf, BUFSZ,
+	    BUFSZ, (void *)2);
+	want[0] = BUFSZ / 2;
+	want[1] = BUFSZ / 2;
+	want[2] = 0;
+	runq(&piu, 3, want);
+	psc_assert(memcmp(wbuf, rbuf, BUFSZ) == 0);
+
+	/* the queue must refuse more entries than it has slots for */
+	for (rc = 0; pfl_iouring_get_sqe(&piu); rc++)
+		;
+	psc_assert(rc == (int)piu.piu_sq_entries);
+
+	pfl_iouring_destroy(&piu);
+	close(fd);
+	PSCFREE(wbuf);
+	PSCFREE(rbuf);
+	exit(0);
+}
+
+#else
+
+int
+main(__unusedx int argc, __unusedx char *argv[])
+{
+	warnx("io_uring not supported; skipping");
+	exit(0);
+}
+
+#endif
@@ -0,0 +1,182 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Start real pfl processes under each PSC_LOG_ASYNC mode and check
+ * that they come up and that every message logged reaches stderr.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/pfl.h"
+#include "pfl/thread.h"
+
+#define MARKER "logasync-marker"
+
+int nthr = 4;
+int niter = 2000;
+pthread_barrier_t barrier;
+
+__dead void
+usage(void)
+{
+	extern const char *__progname;
+
+	fprintf(stderr, "usage: %s [-n nthr] [-i iterations]\n",
+	    __progname);
+	exit(1);
+}
+
+void
+logger_main(struct psc_thread *thr)
+{
+	int i;
+
+	for (i = 0; i < niter; i++)
+		psclog_max(MARKER " %s i=%d", thr->pscthr_name, i);
+	pthread_barrier_wait(&barrier);
+}
+
+/*
+ * The process being tested: log from several threads and exit, relying on the exit flush to drain anything queued.
+ */
+__dead void
+child(void)
+{
+	int i;
+
+	pscthr_init(0, NULL, 0, "logmain");
+	psclog_max(MARKER " main up");
+
+	pthread_barrier_init(&barrier, NULL, nthr + 1);
+	for (i = 0; i < nthr; i++)
+		pscthr_init(0, logger_main, 0, "logthr%d", i);
+	pthread_barrier_wait(&barrier);
+	exit(0);
+}
+
+/*
+ * Run ourselves in child mode and return the number of marker lines
+ * it wrote to stderr.
+ */
+int
+run(const char *prog, const char *mode)
+{
+	char buf[BUFSIZ], nbuf[16], ibuf[16];
+	int fds[2], n = 0, status;
+	FILE *fp;
+	pid_t pid;
+
+	if (pipe(fds) == -1)
+		err(1, "pipe");
+	pid = fork();
+	if (pid == -1)
+		err(1, "fork");
+	if (pid == 0) {
+		close(fds[0]);
+		if (dup2(fds[1], STDERR_FILENO) == -1)
+			err(1, "dup2");
+		close(fds[1]);
+		setenv("PSC_LOG_ASYNC", mode, 1);
+		unsetenv("PSC_LOG_ASYNC_FILE");
+		snprintf(nbuf, sizeof(nbuf), "%d", nthr);
+		snprintf(ibuf, sizeof(ibuf), "%d", niter);
+		execl(prog, prog, "-c", "-n", nbuf, "-i", ibuf,
+		    (char *)NULL);
+		err(1, "%s", prog);
+	}
+
+	close(fds[1]);
+	fp = fdopen(fds[0], "r");
+	if (fp == NULL)
+		err(1, "fdopen");
+	while (fgets(buf, sizeof(buf), fp))
+		if (strstr(buf, MARKER))
+			n++;
+		else
+			fputs(buf, stderr);
+	fclose(fp);
+
+	if (waitpid(pid, &status, 0) == -1)
+		err(1, "waitpid");
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		errx(1, "PSC_LOG_ASYNC=%s: child failed to run (status "
+		    "%#x)", mode, status);
+	return (n);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c, cflag = 0, n, total;
+
+	pfl_init();
+	while ((c = getopt(argc, argv, "ci:n:")) != -1)
+		switch (c) {
+		case 'c':
+			cflag = 1;
+			break;
+		case 'i':
+			niter = atoi(optarg);
+			break;
+		case 'n':
+			nthr = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc || nthr < 1 || niter < 0)
+		usage();
+
+	if (cflag)
+		child();
+
+	total = nthr * niter + 1;
+
+	n = run(argv[0], "0");
+	if (n != total)
+		errx(1, "sync: got %d messages, want %d", n, total);
+
+	n = run(argv[0], "block");
+	if (n != total)
+		errx(1, "block: got %d messages, want %d", n, total);
+
+	/* overflow may legitimately discard some */
+	n = run(argv[0], "drop");
+	if (n < 1 || n > total)
+		errx(1, "drop: got %d messages, want 1-%d", n, total);
+
+	return (0);
+}
@@ -0,0 +1,148 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/pfl.h"
+
+#define NTHRS		8
+#define NITERS		100000
+
+struct pfl_opstat *opst;
+
+__dead void
+usage(void)
+{
+	extern const char *__progname;
+
+	fprintf(stderr, "usage: %s\n", __progname);
+	exit(1);
+}
+
+void *
+thr_main(__unusedx void *arg)
+{
+	int i;
+
+	for (i = 0; i < NITERS; i++)
+		pfl_opstat_incr(opst);
+	return (NULL);
+}
+
+/*
+ * Check a reported percentile against the exact answer, allowing for
+ * the 1/NSUB bucket width.
+ */
+void
+check_pctl(struct pfl_opstat *p, int64_t exact)
+{
+	int64_t val;
+
+	val = psc_atomic64_read(&p->opst_lifetime);
+	psc_assert(val >= exact);
+	psc_assert(val <= exact + exact / PFL_OPSTAT_HIST_NSUB + 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pfl_opstat_hist *oh;
+	pthread_t thrs[NTHRS];
+	int64_t i;
+	int j;
+
+	pfl_init();
+	if (getopt(argc, argv, "") != -1)
+		usage();
+	argc -= optind;
+	if (argc)
+		usage();
+
+	/* sharded counters must sum exactly */
+	opst = pfl_opstat_initf(OPSTF_SHARDED, "test");
+	psc_assert(opst->opst_shards);
+	psc_assert(((uintptr_t)opst->opst_shards &
+	    (PFL_CACHELINE_SIZE - 1)) == 0);
+	for (j = 0; j < NTHRS; j++)
+		pthread_create(&thrs[j], NULL, thr_main, NULL);
+	for (j = 0; j < NTHRS; j++)
+		pthread_join(thrs[j], NULL);
+	psc_assert(pfl_opstat_read(opst) == NTHRS * NITERS);
+
+	pfl_opstat_set(opst, 5);
+	psc_assert(pfl_opstat_read(opst) == 5);
+
+	/* uniform 1..10000 */
+	oh = pfl_opstat_hist_initf(OPSTF_BASE10, "hist");
+	for (i = 1; i <= 10000; i++)
+		pfl_opstat_hist_add(oh, i);
+	pfl_opstat_hist_update(oh);
+	psc_assert(pfl_opstat_read(oh->oh_sum) == 10000 * 10001 / 2);
+	check_pctl(oh->oh_pctl[0], 5000);
+	check_pctl(oh->oh_pctl[1], 9900);
+	check_pctl(oh->oh_pctl[2], 9990);
+
+	/* small values get exact buckets */
+	oh = pfl_opstat_hist_initf(OPSTF_BASE10, "hist-small");
+	for (i = 0; i < 1000; i++)
+		pfl_opstat_hist_add(oh, i % 4);
+	pfl_opstat_hist_update(oh);
+	psc_assert(psc_atomic64_read(&oh->oh_pctl[0]->opst_lifetime) == 1);
+	psc_assert(psc_atomic64_read(&oh->oh_pctl[2]->opst_lifetime) == 3);
+
+	/* extremes must not overflow the bucket table */
+	oh = pfl_opstat_hist_initf(OPSTF_BASE10, "hist-max");
+	pfl_opstat_hist_add(oh, INT64_MAX);
+	pfl_opstat_hist_add(oh, -1);
+	pfl_opstat_hist_update(oh);
+	psc_assert(psc_atomic64_read(&oh->oh_pctl[2]->opst_lifetime) ==
+	    INT64_MAX);
+
+	/* old samples fade out of the percentiles */
+	oh = pfl_opstat_hist_initf(OPSTF_BASE10, "hist-decay");
+	for (i = 0; i < 1000; i++)
+		pfl_opstat_hist_add(oh, 1000000);
+	pfl_opstat_hist_update(oh);
+	check_pctl(oh->oh_pctl[0], 1000000);
+	for (j = 0; j < 300; j++)
+		pfl_opstat_hist_update(oh);
+	for (i = 0; i < 10; i++)
+		pfl_opstat_hist_add(oh, 7);
+	pfl_opstat_hist_update(oh);
+	psc_assert(psc_atomic64_read(&oh->oh_pctl[2]->opst_lifetime) ==
+	    7);
+
+	/* the same name yields the same histogram */
+	psc_assert(pfl_opstat_hist_initf(OPSTF_BASE10, "hist-decay") ==
+	    oh);
+
+	exit(0);
+}
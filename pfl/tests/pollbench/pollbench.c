@@ -0,0 +1,244 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2015-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Event-dispatch latency of poll(2) vs. edge-triggered epoll(7) as a
+ * function of the number of mostly idle connections, modeled after the
+ * usocklnd poll threads: one connection at a time becomes readable and
+ * the time from the write until its handler runs is measured.
+ */
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/pfl.h"
+
+int		 maxconns = 4096;
+int		 iterations = 2000;
+int		*rfds;
+int		*wfds;
+
+uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+void
+setup(int n)
+{
+	int i, fds[2];
+
+	rfds = calloc(n, sizeof(*rfds));
+	wfds = calloc(n, sizeof(*wfds));
+	if (rfds == NULL || wfds == NULL)
+		err(1, "calloc");
+	for (i = 0; i < n; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+			err(1, "socketpair");
+		if (fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1)
+			err(1, "fcntl");
+		rfds[i] = fds[0];
+		wfds[i] = fds[1];
+	}
+}
+
+void
+fire(int i)
+{
+	char c = 0;
+
+	if (write(wfds[i], &c, 1) != 1)
+		err(1, "write");
+}
+
+void
+drain(int fd)
+{
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+/*
+ * Like usocklnd_execute_handlers(): poll(2) the whole array and then
+ * scan it for revents.
+ */
+double
+bench_poll(int n)
+{
+	struct pollfd *pfd;
+	uint64_t start, total = 0;
+	int i, j, k, found;
+
+	pfd = calloc(n, sizeof(*pfd));
+	if (pfd == NULL)
+		err(1, "calloc");
+	for (i = 0; i < n; i++) {
+		pfd[i].fd = rfds[i];
+		pfd[i].events = POLLIN;
+	}
+
+	for (k = 0; k < iterations; k++) {
+		j = random() % n;
+		start = now_ns();
+		fire(j);
+		if (poll(pfd, n, -1) == -1)
+			err(1, "poll");
+		for (i = found = 0; i < n; i++)
+			if (pfd[i].revents & POLLIN) {
+				drain(pfd[i].fd);
+				found++;
+			}
+		total += now_ns() - start;
+		if (found != 1)
+			errx(1, "poll: %d ready fds, expected 1", found);
+	}
+	free(pfd);
+	return ((double)total / iterations);
+}
+
+#ifdef HAVE_EPOLL
+double
+bench_epoll(int n)
+{
+	struct epoll_event ev, evs[128];
+	uint64_t start, total = 0;
+	int epfd, i, k, m;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		err(1, "epoll_create1");
+	for (i = 0; i < n; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = rfds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, rfds[i], &ev) == -1)
+			err(1, "epoll_ctl");
+	}
+
+	for (k = 0; k < iterations; k++) {
+		i = random() % n;
+		start = now_ns();
+		fire(i);
+		m = epoll_wait(epfd, evs, nitems(evs), -1);
+		if (m == -1)
+			err(1, "epoll_wait");
+		for (i = 0; i < m; i++)
+			drain(evs[i].data.fd);
+		total += now_ns() - start;
+		if (m != 1)
+			errx(1, "epoll: %d ready fds, expected 1", m);
+	}
+	close(epfd);
+	return ((double)total / iterations);
+}
+#endif
+
+__dead void
+usage(void)
+{
+	extern const char *__progname;
+
+	fprintf(stderr, "usage: %s [-i iterations] [-n maxconns]\n",
+	    __progname);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct rlimit rlim;
+	int c, n;
+	long l;
+
+	pfl_init();
+	while ((c = getopt(argc, argv, "i:n:")) != -1)
+		switch (c) {
+		case 'i':
+			l = strtol(optarg, NULL, 10);
+			if (l <= 0 || l > INT_MAX)
+				errx(1, "invalid iterations: %s", optarg);
+			iterations = (int)l;
+			break;
+		case 'n':
+			l = strtol(optarg, NULL, 10);
+			if (l <= 0 || l > INT_MAX / 2)
+				errx(1, "invalid maxconns: %s", optarg);
+			maxconns = (int)l;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	if (argc)
+		usage();
+
+	/* two descriptors per connection plus some slack */
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == -1)
+		err(1, "getrlimit");
+	rlim.rlim_cur = rlim.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rlim);
+	if (getrlimit(RLIMIT_NOFILE, &rlim) == -1)
+		err(1, "getrlimit");
+	if ((rlim_t)maxconns * 2 + 16 > rlim.rlim_cur) {
+		maxconns = (rlim.rlim_cur - 16) / 2;
+		warnx("limiting to %d connections by RLIMIT_NOFILE",
+		    maxconns);
+	}
+
+	setup(maxconns);
+
+	printf("%8s %12s %12s\n", "nconns", "poll(ns)", "epoll(ns)");
+	for (n = 1;; n = n * 2 > maxconns ? maxconns : n * 2) {
+		printf("%8d %12.0f", n, bench_poll(n));
+#ifdef HAVE_EPOLL
+		printf(" %12.0f", bench_epoll(n));
+#else
+		printf(" %12s", "-");
+#endif
+		printf("\n");
+		if (n == maxconns)
+			break;
+	}
+	exit(0);
+}
@@ -45,6 +45,7 @@
 #include "pfl/dynarray.h"
 #include "pfl/lock.h"
 #include "pfl/lockedlist.h"
+#include "pfl/logasync.h"
 #include "pfl/mem.h"
 #include "pfl/opstats.h"
 #include "pfl/str.h"
@@ -91,6 +92,7 @@ _pscthr_destroy(void *arg)
 			    thr->pscthr_uniqid - 1);
 	}
 	PLL_ULOCK(&psc_threads);
+	pflog_async_thrdone(thr);
 	/* crash below @40977 */
 	psc_free(thr->pscthr_loglevels, PAF_NOLOG);
 	psc_free(thr->pscthr_callerinfo, PAF_NOLOG);
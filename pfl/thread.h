@@ -50,6 +50,7 @@ struct psc_thread {
 	char			  pscthr_name[PSC_THRNAME_MAX]; /* human readable name */
 	int			 *pscthr_loglevels;		/* logging granularity */
 	struct pfl_callerinfo	 *pscthr_callerinfo;
+	struct pflog_ring	 *pscthr_logring;		/* async log records */
 	void			 *pscthr_private;		/* app-specific data */
 };
 
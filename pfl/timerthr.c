@@ -47,6 +47,7 @@ void
 pfl_opstimerthr_main(struct psc_thread *thr)
 {
 	struct psc_waitq dummy = PSC_WAITQ_INIT("opstats");
+	struct pfl_opstat_hist *oh;
 	struct pfl_opstat *opst;
 	struct timespec ts;
 	double alpha = .25;
@@ -65,11 +66,18 @@ pfl_opstimerthr_main(struct psc_thread *thr)
 		ts.tv_sec++;
 		psc_waitq_waitabs(&dummy, NULL, &ts);
 
+		pfl_lockprof_update();
+
 		spinlock(&pfl_opstats_lock);
+		DYNARRAY_FOREACH(oh, i, &pfl_opstat_hists)
+			pfl_opstat_hist_update(oh);
+
 		DYNARRAY_FOREACH(opst, i, &pfl_opstats) {
+			if (opst->opst_flags & OPSTF_GAUGE)
+				continue;
 
 			/* update last second rate */
-			curr = psc_atomic64_read(&opst->opst_lifetime);
+			curr = pfl_opstat_read(opst);
 			len = curr - opst->opst_last;
 			if (len < 0)
 				len = -len;
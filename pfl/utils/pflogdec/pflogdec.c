@@ -0,0 +1,161 @@
+/* $Id$ */
+/*
+ * %ISC_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2007-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the
+ * above copyright notice and this permission notice appear in all
+ * copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS.  IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ * PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ * --------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Decode a binary log written with PSC_LOG_ASYNC_FILE into the usual
+ * text form.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfl/cdefs.h"
+#include "pfl/log.h"
+#include "pfl/logasync.h"
+#include "pfl/pfl.h"
+
+__dead void
+usage(void)
+{
+	extern const char *__progname;
+
+	fprintf(stderr, "usage: %s [-f logfmt] file ...\n", __progname);
+	exit(1);
+}
+
+/*
+ * Pull the next NUL-terminated string out of a record's trailer.
+ */
+const char *
+nextstr(char **p, char *end)
+{
+	char *s = *p, *t;
+
+	t = memchr(s, '\0', end - s);
+	if (t == NULL)
+		return (NULL);
+	*p = t + 1;
+	return (s);
+}
+
+void
+decode(const char *fn)
+{
+	const char *file, *func, *thrname, *subsys;
+	union {
+		struct pflog_rec r;
+		char		 buf[PFLOG_REC_SZ];
+	} u;
+	char trailer[65536], out[BUFSIZ], *p, *end;
+	struct pflog_filehdr fh;
+	struct pflog_ctx ctx;
+	struct timeval tv;
+	size_t len;
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (fp == NULL)
+		err(1, "%s", fn);
+	if (fread(&fh, sizeof(fh), 1, fp) != 1 ||
+	    memcmp(fh.plfh_magic, PFLOG_FILE_MAGIC,
+	    sizeof(fh.plfh_magic)))
+		errx(1, "%s: not a binary log", fn);
+	if (fh.plfh_version != PFLOG_FILE_VERSION ||
+	    fh.plfh_recsz != sizeof(struct pflog_rec))
+		errx(1, "%s: unsupported version %u or record size %u",
+		    fn, fh.plfh_version, fh.plfh_recsz);
+
+	while (fread(&u.r, sizeof(u.r), 1, fp) == 1) {
+		if (u.r.plr_magic != PFLOG_REC_MAGIC ||
+		    u.r.plr_reclen < sizeof(u.r) + u.r.plr_datalen ||
+		    u.r.plr_datalen > PFLOG_DATA_MAX)
+			errx(1, "%s: corrupt record at offset %ld", fn,
+			    ftell(fp) - (long)sizeof(u.r));
+		len = u.r.plr_reclen - sizeof(u.r);
+		if (fread(trailer, len, 1, fp) != 1)
+			errx(1, "%s: truncated record", fn);
+
+		p = trailer;
+		end = trailer + len - u.r.plr_datalen;
+		file = nextstr(&p, end);
+		func = nextstr(&p, end);
+		thrname = nextstr(&p, end);
+		subsys = nextstr(&p, end);
+		if (subsys == NULL)
+			errx(1, "%s: corrupt record trailer", fn);
+		memcpy(u.r.plr_data, end, u.r.plr_datalen);
+
+		tv.tv_sec = u.r.plr_sec;
+		tv.tv_usec = u.r.plr_usec;
+
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.plc_file = file;
+		ctx.plc_func = func;
+		ctx.plc_lineno = u.r.plr_lineno;
+		ctx.plc_level = u.r.plr_level;
+		ctx.plc_subsys = subsys;
+		ctx.plc_subsysid = u.r.plr_subsys;
+		ctx.plc_tv = &tv;
+		ctx.plc_thrname = thrname;
+		ctx.plc_thrid = u.r.plr_thrid;
+		ctx.plc_pthread = u.r.plr_pthread;
+		ctx.plc_fsctx_pid = u.r.plr_fsctx_pid;
+		ctx.plc_fsctx_uid = u.r.plr_fsctx_uid;
+		ctx.plc_peer = u.r.plr_peeroff ?
+		    u.r.plr_data + u.r.plr_peeroff : "";
+
+		len = pflog_fmtprefix(out, sizeof(out), &ctx);
+		pflog_rec_render(&u.r, out + len, sizeof(out) - len);
+		printf("%s\n", out);
+	}
+	if (ferror(fp))
+		err(1, "%s", fn);
+	fclose(fp);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "f:")) != -1)
+		switch (c) {
+		case 'f':
+			psc_logfmt = optarg;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (argc == 0)
+		usage();
+
+	for (; *argv; argv++)
+		decode(*argv);
+	exit(0);
+}
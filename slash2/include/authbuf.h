@@ -29,9 +29,11 @@
 #define _SL_AUTHBUF_H_
 
 #include <gcrypt.h>
+#include <stdint.h>
 
 #include "pfl/atomic.h"
 
+struct iovec;
 struct stat;
 struct pscrpc_request;
 
@@ -39,6 +41,15 @@ struct pscrpc_request;
 #define AUTHBUF_MINKEYSIZE	1024
 #define AUTHBUF_MAXKEYSIZE	(128 * 1024)
 
+#define AUTHBUF_BULK_MIN	(256 * 1024)	/* smallest payload hashed in parallel */
+#define AUTHBUF_BULK_NTHR	4		/* bulk hash helper threads */
+
+/* CRC of a bulk iovec element the caller computed in passing */
+struct sl_bulkhash_hint {
+	uint32_t		bhh_crc;	/* see psc_crc32r_add() */
+	int			bhh_valid;
+};
+
 int	authbuf_check(struct pscrpc_request *, int, int);
 void	authbuf_sign(struct pscrpc_request *, int);
 
@@ -47,7 +58,14 @@ void	authbuf_checkkeyfile(void);
 void	authbuf_createkeyfile(void);
 void	authbuf_readkeyfile(void);
 
+void	sl_bulkhash(void *, const struct iovec *, int,
+	    const struct sl_bulkhash_hint *);
+void	sl_bulkhash_init(void);
+void	sl_bulkhashthr_spawn(int, int, const char *);
+
 extern psc_atomic64_t	sl_authbuf_nonce;
 extern gcry_md_hd_t	sl_authbuf_hd;
+extern int		sl_bulkhash_min;
+extern int		sl_bulkhash_nthr;
 
 #endif /* _SL_AUTHBUF_H_ */
@@ -218,7 +218,8 @@ struct fidc_membh {
 #define FCMH_OPCNT_SYNC_AHEAD		11	/* IOD: sync ahead */
 #define FCMH_OPCNT_UPDATE		12	/* IOD: update file */
 #define FCMH_OPCNT_CALLBACK		13
-#define FCMH_OPCNT_MAXTYPE		14
+#define FCMH_OPCNT_WRITEBACK		14	/* IOD: dirty slivers queued */
+#define FCMH_OPCNT_MAXTYPE		15
 
 void	fidc_init(int);
 void	fidc_destroy(void);
@@ -73,6 +73,7 @@
 
 #define SL_FN_UPDATELOG		"op-update"
 #define SL_FN_UPDATEPROG	"op-update-prog"
+#define SL_FN_UPDATERECVPROG	"op-update-recv-prog"
 
 #define SL_FN_RECLAIMLOG	"op-reclaim"
 #define SL_FN_RECLAIMPROG	"op-reclaim-prog"
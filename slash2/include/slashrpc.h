@@ -197,6 +197,8 @@ enum {
 
 	SRMT_FILECB,				/* 52: file callback */
 
+	SRMT_BMAPCRCWRT,			/* 53: update bmap data checksums */
+
 	SRMT_TOTAL
 };
 
@@ -577,6 +579,29 @@ struct srm_updatefile_req {
 
 #define srm_updatefile_rep	srm_generic_rep
 
+/*
+ * Sliver data checksums recomputed by an IOS after writes, sent in
+ * batches per bmap so the MDS can hand them out for read verification.
+ */
+struct srt_bmap_crcwire {
+	uint64_t		crc;		/* CRC of the whole sliver */
+	uint32_t		slot;		/* sliver number in bmap */
+	 int32_t		_pad;
+} __packed;
+
+/* must fit in SLM_RMI_BUFSZ */
+#define MAX_BMAP_NCRC_UPDATES	32
+
+struct srm_bmap_crcwrt_req {
+	struct sl_fidgen	fg;
+	sl_bmapno_t		bmapno;
+	uint32_t		ncrcs;
+	uint64_t		seq;		/* last write lease seen */
+	struct srt_bmap_crcwire	crcs[MAX_BMAP_NCRC_UPDATES];
+} __packed;
+
+#define srm_bmap_crcwrt_rep	srm_generic_rep
+
 struct srm_bmap_iod_get {
 	uint64_t		fid;
 	uint32_t		bno;
@@ -76,7 +76,6 @@ struct sl_resource {
 
 	sl_ios_id_t		 res_id;
 	psc_atomic32_t		 res_batchcnt;
-	int			 res_offset;
 	int			 res_flags;	/* see RESF_* below */
 	enum sl_res_type	 res_type;
 	uint32_t		 res_stkvers;	/* peer SLASH2 stack version */
@@ -86,6 +85,8 @@ struct sl_resource {
 	struct psc_dynarray	 res_members;	/* for cluster types */
 	char			 res_name[RES_NAME_MAX];
 	char			*res_desc;	/* human description */
+	char			*res_repl_egress_bw;
+	char			*res_repl_ingress_bw;
 	struct slcfg_local	*res_localcfg;
 };
 
@@ -148,6 +149,7 @@ resm_get_pri(struct sl_resm *resm)
 struct sl_site {
 	char			 site_name[SITE_NAME_MAX];
 	char			*site_desc;
+	char			*site_repl_link_bw;
 	struct psc_listentry	 site_lentry;
 	struct psc_dynarray	 site_resources;
 	sl_siteid_t		 site_id;
@@ -190,6 +192,7 @@ struct slcfg_local {
 	char			 cfg_prefios[RES_NAME_MAX];
 	char			 cfg_zpname[NAME_MAX + 1];
 	char			*cfg_selftest;
+	int			 cfg_io_uring;
 	int			 cfg_async_io:1;
 	int			 cfg_root_squash:1;
 };
@@ -46,6 +46,7 @@
 struct pscrpc_import;
 struct pscrpc_export;
 
+struct sl_bulkhash_hint;
 struct sl_resm;
 
 extern struct pfl_rwlock	 sl_conn_lock;
@@ -387,6 +388,8 @@ const char *
 	 slrpc_getname_for_opcode(int);
 
 int	 slrpc_bulkclient(struct pscrpc_request *, int, int, struct iovec *, int);
+int	 slrpc_bulkclient_hint(struct pscrpc_request *, int, int, struct iovec *, int,
+	    const struct sl_bulkhash_hint *);
 int	 slrpc_bulkserver(struct pscrpc_request *, int, int, struct iovec *, int);
 
 void	 slrpc_bulk_sign(struct pscrpc_request *, void *, struct iovec *, int);
@@ -63,8 +63,8 @@
 #define SLERR_ION_READONLY		(_SLERR_START + 28)
 /* 29 - reuse */
 #define SLERR_RES_BADTYPE		(_SLERR_START + 30)
-/* 31 - reuse me */
-/* 32 - reuse me */
+#define SLERR_MDS_READONLY		(_SLERR_START + 31)
+#define SLERR_MDS_STALE			(_SLERR_START + 32)
 /* 33 - reuse me */
 #define SLERR_CRCABSENT			(_SLERR_START + 34)
 
@@ -48,6 +48,7 @@
 #include "pfl/tree.h"
 #include "pfl/treeutil.h"
 
+#include "authbuf.h"
 #include "bmap.h"
 #include "bmap_cli.h"
 #include "pgcache.h"
@@ -149,9 +150,12 @@ bmap_free_all_locked(struct fidc_membh *f)
 
 /*
  * Pin (mark read-only) all pages attached to a bmap write coalescer.
+ * For each iovec that covers a whole page, also hand back the CRC
+ * msl_pages_copyin() computed for it, if still valid.
  */
 void
-bwc_pin_pages(struct bmpc_write_coalescer *bwc)
+bwc_pin_pages(struct bmpc_write_coalescer *bwc,
+    struct sl_bulkhash_hint *hints)
 {
 	struct bmap_pagecache_entry *pg;
 	int i;
@@ -160,6 +164,9 @@ bwc_pin_pages(struct bmpc_write_coalescer *bwc)
 		pg = bwc->bwc_bmpces[i];
 		BMPCE_LOCK(pg);
 		pg->bmpce_pins++;
+		hints[i].bhh_valid = pg->bmpce_flags & BMPCEF_CRC &&
+		    bwc->bwc_iovs[i].iov_len == BMPC_BUFSZ;
+		hints[i].bhh_crc = pg->bmpce_crc;
 		BMPCE_ULOCK(pg);
 	}
 }
@@ -247,6 +254,7 @@ __static int
 bmap_flush_create_rpc(struct bmpc_write_coalescer *bwc,
     struct slrpc_cservice *csvc, struct bmap *b)
 {
+	struct sl_bulkhash_hint hints[BMPC_COALESCE_MAX_IOV];
 	struct pscrpc_request *rq = NULL;
 	struct resprof_cli_info *rpci;
 	struct srm_io_req *mq;
@@ -262,10 +270,13 @@ bmap_flush_create_rpc(struct bmpc_write_coalescer *bwc,
 	if (rc)
 		goto out;
 
-	rc = slrpc_bulkclient(rq, BULK_GET_SOURCE, SRIC_BULK_PORTAL,
-	    bwc->bwc_iovs, bwc->bwc_niovs);
+	/* The bulk is signed on setup so the pages must be stable. */
+	bwc_pin_pages(bwc, hints);
+
+	rc = slrpc_bulkclient_hint(rq, BULK_GET_SOURCE,
+	    SRIC_BULK_PORTAL, bwc->bwc_iovs, bwc->bwc_niovs, hints);
 	if (rc)
-		goto out;
+		goto unpin;
 
 	mq->offset = bwc->bwc_soff;
 	mq->size = bwc->bwc_size;
@@ -281,8 +292,6 @@ bmap_flush_create_rpc(struct bmpc_write_coalescer *bwc,
 	    m->resm_res_id, SLPRI_FG_ARGS(&mq->sbd.sbd_fg), mq->offset,
 	    mq->size, bmap_2_ios(b), rpci->rpci_infl_rpcs);
 
-	bwc_pin_pages(bwc);
-
 	rq->rq_interpret_reply = msl_ric_bflush_cb;
 	rq->rq_async_args.pointer_arg[MSL_CBARG_CSVC] = csvc;
 	rq->rq_async_args.pointer_arg[MSL_CBARG_RESM] = m;
@@ -291,6 +300,7 @@ bmap_flush_create_rpc(struct bmpc_write_coalescer *bwc,
 	if (!rc)
 		return (0);
 
+ unpin:
 	bwc_unpin_pages(bwc);
 
  out:
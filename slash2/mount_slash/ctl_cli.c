@@ -35,6 +35,7 @@
 #include "pfl/rsx.h"
 #include "pfl/str.h"
 
+#include "authbuf.h"
 #include "bmap.h"
 #include "bmap_cli.h"
 #include "ctl.h"
@@ -589,6 +590,34 @@ msctlparam_mds_get(char buf[PCP_VALUE_MAX])
 	strlcpy(buf, msl_rmc_resm->resm_name, PCP_VALUE_MAX);
 }
 
+void
+msctlparam_mds_replicas_get(char buf[PCP_VALUE_MAX])
+{
+	int i;
+
+	buf[0] = '\0';
+	for (i = 0; i < msl_rmc_nreplicas; i++) {
+		if (i)
+			strlcat(buf, ",", PCP_VALUE_MAX);
+		strlcat(buf, msl_rmc_replicas[i].mmr_resm->resm_name,
+		    PCP_VALUE_MAX);
+	}
+}
+
+void
+msctlparam_mds_replica_policy_get(char buf[PCP_VALUE_MAX])
+{
+	static const char *names[] = { "primary", "rr", "fid" };
+
+	strlcpy(buf, names[msl_rmc_rdpolicy], PCP_VALUE_MAX);
+}
+
+int
+msctlparam_mds_replica_policy_set(const char *val)
+{
+	return (slc_rmc_setrdpolicy(val) ? -1 : 0);
+}
+
 void
 msctlparam_prefios_get(char buf[PCP_VALUE_MAX])
 {
@@ -1045,6 +1074,8 @@ msctlthr_spawn(void)
 	psc_ctlparam_register_simple("sys.logrotate",
 	    slctlparam_logrotate_get, slctlparam_logrotate_set);
 
+	psc_ctlparam_register_var("sys.lockprof", PFLCTL_PARAMT_INT,
+	    PFLCTL_PARAMF_RDWR, &pfl_lockprof);
 	psc_ctlparam_register_var("sys.nbrq_outstanding",
 	    PFLCTL_PARAMT_INT, 0, &sl_nbrqset->set_remaining);
 	psc_ctlparam_register_var("sys.nbrqthr_wait", PFLCTL_PARAMT_INT,
@@ -1064,6 +1095,9 @@ msctlthr_spawn(void)
 	psc_ctlparam_register_var("sys.bmap_reassign",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &msl_bmap_reassign);
 
+	psc_ctlparam_register_var("sys.bulkhash_min",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sl_bulkhash_min);
+
 	/* XXX: add max_fs_iosz */
 	psc_ctlparam_register_var("sys.datadir", PFLCTL_PARAMT_STR, 0,
 	    (char *)sl_datadir);
@@ -1080,6 +1114,11 @@ msctlthr_spawn(void)
 	    msctlparam_prefios_get, msctlparam_prefios_set);
 	psc_ctlparam_register_simple("sys.mds", msctlparam_mds_get,
 	    NULL);
+	psc_ctlparam_register_simple("sys.mds_replicas",
+	    msctlparam_mds_replicas_get, NULL);
+	psc_ctlparam_register_simple("sys.mds_replica_policy",
+	    msctlparam_mds_replica_policy_get,
+	    msctlparam_mds_replica_policy_set);
 	psc_ctlparam_register_var("sys.fuse_direct_io", PFLCTL_PARAMT_INT,
 	    PFLCTL_PARAMF_RDWR, &msl_fuse_direct_io);
 
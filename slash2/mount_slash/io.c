@@ -38,6 +38,7 @@
 
 #include "pfl/cdefs.h"
 #include "pfl/completion.h"
+#include "pfl/crc.h"
 #include "pfl/ctlsvr.h"
 #include "pfl/dynarray.h"
 #include "pfl/fault.h"
@@ -81,6 +82,15 @@ struct timespec		 msl_bmap_timeo_inc = { BMAP_CLI_TIMEO_INC, 0 };
 int                      msl_predio_pipe_size = 256;
 int                      msl_predio_max_pages = 64;
 
+/* moving average of READ RPC latency, sizes read-ahead windows */
+psc_atomic64_t		 msl_predio_rpc_usecs = PSC_ATOMIC64_INIT(1000);
+
+/*
+ * Maximum distance between two reads for them to be considered part of
+ * the same strided stream.
+ */
+#define MSL_PREDIO_MAX_STRIDE	SLASH_BMAP_SIZE
+
 struct pfl_opstats_grad	 slc_iosyscall_iostats_rd;
 struct pfl_opstats_grad	 slc_iosyscall_iostats_wr;
 struct pfl_opstats_grad	 slc_iorpc_iostats_rd;
@@ -967,10 +977,27 @@ if (!pfl_rpc_max_retry) {
 		if ((r->biorq_flags & BIORQ_READAHEAD) == 0)
 			mfsrq_seterr(r->biorq_fsrqi, rc);
 	} else {
+		struct timespec now, d;
+		int64_t usecs, avg;
+
 		mq = pscrpc_msg_buf(rq->rq_reqmsg, 0, sizeof(*mq));
 		pfl_opstats_grad_incr(&slc_iorpc_iostats_rd, mq->size);
 		if (r->biorq_flags & BIORQ_READAHEAD)
 			OPSTAT2_ADD("msl.readahead-issue", mq->size);
+
+		/* Feed the latency estimate used to size predio. */
+		PFL_GETTIMESPEC(&now);
+		timespecsub(&now, &rq->rq_sent_ts, &d);
+		if (d.tv_sec >= 0) {
+			usecs = d.tv_sec * 1000000 + d.tv_nsec / 1000;
+			/* completions race; do not lose samples */
+			do {
+				avg = psc_atomic64_read(
+				    &msl_predio_rpc_usecs);
+			} while (psc_atomic64_cmpxchg(
+			    &msl_predio_rpc_usecs, avg,
+			    avg - avg / 8 + usecs / 8) != avg);
+		}
 	}
 
 	msl_biorq_release(r);
@@ -1666,7 +1693,7 @@ msl_pages_copyin(struct bmpc_ioreq *r)
 	struct bmap_pagecache_entry *e;
 	uint32_t toff, tsize, nbytes;
 	char *dest, *src;
-	int i;
+	int i, full;
 
 	src = r->biorq_buf;
 	tsize = r->biorq_len;
@@ -1713,11 +1740,23 @@ msl_pages_copyin(struct bmpc_ioreq *r)
 			nbytes = MIN(BMPC_BUFSZ, tsize);
 		}
 
-		/* Do the deed. */
-		memcpy(dest, src, nbytes);
+		/*
+		 * Do the deed.  When the whole page is overwritten, pick
+		 * up its bulk hash CRC in the same pass so the flush
+		 * does not have to read the page again to sign it.
+		 */
+		full = toff == e->bmpce_off && nbytes == BMPC_BUFSZ;
+		if (full) {
+			e->bmpce_crc = 0;
+			psc_crc_copy(dest, src, nbytes, NULL,
+			    &e->bmpce_crc);
+		} else {
+			memcpy(dest, src, nbytes);
+			e->bmpce_flags &= ~BMPCEF_CRC;
+		}
 
-		if (toff == e->bmpce_off && nbytes == BMPC_BUFSZ)
-			e->bmpce_flags |= BMPCEF_DATARDY;
+		if (full)
+			e->bmpce_flags |= BMPCEF_DATARDY | BMPCEF_CRC;
 		else if (e->bmpce_len == 0) {
 			e->bmpce_start = toff;
 			e->bmpce_len = nbytes;
@@ -1749,8 +1788,11 @@ msl_pages_copyin(struct bmpc_ioreq *r)
 }
 
 /*
- * Copy pages to the user application buffer (i.e. application read(2)
- * servicing).
+ * Gather the pages of a read biorq into the iovecs of the FUSE reply
+ * (i.e. application read(2) servicing).  No data is copied here: the
+ * bulk RPC lands directly in the page cache buffers and the reply is
+ * written to the FUSE device straight from them, so the pages must stay
+ * referenced by the biorq until the reply has been sent.
  */
 size_t
 msl_pages_copyout(struct bmpc_ioreq *r, struct msl_fsrqinfo *q)
@@ -1825,64 +1867,234 @@ msl_pages_copyout(struct bmpc_ioreq *r, struct msl_fsrqinfo *q)
 	return (tbytes);
 }
 
+/*
+ * Retire a predictive I/O stream, accounting any read-ahead it issued
+ * that the application never got to.
+ */
+__static void
+msl_predio_stream_reset(struct msl_predio_stream *s, int track_ra)
+{
+	off_t waste;
+
+	if (track_ra && s->mps_nseq && s->mps_stride &&
+	    s->mps_off > s->mps_lastoff + s->mps_stride) {
+		waste = (s->mps_off - s->mps_lastoff) / s->mps_stride - 1;
+		waste *= s->mps_lastsize;
+		if (MPS_STRIDED(s))
+			OPSTAT2_ADD("msl.predio-stride-waste", waste);
+		else
+			OPSTAT2_ADD("msl.predio-seq-waste", waste);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+/*
+ * Match an application I/O against the access streams of a file handle.
+ * Up to MFH_PREDIO_NSTREAMS concurrent streams are tracked so
+ * interleaved sequential readers do not defeat each other, and streams
+ * which advance by a constant stride are recognized as well.  An I/O
+ * that fits no stream replaces the least recently used one.
+ */
 void
 mfh_track_predictive_io(struct msl_fhent *mfh, size_t size, off_t off,
     enum rw rw)
 {
-	int delta = BMPC_BUFSZ;
+	struct msl_predio_stream *s, *lru = NULL;
+	int i, delta = BMPC_BUFSZ, track_ra;
+	off_t next;
 
 	MFH_LOCK(mfh);
 
-	if (rw == SL_WRITE) {
-		if (mfh->mfh_flags & MFHF_TRACKING_RA) {
-			mfh->mfh_flags &= ~MFHF_TRACKING_RA;
-			mfh->mfh_flags |= MFHF_TRACKING_WA;
-			mfh->mfh_predio_off = 0;
-			mfh->mfh_predio_nseq = 0;
-			mfh->mfh_predio_lastoff = 0;
-			mfh->mfh_predio_lastsize = 0;
-		}
-	} else {
-		if (mfh->mfh_flags & MFHF_TRACKING_WA) {
-			mfh->mfh_flags &= ~MFHF_TRACKING_WA;
-			mfh->mfh_flags |= MFHF_TRACKING_RA;
-			mfh->mfh_predio_off = 0;
-			mfh->mfh_predio_nseq = 0;
-			mfh->mfh_predio_lastoff = 0;
-			mfh->mfh_predio_lastsize = 0;
-		}
+	track_ra = !(mfh->mfh_flags & MFHF_TRACKING_WA);
+	if ((rw == SL_WRITE && mfh->mfh_flags & MFHF_TRACKING_RA) ||
+	    (rw == SL_READ && mfh->mfh_flags & MFHF_TRACKING_WA)) {
+		mfh->mfh_flags ^= MFHF_TRACKING_RA | MFHF_TRACKING_WA;
+		for (i = 0; i < MFH_PREDIO_NSTREAMS; i++)
+			msl_predio_stream_reset(
+			    &mfh->mfh_predio_streams[i], track_ra);
 	}
+	track_ra = rw == SL_READ;
 
 	/*
 	 * If the first read starts from offset 0, the following will
 	 * automatically trigger a read-ahead because as part of the
 	 * msl_fhent structure, the fields are zeroed during allocation.
 	 */
-	if (off == mfh->mfh_predio_lastoff + mfh->mfh_predio_lastsize) {
-		OPSTAT_INCR("msl.predio-sequential");
-		mfh->mfh_predio_nseq++;
-		goto out;
+	for (i = 0, s = mfh->mfh_predio_streams;
+	    i < MFH_PREDIO_NSTREAMS; i++, s++) {
+		if (off == s->mps_lastoff + s->mps_stride)
+			goto match;
+		if (lru == NULL || s->mps_gen < lru->mps_gen)
+			lru = s;
+	}
+
+	for (i = 0, s = mfh->mfh_predio_streams;
+	    i < MFH_PREDIO_NSTREAMS; i++, s++) {
+		if (!s->mps_gen)
+			continue;
+		next = s->mps_lastoff + s->mps_stride;
+		if (off <= next + delta && off >= next - delta) {
+			OPSTAT_INCR("msl.predio-semi-sequential");
+			s->mps_nbytes += size;
+			goto out;
+		}
 	}
-	if (off > mfh->mfh_predio_lastoff + mfh->mfh_predio_lastsize + delta ||
-	    off < mfh->mfh_predio_lastoff + mfh->mfh_predio_lastsize - delta) {
-		OPSTAT_INCR("msl.predio-reset");
-		mfh->mfh_predio_off = 0;
-		mfh->mfh_predio_nseq = 0;
-		goto out;
+
+	/*
+	 * A stream that has seen only one I/O may be the start of a
+	 * strided pattern; adopt the gap as its stride and see if the
+	 * next I/O confirms it.
+	 */
+	for (i = 0, s = mfh->mfh_predio_streams;
+	    i < MFH_PREDIO_NSTREAMS; i++, s++) {
+		if (!s->mps_gen || MPS_STRIDED(s) || s->mps_nseq > 1)
+			continue;
+		if (off >= s->mps_lastoff + s->mps_lastsize + delta &&
+		    off - s->mps_lastoff <= MSL_PREDIO_MAX_STRIDE) {
+			OPSTAT_INCR("msl.predio-stride-detect");
+			next = off - s->mps_lastoff;
+			msl_predio_stream_reset(s, track_ra);
+			s->mps_stride = next;
+			goto out;
+		}
+	}
+
+	OPSTAT_INCR("msl.predio-reset");
+	s = lru;
+	msl_predio_stream_reset(s, track_ra);
+	goto out;
+
+ match:
+	if (s->mps_nseq == 0) {
+		PFL_GETTIMESPEC(&s->mps_start);
+		s->mps_nbytes = 0;
+	}
+	s->mps_nseq++;
+	s->mps_nbytes += size;
+	if (MPS_STRIDED(s))
+		OPSTAT_INCR("msl.predio-strided");
+	else
+		OPSTAT_INCR("msl.predio-sequential");
+
+	/* Did read-ahead already cover this I/O? */
+	if (track_ra && s->mps_nseq > 1) {
+		if (off + (off_t)size <= s->mps_off) {
+			if (MPS_STRIDED(s))
+				OPSTAT_INCR("msl.predio-stride-hit");
+			else
+				OPSTAT_INCR("msl.predio-seq-hit");
+		} else {
+			if (MPS_STRIDED(s))
+				OPSTAT_INCR("msl.predio-stride-miss");
+			else
+				OPSTAT_INCR("msl.predio-seq-miss");
+		}
 	}
-	OPSTAT_INCR("msl.predio-semi-sequential");
 
  out:
-	mfh->mfh_predio_lastoff = off;
-	mfh->mfh_predio_lastsize = size;
+	s->mps_lastoff = off;
+	s->mps_lastsize = size;
+	if (!MPS_STRIDED(s))
+		s->mps_stride = size;
+	s->mps_gen = ++mfh->mfh_predio_gen;
+	mfh->mfh_predio_cur = s - mfh->mfh_predio_streams;
 
 	MFH_ULOCK(mfh);
 }
+
+/*
+ * Size the read-ahead pipe of a stream so it holds what the application
+ * consumes, at the rate observed over the current run, during two READ
+ * RPC round trips.  The window at most doubles per I/O so a burst does
+ * not flood the pipe, and is capped by msl_predio_pipe_size.
+ */
+__static int
+msl_predio_window(struct msl_predio_stream *s, int npages)
+{
+	struct timespec now, d;
+	double usecs, want;
+	int window;
+
+	PFL_GETTIMESPEC(&now);
+	timespecsub(&now, &s->mps_start, &d);
+	usecs = d.tv_sec * 1e6 + d.tv_nsec / 1e3;
+	if (usecs < 1)
+		usecs = 1;
+
+	want = 2. * s->mps_nbytes / usecs *
+	    psc_atomic64_read(&msl_predio_rpc_usecs);
+	if (want > (double)msl_predio_pipe_size * BMPC_BUFSZ)
+		window = msl_predio_pipe_size;
+	else
+		window = want / BMPC_BUFSZ + 1;
+
+	window = MIN(window, MAX(s->mps_window * 2, npages * 2));
+	window = MAX(window, npages);
+	window = MIN(window, msl_predio_pipe_size);
+	s->mps_window = window;
+	return (window);
+}
+
+/*
+ * Enqueue read-ahead of a file-wise range, splitting it at bmap
+ * boundaries.  Returns the offset following the last page enqueued.
+ */
+__static off_t
+msl_predio_enqueue_range(struct fidc_membh *f, enum rw rw, off_t off,
+    int rapages)
+{
+	int bsize, tpages;
+	sl_bmapno_t bno;
+	off_t raoff;
+
+	/* convert to bmap relative */
+	bno = off / SLASH_BMAP_SIZE;
+	raoff = off - bno * SLASH_BMAP_SIZE;
+
+#ifdef MYDEBUG
+	psclog_max("readahead: FID = "SLPRI_FID", bno = %d, offset = %ld, size = %d", 
+	    fcmh_2_fid(f), bno, raoff, rapages);
+#endif
+
+	/* 
+	 * Now issue an I/O for each bmap in the prediction. This loop
+	 * can handle read-ahead into multiple bmaps.
+	 */
+	for (; rapages && bno < fcmh_2_nbmaps(f); rapages -= tpages) {
+
+		bsize = SLASH_BMAP_SIZE;
+		if (bno == fcmh_2_nbmaps(f) - 1) {
+			bsize = fcmh_2_fsz(f) % SLASH_BMAP_SIZE;
+			if (bsize == 0 && fcmh_2_fsz(f))
+				bsize = SLASH_BMAP_SIZE;
+		}
+		tpages = howmany(bsize - raoff, BMPC_BUFSZ);
+		if (tpages <= 0)
+			break;
+#if 0
+		if (tpages > BMPC_MAXBUFSRPC)
+			tpages = BMPC_MAXBUFSRPC;
+#endif
+		if (tpages > rapages)
+			tpages = rapages;
+
+		predio_enqueue(&f->fcmh_fg, bno, rw, raoff, tpages);
+
+		raoff += tpages * BMPC_BUFSZ;
+		if (raoff >= SLASH_BMAP_SIZE) {
+			raoff = 0;
+			bno++;
+		}
+	}
+	return (bno * SLASH_BMAP_SIZE + raoff);
+}
+
 /*
  * Calculate the next predictive I/O for an actual I/O request.
  *
- * The actual I/O must be within a window that was set from the previous
- * I/O.
+ * The actual I/O must belong to a stream established by previous I/Os
+ * (see mfh_track_predictive_io()).  The read-ahead pipe of the stream
+ * is topped up to its window once it has drained to half of it.
  *
  * Predictive I/O may extend beyond the current bmap as I/O reaches
  * close to the bmap boundary, in which case predio activity is split
@@ -1900,14 +2112,16 @@ __static void
 msl_issue_predio(struct msl_fhent *mfh, sl_bmapno_t bno, enum rw rw,
     uint32_t off, int npages)
 {
-	int bsize, tpages, rapages;
+	int window, rapages, recpages, nrec;
+	struct msl_predio_stream *s;
 	struct fidc_membh *f;
-	off_t raoff;
+	off_t raoff, rend, pgoff;
 
 	f = mfh->mfh_fcmh;
 	MFH_LOCK(mfh);
 
-	if (!mfh->mfh_predio_nseq)
+	s = &mfh->mfh_predio_streams[mfh->mfh_predio_cur];
+	if (!s->mps_nseq)
 		PFL_GOTOERR(out, 0);
 
 	if (mfh->mfh_flags & MFHF_TRACKING_WA) {
@@ -1920,64 +2134,66 @@ msl_issue_predio(struct msl_fhent *mfh, sl_bmapno_t bno, enum rw rw,
 		PFL_GOTOERR(out, 0);
 	}
 
+	window = msl_predio_window(s, npages);
+
+	if (MPS_STRIDED(s)) {
+		/*
+		 * Fetch whole records ahead of the stream, skipping the
+		 * gaps between them.
+		 */
+		recpages = howmany(s->mps_lastsize, BMPC_BUFSZ) + 1;
+		nrec = MAX(window / recpages, 1);
+		raoff = s->mps_lastoff + s->mps_stride;
+		if (raoff + nrec / 2 * s->mps_stride < s->mps_off) {
+			OPSTAT_INCR("msl.predio-pipe-hit");
+			PFL_GOTOERR(out, 0);
+		}
+		OPSTAT_INCR("msl.predio-pipe-miss");
+
+		rend = raoff + nrec * s->mps_stride;
+		if (s->mps_off > raoff)
+			raoff = s->mps_off;
+		for (rapages = msl_predio_max_pages; raoff < rend &&
+		    rapages > 0; raoff += s->mps_stride) {
+			pgoff = raoff & ~(off_t)BMPC_BUFMASK;
+			recpages = howmany(raoff + s->mps_lastsize - pgoff,
+			    BMPC_BUFSZ);
+			if (pgoff / SLASH_BMAP_SIZE != (pgoff +
+			    recpages * BMPC_BUFSZ - 1) / SLASH_BMAP_SIZE)
+				recpages = howmany(SLASH_BMAP_SIZE - pgoff %
+				    SLASH_BMAP_SIZE, BMPC_BUFSZ);
+			recpages = MIN(recpages, rapages);
+			if (msl_predio_enqueue_range(f, rw, pgoff,
+			    recpages) == pgoff)
+				break;
+			rapages -= recpages;
+		}
+		s->mps_off = raoff;
+		PFL_GOTOERR(out, 0);
+	}
+
 	raoff = bno * SLASH_BMAP_SIZE + off + npages * BMPC_BUFSZ;
-	if (raoff + msl_predio_pipe_size * BMPC_BUFSZ < mfh->mfh_predio_off) {
+	if (raoff + window / 2 * BMPC_BUFSZ < s->mps_off) {
 		OPSTAT_INCR("msl.predio-pipe-hit");
 		PFL_GOTOERR(out, 0);
 	}
 	OPSTAT_INCR("msl.predio-pipe-miss");
 
+	rend = raoff + window * BMPC_BUFSZ;
+
 	/* Adjust raoff based on our position in the pipe */
-	if (mfh->mfh_predio_off) {
-		if (mfh->mfh_predio_off > raoff) {
+	if (s->mps_off) {
+		if (s->mps_off > raoff) {
 			OPSTAT_INCR("msl.predio-pipe-enlarge");
-			raoff = mfh->mfh_predio_off;
+			raoff = s->mps_off;
 		} else
 			OPSTAT_INCR("msl.predio-pipe-overrun");
 	}
 
-	/* convert to bmap relative */
-	bno = raoff / SLASH_BMAP_SIZE;
-	raoff = raoff - bno * SLASH_BMAP_SIZE;
-	rapages = MIN(MAX(mfh->mfh_predio_nseq*2, npages), msl_predio_max_pages);
-
-#ifdef MYDEBUG
-	psclog_max("readahead: FID = "SLPRI_FID", bno = %d, offset = %ld, size = %d", 
-	    fcmh_2_fid(f), bno, raoff, rapages);
-#endif
-
-	/* 
-	 * Now issue an I/O for each bmap in the prediction. This loop
-	 * can handle read-ahead into multiple bmaps.
-	 */
-	for (; rapages && bno < fcmh_2_nbmaps(f); rapages -= tpages) {
-
-		bsize = SLASH_BMAP_SIZE;
-		if (bno == fcmh_2_nbmaps(f) - 1) {
-			bsize = fcmh_2_fsz(f) % SLASH_BMAP_SIZE;
-			if (bsize == 0 && fcmh_2_fsz(f))
-				bsize = SLASH_BMAP_SIZE;
-		}
-		tpages = howmany(bsize - raoff, BMPC_BUFSZ);
-		if (!tpages)
-			break;
-#if 0
-		if (tpages > BMPC_MAXBUFSRPC)
-			tpages = BMPC_MAXBUFSRPC;
-#endif
-		if (tpages > rapages)
-			tpages = rapages;
-
-		predio_enqueue(&f->fcmh_fg, bno, rw, raoff, tpages);
-
-		raoff += tpages * BMPC_BUFSZ;
-		if (raoff >= SLASH_BMAP_SIZE) {
-			raoff = 0;
-			bno++;
-		}
-	}
+	rapages = howmany(rend - raoff, BMPC_BUFSZ);
+	rapages = MIN(MAX(rapages, npages), msl_predio_max_pages);
 
-	mfh->mfh_predio_off = bno * SLASH_BMAP_SIZE + raoff;
+	s->mps_off = msl_predio_enqueue_range(f, rw, raoff, rapages);
 
  out:
 	MFH_ULOCK(mfh);
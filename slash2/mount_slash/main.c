@@ -67,6 +67,7 @@
 #include "pfl/usklndthr.h"
 #include "pfl/vbitmap.h"
 
+#include "authbuf.h"
 #include "bmap_cli.h"
 #include "cache_params.h"
 #include "creds.h"
@@ -776,6 +777,7 @@ msl_stat(struct fidc_membh *f, void *arg)
 	struct srm_getattr_req *mq;
 	struct srm_getattr_rep *mp;
 	struct fcmh_cli_info *fci;
+	struct sl_resm *resm;
 	struct timeval now;
 	int rc = 0, timeout;
 	int32_t lease = 0;
@@ -828,15 +830,18 @@ msl_stat(struct fidc_membh *f, void *arg)
 			timeout = MSL_STATFS_ROOT_TIMEOUT;
 		}
 
-		MSL_RMC_NEWREQ(f, csvc, SRMT_GETATTR, rq, mq, mp, rc, timeout);
-		if (!rc) {
-			mq->fg = f->fcmh_fg;
-			mq->iosid = msl_pref_ios;
+		do {
+			MSL_RMC_RDREQ(f, resm, csvc, SRMT_GETATTR, rq,
+			    mq, mp, rc, timeout);
+			if (!rc) {
+				mq->fg = f->fcmh_fg;
+				mq->iosid = msl_pref_ios;
 
-			if (timeout)
-				rq->rq_timeout = timeout;
-			rc = SL_RSX_WAITREP(csvc, rq, mp);
-		}
+				if (timeout)
+					rq->rq_timeout = timeout;
+				rc = SL_RSX_WAITREP(csvc, rq, mp);
+			}
+		} while (slc_rmc_replica_retry(resm, rc));
 		if (fcmh_2_fid(f) == SLFID_ROOT) {
 			if (rc)  {
 				OPSTAT_INCR("msl.stat-root-fail");
@@ -1141,11 +1146,12 @@ msl_lookup_rpc(struct pscfs_req *pfr, struct fidc_membh *p,
 	struct fidc_membh *f = NULL;
 	struct srm_lookup_req *mq;
 	struct srm_lookup_rep *mp;
+	struct sl_resm *resm;
 	int rc;
 	int32_t lease = 0;
 
  retry:
-	MSL_RMC_NEWREQ(p, csvc, SRMT_LOOKUP, rq, mq, mp, rc, 0);
+	MSL_RMC_RDREQ(p, resm, csvc, SRMT_LOOKUP, rq, mq, mp, rc, 0);
 	if (!rc) {
 		mq->pfg.fg_fid = pfid;
 		mq->pfg.fg_gen = FGEN_ANY;
@@ -1153,6 +1159,8 @@ msl_lookup_rpc(struct pscfs_req *pfr, struct fidc_membh *p,
 
 		rc = SL_RSX_WAITREP(csvc, rq, mp);
 	}
+	if (slc_rmc_replica_retry(resm, rc))
+		goto retry;
 	if (rc && slc_rpc_should_retry(pfr, &rc))
 		goto retry;
 
@@ -1842,6 +1850,7 @@ msl_readdir_cb(struct pscrpc_request *rq, struct pscrpc_async_args *av)
 	struct dircache_page *p = av->pointer_arg[MSL_READDIR_CBARG_PAGE];
 	struct fidc_membh *d = av->pointer_arg[MSL_READDIR_CBARG_FCMH];
 	void *dentbuf = av->pointer_arg[MSL_READDIR_CBARG_DENTBUF];
+	struct sl_resm *resm = av->pointer_arg[MSL_READDIR_CBARG_RESM];
 	char buf[PSCRPC_NIDSTR_SIZE];
 	int rc, async;
 	size_t len;
@@ -1851,6 +1860,9 @@ msl_readdir_cb(struct pscrpc_request *rq, struct pscrpc_async_args *av)
 
 	if (rc) {
 		DEBUG_REQ(PLL_ERROR, rq, buf, "rc=%d", rc);
+		/* have mslfsop_readdir() reissue it elsewhere */
+		if (slc_rmc_replica_retry(resm, rc))
+			rc = -EAGAIN;
 		PFL_GOTOERR(out, rc);
 	}
 
@@ -1933,6 +1945,7 @@ msl_readdir_issue(struct fidc_membh *d, off_t off, size_t size,
 	struct srm_readdir_rep *mp = NULL;
 	struct pscrpc_request *rq = NULL;
 	struct dircache_page *p;
+	struct sl_resm *resm;
 	struct iovec iov;
 	int rc, nents, wake;
 
@@ -1945,7 +1958,10 @@ msl_readdir_issue(struct fidc_membh *d, off_t off, size_t size,
 	DIRCACHE_ULOCK(d);
 	fcmh_op_start_type(d, FCMH_OPCNT_READDIR);
 
-	MSL_RMC_NEWREQ(d, csvc, SRMT_READDIR, rq, mq, mp, rc, 0);
+	do {
+		MSL_RMC_RDREQ(d, resm, csvc, SRMT_READDIR, rq, mq, mp,
+		    rc, 0);
+	} while (slc_rmc_replica_retry(resm, rc));
 	if (rc)
 		PFL_GOTOERR(out2, rc);
 
@@ -1983,6 +1999,7 @@ msl_readdir_issue(struct fidc_membh *d, off_t off, size_t size,
 	rq->rq_async_args.pointer_arg[MSL_READDIR_CBARG_FCMH] = d;
 	rq->rq_async_args.pointer_arg[MSL_READDIR_CBARG_PAGE] = p;
 	rq->rq_async_args.pointer_arg[MSL_READDIR_CBARG_DENTBUF] = dentbuf;
+	rq->rq_async_args.pointer_arg[MSL_READDIR_CBARG_RESM] = resm;
 	PFLOG_DIRCACHEPG(PLL_DEBUG, p, "issuing");
 	rc = SL_NBRQSET_ADD(csvc, rq);
 	if (!rc)
@@ -2243,6 +2260,7 @@ mslfsop_readlink(struct pscfs_req *pfr, pscfs_inum_t inum)
 	struct srm_readlink_rep *mp;
 	struct fidc_membh *c = NULL;
 	struct pscfs_creds pcr;
+	struct sl_resm *resm;
 	struct iovec iov;
 	int rc;
 
@@ -2256,7 +2274,7 @@ mslfsop_readlink(struct pscfs_req *pfr, pscfs_inum_t inum)
 		PFL_GOTOERR(out, rc);
 
  retry:
-	MSL_RMC_NEWREQ(c, csvc, SRMT_READLINK, rq, mq, mp, rc, 0);
+	MSL_RMC_RDREQ(c, resm, csvc, SRMT_READLINK, rq, mq, mp, rc, 0);
 	if (!rc) {
 
 		mq->fg = c->fcmh_fg;
@@ -2268,6 +2286,8 @@ mslfsop_readlink(struct pscfs_req *pfr, pscfs_inum_t inum)
 		rc = SL_RSX_WAITREPF(csvc, rq, mp,
 		    SRPCWAITF_DEFER_BULK_AUTHBUF_CHECK);
 	}
+	if (slc_rmc_replica_retry(resm, rc))
+		goto retry;
 	if (rc && slc_rpc_should_retry(pfr, &rc))
 		goto retry;
 	rc = abs(rc);
@@ -4442,6 +4462,8 @@ msl_init(void)
 
 	msbmapthr_spawn();
 	msreapthr_spawn(MSTHRT_REAP, "pool reapthr");
+	sl_bulkhashthr_spawn(MSTHRT_BULKHASH, AUTHBUF_BULK_NTHR,
+	    "msbhthr%d");
 	msattrflushthr_spawn();
 	msreadaheadthr_spawn();
 
@@ -4455,6 +4477,18 @@ msl_init(void)
 	if (rc)
 		psc_fatalx("invalid MDS %s: %s", name, strerror(rc));
 
+	name = getenv("MDS_REPLICAS");
+	if (name) {
+		rc = slc_rmc_setreplicas(name);
+		if (rc)
+			psc_fatalx("invalid MDS_REPLICAS %s: %s", name,
+			    strerror(rc));
+	}
+
+	name = getenv("MDS_REPLICA_POLICY");
+	if (name && slc_rmc_setrdpolicy(name))
+		psc_fatalx("invalid MDS_REPLICA_POLICY %s", name);
+
 	name = getenv("PREF_IOS");
 	if (name) {
 
@@ -4530,7 +4564,9 @@ msl_opt_lookup(const char *opt)
 		{ "acl",		LOOKUP_TYPE_BOOL,	&msl_acl },
 		{ "ctlsock",		LOOKUP_TYPE_STR,	&msl_ctlsockfn },
 		{ "datadir",		LOOKUP_TYPE_STR,	&sl_datadir },
+		{ "fuse_mq",		LOOKUP_TYPE_BOOL,	&pscfs_fuse_mq },
 		{ "mapfile",		LOOKUP_TYPE_BOOL,	&msl_has_mapfile },
+		{ "pagecache_hugetlb",	LOOKUP_TYPE_BOOL,	&msl_pgcache_hugetlb },
 		{ "pagecache_maxsize",	LOOKUP_TYPE_UINT64,	&msl_pagecache_maxsize },
 		{ "predio_issue_maxpages",
 					LOOKUP_TYPE_INT,	&msl_predio_max_pages},
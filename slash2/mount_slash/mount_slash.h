@@ -52,6 +52,7 @@ enum {
 	MSTHRT_BENCH,			/* I/O benchmarking thread */
 	MSTHRT_BRELEASE,		/* bmap lease releaser */
 	MSTHRT_BWATCH,			/* bmap lease watcher */
+	MSTHRT_BULKHASH,		/* bulk payload hash helper */
 	MSTHRT_CTL,			/* control processor */
 	MSTHRT_CTLAC,			/* control acceptor */
 	MSTHRT_REAP,			/* pool reap thread */
@@ -146,6 +147,28 @@ struct slc_wkdata_readdir {
 	size_t				 size;
 };
 
+/*
+ * Access stream detected on a file handle for predictive I/O.  A stream
+ * is either sequential (mps_stride == mps_lastsize) or a constant
+ * stride, with each I/O mps_stride bytes past the previous one.
+ * Offsets are file-wise.
+ */
+struct msl_predio_stream {
+	off_t				 mps_lastoff;	/* last I/O offset */
+	off_t				 mps_lastsize;	/* last I/O size */
+	off_t				 mps_stride;	/* distance between I/Os */
+	off_t				 mps_off;	/* next predio I/O offset */
+	off_t				 mps_nbytes;	/* bytes consumed this run */
+	struct timespec			 mps_start;	/* start of this run */
+	uint64_t			 mps_gen;	/* last use, for LRU */
+	int				 mps_nseq;	/* num I/Os matching stride */
+	int				 mps_window;	/* pipe depth in pages */
+};
+
+#define MFH_PREDIO_NSTREAMS		4
+
+#define MPS_STRIDED(s)			((s)->mps_stride > (s)->mps_lastsize)
+
 /* file handle in struct fuse_file_info */
 struct msl_fhent {
 	psc_spinlock_t			 mfh_lock;
@@ -162,11 +185,10 @@ struct msl_fhent {
 
 	int				 mfh_oflags;	/* open(2) flags */
 
-	/* offsets are file-wise */
-	off_t				 mfh_predio_lastoff;	/* last I/O offset */
-	off_t				 mfh_predio_lastsize;	/* last I/O size */
-	off_t				 mfh_predio_off;	/* next predio I/O offset */
-	int				 mfh_predio_nseq;	/* num sequential IOs */
+	/* predictive I/O streams, see mfh_track_predictive_io() */
+	struct msl_predio_stream	 mfh_predio_streams[MFH_PREDIO_NSTREAMS];
+	int				 mfh_predio_cur;	/* stream of last I/O */
+	uint64_t			 mfh_predio_gen;	/* LRU clock */
 
 	/* stats */
 	struct timespec			 mfh_open_time;	/* clock_gettime(2) at open(2) time */
@@ -406,6 +428,7 @@ extern int			 msl_mds_max_inflight_rpcs;
 extern int			 msl_max_nretries;
 
 extern int			 msl_predio_max_pages;
+extern psc_atomic64_t		 msl_predio_rpc_usecs;
 extern int			 msl_predio_pipe_size;
 
 extern int			 msl_max_retries;
@@ -414,6 +437,7 @@ extern int			 msl_read_only;
 extern int			 msl_repl_enable;
 extern int			 msl_statfs_pref_ios_only;
 extern uint64_t			 msl_pagecache_maxsize;
+extern int			 msl_pgcache_hugetlb;
 extern int			 msl_max_namecache_per_directory; 
 extern int			 msl_attributes_timeout;
 
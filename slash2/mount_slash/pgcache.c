@@ -31,6 +31,11 @@
 #define PSC_SUBSYS SLSS_BMAP
 #include "slsubsys.h"
 
+#include <sys/mman.h>
+
+#ifdef __linux
+#include <sched.h>
+#endif
 #include <time.h>
 
 #include "pfl/atomic.h"
@@ -61,97 +66,307 @@ RB_GENERATE(bmap_pagecachetree, bmap_pagecache_entry, bmpce_tentry,
     bmpce_cmp)
 RB_GENERATE(bmpc_biorq_tree, bmpc_ioreq, biorq_tentry, bmpc_biorq_cmp)
 
-struct psc_listcache	 free_page_buffers;
+/*
+ * Free page buffers, one list per CPU (modulo MSL_PGCACHE_NFREEL).
+ * Each chunk belongs to one list and its pages always return there, to
+ * the head, so the pages reused first are those of chunks still in use
+ * and idle chunks get a chance to become entirely free.  A chunk counts
+ * how many of its pages are free; that count only changes with its
+ * list locked, so holding that lock is enough to unmap a free chunk.
+ */
+struct psc_listcache	 msl_pgcache_freel[MSL_PGCACHE_NFREEL];
+
+/* all chunks; its lock also serializes growth */
+struct psc_lockedlist	 msl_pgchunks = PLL_INIT(&msl_pgchunks,
+    struct msl_pgchunk, pgc_lentry);
+
+psc_spinlock_t		 msl_pgcache_waitlock = SPINLOCK_INIT;
+struct psc_waitq	 msl_pgcache_waitq = PSC_WAITQ_INIT("pgcache");
 
 int			 page_buffer_total;
+int			 msl_pgcache_hugetlb;
 
 struct psc_listcache	 bmpcLru;
 
 int			 msl_bmpce_gen;
 
-void
-msl_pgcache_init(void)
+__static int
+msl_pgcache_freel_idx(void)
+{
+#ifdef __linux
+	int cpu;
+
+	cpu = sched_getcpu();
+	if (cpu >= 0)
+		return (cpu % MSL_PGCACHE_NFREEL);
+#endif
+	return (pscthr_gettid() % MSL_PGCACHE_NFREEL);
+}
+
+/*
+ * Map a 2MiB aligned region, preferably backed by huge pages.
+ */
+__static void *
+msl_pgchunk_map(int *flags)
 {
+	char *p, *base;
+	size_t head;
+
+#ifdef MAP_HUGETLB
+	if (msl_pgcache_hugetlb) {
+		p = mmap(NULL, MSL_PGCHUNK_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			*flags |= PGCF_HUGETLB;
+			return (p);
+		}
+		OPSTAT_INCR("msl.pgchunk-hugetlb-err");
+	}
+#endif
+
+	/*
+	 * Over-map and trim so the chunk is aligned, which lets
+	 * transparent huge pages back it.
+	 */
+	p = mmap(NULL, 2 * MSL_PGCHUNK_SIZE, PROT_READ | PROT_WRITE,
+	    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (p == MAP_FAILED)
+		return (NULL);
+	base = (char *)(((uintptr_t)p + MSL_PGCHUNK_SIZE - 1) &
+	    ~(uintptr_t)(MSL_PGCHUNK_SIZE - 1));
+	head = base - p;
+	if (head)
+		munmap(p, head);
+	munmap(base + MSL_PGCHUNK_SIZE, MSL_PGCHUNK_SIZE - head);
+#ifdef MADV_HUGEPAGE
+	madvise(base, MSL_PGCHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+	return (base);
+}
+
+/*
+ * Add a new chunk and put its pages on the given free list.  If @entryp
+ * is given, the first page is handed back to the caller instead.  The
+ * caller must have already accounted for the chunk in
+ * page_buffer_total; this is undone on failure.
+ */
+__static struct msl_pgchunk *
+msl_pgchunk_alloc(int flags, int idx, struct bmap_page_entry **entryp)
+{
+	struct bmap_page_entry *entry;
+	struct psc_listcache *lc;
+	struct msl_pgchunk *c;
 	int i;
+
+	c = TRY_PSCALLOC(sizeof(*c));
+	if (c) {
+		c->pgc_base = msl_pgchunk_map(&flags);
+		if (c->pgc_base == NULL) {
+			PSCFREE(c);
+			c = NULL;
+		}
+	}
+	if (c == NULL) {
+		PLL_LOCK(&msl_pgchunks);
+		page_buffer_total -= MSL_PGCHUNK_NPAGES;
+		PLL_ULOCK(&msl_pgchunks);
+		return (NULL);
+	}
+	c->pgc_flags = flags;
+	c->pgc_freel = idx;
+	INIT_PSC_LISTENTRY(&c->pgc_lentry);
+	for (i = 0, entry = c->pgc_pages; i < MSL_PGCHUNK_NPAGES;
+	    i++, entry++) {
+		entry->page_chunk = c;
+		entry->page_buf = (char *)c->pgc_base + i * BMPC_BUFSZ;
+		INIT_PSC_LISTENTRY(&entry->page_lentry);
+	}
+	pll_add(&msl_pgchunks, c);
+
+	/*
+	 * The chunk cannot look entirely free to msl_pgcache_trim()
+	 * until every page has made it onto the list.
+	 */
+	lc = &msl_pgcache_freel[idx];
+	LIST_CACHE_LOCK(lc);
+	for (i = 0, entry = c->pgc_pages; i < MSL_PGCHUNK_NPAGES;
+	    i++, entry++) {
+		if (entryp && i == 0) {
+			*entryp = entry;
+			continue;
+		}
+		lc_add(lc, entry);
+		psc_atomic32_inc(&c->pgc_nfree);
+	}
+	LIST_CACHE_ULOCK(lc);
+	return (c);
+}
+
+/*
+ * Unmap a chunk whose pages are all free.  The lock of its free list
+ * must be held.
+ */
+__static void
+msl_pgchunk_free(struct msl_pgchunk *c)
+{
 	struct bmap_page_entry *entry;
+	int i, rc;
 
-	lc_reginit(&free_page_buffers, struct bmap_page_entry,
-	    page_lentry, "pagebuffers");
+	PLL_LOCK_ENSURE(&msl_pgchunks);
+
+	for (i = 0, entry = c->pgc_pages; i < MSL_PGCHUNK_NPAGES;
+	    i++, entry++)
+		lc_remove(&msl_pgcache_freel[c->pgc_freel], entry);
+	pll_remove(&msl_pgchunks, c);
+	rc = munmap(c->pgc_base, MSL_PGCHUNK_SIZE);
+	if (!rc)
+		OPSTAT_INCR("msl.pgchunk-munmap");
+	else
+		OPSTAT_INCR("msl.pgchunk-munmap-err");
+	PSCFREE(c);
+	page_buffer_total -= MSL_PGCHUNK_NPAGES;
+}
+
+/*
+ * Called from the reaper: unmap entirely free chunks grown on demand
+ * and drop the backing memory of the rest.
+ */
+__static int
+msl_pgcache_trim(void)
+{
+	struct msl_pgchunk *c, *tmp;
+	int i, rc, didwork = 0;
+
+	for (i = 0; i < MSL_PGCACHE_NFREEL; i++)
+		LIST_CACHE_LOCK(&msl_pgcache_freel[i]);
+	PLL_LOCK(&msl_pgchunks);
+	PLL_FOREACH_SAFE(c, tmp, &msl_pgchunks) {
+		if (psc_atomic32_read(&c->pgc_nfree) !=
+		    MSL_PGCHUNK_NPAGES)
+			continue;
+		if (c->pgc_flags & PGCF_CANFREE) {
+			msl_pgchunk_free(c);
+			didwork = 1;
+			continue;
+		}
+		if (!c->pgc_dirty)
+			continue;
+		rc = madvise(c->pgc_base, MSL_PGCHUNK_SIZE,
+		    MADV_DONTNEED);
+		if (!rc)
+			OPSTAT_INCR("madvise-success-reap");
+		else
+			OPSTAT_INCR("madvise-failure-reap");
+		c->pgc_dirty = 0;
+		didwork = 1;
+	}
+	PLL_ULOCK(&msl_pgchunks);
+	for (i = MSL_PGCACHE_NFREEL - 1; i >= 0; i--)
+		LIST_CACHE_ULOCK(&msl_pgcache_freel[i]);
+	return (didwork);
+}
+
+void
+msl_pgcache_init(void)
+{
+	int i, n;
+
+	for (i = 0; i < MSL_PGCACHE_NFREEL; i++)
+		lc_reginit(&msl_pgcache_freel[i], struct bmap_page_entry,
+		    page_lentry, "pagebuffers%d", i);
 
 	/*
  	 * Note that ppm_max can change after we start.
  	 */
-	entry = PSCALLOC(sizeof(struct bmap_page_entry) * bmpce_pool->ppm_max); 
-	for (i = 0; i < bmpce_pool->ppm_max; i++) {
-		psc_assert(entry);
-		entry->page_flag = 0;
-		page_buffer_total++;
-		entry->page_buf = mmap(NULL, BMPC_BUFSZ, PROT_READ|PROT_WRITE, 
-		    MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+	n = (bmpce_pool->ppm_max + MSL_PGCHUNK_NPAGES - 1) /
+	    MSL_PGCHUNK_NPAGES;
+	for (i = 0; i < n; i++) {
+		page_buffer_total += MSL_PGCHUNK_NPAGES;
+		if (msl_pgchunk_alloc(0, i % MSL_PGCACHE_NFREEL,
+		    NULL) == NULL)
+			psc_fatal("unable to map page cache");
+	}
+}
 
-		if (entry->page_buf == MAP_FAILED)
-			psc_fatalx("Please raise vm.max_map_count limit");
+__static struct bmap_page_entry *
+msl_pgcache_tryget(int idx)
+{
+	struct bmap_page_entry *entry;
+	struct psc_listcache *lc;
+	int i;
 
-		INIT_PSC_LISTENTRY(&entry->page_lentry);
-		lc_add(&free_page_buffers, entry);
-		entry++;
+	for (i = 0; i < MSL_PGCACHE_NFREEL; i++) {
+		lc = &msl_pgcache_freel[(idx + i) % MSL_PGCACHE_NFREEL];
+		LIST_CACHE_LOCK(lc);
+		entry = lc_getnb(lc);
+		if (entry)
+			psc_atomic32_dec(&entry->page_chunk->pgc_nfree);
+		LIST_CACHE_ULOCK(lc);
+		if (entry) {
+			if (i)
+				OPSTAT_INCR("msl.pgcache-steal");
+			return (entry);
+		}
 	}
+	return (NULL);
 }
 
 struct bmap_page_entry *
 msl_pgcache_get(int wait)
 {
-	struct timespec ts;
 	struct bmap_page_entry *entry;
-	static int warned = 0, failed = 0;
+	static int warned = 0;
+	int idx, grow;
 
-	entry = lc_getnb(&free_page_buffers);
+	idx = msl_pgcache_freel_idx();
+	entry = msl_pgcache_tryget(idx);
 	if (entry)
 		goto out;
  again:
 
-	LIST_CACHE_LOCK(&free_page_buffers);
+	grow = 0;
+	PLL_LOCK(&msl_pgchunks);
 	if (page_buffer_total < bmpce_pool->ppm_max) {
-		entry = PSCALLOC(sizeof(struct bmap_page_entry)); 
-		entry->page_buf = mmap(NULL, BMPC_BUFSZ, PROT_READ|PROT_WRITE, 
-		    MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
-		if (entry->page_buf != MAP_FAILED) {
+		page_buffer_total += MSL_PGCHUNK_NPAGES;
+		grow = 1;
+	}
+	PLL_ULOCK(&msl_pgchunks);
+	if (grow) {
+		if (msl_pgchunk_alloc(PGCF_CANFREE, idx, &entry)) {
 			warned = 0;
-			page_buffer_total++;
 			OPSTAT_INCR("mmap-grow-ok");
-			INIT_PSC_LISTENTRY(&entry->page_lentry);
-			LIST_CACHE_ULOCK(&free_page_buffers);
-			entry->page_flag = PAGE_CANFREE;
-			return (entry);
+			goto out;
 		}
-		failed = 1;
-		PSCFREE(entry); 
 		OPSTAT_INCR("mmap-grow-err");
-	}
-	LIST_CACHE_ULOCK(&free_page_buffers);
-
-	if (failed && warned < 5) {
-		warned++;
-		psclog_warnx("Please raise vm.max_map_count for performance");
+		if (warned < 5) {
+			warned++;
+			psclog_warn("unable to grow page cache");
+		}
 	}
 
 	if (wait) {
 		/*
 		 * Use timed wait in case the limit is bumped by sys admin.
 		 */
-		ts.tv_nsec = 0;
-		ts.tv_sec = time(NULL) + 30;
-		entry = lc_gettimed(&free_page_buffers, &ts);
+		spinlock(&msl_pgcache_waitlock);
+		entry = msl_pgcache_tryget(idx);
+		if (entry) {
+			freelock(&msl_pgcache_waitlock);
+			goto out;
+		}
+		psc_waitq_waitrel_s(&msl_pgcache_waitq,
+		    &msl_pgcache_waitlock, 30);
+		entry = msl_pgcache_tryget(idx);
 		if (!entry) {
 			OPSTAT_INCR("pagecache-get-retry");
 			goto again;
 		}
 	} else
-		entry = lc_getnb(&free_page_buffers);
+		entry = msl_pgcache_tryget(idx);
 
  out:
 	if (entry)
-		entry->page_flag |= PAGE_MADVISE;
+		entry->page_chunk->pgc_dirty = 1;
 
 	return (entry);
 }
@@ -159,36 +374,38 @@ msl_pgcache_get(int wait)
 void
 msl_pgcache_put(struct bmap_page_entry *entry)
 {
-	int rc;
+	struct msl_pgchunk *c = entry->page_chunk;
+	struct psc_listcache *lc;
+
+	lc = &msl_pgcache_freel[c->pgc_freel];
+	LIST_CACHE_LOCK(lc);
+	lc_addstack(lc, entry);
+
 	/*
- 	 * Do not assume that the max value has not changed.
- 	 */
-	LIST_CACHE_LOCK(&free_page_buffers);
-	if (page_buffer_total <= bmpce_pool->ppm_max) {
-		if (entry->page_flag & PAGE_CANFREE)
-			lc_addhead(&free_page_buffers, entry);
-		else
-			lc_addtail(&free_page_buffers, entry);
-	} else {
-		if (entry->page_flag & PAGE_CANFREE) {
-			rc = munmap(entry->page_buf, BMPC_BUFSZ);
-			if (!rc)
-				OPSTAT_INCR("munmap-success");
-			else
-				OPSTAT_INCR("munmap-failure");
-			PSCFREE(entry);
-			page_buffer_total--;
-		} else
-			lc_add(&free_page_buffers, entry);
+	 * Give back a chunk grown on demand as soon as it is entirely
+	 * free while we are above the maximum.  Do not assume that the
+	 * max value has not changed.
+	 */
+	if (psc_atomic32_inc_getnew(&c->pgc_nfree) ==
+	    MSL_PGCHUNK_NPAGES && (c->pgc_flags & PGCF_CANFREE)) {
+		PLL_LOCK(&msl_pgchunks);
+		if (page_buffer_total > bmpce_pool->ppm_max)
+			msl_pgchunk_free(c);
+		PLL_ULOCK(&msl_pgchunks);
+	}
+	LIST_CACHE_ULOCK(lc);
+
+	if (psc_waitq_nwaiters(&msl_pgcache_waitq)) {
+		spinlock(&msl_pgcache_waitlock);
+		psc_waitq_wakeall(&msl_pgcache_waitq);
+		freelock(&msl_pgcache_waitlock);
 	}
-	LIST_CACHE_ULOCK(&free_page_buffers);
 }
 
 int
 msl_pgcache_reap(void)
 {
-	struct bmap_page_entry *entry, *tmp;
-	int rc, nfree, didwork = 0;
+	int nfree, didwork = 0;
 
 	/* (gdb) p bmpce_pool.ppm_u.ppmu_explist.pexl_pll.pll_nitems */
 	nfree = bmpce_pool->ppm_nfree; 
@@ -199,32 +416,7 @@ msl_pgcache_reap(void)
 	/* I tried the other way, but RSS wouldn't go down as much */
 	if (bmpce_pool->ppm_nfree != bmpce_pool->ppm_total)
 		return (didwork);
-	/*
- 	 * Do not assume that the max value has not changed.
- 	 */
-	LIST_CACHE_LOCK(&free_page_buffers);
-	LIST_CACHE_FOREACH_SAFE(entry, tmp, &free_page_buffers) {
-		if (entry->page_flag & PAGE_CANFREE) {
-			lc_remove(&free_page_buffers, entry);
-			rc = munmap(entry->page_buf, BMPC_BUFSZ);
-			if (!rc)
-				OPSTAT_INCR("munmap-success-reap");
-			else
-				OPSTAT_INCR("munmap-failure-reap");
-			PSCFREE(entry);
-			page_buffer_total--;
-			continue;
-		}
-		if (!(entry->page_flag & PAGE_MADVISE))
-			continue;
-		rc = madvise(entry->page_buf, BMPC_BUFSZ, MADV_DONTNEED);
-		if (!rc)
-			OPSTAT_INCR("madvise-success-reap");
-		else
-			OPSTAT_INCR("madvise-failure-reap");
-		entry->page_flag &= ~PAGE_MADVISE;
-	}
-	LIST_CACHE_ULOCK(&free_page_buffers);
+	msl_pgcache_trim();
 	return (1);
 }
 
@@ -739,6 +931,7 @@ dump_bmpce_flags(uint32_t flags)
 	PFL_PRFLAG(BMPCEF_READAHEAD, &flags, &seq);
 	PFL_PRFLAG(BMPCEF_ACCESSED, &flags, &seq);
 	PFL_PRFLAG(BMPCEF_IDLE, &flags, &seq);
+	PFL_PRFLAG(BMPCEF_CRC, &flags, &seq);
 	if (flags)
 		printf(" unknown: %#x", flags);
 	printf("\n");
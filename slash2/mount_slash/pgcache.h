@@ -65,6 +65,7 @@ struct bmap_pagecache_entry {
 	uint16_t		 bmpce_len;
 	uint32_t		 bmpce_off;	/* relative to inside bmap */
 	uint32_t		 bmpce_start;	/* region where data are valid */
+	uint32_t		 bmpce_crc;	/* page CRC32, see BMPCEF_CRC */
 	 int16_t		 bmpce_pins;	/* page contents are read-only */
 	psc_spinlock_t		 bmpce_lock;
 	struct bmap_page_entry	*bmpce_entry;	/* statically allocated pg contents */
@@ -74,15 +75,42 @@ struct bmap_pagecache_entry {
 	struct psc_listentry	 bmpce_lentry;	/* chain on bmap LRU */
 };
 
-#define	PAGE_CANFREE		0x01
-#define	PAGE_MADVISE		0x02
+/*
+ * Page buffers are carved out of 2MiB chunks so the cache costs one VMA
+ * (and, with THP or hugetlb, one TLB entry) per 64 pages instead of one
+ * per page.  Memory is given back to the OS a whole chunk at a time.
+ */
+#define MSL_PGCHUNK_SIZE	(2 * 1024 * 1024)
+#define MSL_PGCHUNK_NPAGES	(MSL_PGCHUNK_SIZE / BMPC_BUFSZ)
+
+/*
+ * Number of free lists.  Pages are handed out from the current CPU's
+ * list first and always go back to the list of their own chunk.
+ */
+#define MSL_PGCACHE_NFREEL	16
+
+struct msl_pgchunk;
 
 struct bmap_page_entry {
 	struct psc_listentry	 page_lentry;
-	int			 page_flag;
+	struct msl_pgchunk	*page_chunk;
 	void			*page_buf;
 };
 
+struct msl_pgchunk {
+	struct psc_listentry	 pgc_lentry;
+	void			*pgc_base;
+	int			 pgc_flags;
+	int			 pgc_freel;	/* free list of our pages */
+	int			 pgc_dirty;	/* touched since last reap */
+	psc_atomic32_t		 pgc_nfree;	/* pages on free lists */
+	struct bmap_page_entry	 pgc_pages[MSL_PGCHUNK_NPAGES];
+};
+
+/* pgc_flags */
+#define PGCF_CANFREE		(1 << 0)	/* grown past init, may be unmapped */
+#define PGCF_HUGETLB		(1 << 1)	/* backed by MAP_HUGETLB */
+
 /* bmpce_flags */
 #define BMPCEF_DATARDY		(1 <<  0)	/* data loaded in memory */
 #define BMPCEF_FAULTING		(1 <<  1)	/* loading via RPC */
@@ -94,6 +122,7 @@ struct bmap_page_entry {
 #define BMPCEF_READAHEAD	(1 <<  7)	/* populated from readahead */
 #define BMPCEF_ACCESSED		(1 <<  8)	/* bmpce was used before reap (readahead) */
 #define BMPCEF_IDLE		(1 <<  9)	/* on idle_pages listcache */
+#define BMPCEF_CRC		(1 << 10)	/* bmpce_crc matches page contents */
 
 #define BMPCE_LOCK(e)		spinlock(&(e)->bmpce_lock)
 #define BMPCE_ULOCK(e)		freelock(&(e)->bmpce_lock)
@@ -126,7 +155,7 @@ struct bmap_page_entry {
 #define DEBUG_BMPCE(level, pg, fmt, ...)				\
 	psclogs((level), SLSS_BMAP,					\
 	    "bmpce@%p fcmh=%p fid="SLPRI_FID" "				\
-	    "fl=%#x:%s%s%s%s%s%s%s%s%s "				\
+	    "fl=%#x:%s%s%s%s%s%s%s%s%s%s "				\
 	    "off=%#09x entry=%p ref=%u : " fmt,				\
 	    (pg), (pg)->bmpce_bmap->bcm_fcmh,				\
 	    fcmh_2_fid((pg)->bmpce_bmap->bcm_fcmh), (pg)->bmpce_flags,	\
@@ -139,6 +168,7 @@ struct bmap_page_entry {
 	    (pg)->bmpce_flags & BMPCEF_READAHEAD	? "r" : "",	\
 	    (pg)->bmpce_flags & BMPCEF_ACCESSED		? "a" : "",	\
 	    (pg)->bmpce_flags & BMPCEF_IDLE		? "i" : "",	\
+	    (pg)->bmpce_flags & BMPCEF_CRC		? "c" : "",	\
 	    (pg)->bmpce_off, (pg)->bmpce_entry,				\
 	    (pg)->bmpce_ref, ## __VA_ARGS__)
 
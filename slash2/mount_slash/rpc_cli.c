@@ -19,6 +19,10 @@
  * %END_LICENSE%
  */
 
+#include <string.h>
+#include <time.h>
+
+#include "pfl/atomic.h"
 #include "pfl/cdefs.h"
 #include "pfl/fs.h"
 #include "pfl/fsmod.h"
@@ -29,6 +33,7 @@
 #include "pfl/str.h"
 
 #include "ctl_cli.h"
+#include "fidc_cli.h"
 #include "mount_slash.h"
 #include "rpc_cli.h"
 #include "slashrpc.h"
@@ -44,6 +49,12 @@ struct sl_resm			*msl_rmc_resm;
 struct pscrpc_svc_handle	*msl_rci_svh;
 struct pscrpc_svc_handle	*msl_rcm_svh;
 
+/* MDS read replicas of msl_rmc_resm */
+struct msl_mds_replica		 msl_rmc_replicas[MSL_MAX_MDS_REPLICAS];
+int				 msl_rmc_nreplicas;
+int				 msl_rmc_rdpolicy = MSL_RDPOL_PRIMARY;
+psc_atomic32_t			 msl_rmc_rdnext;
+
 void
 msl_resm_throttle_wake(struct sl_resm *m, int rc)
 {
@@ -288,20 +299,27 @@ slc_rpc_initsvc(void)
  * This function is called once at mount time.  If the MDS changes, we
  * have to remount.
  */
-int
-slc_rmc_setmds(const char *name)
+__static struct sl_resm *
+slc_str2mdsresm(const char *name)
 {
 	struct sl_resource *res;
 	lnet_nid_t nid;
 
 	nid = libcfs_str2nid(name);
-	if (nid == LNET_NID_ANY) {
-		res = libsl_str2res(name);
-		if (res == NULL)
-			return (SLERR_RES_UNKNOWN);
-		msl_rmc_resm = psc_dynarray_getpos(&res->res_members, 0);
-	} else
-		msl_rmc_resm = libsl_nid2resm(nid);
+	if (nid != LNET_NID_ANY)
+		return (libsl_nid2resm(nid));
+	res = libsl_str2res(name);
+	if (res == NULL)
+		return (NULL);
+	return (psc_dynarray_getpos(&res->res_members, 0));
+}
+
+int
+slc_rmc_setmds(const char *name)
+{
+	msl_rmc_resm = slc_str2mdsresm(name);
+	if (msl_rmc_resm == NULL)
+		return (SLERR_RES_UNKNOWN);
 
 	slc_getmcsvc_nb(msl_rmc_resm, 0);
 	slconnthr_watch(slcconnthr, msl_rmc_resm->resm_csvc, 0, NULL, NULL);
@@ -309,6 +327,138 @@ slc_rmc_setmds(const char *name)
 	return (0);
 }
 
+/*
+ * Register the MDS read replicas of our MDS from a comma-separated
+ * list of resource names or NIDs.  Like slc_rmc_setmds(), this is
+ * only done at mount time.
+ */
+int
+slc_rmc_setreplicas(const char *list)
+{
+	char *buf, *name, *next;
+	struct sl_resm *resm;
+	int rc = 0;
+
+	buf = pfl_strdup(list);
+	for (name = buf; name; name = next) {
+		next = strchr(name, ',');
+		if (next)
+			*next++ = '\0';
+		if (*name == '\0')
+			continue;
+		resm = slc_str2mdsresm(name);
+		if (resm == NULL || resm->resm_type != SLREST_MDS ||
+		    resm == msl_rmc_resm) {
+			psclog_warnx("MDS replica %s: %s", name,
+			    sl_strerror(SLERR_RES_BADTYPE));
+			PFL_GOTOERR(out, rc = SLERR_RES_BADTYPE);
+		}
+		if (msl_rmc_nreplicas == MSL_MAX_MDS_REPLICAS)
+			PFL_GOTOERR(out, rc = E2BIG);
+		msl_rmc_replicas[msl_rmc_nreplicas++].mmr_resm = resm;
+
+		slc_getmcsvc_nb(resm, 0);
+		slconnthr_watch(slcconnthr, resm->resm_csvc, 0, NULL,
+		    NULL);
+	}
+	if (msl_rmc_nreplicas && msl_rmc_rdpolicy == MSL_RDPOL_PRIMARY)
+		msl_rmc_rdpolicy = MSL_RDPOL_RR;
+
+ out:
+	PSCFREE(buf);
+	return (rc);
+}
+
+int
+slc_rmc_setrdpolicy(const char *val)
+{
+	if (strcmp(val, "primary") == 0)
+		msl_rmc_rdpolicy = MSL_RDPOL_PRIMARY;
+	else if (strcmp(val, "rr") == 0)
+		msl_rmc_rdpolicy = MSL_RDPOL_RR;
+	else if (strcmp(val, "fid") == 0)
+		msl_rmc_rdpolicy = MSL_RDPOL_FID;
+	else
+		return (EINVAL);
+	return (0);
+}
+
+/*
+ * Pick the MDS to send a read-only namespace request about @f (or
+ * the root when NULL) to.  Files homed at another site always go to
+ * their own MDS.  Replicas that recently refused or failed a request
+ * are passed over, and we fall back to the primary if none is left.
+ */
+struct sl_resm *
+slc_rmc_rdresm(struct fidc_membh *f)
+{
+	struct msl_mds_replica *mmr;
+	struct sl_resm *resm;
+	uint32_t start;
+	time_t now;
+	int i, n;
+
+	resm = f ? fcmh_2_fci(f)->fci_resm : msl_rmc_resm;
+	n = msl_rmc_nreplicas;
+	if (resm != msl_rmc_resm || n == 0)
+		return (resm);
+
+	switch (msl_rmc_rdpolicy) {
+	case MSL_RDPOL_FID:
+		if (f) {
+			start = fcmh_2_fid(f) % n;
+			break;
+		}
+		/* FALLTHROUGH */
+	case MSL_RDPOL_RR:
+		start = psc_atomic32_inc_getnew(&msl_rmc_rdnext);
+		break;
+	default:
+		return (resm);
+	}
+
+	now = time(NULL);
+	for (i = 0; i < n; i++) {
+		mmr = &msl_rmc_replicas[(start + i) % n];
+		if (mmr->mmr_skip_until <= now) {
+			OPSTAT_INCR("msl.replica-read");
+			return (mmr->mmr_resm);
+		}
+	}
+	OPSTAT_INCR("msl.replica-none");
+	return (resm);
+}
+
+/*
+ * Called when a read-only namespace request sent to @resm failed at
+ * the RPC level with @rc.  If @resm is a read replica, stop using it
+ * for a while and return 1 so the caller reissues the request, which
+ * then goes to another replica or to the primary.
+ */
+int
+slc_rmc_replica_retry(struct sl_resm *resm, int rc)
+{
+	struct msl_mds_replica *mmr;
+	int i;
+
+	if (rc == 0 || resm == msl_rmc_resm)
+		return (0);
+	for (i = 0, mmr = msl_rmc_replicas; i < msl_rmc_nreplicas;
+	    i++, mmr++)
+		if (mmr->mmr_resm == resm) {
+			psclog_diag("MDS replica %s failed: rc=%d",
+			    resm->resm_name, rc);
+			if (abs(rc) == SLERR_MDS_STALE)
+				OPSTAT_INCR("msl.replica-stale");
+			else
+				OPSTAT_INCR("msl.replica-fail");
+			mmr->mmr_skip_until = time(NULL) +
+			    MSL_MDS_REPLICA_BACKOFF;
+			return (1);
+		}
+	return (0);
+}
+
 /*
  * Determine if process doesn't want to wait or if maximum allowed
  * timeout has been reached for RPC communication.
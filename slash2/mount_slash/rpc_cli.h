@@ -45,6 +45,7 @@ struct slrpc_cservice;
 #define MSL_READDIR_CBARG_FCMH		1
 #define MSL_READDIR_CBARG_PAGE		2
 #define MSL_READDIR_CBARG_DENTBUF	3
+#define MSL_READDIR_CBARG_RESM		4
 
 /* RPC channel for CLI from MDS. */
 #define SRCM_NTHREADS			8
@@ -63,6 +64,21 @@ struct slrpc_cservice;
 #define RESM_MAX_IOS_OUTSTANDING_RPCS	480
 #define RESM_MAX_MDS_OUTSTANDING_RPCS	2048
 
+/* routing of read-only namespace RPCs to MDS read replicas */
+#define MSL_MAX_MDS_REPLICAS		8
+#define MSL_MDS_REPLICA_BACKOFF		10		/* secs to avoid a replica after it fails */
+
+enum {
+	MSL_RDPOL_PRIMARY,				/* always ask the primary */
+	MSL_RDPOL_RR,					/* rotate among replicas */
+	MSL_RDPOL_FID					/* pick replica by FID */
+};
+
+struct msl_mds_replica {
+	struct sl_resm		*mmr_resm;
+	time_t			 mmr_skip_until;
+};
+
 /*
  * Initialize a new RPC request for a pscfs clientctx.
  * Most arguments here are macro-value-result.
@@ -71,12 +87,28 @@ struct slrpc_cservice;
  * used by the client side RPC retry logic.
  */
 #define MSL_RMC_NEWREQ(f, csvc, op, rq, mq, mp, rc, timeout)		\
+	_MSL_RMC_NEWREQ((f) ? fcmh_2_fci(f)->fci_resm : msl_rmc_resm,	\
+	    csvc, op, rq, mq, mp, rc, timeout)
+
+/*
+ * Like MSL_RMC_NEWREQ() but for read-only namespace requests, which
+ * may be sent to an MDS read replica.  @resm is set to the MDS chosen
+ * so a failure can be passed to slc_rmc_replica_retry().
+ */
+#define MSL_RMC_RDREQ(f, resm, csvc, op, rq, mq, mp, rc, timeout)	\
+	do {								\
+		(resm) = slc_rmc_rdresm(f);				\
+		_MSL_RMC_NEWREQ((resm), csvc, op, rq, mq, mp, rc,	\
+		    timeout);						\
+	} while (0)
+
+#define _MSL_RMC_NEWREQ(resm, csvc, op, rq, mq, mp, rc, timeout)	\
 	do {								\
 		struct sl_resm *_resm;					\
 									\
 		(mq) = NULL;						\
 		(mp) = NULL;						\
-		_resm = (f) ? fcmh_2_fci(f)->fci_resm : msl_rmc_resm;	\
+		_resm = (resm);						\
 		pscrpc_req_finished(rq);				\
 		(rq) = NULL;						\
 		if (csvc) {						\
@@ -120,6 +152,11 @@ int	slc_rpc_should_retry(struct pscfs_req *, int *);
 
 int	slc_rmc_getcsvc(struct sl_resm *, struct slrpc_cservice **, int);
 int	slc_rmc_setmds(const char *);
+int	slc_rmc_setreplicas(const char *);
+int	slc_rmc_setrdpolicy(const char *);
+struct sl_resm *
+	slc_rmc_rdresm(struct fidc_membh *);
+int	slc_rmc_replica_retry(struct sl_resm *, int);
 
 int	slc_rci_handler(struct pscrpc_request *);
 int	slc_rcm_handler(struct pscrpc_request *);
@@ -127,6 +164,10 @@ int	slc_rcm_handler(struct pscrpc_request *);
 extern struct pscrpc_svc_handle	*msl_rci_svh;
 extern struct pscrpc_svc_handle	*msl_rcm_svh;
 
+extern struct msl_mds_replica	 msl_rmc_replicas[];
+extern int			 msl_rmc_nreplicas;
+extern int			 msl_rmc_rdpolicy;
+
 /* Grab calling thread's multiwait structure. */
 static __inline struct pfl_multiwait *
 msl_getmw(void)
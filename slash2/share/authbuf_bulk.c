@@ -0,0 +1,284 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2009-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * authbuf_bulk - parallel hashing of bulk RPC payloads.
+ *
+ * The bulk hash is CRC32 (RFC 1510) over the secret key followed by the
+ * payload.  CRC is linear, so the CRC of a concatenation A||B can be
+ * computed from crc(A), crc(B) and len(B) alone.  That lets a large
+ * payload be cut into leaves that are hashed independently, by the
+ * calling thread and a small pool of helpers, and then folded together
+ * in order.  It also lets callers that already computed the CRC of an
+ * iovec element in passing, e.g. while copying it, hand that in
+ * instead of having it hashed again.  The result is bit-identical to
+ * hashing the whole buffer serially, so peers need not agree on which
+ * method was used.
+ *
+ * RFC 1510 CRC32 is the raw reflected CRC32 register update, which is
+ * what psc_crc32r_add() computes.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <gcrypt.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pfl/alloc.h"
+#include "pfl/atomic.h"
+#include "pfl/crc.h"
+#include "pfl/list.h"
+#include "pfl/lock.h"
+#include "pfl/log.h"
+#include "pfl/thread.h"
+#include "pfl/waitq.h"
+
+#include "authbuf.h"
+#include "cache_params.h"
+
+struct sl_bulkhash_leaf {
+	const void		*bhl_base;
+	size_t			 bhl_len;
+	uint32_t		 bhl_crc;
+	int			 bhl_valid;	/* CRC supplied by caller */
+};
+
+struct sl_bulkhash_job {
+	struct psclist_head	 bhj_lentry;
+	struct sl_bulkhash_leaf	*bhj_leaves;
+	int			 bhj_nleaves;
+	psc_atomic32_t		 bhj_next;	/* next unclaimed leaf */
+	int			 bhj_nhelpers;	/* helpers still attached */
+	int			 bhj_ndone;
+};
+
+int			 sl_bulkhash_min = AUTHBUF_BULK_MIN;
+int			 sl_bulkhash_nthr;
+uint32_t		 sl_authbuf_keycrc;
+
+__static struct psc_spinlock	sl_bulkhash_lock = SPINLOCK_INIT;
+__static struct psclist_head	sl_bulkhash_jobs =
+				    PSCLIST_HEAD_INIT(sl_bulkhash_jobs);
+__static struct psc_waitq	sl_bulkhash_workwq =
+				    PSC_WAITQ_INIT("bulkhash-work");
+__static struct psc_waitq	sl_bulkhash_donewq =
+				    PSC_WAITQ_INIT("bulkhash-done");
+
+__static void
+sl_bulkhash_leaf(struct sl_bulkhash_leaf *l)
+{
+	if (l->bhl_valid)
+		return;
+	l->bhl_crc = 0;
+	psc_crc32r_add(&l->bhl_crc, l->bhl_base, l->bhl_len);
+}
+
+/*
+ * Hash unclaimed leaves of a job until there are none left.  Returns
+ * the number of leaves this thread hashed.
+ */
+__static int
+sl_bulkhash_work(struct sl_bulkhash_job *j)
+{
+	int i, n = 0;
+
+	for (;;) {
+		i = psc_atomic32_inc_getnew(&j->bhj_next) - 1;
+		if (i >= j->bhj_nleaves)
+			break;
+		sl_bulkhash_leaf(&j->bhj_leaves[i]);
+		n++;
+	}
+	return (n);
+}
+
+void
+sl_bulkhashthr_main(struct psc_thread *thr)
+{
+	struct sl_bulkhash_job *j;
+	int n;
+
+	while (pscthr_run(thr)) {
+		spinlock(&sl_bulkhash_lock);
+		j = psc_listhd_first_obj(&sl_bulkhash_jobs,
+		    struct sl_bulkhash_job, bhj_lentry);
+		if (j == NULL) {
+			psc_waitq_waitrel_s(&sl_bulkhash_workwq,
+			    &sl_bulkhash_lock, 1);
+			continue;
+		}
+		j->bhj_nhelpers++;
+		freelock(&sl_bulkhash_lock);
+
+		n = sl_bulkhash_work(j);
+
+		spinlock(&sl_bulkhash_lock);
+		/* all leaves are claimed; stop advertising the job */
+		if (psclist_conjoint(&j->bhj_lentry, &sl_bulkhash_jobs))
+			psclist_del(&j->bhj_lentry, &sl_bulkhash_jobs);
+		j->bhj_ndone += n;
+		if (--j->bhj_nhelpers == 0)
+			psc_waitq_wakeall(&sl_bulkhash_donewq);
+		freelock(&sl_bulkhash_lock);
+	}
+}
+
+/*
+ * Hash leaves on the calling thread with help from the bulkhash
+ * threads.
+ */
+__static void
+sl_bulkhash_parallel(struct sl_bulkhash_leaf *leaves, int nleaves)
+{
+	struct sl_bulkhash_job j;
+	int i;
+
+	memset(&j, 0, sizeof(j));
+	INIT_PSC_LISTENTRY(&j.bhj_lentry);
+	j.bhj_leaves = leaves;
+	j.bhj_nleaves = nleaves;
+
+	spinlock(&sl_bulkhash_lock);
+	psclist_add_tail(&j.bhj_lentry, &sl_bulkhash_jobs);
+	psc_waitq_wakeall(&sl_bulkhash_workwq);
+	freelock(&sl_bulkhash_lock);
+
+	i = sl_bulkhash_work(&j);
+
+	spinlock(&sl_bulkhash_lock);
+	if (psclist_conjoint(&j.bhj_lentry, &sl_bulkhash_jobs))
+		psclist_del(&j.bhj_lentry, &sl_bulkhash_jobs);
+	j.bhj_ndone += i;
+	while (j.bhj_nhelpers) {
+		psc_waitq_wait(&sl_bulkhash_donewq, &sl_bulkhash_lock);
+		spinlock(&sl_bulkhash_lock);
+	}
+	freelock(&sl_bulkhash_lock);
+	psc_assert(j.bhj_ndone == nleaves);
+}
+
+/*
+ * Compute the bulk hash of an iovec.  Payloads at least sl_bulkhash_min
+ * bytes long are split into leaves hashed in parallel by the bulkhash
+ * threads, if any were spawned.
+ * @buf: AUTHBUF_ALGLEN byte output.
+ * @iov: payload.
+ * @n: number of iovec elements.
+ * @hints: optional array of @n precomputed CRCs of iovec elements.
+ */
+void
+sl_bulkhash(void *buf, const struct iovec *iov, int n,
+    const struct sl_bulkhash_hint *hints)
+{
+	struct sl_bulkhash_leaf *leaves, *l;
+	uint32_t crc;
+	size_t len, off;
+	int i, nleaves;
+
+	for (i = 0, len = 0, nleaves = 0; i < n; i++) {
+		if (hints && hints[i].bhh_valid)
+			nleaves++;
+		else {
+			len += iov[i].iov_len;
+			nleaves += howmany(iov[i].iov_len,
+			    SLASH_SLVR_BLKSZ);
+		}
+	}
+
+	if (hints == NULL && (sl_bulkhash_nthr == 0 ||
+	    len < (size_t)sl_bulkhash_min || nleaves < 2)) {
+		crc = sl_authbuf_keycrc;
+		for (i = 0; i < n; i++)
+			psc_crc32r_add(&crc, iov[i].iov_base,
+			    iov[i].iov_len);
+		goto out;
+	}
+
+	leaves = l = PSCALLOC(nleaves * sizeof(*l));
+	for (i = 0; i < n; i++) {
+		if (hints && hints[i].bhh_valid) {
+			l->bhl_len = iov[i].iov_len;
+			l->bhl_crc = hints[i].bhh_crc;
+			l->bhl_valid = 1;
+			l++;
+			continue;
+		}
+		for (off = 0; off < iov[i].iov_len; off += l->bhl_len,
+		    l++) {
+			l->bhl_base = (char *)iov[i].iov_base + off;
+			l->bhl_len = MIN(iov[i].iov_len - off,
+			    SLASH_SLVR_BLKSZ);
+		}
+	}
+
+	if (sl_bulkhash_nthr && len >= (size_t)sl_bulkhash_min &&
+	    nleaves > 1)
+		sl_bulkhash_parallel(leaves, nleaves);
+	else
+		for (i = 0; i < nleaves; i++)
+			sl_bulkhash_leaf(&leaves[i]);
+
+	crc = sl_authbuf_keycrc;
+	for (i = 0, l = leaves; i < nleaves; i++, l++)
+		crc = psc_crc32r_combine(crc, l->bhl_crc, l->bhl_len);
+	PSCFREE(leaves);
+
+ out:
+	((unsigned char *)buf)[0] = crc >> 24;
+	((unsigned char *)buf)[1] = crc >> 16;
+	((unsigned char *)buf)[2] = crc >> 8;
+	((unsigned char *)buf)[3] = crc;
+}
+
+/*
+ * Record the CRC state after the secret key, which seeds the bulk
+ * hash.  Called once the key has been loaded into sl_authbuf_hd.
+ */
+void
+sl_bulkhash_init(void)
+{
+	const unsigned char *p;
+	char ebuf[BUFSIZ];
+	gcry_error_t gerr;
+	gcry_md_hd_t hd;
+
+	gerr = gcry_md_copy(&hd, sl_authbuf_hd);
+	if (gerr) {
+		gpg_strerror_r(gerr, ebuf, sizeof(ebuf));
+		psc_fatalx("gcry_md_copy: %s [%d]", ebuf, gerr);
+	}
+	p = gcry_md_read(hd, 0);
+	sl_authbuf_keycrc = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	    (uint32_t)p[2] << 8 | p[3];
+	gcry_md_close(hd);
+}
+
+void
+sl_bulkhashthr_spawn(int thrtype, int nthr, const char *namefmt)
+{
+	int i;
+
+	for (i = 0; i < nthr; i++)
+		pscthr_init(thrtype, sl_bulkhashthr_main, 0, namefmt, i);
+	sl_bulkhash_nthr = nthr;
+}
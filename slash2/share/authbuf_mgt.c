@@ -90,6 +90,7 @@ authbuf_readkeyfile(void)
 		psc_fatalx("gcry_md_open: %d", gerr);
 	gcry_md_write(sl_authbuf_hd, sl_authbuf_key,
 	    sl_authbuf_keysize);
+	sl_bulkhash_init();
 
 	PSCFREE(sl_authbuf_key);
 
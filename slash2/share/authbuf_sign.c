@@ -52,7 +52,6 @@ authbuf_sign(struct pscrpc_request *rq, int msgtype)
 {
 	lnet_process_id_t self_prid, peer_prid;
 	struct srt_authbuf_footer *saf;
-	struct pscrpc_bulk_desc *bd;
 	struct pscrpc_msg *m;
 	char ebuf[BUFSIZ];
 	gcry_error_t gerr;
@@ -113,10 +112,10 @@ authbuf_sign(struct pscrpc_request *rq, int msgtype)
 
 	gcry_md_close(hd);
 
-	bd = rq->rq_bulk;
-	if (bd && bd->bd_type == BULK_GET_SOURCE)
-		slrpc_bulk_sign(rq, saf->saf_bulkhash, bd->bd_iov,
-		    bd->bd_iov_count);
+	/*
+	 * A bulk we send (BULK_GET_SOURCE) was already signed by
+	 * slrpc_bulkclient_hint().
+	 */
 }
 
 /*
@@ -128,10 +128,9 @@ fidc_reap(int max, int flags)
 
 	psclog_debug("reaping %d files from fidcache", nreap);
 
-	for (i = 0; i < nreap; i++) {
-		psc_hashent_remove(&sl_fcmh_hashtbl, reap[i]);
+	psc_hashent_removev(&sl_fcmh_hashtbl, (void **)reap, nreap);
+	for (i = 0; i < nreap; i++)
 		fcmh_destroy(reap[i]);
-	}
 	return (i);
 }
 
@@ -144,6 +143,24 @@ fidc_reaper(struct psc_poolmgr *m)
 	return (fidc_reap(psc_atomic32_read(&m->ppm_nwaiters), 0));
 }
 
+/*
+ * Lock-free lookup callback: reference the fcmh unless it is coming or
+ * going, in which case _fidc_lookup() retries under the bucket lock.
+ */
+__static void
+fidc_lookup_cb(void *p, void *arg)
+{
+	struct fidc_membh *f = p, **fp = arg;
+
+	FCMH_LOCK(f);
+	if (f->fcmh_flags & (FCMH_TOFREE | FCMH_INITING)) {
+		FCMH_ULOCK(f);
+		return;
+	}
+	fcmh_op_start_type(f, FCMH_OPCNT_LOOKUP_FIDC);
+	*fp = f;
+}
+
 /*
  * Search the FID cache for a member by its FID, optionally creating it.
  *
@@ -173,6 +190,15 @@ _fidc_lookup(const struct pfl_callerinfo *pci, slfid_t fid,
 	*fp = NULL;
 	fnew = NULL; /* gcc */
 
+	/* Most lookups hit an established fcmh; try without locking. */
+	if ((flags & FIDC_LOOKUP_EXCL) == 0) {
+		f = NULL;
+		psc_hashtbl_search_cb(&sl_fcmh_hashtbl, fidc_lookup_cb,
+		    &f, &fid);
+		if (f)
+			goto hit;
+	}
+
 	/* OK.  Now check if it is already in the cache. */
 	b = psc_hashbkt_get(&sl_fcmh_hashtbl, &fid);
  restart:
@@ -244,6 +270,7 @@ _fidc_lookup(const struct pfl_callerinfo *pci, slfid_t fid,
 
 		psc_hashbkt_put(&sl_fcmh_hashtbl, b);
 
+ hit:
 		/* call sli_fcmh_reopen() - sliod only */
 		if (sl_fcmh_ops.sfop_reopen) {
 			rc = sl_fcmh_ops.sfop_reopen(f, fgen);
@@ -367,7 +394,7 @@ fidc_init(int privsiz)
 	lc_reginit(&sl_fcmh_idle, struct fidc_membh, fcmh_lentry,
 	    "fcmhidle");
 
-	psc_hashtbl_init(&sl_fcmh_hashtbl, 0, struct fidc_membh,
+	psc_hashtbl_init(&sl_fcmh_hashtbl, PHTF_RCU, struct fidc_membh,
 	    fcmh_fg, fcmh_hentry, 3 * nobj - 1, NULL, "fidc");
 }
 
@@ -456,7 +483,8 @@ fcmh_op_done_type(struct fidc_membh *f, int type)
 			 * _fidc_lookup is guaranteed to obtain this
 			 * fcmh lock and skip the fcmh because of
 			 * FCMH_TOFREE before this thread calls
-			 * fcmh_destroy().
+			 * fcmh_destroy().  Lock-free lookups are waited
+			 * out by psc_hashent_remove() the same way.
 			 */
 			FCMH_ULOCK(f);
 
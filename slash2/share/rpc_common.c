@@ -1267,23 +1267,7 @@ void
 slrpc_bulk_sign(__unusedx struct pscrpc_request *rq, void *buf,
     struct iovec *iov, int n)
 {
-	char ebuf[BUFSIZ];
-	gcry_error_t gerr;
-	gcry_md_hd_t hd;
-	int i;
-
-	gerr = gcry_md_copy(&hd, sl_authbuf_hd);
-	if (gerr) {
-		gpg_strerror_r(gerr, ebuf, sizeof(ebuf));
-		psc_fatalx("gcry_md_copy: %s [%d]", ebuf, gerr);
-	}
-
-	for (i = 0; i < n; i++)
-		gcry_md_write(hd, iov[i].iov_base, iov[i].iov_len);
-
-	memcpy(buf, gcry_md_read(hd, 0), AUTHBUF_ALGLEN);
-
-	gcry_md_close(hd);
+	sl_bulkhash(buf, iov, n, NULL);
 }
 
 int
@@ -1363,13 +1347,34 @@ slrpc_bulkserver(struct pscrpc_request *rq, int type, int chan,
 }
 
 /*
- * Perform RPC bulk operation as an RPC client.
+ * Perform RPC bulk operation as an RPC client.  A bulk the server will
+ * pull from us is signed right away, so the caller must not modify it
+ * afterwards.
+ * @hints: optional precomputed CRCs of the iovec elements, see
+ *	sl_bulkhash().
  */
+int
+slrpc_bulkclient_hint(struct pscrpc_request *rq, int type, int chan,
+    struct iovec *iov, int n, const struct sl_bulkhash_hint *hints)
+{
+	struct srt_authbuf_footer *saf;
+	struct pscrpc_msg *m;
+	int rc;
+
+	rc = rsx_bulkclient(rq, type, chan, iov, n);
+	if (rc == 0 && type == BULK_GET_SOURCE) {
+		m = rq->rq_reqmsg;
+		saf = pscrpc_msg_buf(m, m->bufcount - 1, sizeof(*saf));
+		sl_bulkhash(saf->saf_bulkhash, iov, n, hints);
+	}
+	return (rc);
+}
+
 int
 slrpc_bulkclient(struct pscrpc_request *rq, int type, int chan,
     struct iovec *iov, int n)
 {
-	return (rsx_bulkclient(rq, type, chan, iov, n));
+	return (slrpc_bulkclient_hint(rq, type, chan, iov, n, NULL));
 }
 
 /*
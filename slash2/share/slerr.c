@@ -55,8 +55,8 @@ char *sl_errstrs[] = {
 /* 28 */ "unknown code 28",
 /* 29 */ "unknown code 29",
 /* 30 */ "Peer resource is of wrong type",
-/* 31 */ "unknown code 31",
-/* 32 */ "unknown code 32",
+/* 31 */ "MDS is a read-only replica",
+/* 32 */ "MDS replica is too far behind its primary",
 /* 33 */ "unknown code 33",
 /* 34 */ "CRC absent",
 	 NULL
@@ -116,18 +116,22 @@ struct slconf_symbol sym_table[] = {
 	SYM_GLOBAL("port",		SL_TYPE_INT,	0,		gconf_port,		NULL),
 	SYM_GLOBAL("routes",		SL_TYPE_STR,	0,		gconf_lroutes,		NULL),
 
+	SYM_SITE("repl_link_bw",	SL_TYPE_STRP,	0,		site_repl_link_bw,	NULL),
 	SYM_SITE("site_desc",		SL_TYPE_STRP,	0,		site_desc,		NULL),
 	SYM_SITE("site_id",		SL_TYPE_INT,	SITE_MAXID,	site_id,		NULL),
 
 	SYM_RES("desc",			SL_TYPE_STRP,	0,		res_desc,		NULL),
 	SYM_RES("flags",		SL_TYPE_INT,	0,		res_flags,		slcfg_str2flags),
 	SYM_RES("id",			SL_TYPE_INT,	RES_MAXID,	res_id,			NULL),
+	SYM_RES("repl_egress_bw",	SL_TYPE_STRP,	0,		res_repl_egress_bw,	NULL),
+	SYM_RES("repl_ingress_bw",	SL_TYPE_STRP,	0,		res_repl_ingress_bw,	NULL),
 	SYM_RES("type",			SL_TYPE_INT,	0,		res_type,		slcfg_str2restype),
 
 	SYM_LOCAL("allow_exec",		SL_TYPE_STRP,	0,		cfg_allowexe,		NULL),
 	SYM_LOCAL("arc_max",		SL_TYPE_SIZET,	0,		cfg_arc_max,		NULL),
 	SYM_LOCAL("fidcachesz",		SL_TYPE_SIZET,	0,		cfg_fidcachesz,		NULL),
 	SYM_LOCAL("fsroot",		SL_TYPE_STRP,	0,		cfg_fsroot,		NULL),
+	SYM_LOCAL("io_uring",		SL_TYPE_BOOL,	0,		cfg_io_uring,		NULL),
 	SYM_LOCAL("journal",		SL_TYPE_STRP,	0,		cfg_journal,		NULL),
 	SYM_LOCAL("pref_ios",		SL_TYPE_STR,	0,		cfg_prefios,		NULL),
 	SYM_LOCAL("pref_mds",		SL_TYPE_STR,	0,		cfg_prefmds,		NULL),
@@ -0,0 +1,626 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2008-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Replication bandwidth shaping.
+ *
+ * Every IOS has an egress and an ingress token bucket and every pair of
+ * sites with a configured link rate has a link bucket.  A replication
+ * is admitted when all buckets it crosses hold tokens; the whole bmap
+ * is then charged against them, which may leave them in debt.  Buckets
+ * refill at the rate in effect for the current time of day and hold at
+ * most slm_bwshape_burst seconds worth of tokens.
+ *
+ * A bmap that is refused is remembered along with the bucket that
+ * refused it and handed back to upd_pagein_wk() by the pager thread
+ * once that bucket is expected to have tokens again, instead of
+ * waiting for the next full scan of the upsch table.
+ *
+ * The slm_bwshapes list lock protects all bucket state and the list of
+ * deferred bmaps.  It may be taken while holding RPMI locks but not the
+ * other way around.
+ */
+
+#define PSC_SUBSYS SLMSS_UPSCH
+#include "subsys_mds.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "pfl/alloc.h"
+#include "pfl/cdefs.h"
+#include "pfl/list.h"
+#include "pfl/lockedlist.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/str.h"
+#include "pfl/time.h"
+#include "pfl/waitq.h"
+#include "pfl/workthr.h"
+
+#include "bwshape_mds.h"
+#include "slashd.h"
+#include "slconfig.h"
+#include "up_sched_res.h"
+
+#define SLM_BWS_DELAY_MIN	1000000		/* nsec */
+#define SLM_BWS_DELAY_MAX	60		/* sec */
+
+/* a bmap refused by a bucket, waiting to be retried */
+struct slm_bws_defer {
+	slfid_t			 bsd_fid;
+	sl_bmapno_t		 bsd_bno;
+	struct slm_bwshape	*bsd_bws;	/* NULL: over pending cap */
+	struct timespec		 bsd_due;
+	struct psc_listentry	 bsd_lentry;
+};
+
+struct psc_lockedlist	 slm_bwshapes = PLL_INIT(&slm_bwshapes,
+			    struct slm_bwshape, bws_lentry);
+int			 slm_bwshape_burst = SLM_BWS_BURST;
+
+__static struct psclist_head	slm_bws_deferred =
+				    PSCLIST_HEAD_INIT(slm_bws_deferred);
+__static int			slm_bws_ndeferred;
+__static int			slm_bws_ncapwait;	/* deferred with no bucket */
+__static struct timespec	slm_bws_wakeup;	/* when the pager next runs */
+
+/*
+ * Parse a rate such as "20m" into bytes/sec.  Returns -2 if the rate is
+ * invalid.
+ */
+__static int64_t
+slm_bwshape_parserate(const char *s, const char *e)
+{
+	int64_t v, mult = 1;
+	char buf[32], *endp;
+
+	if (e - s >= (int)sizeof(buf) || e == s)
+		return (-2);
+	memcpy(buf, s, e - s);
+	buf[e - s] = '\0';
+
+	if (strcasecmp(buf, "unlimited") == 0)
+		return (SLM_BWS_UNLIMITED);
+
+	v = strtoll(buf, &endp, 10);
+	if (endp == buf || v < 0)
+		return (-2);
+	switch (tolower(*endp)) {
+	case '\0':
+	case 'b':
+		break;
+	case 'k':
+		mult = 1024;
+		break;
+	case 'm':
+		mult = 1024 * 1024;
+		break;
+	case 'g':
+		mult = INT64_C(1024) * 1024 * 1024;
+		break;
+	case 't':
+		mult = INT64_C(1024) * 1024 * 1024 * 1024;
+		break;
+	default:
+		return (-2);
+	}
+	if (*endp && endp[1])
+		return (-2);
+	return (v * mult);
+}
+
+/*
+ * Parse "HH:MM" into a minute of the day.  Returns -1 if invalid.
+ */
+__static int
+slm_bwshape_parsetime(const char *s, const char *e)
+{
+	int h, m;
+
+	if (e - s != 5 || !isdigit(s[0]) || !isdigit(s[1]) ||
+	    s[2] != ':' || !isdigit(s[3]) || !isdigit(s[4]))
+		return (-1);
+	h = (s[0] - '0') * 10 + s[1] - '0';
+	m = (s[3] - '0') * 10 + s[4] - '0';
+	if (h > 24 || m > 59 || (h == 24 && m))
+		return (-1);
+	return (h * 60 + m);
+}
+
+/*
+ * Parse a rate schedule from slcfg, e.g.
+ *
+ *	"100m 08:00-18:00=20m 22:00-06:00=unlimited"
+ *
+ * The bare rate applies outside of all windows; windows may wrap past
+ * midnight and the first one that matches wins.  A missing schedule
+ * means unlimited.
+ */
+__static struct slm_bws_sched *
+slm_bwshape_parsesched(const char *name, const char *var,
+    const char *spec)
+{
+	const char *p, *e, *dash, *eq;
+	struct slm_bws_sched *bss;
+	struct slm_bws_window *w;
+
+	if (spec == NULL)
+		return (NULL);
+
+	bss = PSCALLOC(sizeof(*bss));
+	bss->bss_defrate = SLM_BWS_UNLIMITED;
+	for (p = spec; *p; p = e) {
+		while (*p == ' ' || *p == '\t' || *p == ',' || *p == ';')
+			p++;
+		if (*p == '\0')
+			break;
+		for (e = p; *e && *e != ' ' && *e != '\t' && *e != ',' &&
+		    *e != ';'; e++)
+			;
+
+		eq = memchr(p, '=', e - p);
+		if (eq == NULL) {
+			bss->bss_defrate = slm_bwshape_parserate(p, e);
+			if (bss->bss_defrate == -2)
+				goto bad;
+			continue;
+		}
+
+		if (bss->bss_nwin >= SLM_BWS_NWIN)
+			psc_fatalx("%s %s: more than %d time windows",
+			    name, var, SLM_BWS_NWIN);
+		w = &bss->bss_win[bss->bss_nwin++];
+		dash = memchr(p, '-', eq - p);
+		if (dash == NULL)
+			goto bad;
+		w->bsw_start = slm_bwshape_parsetime(p, dash);
+		w->bsw_end = slm_bwshape_parsetime(dash + 1, eq);
+		w->bsw_rate = slm_bwshape_parserate(eq + 1, e);
+		if (w->bsw_start == -1 || w->bsw_end == -1 ||
+		    w->bsw_rate == -2)
+			goto bad;
+	}
+	return (bss);
+
+ bad:
+	psc_fatalx("%s %s: invalid bandwidth schedule '%s'", name, var,
+	    spec);
+}
+
+__static int64_t
+slm_bwshape_schedrate(const struct slm_bws_sched *bss, int mod)
+{
+	const struct slm_bws_window *w;
+	int i;
+
+	if (bss == NULL)
+		return (SLM_BWS_UNLIMITED);
+	for (i = 0, w = bss->bss_win; i < bss->bss_nwin; i++, w++)
+		if (w->bsw_start <= w->bsw_end ?
+		    mod >= w->bsw_start && mod < w->bsw_end :
+		    mod >= w->bsw_start || mod < w->bsw_end)
+			return (w->bsw_rate);
+	return (bss->bss_defrate);
+}
+
+/*
+ * Local minute of the day, for picking time windows.
+ */
+__static int
+slm_bwshape_minute(void)
+{
+	struct tm tm;
+	time_t now;
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	return (tm.tm_hour * 60 + tm.tm_min);
+}
+
+/*
+ * Bring a bucket up to date: pick up the rate for the time of day,
+ * add the tokens accrued since the last refill and fold the bytes
+ * admitted since then into the measured rate.
+ */
+__static void
+slm_bwshape_refill(struct slm_bwshape *bws, const struct timespec *now,
+    int mod)
+{
+	int64_t rate, r, cap;
+	struct timespec d;
+	double dt;
+
+	rate = slm_bwshape_schedrate(bws->bws_sched[0], mod);
+	r = slm_bwshape_schedrate(bws->bws_sched[1], mod);
+	if (rate == SLM_BWS_UNLIMITED || (r != SLM_BWS_UNLIMITED &&
+	    r < rate))
+		rate = r;
+
+	timespecsub(now, &bws->bws_refill, &d);
+	bws->bws_refill = *now;
+	dt = d.tv_sec + d.tv_nsec * 1e-9;
+
+	if (rate != SLM_BWS_UNLIMITED) {
+		cap = rate * MAX(slm_bwshape_burst, 1);
+		if (bws->bws_rate == SLM_BWS_UNLIMITED)
+			bws->bws_tokens = cap;
+		else if (bws->bws_tokens + rate * dt >= cap)
+			bws->bws_tokens = cap;
+		else
+			bws->bws_tokens += rate * dt;
+	}
+	bws->bws_rate = rate;
+
+	timespecsub(now, &bws->bws_intv_start, &d);
+	if (d.tv_sec >= 1) {
+		dt = d.tv_sec + d.tv_nsec * 1e-9;
+		bws->bws_xrate = (bws->bws_xrate * 3 +
+		    bws->bws_intv_nbytes / dt) / 4;
+		bws->bws_intv_nbytes = 0;
+		bws->bws_intv_start = *now;
+	}
+}
+
+#define BWS_EMPTY(bws)							\
+	((bws)->bws_rate != SLM_BWS_UNLIMITED && (bws)->bws_tokens <= 0)
+
+/*
+ * How long until a bucket has tokens again.
+ */
+__static void
+slm_bwshape_delay(const struct slm_bwshape *bws, struct timespec *ts)
+{
+	int64_t nsec;
+
+	if (bws == NULL) {
+		ts->tv_sec = 1;
+		ts->tv_nsec = 0;
+		return;
+	}
+	if (!BWS_EMPTY(bws))
+		nsec = 0;
+	else if (bws->bws_rate == 0)
+		nsec = SLM_BWS_DELAY_MAX * INT64_C(1000000000);
+	else
+		nsec = (1 - bws->bws_tokens) * 1e9 / bws->bws_rate;
+	nsec = MAX(nsec, SLM_BWS_DELAY_MIN);
+	nsec = MIN(nsec, SLM_BWS_DELAY_MAX * INT64_C(1000000000));
+	ts->tv_sec = nsec / 1000000000;
+	ts->tv_nsec = nsec % 1000000000;
+}
+
+__static struct slm_bwshape *
+slm_bwshape_getlink(const struct sl_site *a, const struct sl_site *b)
+{
+	struct slm_bwshape *bws;
+
+	if (a == b)
+		return (NULL);
+	PLL_FOREACH(bws, &slm_bwshapes)
+		if (bws->bws_type == BWST_LINK &&
+		    ((bws->bws_site[0] == a && bws->bws_site[1] == b) ||
+		     (bws->bws_site[0] == b && bws->bws_site[1] == a)))
+			return (bws);
+	return (NULL);
+}
+
+/*
+ * Try to admit a replication of @amt bytes from @src to @dst.  Returns
+ * 1 and charges every bucket on the path if all of them have tokens;
+ * otherwise returns 0 and sets @bwsp to the bucket that refused.
+ */
+int
+slm_bwshape_admit(struct sl_resm *src, struct sl_resm *dst,
+    int64_t amt, struct slm_bwshape **bwsp)
+{
+	struct slm_bwshape *v[3];
+	struct timespec now;
+	int i, mod, rc = 1;
+
+	PFL_GETTIMESPEC_MONO(&now);
+	mod = slm_bwshape_minute();
+
+	PLL_LOCK(&slm_bwshapes);
+	v[0] = res2iosinfo(src->resm_res)->si_bws_egress;
+	v[1] = res2iosinfo(dst->resm_res)->si_bws_ingress;
+	v[2] = slm_bwshape_getlink(src->resm_res->res_site,
+	    dst->resm_res->res_site);
+
+	for (i = 0; i < nitems(v); i++) {
+		if (v[i] == NULL)
+			continue;
+		slm_bwshape_refill(v[i], &now, mod);
+		if (BWS_EMPTY(v[i])) {
+			v[i]->bws_nrefused++;
+			if (bwsp)
+				*bwsp = v[i];
+			rc = 0;
+			goto out;
+		}
+	}
+	for (i = 0; i < nitems(v); i++) {
+		if (v[i] == NULL)
+			continue;
+		if (v[i]->bws_rate != SLM_BWS_UNLIMITED)
+			v[i]->bws_tokens -= amt;
+		v[i]->bws_nbytes += amt;
+		v[i]->bws_intv_nbytes += amt;
+	}
+
+ out:
+	PLL_ULOCK(&slm_bwshapes);
+	return (rc);
+}
+
+/*
+ * Whether an IOS has run out of ingress tokens, in which case there is
+ * no point in handing the pagein workers more bmaps destined for it.
+ */
+int
+slm_bwshape_blocked(struct sl_resource *r)
+{
+	struct slm_bwshape *bws;
+	struct timespec now;
+	int rc;
+
+	bws = res2iosinfo(r)->si_bws_ingress;
+	if (bws == NULL)
+		return (0);
+
+	PFL_GETTIMESPEC_MONO(&now);
+	PLL_LOCK(&slm_bwshapes);
+	slm_bwshape_refill(bws, &now, slm_bwshape_minute());
+	rc = BWS_EMPTY(bws);
+	PLL_ULOCK(&slm_bwshapes);
+	return (rc);
+}
+
+/*
+ * Remember a bmap that could not be scheduled so the pager retries it
+ * once @bws has tokens again.  A NULL @bws means the pending cap was
+ * hit; such bmaps are retried when replication work completes.  If too
+ * many bmaps are already waiting, the bmap is left to the next scan of
+ * the upsch table.
+ */
+void
+slm_bwshape_defer(slfid_t fid, sl_bmapno_t bno, struct slm_bwshape *bws)
+{
+	struct slm_bws_defer *d, *nd;
+	struct timespec now, wait;
+	int wake = 0;
+
+	nd = PSCALLOC(sizeof(*nd));
+	INIT_PSC_LISTENTRY(&nd->bsd_lentry);
+	nd->bsd_fid = fid;
+	nd->bsd_bno = bno;
+	nd->bsd_bws = bws;
+
+	PFL_GETTIMESPEC_MONO(&now);
+	PLL_LOCK(&slm_bwshapes);
+	psclist_for_each_entry(d, &slm_bws_deferred, bsd_lentry)
+		if (d->bsd_fid == fid && d->bsd_bno == bno) {
+			OPSTAT_INCR("bwshape-defer-dup");
+			goto out;
+		}
+	if (slm_bws_ndeferred >= SLM_BWS_DEFER_MAX) {
+		OPSTAT_INCR("bwshape-defer-drop");
+		goto out;
+	}
+
+	slm_bwshape_delay(bws, &wait);
+	timespecadd(&now, &wait, &nd->bsd_due);
+	psclist_add_tail(&nd->bsd_lentry, &slm_bws_deferred);
+	slm_bws_ndeferred++;
+	if (bws)
+		bws->bws_ndeferred++;
+	else
+		slm_bws_ncapwait++;
+	if (timespeccmp(&nd->bsd_due, &slm_bws_wakeup, <))
+		wake = 1;
+	nd = NULL;
+	OPSTAT_INCR("bwshape-defer");
+
+ out:
+	PLL_ULOCK(&slm_bwshapes);
+	PSCFREE(nd);
+	if (wake)
+		psc_waitq_wakeall(&slm_pager_workq);
+}
+
+/*
+ * Replication bandwidth was released; retry bmaps that were held back
+ * by the pending cap.
+ */
+void
+slm_bwshape_wake(void)
+{
+	struct slm_bws_defer *d;
+	struct timespec now;
+	int wake = 0;
+
+	PFL_GETTIMESPEC_MONO(&now);
+	PLL_LOCK(&slm_bwshapes);
+	if (slm_bws_ncapwait == 0) {
+		PLL_ULOCK(&slm_bwshapes);
+		return;
+	}
+	psclist_for_each_entry(d, &slm_bws_deferred, bsd_lentry)
+		if (d->bsd_bws == NULL &&
+		    timespeccmp(&d->bsd_due, &now, >)) {
+			d->bsd_due = now;
+			wake = 1;
+		}
+	PLL_ULOCK(&slm_bwshapes);
+	if (wake)
+		psc_waitq_wakeall(&slm_pager_workq);
+}
+
+/*
+ * Called by the pager thread on each pass: refill all buckets, requeue
+ * the deferred bmaps whose buckets have tokens again and shorten
+ * @stall so the pager runs again as soon as the next one does.
+ */
+void
+slm_bwshape_tick(struct timeval *stall)
+{
+	struct psclist_head due = PSCLIST_HEAD_INIT(due);
+	struct slm_wkdata_upschq *wk;
+	struct timespec now, next, wait;
+	struct slm_bws_defer *d, *nd;
+	struct slm_bwshape *bws;
+	int mod;
+
+	PFL_GETTIMESPEC_MONO(&now);
+	mod = slm_bwshape_minute();
+	next.tv_sec = now.tv_sec + stall->tv_sec;
+	next.tv_nsec = now.tv_nsec + stall->tv_usec * 1000;
+	if (next.tv_nsec >= 1000000000) {
+		next.tv_sec++;
+		next.tv_nsec -= 1000000000;
+	}
+
+	PLL_LOCK(&slm_bwshapes);
+	PLL_FOREACH(bws, &slm_bwshapes) {
+		slm_bwshape_refill(bws, &now, mod);
+		if (BWS_EMPTY(bws) && bws->bws_ndeferred) {
+			slm_bwshape_delay(bws, &wait);
+			timespecadd(&now, &wait, &wait);
+			if (timespeccmp(&wait, &next, <))
+				next = wait;
+		}
+	}
+	psclist_for_each_entry_safe(d, nd, &slm_bws_deferred,
+	    bsd_lentry) {
+		bws = d->bsd_bws;
+		if (timespeccmp(&d->bsd_due, &now, <=) && bws &&
+		    BWS_EMPTY(bws)) {
+			/* another bmap got the tokens first */
+			slm_bwshape_delay(bws, &wait);
+			timespecadd(&now, &wait, &d->bsd_due);
+		}
+		if (timespeccmp(&d->bsd_due, &now, >)) {
+			if (timespeccmp(&d->bsd_due, &next, <))
+				next = d->bsd_due;
+			continue;
+		}
+		psclist_del(&d->bsd_lentry, &slm_bws_deferred);
+		psclist_add_tail(&d->bsd_lentry, &due);
+		slm_bws_ndeferred--;
+		if (bws)
+			bws->bws_ndeferred--;
+		else
+			slm_bws_ncapwait--;
+	}
+	slm_bws_wakeup = next;
+	PLL_ULOCK(&slm_bwshapes);
+
+	psclist_for_each_entry_safe(d, nd, &due, bsd_lentry) {
+		psclist_del(&d->bsd_lentry, &due);
+		wk = pfl_workq_getitem(upd_pagein_wk,
+		    struct slm_wkdata_upschq);
+		wk->fid = d->bsd_fid;
+		wk->bno = d->bsd_bno;
+		pfl_workq_putitem(wk);
+		OPSTAT_INCR("bwshape-requeue");
+		PSCFREE(d);
+	}
+
+	timespecsub(&next, &now, &wait);
+	stall->tv_sec = wait.tv_sec;
+	stall->tv_usec = wait.tv_nsec / 1000;
+}
+
+__static struct slm_bwshape *
+slm_bwshape_new(int type, const char *name,
+    const struct slm_bws_sched *s0, const struct slm_bws_sched *s1)
+{
+	struct slm_bwshape *bws;
+
+	bws = PSCALLOC(sizeof(*bws));
+	INIT_PSC_LISTENTRY(&bws->bws_lentry);
+	bws->bws_type = type;
+	strlcpy(bws->bws_name, name, sizeof(bws->bws_name));
+	bws->bws_sched[0] = s0;
+	bws->bws_sched[1] = s1;
+	bws->bws_rate = SLM_BWS_UNLIMITED;
+	PFL_GETTIMESPEC_MONO(&bws->bws_refill);
+	bws->bws_intv_start = bws->bws_refill;
+	pll_add(&slm_bwshapes, bws);
+	return (bws);
+}
+
+/*
+ * Create the buckets from the parsed configuration.
+ */
+void
+slm_bwshape_init(void)
+{
+	struct sl_site *s, *t;
+	struct sl_resource *r;
+	struct site_mds_info *smi, *tmi;
+	struct sl_mds_iosinfo *si;
+	struct slm_bwshape *bws;
+	char name[RES_NAME_MAX];
+	int i;
+
+	CONF_LOCK();
+	CONF_FOREACH_RES(s, r, i) {
+		if (!RES_ISFS(r))
+			continue;
+		si = res2iosinfo(r);
+		si->si_bws_egress = slm_bwshape_new(BWST_EGRESS,
+		    r->res_name, slm_bwshape_parsesched(r->res_name,
+		    "repl_egress_bw", r->res_repl_egress_bw), NULL);
+		si->si_bws_ingress = slm_bwshape_new(BWST_INGRESS,
+		    r->res_name, slm_bwshape_parsesched(r->res_name,
+		    "repl_ingress_bw", r->res_repl_ingress_bw), NULL);
+	}
+
+	CONF_FOREACH_SITE(s) {
+		smi = site2smi(s);
+		smi->smi_bws_link = slm_bwshape_parsesched(s->site_name,
+		    "repl_link_bw", s->site_repl_link_bw);
+	}
+	/* one link bucket per pair of sites */
+	CONF_FOREACH_SITE(s) {
+		smi = site2smi(s);
+		CONF_FOREACH_SITE(t) {
+			if (t->site_id <= s->site_id)
+				continue;
+			tmi = site2smi(t);
+			if (smi->smi_bws_link == NULL &&
+			    tmi->smi_bws_link == NULL)
+				continue;
+			snprintf(name, sizeof(name), "%s:%s",
+			    s->site_name, t->site_name);
+			bws = slm_bwshape_new(BWST_LINK, name,
+			    smi->smi_bws_link, tmi->smi_bws_link);
+			bws->bws_site[0] = s;
+			bws->bws_site[1] = t;
+		}
+	}
+	CONF_ULOCK();
+}
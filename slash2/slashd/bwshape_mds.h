@@ -0,0 +1,98 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2008-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * Replication bandwidth shaping.  Token buckets limit the rate at which
+ * replication work is scheduled out of each IOS, into each IOS, and
+ * across the link between each pair of sites.  Rates come from slcfg
+ * and may vary by time of day.
+ */
+
+#ifndef _SLASHD_BWSHAPE_MDS_H_
+#define _SLASHD_BWSHAPE_MDS_H_
+
+#include <sys/time.h>
+
+#include <stdint.h>
+
+#include "pfl/list.h"
+
+#include "fid.h"
+#include "slconfig.h"
+#include "sltypes.h"
+
+#define SLM_BWS_NWIN		8		/* time-of-day windows per schedule */
+#define SLM_BWS_UNLIMITED	INT64_C(-1)
+#define SLM_BWS_BURST		2		/* bucket depth in seconds of rate */
+#define SLM_BWS_DEFER_MAX	4096		/* bmaps awaiting tokens */
+
+/* rate override for part of the day */
+struct slm_bws_window {
+	int			 bsw_start;		/* minute of day */
+	int			 bsw_end;		/* minute of day, exclusive */
+	int64_t			 bsw_rate;		/* bytes/sec */
+};
+
+struct slm_bws_sched {
+	int64_t			 bss_defrate;		/* bytes/sec */
+	int			 bss_nwin;
+	struct slm_bws_window	 bss_win[SLM_BWS_NWIN];
+};
+
+#define BWST_EGRESS		0
+#define BWST_INGRESS		1
+#define BWST_LINK		2
+
+struct slm_bwshape {
+	int			 bws_type;		/* BWST_* */
+	char			 bws_name[RES_NAME_MAX];
+
+	/* the rate in effect is the lowest of these */
+	const struct slm_bws_sched *bws_sched[2];
+
+	int64_t			 bws_rate;		/* bytes/sec in effect */
+	int64_t			 bws_tokens;		/* bytes; negative is debt */
+	struct timespec		 bws_refill;
+
+	uint64_t		 bws_nbytes;		/* lifetime bytes admitted */
+	int64_t			 bws_xrate;		/* measured bytes/sec */
+	uint64_t		 bws_intv_nbytes;
+	struct timespec		 bws_intv_start;
+
+	uint64_t		 bws_nrefused;
+	int			 bws_ndeferred;		/* bmaps awaiting tokens */
+
+	const struct sl_site	*bws_site[2];		/* BWST_LINK */
+	struct psc_listentry	 bws_lentry;
+};
+
+int	 slm_bwshape_admit(struct sl_resm *, struct sl_resm *, int64_t,
+	    struct slm_bwshape **);
+int	 slm_bwshape_blocked(struct sl_resource *);
+void	 slm_bwshape_defer(slfid_t, sl_bmapno_t, struct slm_bwshape *);
+void	 slm_bwshape_init(void);
+void	 slm_bwshape_tick(struct timeval *);
+void	 slm_bwshape_wake(void);
+
+extern struct psc_lockedlist	 slm_bwshapes;
+extern int			 slm_bwshape_burst;
+
+#endif /* _SLASHD_BWSHAPE_MDS_H_ */
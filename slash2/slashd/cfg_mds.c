@@ -30,6 +30,7 @@
 #include "rpc_mds.h"
 #include "slashd.h"
 #include "slconfig.h"
+#include "up_sched_res.h"
 
 void
 slcfg_init_res(struct sl_resource *r)
@@ -50,9 +51,12 @@ slcfg_init_res(struct sl_resource *r)
 	} else {
 		rpmi->rpmi_info = si = PSCALLOC(sizeof(*si));
 		si->si_flags = SIF_NEED_JRNL_INIT;
-		if (RES_ISFS(r))
+		if (RES_ISFS(r)) {
 			pfl_meter_init(&si->si_batchmeter, 0,
 			    "reclaim-%s", r->res_name);
+			si->si_upschq = PSCALLOC(sizeof(*si->si_upschq));
+			slm_upsch_resq_init(si->si_upschq);
+		}
 		if (r->res_flags & RESF_DISABLE_BIA)
 			si->si_flags |= SIF_DISABLE_LEASE;
 	}
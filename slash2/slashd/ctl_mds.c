@@ -28,6 +28,7 @@
 #include "pfl/ctlsvr.h"
 
 #include "bmap_mds.h"
+#include "bwshape_mds.h"
 #include "creds.h"
 #include "ctl.h"
 #include "ctl_mds.h"
@@ -208,6 +209,65 @@ slmctl_resfieldi_preclaim(int fd, struct psc_ctlmsghdr *mh,
 	    levels, nlevels, nbuf));
 }
 
+int
+slmctl_resfieldi_upsch(int fd, struct psc_ctlmsghdr *mh,
+    struct psc_ctlmsg_param *pcp, char **levels, int nlevels, int set,
+    const char *field, int val)
+{
+	char nbuf[16];
+
+	if (set)
+		return (psc_ctlsenderr(fd, mh, NULL,
+		    "%s: field is read-only", field));
+	snprintf(nbuf, sizeof(nbuf), "%d", val);
+	return (psc_ctlmsg_param_send(fd, mh, pcp, PCTHRNAME_EVERYONE,
+	    levels, nlevels, nbuf));
+}
+
+int
+slmctl_resfieldi_upsch_cached(int fd, struct psc_ctlmsghdr *mh,
+    struct psc_ctlmsg_param *pcp, char **levels, int nlevels, int set,
+    struct sl_resource *r)
+{
+	struct slm_upsch_resq *q = res2iosinfo(r)->si_upschq;
+
+	return (slmctl_resfieldi_upsch(fd, mh, pcp, levels, nlevels, set,
+	    "upsch_cached", q ? q->upq_ncached : 0));
+}
+
+int
+slmctl_resfieldi_upsch_flows(int fd, struct psc_ctlmsghdr *mh,
+    struct psc_ctlmsg_param *pcp, char **levels, int nlevels, int set,
+    struct sl_resource *r)
+{
+	struct slm_upsch_resq *q = res2iosinfo(r)->si_upschq;
+
+	return (slmctl_resfieldi_upsch(fd, mh, pcp, levels, nlevels, set,
+	    "upsch_flows", q ? psc_dynarray_len(&q->upq_flows) : 0));
+}
+
+int
+slmctl_resfieldi_upsch_inflight(int fd, struct psc_ctlmsghdr *mh,
+    struct psc_ctlmsg_param *pcp, char **levels, int nlevels, int set,
+    struct sl_resource *r)
+{
+	struct slm_upsch_resq *q = res2iosinfo(r)->si_upschq;
+
+	return (slmctl_resfieldi_upsch(fd, mh, pcp, levels, nlevels, set,
+	    "upsch_inflight", q ? psc_atomic32_read(&q->upq_inflight) : 0));
+}
+
+int
+slmctl_resfieldi_upsch_queued(int fd, struct psc_ctlmsghdr *mh,
+    struct psc_ctlmsg_param *pcp, char **levels, int nlevels, int set,
+    struct sl_resource *r)
+{
+	struct slm_upsch_resq *q = res2iosinfo(r)->si_upschq;
+
+	return (slmctl_resfieldi_upsch(fd, mh, pcp, levels, nlevels, set,
+	    "upsch_queued", q ? q->upq_ndb : 0));
+}
+
 const struct slctl_res_field slctl_resmds_fields[] = {
 	{ "xid",		slmctl_resfieldm_xid },
 	{ NULL, NULL },
@@ -218,6 +278,10 @@ const struct slctl_res_field slctl_resios_fields[] = {
 	{ "disable_write",	slmctl_resfieldi_disable_write },
 	{ "disable_gc",		slmctl_resfieldi_disable_gc },
 	{ "preclaim",		slmctl_resfieldi_preclaim },
+	{ "upsch_cached",	slmctl_resfieldi_upsch_cached },
+	{ "upsch_flows",	slmctl_resfieldi_upsch_flows },
+	{ "upsch_inflight",	slmctl_resfieldi_upsch_inflight },
+	{ "upsch_queued",	slmctl_resfieldi_upsch_queued },
 	{ "xid",		slmctl_resfieldi_xid },
 	{ NULL, NULL },
 };
@@ -237,6 +301,7 @@ slmctlcmd_stop(__unusedx int fd, __unusedx struct psc_ctlmsghdr *mh,
 	 * SQLite until 3.7.15. Use sqlite3 --version to check the
 	 * version.
 	 */
+	slm_db_commit();
 	sqlite3_close_v2(db_handle);
 
 	mdsio_exit();
@@ -301,6 +366,41 @@ slmctlrep_getreplqueued(int fd, struct psc_ctlmsghdr *mh, void *mb)
 	return (rc);
 }
 
+/*
+ * Send a response to a "GETBWSHAPE" inquiry.
+ * @fd: client socket descriptor.
+ * @mh: already filled-in control message header.
+ * @m: control message to examine and reuse.
+ */
+int
+slmctlrep_getbwshape(int fd, struct psc_ctlmsghdr *mh, void *m)
+{
+	struct slmctlmsg_bwshape *scbw = m;
+	struct slm_bwshape *bws;
+	int rc = 1;
+
+	/* buckets are created at startup and never go away */
+	PLL_FOREACH(bws, &slm_bwshapes) {
+		memset(scbw, 0, sizeof(*scbw));
+		PLL_LOCK(&slm_bwshapes);
+		strlcpy(scbw->scbw_name, bws->bws_name,
+		    sizeof(scbw->scbw_name));
+		scbw->scbw_type = bws->bws_type;
+		scbw->scbw_ndeferred = bws->bws_ndeferred;
+		scbw->scbw_rate = bws->bws_rate;
+		scbw->scbw_tokens = bws->bws_tokens;
+		scbw->scbw_xrate = bws->bws_xrate;
+		scbw->scbw_nbytes = bws->bws_nbytes;
+		scbw->scbw_nrefused = bws->bws_nrefused;
+		PLL_ULOCK(&slm_bwshapes);
+
+		rc = psc_ctlmsg_sendv(fd, mh, scbw, NULL);
+		if (!rc)
+			break;
+	}
+	return (rc);
+}
+
 /*
  * Send a response to a "GETSTATFS" inquiry.
  * @fd: client socket descriptor.
@@ -405,6 +505,17 @@ slmctlparam_execute_set(const char *val)
 	return (rc);
 }
 
+void
+slmctlparam_replica_lag_get(char *val)
+{
+	if (!slm_replica)
+		strlcpy(val, "N/A", PCP_VALUE_MAX);
+	else if (slm_replica_synced == 0)
+		strlcpy(val, "never", PCP_VALUE_MAX);
+	else
+		snprintf(val, PCP_VALUE_MAX, "%d", slm_replica_lag());
+}
+
 void
 slmctlparam_reboots_get(char *val)
 {
@@ -511,6 +622,7 @@ struct psc_ctlop slmctlops[] = {
 	{ slmctlcmd_stop,		0 },
 	{ slmctlrep_getbml,		sizeof(struct slmctlmsg_bml) },
 	{ slmctlcmd_upsch_query,	0 },
+	{ slmctlrep_getbwshape,		sizeof(struct slmctlmsg_bwshape) },
 };
 
 void
@@ -560,6 +672,9 @@ slmctlthr_spawn(const char *fn)
 	psc_ctlparam_register_var("sys.crc_check",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_crc_check);
 
+	psc_ctlparam_register_var("sys.bwshape_burst",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_bwshape_burst);
+
 	psc_ctlparam_register_var("sys.conn_debug",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sl_conn_debug);
 
@@ -568,6 +683,8 @@ slmctlthr_spawn(const char *fn)
 	psc_ctlparam_register_simple("sys.next_fid",
 	    slmctlparam_nextfid_get, slmctlparam_nextfid_set);
 
+	psc_ctlparam_register_var("sys.lockprof", PFLCTL_PARAMT_INT,
+	    PFLCTL_PARAMF_RDWR, &pfl_lockprof);
 	psc_ctlparam_register_var("sys.nbrq_outstanding",
 	    PFLCTL_PARAMT_INT, 0, &sl_nbrqset->set_remaining);
 	psc_ctlparam_register("sys.resources", slctlparam_resources);
@@ -600,6 +717,13 @@ slmctlthr_spawn(const char *fn)
 	psc_ctlparam_register_var("sys.reclaim_cursor",
 	    PFLCTL_PARAMT_UINT64, 0, &slm_reclaim_proc_batchno);
 
+	psc_ctlparam_register_var("sys.replica", PFLCTL_PARAMT_INT, 0,
+	    &slm_replica);
+	psc_ctlparam_register_simple("sys.replica_lag",
+	    slmctlparam_replica_lag_get, NULL);
+	psc_ctlparam_register_var("sys.replica_maxlag",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_replica_maxlag);
+
 	psc_ctlparam_register_simple("sys.reboots",
 	    slmctlparam_reboots_get, slmctlparam_reboots_set);
 
@@ -627,6 +751,18 @@ slmctlthr_spawn(const char *fn)
 	psc_ctlparam_register_var("sys.upsch_page_interval",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_upsch_page_interval);
 
+	psc_ctlparam_register_var("sys.upsch_cache_max",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_upsch_cache_max);
+
+	psc_ctlparam_register_var("sys.upsch_window",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_upsch_window);
+
+	psc_ctlparam_register_var("sys.upsch_commit_rows",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_db_commit_rows);
+
+	psc_ctlparam_register_var("sys.upsch_commit_msecs",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_db_commit_msecs);
+
 	psc_ctlparam_register_var("sys.min_space_reserve",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &slm_min_space_reserve_pct);
 
@@ -54,6 +54,17 @@ struct slmctlmsg_bml {
 	char			scbl_client[PSCRPC_NIDSTR_SIZE];
 };
 
+struct slmctlmsg_bwshape {
+	char			scbw_name[RES_NAME_MAX];
+	int32_t			scbw_type;	/* BWST_* */
+	int32_t			scbw_ndeferred;	/* bmaps awaiting tokens */
+	int64_t			scbw_rate;	/* bytes/sec, -1 if unlimited */
+	int64_t			scbw_tokens;
+	int64_t			scbw_xrate;	/* measured bytes/sec */
+	uint64_t		scbw_nbytes;
+	uint64_t		scbw_nrefused;
+};
+
 struct slmctlmsg_upsch_query {
 	char			scuq_query[0];
 };
@@ -67,3 +78,4 @@ struct slmctlmsg_upsch_query {
 #define SLMCMT_STOP		(NPCMT + 5)
 #define SLMCMT_GETBML		(NPCMT + 6)
 #define SLMCMT_UPSCH_QUERY	(NPCMT + 7)
+#define SLMCMT_GETBWSHAPE	(NPCMT + 8)
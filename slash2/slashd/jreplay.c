@@ -349,6 +349,22 @@ mds_replay_bmap_assign(struct psc_journal_enthdr *pje)
 	return (0);
 }
 
+/*
+ * Throw away a cached copy of a file or directory touched by a replayed
+ * namespace operation to force a reload.
+ */
+__static void
+mds_replay_evict(slfid_t fid)
+{
+	struct fidc_membh *f;
+
+	if (fid == 0 || sl_fcmh_peek_fid(fid, &f))
+		return;
+	FCMH_LOCK(f);
+	f->fcmh_flags |= FCMH_TOFREE;
+	fcmh_op_done(f);
+}
+
 /*
  * Replay a NAMESPACE modification operation.
  *
@@ -364,7 +380,6 @@ mds_replay_namespace(struct slmds_jent_namespace *sjnm)
 	char name[SL_NAME_MAX + 1], newname[SL_NAME_MAX + 1];
 	struct srt_stat sstb;
 	int rc;
-	struct fidc_membh *f = NULL;
 
 	memset(&sstb, 0, sizeof(sstb));
 	sstb.sst_fid = sjnm->sjnm_target_fid,
@@ -451,23 +466,24 @@ mds_replay_namespace(struct slmds_jent_namespace *sjnm)
 	    case NS_OP_SETATTR:
 		rc = mdsio_redo_setattr(current_vfsid,
 		    sjnm->sjnm_target_fid, sjnm->sjnm_mask, &sstb);
-		if (rc)
-			break;
-		/*
-		 * Throw away a cached copy to force a reload.
-		 */
-		rc = sl_fcmh_peek_fg(&sstb.sst_fg, &f);
-		if (!rc) {
-			FCMH_LOCK(f);
-			f->fcmh_flags |= FCMH_TOFREE;
-			fcmh_op_done(f);
-		}
 		break;
 	    default:
 		psclog_errorx("Unexpected opcode %d", sjnm->sjnm_op);
 		rc = EINVAL;
 		break;
 	}
+
+	/*
+	 * Even a failed operation may have changed something, and a
+	 * read replica serves attributes and directory contents out of
+	 * these, so drop every object involved.
+	 */
+	if (sjnm->sjnm_op != NS_OP_RECLAIM) {
+		mds_replay_evict(sjnm->sjnm_parent_fid);
+		mds_replay_evict(sjnm->sjnm_new_parent_fid);
+		mds_replay_evict(sjnm->sjnm_target_fid);
+	}
+
 	if (rc)
 		psclog_errorx("Redo namespace log: "
 		    "op=%d name=%s newname=%s "
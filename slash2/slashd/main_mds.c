@@ -47,6 +47,7 @@
 
 #include "authbuf.h"
 #include "bmap_mds.h"
+#include "bwshape_mds.h"
 #include "ctl_mds.h"
 #include "fidcache.h"
 #include "mdsio.h"
@@ -399,7 +400,7 @@ __dead void
 usage(void)
 {
 	fprintf(stderr,
-	    "usage: %s [-V] [-D datadir] [-f slashconf] [-p zpoolcache] [-S socket]\n"
+	    "usage: %s [-RV] [-D datadir] [-f slashconf] [-p zpoolcache] [-S socket]\n"
 	    "\t[zpoolname]\n",
 	    __progname);
 	exit(1);
@@ -444,7 +445,7 @@ main(int argc, char *argv[])
 	if (p)
 		cfn = p;
 
-	while ((c = getopt(argc, argv, "D:f:p:S:V")) != -1)
+	while ((c = getopt(argc, argv, "D:f:p:RS:V")) != -1)
 		switch (c) {
 		case 'D':
 			sl_datadir = optarg;
@@ -455,6 +456,9 @@ main(int argc, char *argv[])
 		case 'p':
 			zpcachefn = optarg;
 			break;
+		case 'R':
+			slm_replica = 1;
+			break;
 		case 'S':
 			sfn = optarg;
 			break;
@@ -581,6 +585,7 @@ main(int argc, char *argv[])
 	pfl_workq_init(size, 1024, 2048);
 
 	slm_upsch_init();
+	slm_bwshape_init();
 
 	psc_poolmaster_init(&slm_bml_poolmaster,
 	    struct bmap_mds_lease, bml_bmi_lentry, PPMF_AUTO, 2048,
@@ -627,6 +632,10 @@ main(int argc, char *argv[])
 	if (rc != SQLITE_OK)
 		psc_fatalx("Fail to open/create SQLite data base %s", dbfn);
 
+	/* let SQLite back off on contention instead of spinning */
+	sqlite3_busy_timeout(db_handle, 1000);
+	slm_db_init();
+
 	rc = sqlite3_exec(db_handle,
 		"PRAGMA integrity_check", NULL, NULL, &estr);
 	if (rc != SQLITE_OK)
@@ -704,6 +713,13 @@ main(int argc, char *argv[])
 		    total);
 	}
 
+	/* keyset paging of each user's rows, see slm_upsch_page_flow() */
+	dbdo(NULL, NULL, "DROP INDEX IF EXISTS 'upsch_flow_idx'");
+	dbdo(NULL, NULL,
+	    "CREATE INDEX IF NOT EXISTS 'upsch_flow_prio_idx'"
+	    " ON 'upsch' ('resid', 'gid', 'uid', 'sys_prio' DESC,"
+	    " 'usr_prio' DESC, 'fid', 'bno')");
+
 	dbdo(NULL, NULL, "BEGIN TRANSACTION");
 
 	lc_reginit(&slm_db_hipri_workq, struct pfl_workrq, wkrq_lentry,
@@ -19,6 +19,10 @@
  * %END_LICENSE%
  */
 
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
 #include "pfl/alloc.h"
 #include "pfl/atomic.h"
 #include "pfl/ctlsvr.h"
@@ -30,6 +34,7 @@
 #include "pfl/random.h"
 #include "pfl/rpclog.h"
 #include "pfl/rsx.h"
+#include "pfl/str.h"
 #include "pfl/tree.h"
 #include "pfl/treeutil.h"
 #include "pfl/workthr.h"
@@ -1841,10 +1846,28 @@ ptrunc_tally_ios(struct bmap *b, int iosidx, int val, void *arg)
 	}
 }
 
+/*
+ * Forget sliver CRCs starting at @slvrno, as truncation changes the
+ * data they describe.  Returns whether anything was cleared.
+ */
+__static int
+slm_ptrunc_clear_crcs(struct bmap *b, int slvrno)
+{
+	struct bmap_mds_info *bmi = bmap_2_bmi(b);
+	int cleared = 0;
+
+	for (; slvrno < SLASH_SLVRS_PER_BMAP; slvrno++)
+		if (bmi->bmi_crcstates[slvrno] & BMAP_SLVR_CRC) {
+			bmi->bmi_crcstates[slvrno] &= ~BMAP_SLVR_CRC;
+			cleared = 1;
+		}
+	return (cleared);
+}
+
 __static int 
 slm_ptrunc_apply(struct fidc_membh *f)
 {
-	int rc = 0, ret;
+	int rc = 0, ret, cleared;
 	int queued = 0, tract[NBREPLST], retifset[NBREPLST];
 	struct ios_list ios_list;
 	struct bmap *b;
@@ -1871,6 +1894,8 @@ slm_ptrunc_apply(struct fidc_membh *f)
 	rc = bmap_get(f, i, SL_WRITE, &b);
 	if (rc)
 		goto out2;
+	cleared = slm_ptrunc_clear_crcs(b,
+	    fcmh_2_fsz(f) % SLASH_BMAP_SIZE / SLASH_SLVR_SIZE);
 	/*
 	 * Arrange upd_proc_bmap() to call slm_upsch_tryptrunc().
 	 */
@@ -1904,7 +1929,8 @@ slm_ptrunc_apply(struct fidc_membh *f)
                  * If queued, upsch will take a reference with UPD_INCREF().
 		 */
 		upsch_enqueue(upd);
-	}
+	} else if (cleared)
+		mds_bmap_write(b, NULL, NULL);
 	bmap_op_done(b);
 
 	i++;
@@ -1926,10 +1952,13 @@ slm_ptrunc_apply(struct fidc_membh *f)
 			break;
 
 		BHGEN_INCREMENT(b);
+		cleared = slm_ptrunc_clear_crcs(b, 0);
 		ret = mds_repl_bmap_walkcb(b, tract, NULL, 0,
 		    NULL, NULL);
 		if (ret)
 			mds_bmap_write_logrepls(b);
+		else if (cleared)
+			mds_bmap_write(b, NULL, NULL);
 		bmap_op_done(b);
 	}
 
@@ -2078,6 +2107,195 @@ slm_ptrunc_prepare(struct fidc_membh *f, struct srt_stat *sstb, int to_set)
 	return (rc);
 }
 
+/*
+ * Prepared statements are cached by query text since the same handful
+ * of queries are run over and over again by the upsch engine.
+ */
+struct slm_dbstmt {
+	struct pfl_hashentry	 sds_hentry;
+	uint64_t		 sds_key;	/* hash of sds_fmt */
+	char			*sds_fmt;
+	sqlite3_stmt		*sds_sth;
+};
+
+#define SLM_DBSTMT_MAX		256	/* ad hoc ctl queries can be many */
+
+struct psc_hashtbl	 slm_dbstmt_hashtbl;
+int			 slm_dbstmt_count;
+
+/*
+ * Group commit: upsch mutations are batched into one transaction that
+ * is committed once it holds slm_db_commit_rows rows or is
+ * slm_db_commit_msecs old.  Setting either to zero makes every
+ * statement commit on its own again.
+ */
+int			 slm_db_commit_rows = 256;
+int			 slm_db_commit_msecs = 50;
+
+int			 slm_db_txn_rows = -1;	/* -1 if no batch is open */
+struct timespec		 slm_db_txn_start;
+
+__static int
+slm_dbstmt_cmp(const void *cmp, const void *item)
+{
+	const struct slm_dbstmt *sds = item;
+
+	return (strcmp(cmp, sds->sds_fmt) == 0);
+}
+
+void
+slm_db_init(void)
+{
+	psc_hashtbl_init(&slm_dbstmt_hashtbl, 0, struct slm_dbstmt,
+	    sds_key, sds_hentry, 97, slm_dbstmt_cmp, "dbstmt");
+}
+
+/*
+ * Find the prepared statement for a query, preparing and caching it if
+ * need be.  Returns NULL if the statement was not cached, in which
+ * case the caller must finalize it.
+ */
+__static struct slm_dbstmt *
+slm_dbstmt_get(const char *fmt, sqlite3_stmt **sthp)
+{
+	struct slm_dbstmt *sds;
+	uint64_t key;
+	int rc;
+
+	key = psc_str_hashify(fmt);
+	sds = psc_hashtbl_search_cmp(&slm_dbstmt_hashtbl, fmt, &key);
+	if (sds) {
+		OPSTAT_INCR("sql-prepare-hit");
+		*sthp = sds->sds_sth;
+		return (sds);
+	}
+
+	OPSTAT_INCR("sql-prepare-miss");
+	do {
+		rc = sqlite3_prepare_v2(db_handle, fmt, -1, sthp, NULL);
+		if (rc == SQLITE_BUSY)
+			pscthr_yield();
+	} while (rc == SQLITE_BUSY);
+	/* saw SQLITE_MISUSE  = 21  */
+	psc_assert(rc == SQLITE_OK);
+
+	if (slm_dbstmt_count >= SLM_DBSTMT_MAX)
+		return (NULL);
+
+	sds = PSCALLOC(sizeof(*sds));
+	psc_hashent_init(&slm_dbstmt_hashtbl, sds);
+	sds->sds_key = key;
+	sds->sds_fmt = pfl_strdup(fmt);
+	sds->sds_sth = *sthp;
+	psc_hashtbl_add_item(&slm_dbstmt_hashtbl, sds);
+	slm_dbstmt_count++;
+	return (sds);
+}
+
+/*
+ * Determine whether a query controls transactions itself or otherwise
+ * cannot run inside the group commit transaction.
+ */
+__static int
+slm_db_istxnctl(const char *fmt)
+{
+	static const char *const kw[] = {
+		"BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT",
+		"RELEASE", "PRAGMA", "VACUUM"
+	};
+	int i;
+
+	while (isspace(*fmt))
+		fmt++;
+	for (i = 0; i < (int)nitems(kw); i++)
+		if (strncasecmp(fmt, kw[i], strlen(kw[i])) == 0)
+			return (1);
+	return (0);
+}
+
+/*
+ * Notice SQLite having rolled back the group transaction on its own,
+ * as it does after errors such as SQLITE_FULL or SQLITE_IOERR.  The
+ * batch is forgotten so that the next mutation opens a new one instead
+ * of running in autocommit mode while we count rows against nothing.
+ * Returns nonzero if the transaction was lost.
+ */
+__static int
+slm_db_txn_lost_locked(void)
+{
+	psc_mutex_ensure_locked(&slm_upsch_lock);
+	if (slm_db_txn_rows < 0 || !sqlite3_get_autocommit(db_handle))
+		return (0);
+
+	psclog_errorx("SQL transaction rolled back, %d rows lost",
+	    slm_db_txn_rows);
+	OPSTAT_INCR("sql-rollback");
+	slm_db_txn_rows = -1;
+	return (1);
+}
+
+/*
+ * Commit the group transaction, if one is open.
+ */
+__static void
+slm_db_commit_locked(void)
+{
+	int rc;
+
+	psc_mutex_ensure_locked(&slm_upsch_lock);
+	if (slm_db_txn_rows < 0)
+		return;
+
+	rc = sqlite3_exec(db_handle, "COMMIT", NULL, NULL, NULL);
+	if (rc != SQLITE_OK) {
+		psclog_errorx("SQL error: rc=%d query=COMMIT; msg=%s",
+		    rc, sqlite3_errmsg(db_handle));
+		/* if still open, retry next time around */
+		slm_db_txn_lost_locked();
+		return;
+	}
+	OPSTAT_INCR("sql-commit");
+	OPSTAT_ADD("sql-commit-rows", slm_db_txn_rows);
+	slm_db_txn_rows = -1;
+}
+
+void
+slm_db_commit(void)
+{
+	psc_mutex_lock(&slm_upsch_lock);
+	slm_db_commit_locked();
+	psc_mutex_unlock(&slm_upsch_lock);
+}
+
+/*
+ * Commit the group transaction once it has aged enough, for when the
+ * upsch mutations stop coming before slm_db_commit_rows is reached.
+ */
+void
+slmdbcommitthr_main(struct psc_thread *thr)
+{
+	struct timespec now, age;
+	long msecs;
+
+	while (pscthr_run(thr)) {
+		msecs = slm_db_commit_msecs > 0 ? slm_db_commit_msecs :
+		    1000;
+		usleep(msecs * 1000);
+
+		psc_mutex_lock(&slm_upsch_lock);
+		if (slm_db_txn_rows >= 0) {
+			PFL_GETTIMESPEC(&now);
+			timespecsub(&now, &slm_db_txn_start, &age);
+			if (slm_db_commit_msecs <= 0 ||
+			    slm_db_commit_rows <= 1 ||
+			    age.tv_sec * 1000 + age.tv_nsec / 1000000 >=
+			    slm_db_commit_msecs)
+				slm_db_commit_locked();
+		}
+		psc_mutex_unlock(&slm_upsch_lock);
+	}
+}
+
 /*
  * Execute an SQL query on the SQLite database.
  *
@@ -2091,20 +2309,31 @@ _dbdo(const struct pfl_callerinfo *pci,
     int (*cb)(sqlite3_stmt *, void *), void *cbarg,
     const char *fmt, ...)
 {
-	int type, log = 0, dbuf_off = 0, rc, n, i;
+	int type, log = 0, dbuf_off = 0, rc, n, i, txnctl, mutation;
 	char *p, dbuf[LINE_MAX] = "";
 	struct timeval tv, tv0, tvd;
+	struct slm_dbstmt *sds;
 	sqlite3_stmt *sth;
 	va_list ap;
 
-	spinlock(&slm_upsch_lock);
-	do {
-		rc = sqlite3_prepare_v2(db_handle, fmt, -1, &sth, NULL);
-		if (rc == SQLITE_BUSY)
-			pscthr_yield();
-	} while (rc == SQLITE_BUSY);
-	/* saw SQLITE_MISUSE  = 21  */
-	psc_assert(rc == SQLITE_OK);
+	psc_mutex_lock(&slm_upsch_lock);
+	slm_db_txn_lost_locked();
+	txnctl = slm_db_istxnctl(fmt);
+	if (txnctl)
+		slm_db_commit_locked();
+
+	sds = slm_dbstmt_get(fmt, &sth);
+
+	mutation = !txnctl && !sqlite3_stmt_readonly(sth);
+	if (mutation && slm_db_txn_rows < 0 &&
+	    slm_db_commit_rows > 1 && slm_db_commit_msecs > 0 &&
+	    sqlite3_get_autocommit(db_handle)) {
+		rc = sqlite3_exec(db_handle, "BEGIN", NULL, NULL, NULL);
+		if (rc == SQLITE_OK) {
+			slm_db_txn_rows = 0;
+			PFL_GETTIMESPEC(&slm_db_txn_start);
+		}
+	}
 
 	n = sqlite3_bind_parameter_count(sth);
 	va_start(ap, fmt);
@@ -2168,7 +2397,7 @@ _dbdo(const struct pfl_callerinfo *pci,
 		rc = sqlite3_step(sth);
 		if (rc == SQLITE_ROW && cb)
 			cb(sth, cbarg);
-		if (rc != SQLITE_DONE)
+		if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
 			pscthr_yield();
 		if (rc == SQLITE_LOCKED)
 			sqlite3_reset(sth);
@@ -2177,17 +2406,29 @@ _dbdo(const struct pfl_callerinfo *pci,
 	PFL_GETTIMEVAL(&tv);
 	timersub(&tv, &tv0, &tvd);
 	OPSTAT_INCR("sql-query-wait");
-	OPSTAT_ADD("sql-query-wait-usecs",
+	OPSTAT_HIST("sql-query-wait-usecs",
 	    tvd.tv_sec * 1000000 + tvd.tv_usec);
 	if (log)
 		psclog_debug("ran SQL in %.2fs: %s", tvd.tv_sec +
 		    tvd.tv_usec / 1000000.0, dbuf);
 
-	if (rc != SQLITE_DONE)
+	if (rc != SQLITE_DONE) {
 		psclog_errorx("SQL error: rc=%d query=%s; msg=%s", rc,
 		    fmt, sqlite3_errmsg(db_handle));
+		slm_db_txn_lost_locked();
+	}
 
-	sqlite3_finalize(sth);
-	freelock(&slm_upsch_lock);
+	if (mutation && slm_db_txn_rows >= 0) {
+		slm_db_txn_rows += sqlite3_changes(db_handle);
+		if (slm_db_txn_rows >= slm_db_commit_rows)
+			slm_db_commit_locked();
+	}
+
+	if (sds) {
+		sqlite3_reset(sth);
+		sqlite3_clear_bindings(sth);
+	} else
+		sqlite3_finalize(sth);
+	psc_mutex_unlock(&slm_upsch_lock);
 	return (rc == SQLITE_DONE ? 0 : rc);
 }
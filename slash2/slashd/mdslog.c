@@ -84,6 +84,15 @@ struct update_prog_entry {
 	int32_t			 _pad;
 };
 
+/* namespace update progress tracker from peer MDSes */
+struct update_recv_entry {
+	uint64_t		 ure_xid;
+	sl_ios_id_t		 ure_id;
+	int32_t			 _pad;
+};
+
+#define UR_ENTSZ		sizeof(struct update_recv_entry)
+
 /* max # IOS records in one progress file */
 #define MAX_RECLAIM_PROG_ENTRY	1024
 
@@ -98,6 +107,9 @@ struct reclaim_prog_entry {
 struct slm_progress		 nsupd_prg;
 struct slm_progress		 reclaim_prg;
 
+static void			*mds_update_recv_handle;
+static struct update_recv_entry	*mds_update_recv_buf;
+
 /* max # of seconds to wait for updates before hard retry */
 #define SL_UPDATE_MAX_AGE	 30
 #define SL_RECLAIM_MAX_AGE	 30
@@ -195,6 +207,36 @@ mds_record_update_prog(void)
 	psc_assert(size == i * UP_ENTSZ);
 }
 
+/*
+ * Persist the xid of the last namespace update applied from each peer
+ * MDS.  The namespace update handler serializes callers.
+ */
+int
+mds_record_update_recv_prog(void)
+{
+	struct sl_mds_peerinfo *sp;
+	struct update_recv_entry *ur;
+	struct sl_resm *resm;
+	size_t size;
+	int i, rc;
+
+	i = 0;
+	SL_MDS_WALK(resm,
+		if (resm == nodeResm)
+			continue;
+		sp = res2rpmi(resm->resm_res)->rpmi_info;
+		ur = &mds_update_recv_buf[i];
+		ur->ure_id = resm->resm_res_id;
+		ur->ure_xid = sp->sp_recv_seqno;
+		i++;
+	);
+	rc = mds_write_file(mds_update_recv_handle, mds_update_recv_buf,
+	    i * UR_ENTSZ, &size, 0);
+	if (rc == 0 && size != i * UR_ENTSZ)
+		rc = EIO;
+	return (rc);
+}
+
 static void
 mds_record_reclaim_prog(void)
 {
@@ -1004,7 +1046,7 @@ mds_send_batch_update(uint64_t batchno)
 	struct sl_resm *resm;
 	struct sl_site *site;
 	struct iovec iov;
-	uint64_t xid;
+	uint64_t xid, cur_xid;
 	size_t size;
 	void *handle;
 
@@ -1046,6 +1088,10 @@ mds_send_batch_update(uint64_t batchno)
 
 	npeers = 0;
 
+	spinlock(&mds_distill_lock);
+	cur_xid = nsupd_prg.cur_xid;
+	freelock(&mds_distill_lock);
+
 	CONF_LOCK();
 	CONF_FOREACH_SITE(site)
 	    SITE_FOREACH_RES(site, res, siter) {
@@ -1115,6 +1161,7 @@ mds_send_batch_update(uint64_t batchno)
 		mq->count = i;
 		mq->size = iov.iov_len;
 		mq->siteid = nodeSite->site_id;
+		mq->seqno = cur_xid;
 
 		slrpc_bulkclient(rq, BULK_GET_SOURCE, SRMM_BULK_PORTAL,
 		    &iov, 1);
@@ -1152,6 +1199,67 @@ mds_send_batch_update(uint64_t batchno)
 	return (didwork);
 }
 
+/*
+ * Tell peer MDSes that have applied all of our namespace updates that
+ * they are still current.  A read replica uses this to bound how stale
+ * the namespace it serves may be while we have nothing to send.
+ */
+__static void
+mds_send_update_heartbeat(void)
+{
+	struct slrpc_cservice *csvc;
+	struct sl_mds_peerinfo *sp;
+	struct srm_update_rep *mp;
+	struct srm_update_req *mq;
+	struct pscrpc_request *rq;
+	struct sl_resource *res;
+	struct sl_resm *resm;
+	struct sl_site *site;
+	uint64_t xid;
+	int siter, rc;
+
+	spinlock(&mds_distill_lock);
+	xid = nsupd_prg.cur_xid;
+	freelock(&mds_distill_lock);
+
+	CONF_LOCK();
+	CONF_FOREACH_SITE(site)
+	    SITE_FOREACH_RES(site, res, siter) {
+		if (res->res_type != SLREST_MDS)
+			continue;
+		resm = psc_dynarray_getpos(&res->res_members, 0);
+		if (resm == nodeResm)
+			continue;
+		sp = resm2rpmi(resm)->rpmi_info;
+		if (xid && sp->sp_xid <= xid)
+			continue;
+
+		csvc = slm_getmcsvc_wait(resm, 0);
+		if (csvc == NULL)
+			continue;
+		rc = SL_RSX_NEWREQ(csvc, SRMT_NAMESPACE_UPDATE, rq, mq,
+		    mp);
+		if (rc) {
+			sl_csvc_decref(csvc);
+			continue;
+		}
+		mq->count = 0;
+		mq->size = 0;
+		mq->siteid = nodeSite->site_id;
+		mq->seqno = xid;
+
+		rc = SL_RSX_WAITREP(csvc, rq, mp);
+		if (rc == 0)
+			rc = mp->rc;
+		if (rc)
+			psclog_diag("heartbeat to %s failed: rc=%d",
+			    resm->resm_name, rc);
+		pscrpc_req_finished(rq);
+		sl_csvc_decref(csvc);
+	}
+	CONF_ULOCK();
+}
+
 /*
  * Write some system information into our cursor file.  Note that every
  * field must be protected by a spinlock. It is called from zfs_write().
@@ -1716,6 +1824,8 @@ slmjnsthr_main(struct psc_thread *thr)
 			batchno++;
 		} while (didwork && mds_update_hwm(1) >= batchno);
 
+		mds_send_update_heartbeat();
+
 		spinlock(&nsupd_prg.lock);
 		psc_waitq_waitrel_s(&nsupd_prg.waitq, &nsupd_prg.lock,
 		    SL_UPDATE_MAX_AGE);
@@ -2144,6 +2254,36 @@ mds_journal_init(uint64_t fsuuid)
 	    "nsupd_prg.cur_xid = %"PRId64,
 	    nsupd_prg.cur_batchno, nsupd_prg.cur_xid);
 
+	/*
+	 * Load how far we got applying updates from each peer.  File
+	 * systems made before this file existed start with none.
+	 */
+	xmkfn(fn, "%s", SL_FN_UPDATERECVPROG);
+	rc = mds_open_file(fn, O_RDWR | O_CREAT, &mds_update_recv_handle);
+	if (rc)
+		psc_fatalx("failed to open %s: %s", fn, sl_strerror(rc));
+
+	mds_update_recv_buf = PSCALLOC(MAX_UPDATE_PROG_ENTRY *
+	    UR_ENTSZ);
+	rc = mds_read_file(mds_update_recv_handle, mds_update_recv_buf,
+	    MAX_UPDATE_PROG_ENTRY * UR_ENTSZ, &size, 0);
+	psc_assert(rc == 0);
+
+	count = size / UR_ENTSZ;
+	for (i = 0; i < count; i++) {
+		res = libsl_id2res(mds_update_recv_buf[i].ure_id);
+		if (res == NULL || res->res_type != SLREST_MDS) {
+			psclog_warnx("non-MDS resource ID %u "
+			    "in update receive file",
+			    mds_update_recv_buf[i].ure_id);
+			continue;
+		}
+		sp = res2rpmi(res)->rpmi_info;
+		sp->sp_recv_seqno = mds_update_recv_buf[i].ure_xid;
+	}
+	mds_update_recv_buf = psc_realloc(mds_update_recv_buf,
+	    npeers * UR_ENTSZ, 0);
+
  replay_log:
 	slm_journal->pj_npeers = npeers;
 	slm_journal->pj_distill_xid = last_distill_xid;
@@ -45,6 +45,7 @@
 #include "pfl/waitq.h"
 
 #include "bmap_mds.h"
+#include "bwshape_mds.h"
 #include "fid.h"
 #include "fidc_mds.h"
 #include "fidcache.h"
@@ -1083,10 +1084,13 @@ mds_repl_delrq(const struct sl_fidgen *fgp, sl_bmapno_t bmapno,
  * @src: source resm.
  * @dst: destination resm.
  * @amt: adjustment amount in bytes.
+ * @rc: on release, the result of the replication.
+ * @bwsp: on refusal, the rate limit that refused, or NULL if it was
+ *	the cap on pending bytes.
  */
 int
 resmpair_bw_adj(struct sl_resm *src, struct sl_resm *dst,
-    int64_t amt, int rc)
+    int64_t amt, int rc, struct slm_bwshape **bwsp)
 {
 	int ret = 1;
 	struct resprof_mds_info *r_min, *r_max;
@@ -1110,14 +1114,20 @@ resmpair_bw_adj(struct sl_resm *src, struct sl_resm *dst,
 		if (cap) {
 			src_total = is->si_repl_ingress_pending + 
 			    is->si_repl_egress_pending + amt;
-			dst_total = is->si_repl_ingress_pending + 
-			    is->si_repl_egress_pending + amt;
+			dst_total = id->si_repl_ingress_pending + 
+			    id->si_repl_egress_pending + amt;
 			if ((src_total > cap * BW_UNITSZ) || 
 			     dst_total > cap * BW_UNITSZ) { 
+				if (bwsp)
+					*bwsp = NULL;
 				ret = 0;
 				goto out;
 			}
 		}
+		if (!slm_bwshape_admit(src, dst, amt, bwsp)) {
+			ret = 0;
+			goto out;
+		}
 		is->si_repl_egress_pending += amt;
 		id->si_repl_ingress_pending += amt;
 
@@ -1135,19 +1145,17 @@ resmpair_bw_adj(struct sl_resm *src, struct sl_resm *dst,
 			is->si_repl_egress_aggr += -amt;
 			id->si_repl_ingress_aggr += -amt;
 		}
-		/*
-		 * We released some bandwidth; wake anyone waiting for
-		 * some.
-		 */
-#if 0
-		CSVC_WAKE(src->resm_csvc);
-		CSVC_WAKE(dst->resm_csvc);
-#endif
 	}
 
  out:
 	RPMI_ULOCK(r_max);
 	RPMI_ULOCK(r_min);
 
+	/*
+	 * We released some bandwidth; wake anyone waiting for some.
+	 */
+	if (amt < 0)
+		slm_bwshape_wake();
+
 	return (ret);
 }
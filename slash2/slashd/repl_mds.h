@@ -29,6 +29,7 @@
 #define SLM_REPLRQ_NBMAPS_MAX	64
 
 struct resm_mds_info;
+struct slm_bwshape;
 
 struct slm_replst_workreq {
 	struct slrpc_cservice	*rsw_csvc;
@@ -49,7 +50,8 @@ int	 mds_repl_delrq(const struct sl_fidgen *, sl_bmapno_t, sl_bmapno_t *, sl_rep
 int	_mds_repl_ios_lookup(int, struct slash_inode_handle *, sl_ios_id_t, int);
 int	_mds_repl_iosv_lookup(int, struct slash_inode_handle *, const sl_replica_t [], int [], int, int);
 
-int	 resmpair_bw_adj(struct sl_resm *, struct sl_resm *, int64_t, int);
+int	 resmpair_bw_adj(struct sl_resm *, struct sl_resm *, int64_t, int,
+	    struct slm_bwshape **);
 
 void	 slm_repl_upd_write(struct bmap *, int);
 
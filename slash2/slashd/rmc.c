@@ -258,6 +258,16 @@ slm_fcmh_coherent_callback(struct fidc_membh *f,
 	/* default is no cache - once only */
 	lease = 0;
 
+	/*
+	 * A read replica never sees client modifications, so it could
+	 * not break a lease it handed out.
+	 */
+	if (slm_replica) {
+		if (leasep)
+			*leasep = 0;
+		return (0);
+	}
+
 	fmi = fcmh_2_fmi(f);
 	FCMH_LOCK(f);
 	psclist_for_each(tmp, &fmi->fmi_callbacks) {
@@ -2176,6 +2186,34 @@ slm_rmc_handle_getreplst(struct pscrpc_request *rq)
 /*
  * Handle a RPC request, called from pscrpc_server_handle_request().
  */
+/*
+ * A read replica only answers the namespace lookups that it can serve
+ * from the updates it has applied, and only while it is not too far
+ * behind its primary.  Clients send everything else to the primary.
+ */
+__static int
+slm_rmc_replica_check(int opc)
+{
+	switch (opc) {
+	case SRMT_CONNECT:
+	case SRMT_PING:
+		return (0);
+	case SRMT_GETATTR:
+	case SRMT_LOOKUP:
+	case SRMT_READDIR:
+	case SRMT_READLINK:
+		if (slm_replica_lag() > slm_replica_maxlag) {
+			OPSTAT_INCR("replica-stale");
+			return (-SLERR_MDS_STALE);
+		}
+		OPSTAT_INCR("replica-read");
+		return (0);
+	default:
+		OPSTAT_INCR("replica-reject");
+		return (-SLERR_MDS_READONLY);
+	}
+}
+
 int
 slm_rmc_handler(struct pscrpc_request *rq)
 {
@@ -2194,6 +2232,12 @@ slm_rmc_handler(struct pscrpc_request *rq)
 
 	pfl_fault_here(NULL, RMC_HANDLE_FAULT);
 
+	if (slm_replica) {
+		rc = slm_rmc_replica_check(rq->rq_reqmsg->opc);
+		if (rc)
+			PFL_GOTOERR(out, rc);
+	}
+
 	switch (rq->rq_reqmsg->opc) {
 	/* bmap messages */
 	case SRMT_BMAPCHWRMODE:
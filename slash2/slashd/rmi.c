@@ -95,6 +95,89 @@ slm_rmi_handle_bmap_getcrcs(struct pscrpc_request *rq)
 	return (0);
 }
 
+/*
+ * Handle a BMAPCRCWRT request from ION, which carries the recomputed
+ * data checksums of slivers written since the last update.  These are
+ * recorded in the bmap so subsequent reads on any ION can verify the
+ * data they fault in from the backing store.  Updates written under a
+ * write lease older than the bmap's newest one are rejected unless
+ * they come from the ION holding the current lease, so a delayed
+ * update from a stale ION cannot overwrite newer CRCs.
+ * @rq: request.
+ */
+int
+slm_rmi_handle_bmap_crcwrt(struct pscrpc_request *rq)
+{
+	struct srm_bmap_crcwrt_req *mq;
+	struct srm_bmap_crcwrt_rep *mp;
+	struct bmap_mds_info *bmi;
+	struct fidc_membh *f;
+	struct bmap *b = NULL;
+	struct sl_resm *m;
+	sl_ios_id_t iosid;
+	int idx, vfsid;
+	uint32_t i;
+
+	SL_RSX_ALLOCREP(rq, mq, mp);
+	if (mq->ncrcs > MAX_BMAP_NCRC_UPDATES || mq->ncrcs == 0) {
+		psclog_errorx("ncrcs=%u is > %d", mq->ncrcs,
+		    MAX_BMAP_NCRC_UPDATES);
+		mp->rc = -EINVAL;
+		return (0);
+	}
+	for (i = 0; i < mq->ncrcs; i++)
+		if (mq->crcs[i].slot >= SLASH_SLVRS_PER_BMAP) {
+			mp->rc = -EINVAL;
+			return (0);
+		}
+	iosid = libsl_nid2iosid(rq->rq_conn->c_peer.nid);
+
+	mp->rc = slm_fcmh_get(&mq->fg, &f);
+	if (mp->rc)
+		return (0);
+	mp->rc = -slfid_to_vfsid(fcmh_2_fid(f), &vfsid);
+	if (mp->rc)
+		goto out;
+	idx = mds_repl_ios_lookup(vfsid, fcmh_2_inoh(f), iosid);
+	if (idx < 0) {
+		psclog_warnx("CRC update: invalid IOS %x", iosid);
+		mp->rc = idx;
+		goto out;
+	}
+
+	mp->rc = bmap_get(f, mq->bmapno, SL_WRITE, &b);
+	if (mp->rc)
+		goto out;
+
+	bmi = bmap_2_bmi(b);
+	m = libsl_try_nid2resm(rq->rq_peer.nid);
+	if (mq->seq < bmi->bmi_seq &&
+	    (m == NULL || bmi->bmi_wr_ion != resm2rmmi(m))) {
+		OPSTAT_INCR("bmap-crc-update-stale");
+		DEBUG_BMAP(PLL_WARN, b, "stale CRC update from IOS %x: "
+		    "seq=%"PRIu64" < %"PRIu64, iosid, mq->seq,
+		    bmi->bmi_seq);
+		mp->rc = -SLERR_GEN_OLD;
+		bmap_op_done(b);
+		goto out;
+	}
+	for (i = 0; i < mq->ncrcs; i++) {
+		bmi->bmi_crcs[mq->crcs[i].slot] = mq->crcs[i].crc;
+		bmi->bmi_crcstates[mq->crcs[i].slot] |=
+		    BMAP_SLVR_DATA | BMAP_SLVR_CRC;
+	}
+	OPSTAT_ADD("bmap-crc-update", mq->ncrcs);
+
+	/* use nolog like mds_file_update() */
+	mp->rc = -mds_bmap_write(b, NULL, NULL);
+	DEBUG_BMAP(mp->rc ? PLL_ERROR : PLL_DIAG, b,
+	    "CRC update ncrcs=%u rc=%d", mq->ncrcs, mp->rc);
+	bmap_op_done(b);
+
+ out:
+	fcmh_op_done(f);
+	return (0);
+}
 
 int
 mds_file_update(sl_ios_id_t iosid, struct srt_update_rec *recp)
@@ -369,6 +452,9 @@ slm_rmi_handler(struct pscrpc_request *rq)
 	case SRMT_GETBMAPCRCS:
 		rc = slm_rmi_handle_bmap_getcrcs(rq);
 		break;
+	case SRMT_BMAPCRCWRT:
+		rc = slm_rmi_handle_bmap_crcwrt(rq);
+		break;
 	case SRMT_GETBMAPMINSEQ:
 		rc = slm_rmi_handle_bmap_getminseq(rq);
 		break;
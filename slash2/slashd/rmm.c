@@ -26,7 +26,11 @@
 #define PSC_SUBSYS PSS_RPC
 
 #include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "pfl/str.h"
 #include "pfl/rpc.h"
@@ -34,6 +38,7 @@
 #include "pfl/rsx.h"
 #include "pfl/service.h"
 #include "pfl/lock.h"
+#include "pfl/pthrutil.h"
 
 #include "batchrpc.h"
 #include "fid.h"
@@ -47,10 +52,68 @@
 
 #include "zfs-fuse/zfs_slashlib.h"
 
+int			slm_replica;			/* serve reads only */
+int			slm_replica_maxlag = SLM_REPLICA_MAXLAG;
+time_t			slm_replica_synced;		/* last caught up with primary */
+
+/* serializes applying namespace updates and recording our progress */
+struct pfl_mutex	slm_rmm_nsupd_mutex = PSC_MUTEX_INIT;
+
+/*
+ * Apply a namespace update from a peer MDS by replaying it the same
+ * way as an entry from our own journal.
+ */
 int
-slm_rmm_apply_update(__unusedx struct srt_update_entry *entryp)
+slm_rmm_apply_update(struct srt_update_entry *entryp)
 {
-	psc_fatal("obsolete code path");
+	struct slmds_jent_namespace sjnm;
+
+	if (entryp->namelen + entryp->namelen2 > SL_TWO_NAME_MAX)
+		return (EINVAL);
+
+	memset(&sjnm, 0, sizeof(sjnm));
+	sjnm.sjnm_magic = SJ_NAMESPACE_MAGIC;
+	sjnm.sjnm_op = entryp->op;
+	sjnm.sjnm_namelen = entryp->namelen;
+	sjnm.sjnm_namelen2 = entryp->namelen2;
+
+	sjnm.sjnm_parent_fid = entryp->parent_fid;
+	sjnm.sjnm_target_fid = entryp->target_fid;
+	sjnm.sjnm_target_gen = entryp->target_gen;
+	sjnm.sjnm_new_parent_fid = entryp->new_parent_fid;
+
+	sjnm.sjnm_mask = entryp->mask;
+	sjnm.sjnm_mode = entryp->mode;
+	sjnm.sjnm_uid = entryp->uid;
+	sjnm.sjnm_gid = entryp->gid;
+
+	sjnm.sjnm_atime = entryp->atime;
+	sjnm.sjnm_atime_ns = entryp->atime_ns;
+	sjnm.sjnm_mtime = entryp->mtime;
+	sjnm.sjnm_mtime_ns = entryp->mtime_ns;
+	sjnm.sjnm_ctime = entryp->ctime;
+	sjnm.sjnm_ctime_ns = entryp->ctime_ns;
+
+	sjnm.sjnm_size = entryp->size;
+
+	memcpy(sjnm.sjnm_name, entryp->name,
+	    entryp->namelen + entryp->namelen2);
+
+	return (mds_replay_namespace(&sjnm));
+}
+
+/*
+ * Return the number of seconds since we last held every namespace
+ * update our primary had when it contacted us.
+ */
+int
+slm_replica_lag(void)
+{
+	time_t synced = slm_replica_synced;
+
+	if (synced == 0)
+		return (INT_MAX);
+	return (time(NULL) - synced);
 }
 
 /*
@@ -66,16 +129,36 @@ slm_rmm_handle_namespace_update(struct pscrpc_request *rq)
 	struct sl_resource *res;
 	struct sl_site *site;
 	struct iovec iov;
-	int i, len, count;
+	int i, len, count, rc;
+	uint64_t xid = 0;
 
 	SL_RSX_ALLOCREP(rq, mq, mp);
 
 	count = mq->count;
-	if (count <= 0 || mq->size > LNET_MTU) {
+	if (count < 0 || mq->size < 0 || mq->size > LNET_MTU) {
 		mp->rc = -EINVAL;
 		return (mp->rc);
 	}
 
+	/*
+	 * An empty batch is a heartbeat from a peer that has nothing
+	 * newer than what we already applied.
+	 */
+	if (count == 0) {
+		OPSTAT_INCR("nsupd-heartbeat");
+		slm_replica_synced = time(NULL);
+		return (0);
+	}
+
+	/*
+	 * Only a read replica shares its namespace with the sender.
+	 * Acknowledge the batch anyway so the sender can trim its log.
+	 */
+	if (!slm_replica) {
+		OPSTAT_INCR("nsupd-ignore");
+		return (0);
+	}
+
 	iov.iov_len = mq->size;
 	iov.iov_base = PSCALLOC(mq->size);
 
@@ -99,17 +182,59 @@ slm_rmm_handle_namespace_update(struct pscrpc_request *rq)
 	}
 
 	/*
-	 * Iterate through the namespace update buffer and apply updates.
-	 * If we fail to apply an update, we still report success to our
-	 * peer because reporting an error does not help our cause.
+	 * Iterate through the namespace update buffer and apply updates
+	 * in order.  The peer resends a batch from the first entry we
+	 * have not acknowledged, so skip the ones we already applied.
+	 * Stop at the first one we cannot apply and report the error so
+	 * the peer resends from there instead of trimming its log past
+	 * an update we never made.
 	 */
+	psc_mutex_lock(&slm_rmm_nsupd_mutex);
 	entryp = iov.iov_base;
 	for (i = 0; i < count; i++) {
-		slm_rmm_apply_update(entryp);
+		if (PSC_AGP(entryp, offsetof(struct srt_update_entry,
+		    name)) > PSC_AGP(iov.iov_base, mq->size))
+			break;
 		len = UPDATE_ENTRY_LEN(entryp);
+		if (PSC_AGP(entryp, len) > PSC_AGP(iov.iov_base,
+		    mq->size))
+			break;
+		if (entryp->xid <= p->sp_recv_seqno) {
+			OPSTAT_INCR("nsupd-dup");
+			xid = entryp->xid;
+			entryp = PSC_AGP(entryp, len);
+			continue;
+		}
+		rc = slm_rmm_apply_update(entryp);
+		if (rc) {
+			psclog_warnx("namespace update from site %d "
+			    "failed: xid=%"PRIu64" op=%d rc=%d",
+			    mq->siteid, entryp->xid, entryp->op, rc);
+			OPSTAT_INCR("nsupd-apply-fail");
+			mp->rc = -rc;
+			break;
+		}
+		xid = p->sp_recv_seqno = entryp->xid;
+		rc = mds_record_update_recv_prog();
+		if (rc) {
+			psclog_warnx("failed to record namespace update "
+			    "progress: xid=%"PRIu64" rc=%d", xid, rc);
+			mp->rc = -rc;
+			break;
+		}
 		entryp = PSC_AGP(entryp, len);
 	}
+	psc_mutex_unlock(&slm_rmm_nsupd_mutex);
 	zfsslash2_wait_synced(0);
+	if (mp->rc)
+		goto out;
+
+	if (i < count)
+		psclog_warnx("truncated namespace update from site %d: "
+		    "applied %d of %d", mq->siteid, i, count);
+	else if (xid >= mq->seqno)
+		/* we now have everything the peer had distilled */
+		slm_replica_synced = time(NULL);
 
  out:
 	PSCFREE(iov.iov_base);
@@ -44,7 +44,10 @@
 struct fidc_membh;
 struct srt_stat;
 
+struct slm_bws_sched;
+struct slm_bwshape;
 struct slm_sth;
+struct slm_upsch_resq;
 struct bmap_mds_lease;
 extern int slm_lease_timeout;
 extern int slm_callback_timeout;
@@ -64,10 +67,11 @@ enum {
 	SLMTHRT_CTL,			/* control processor */
 	SLMTHRT_CTLAC,			/* control acceptor */
 	SLMTHRT_CURSOR,			/* cursor update thread */
+	SLMTHRT_DBCOMMIT,		/* upsch database group commit */
 	SLMTHRT_DBWORKER,		/* database worker */
 	SLMTHRT_JNAMESPACE,		/* namespace propagating thread */
 	SLMTHRT_JRECLAIM,		/* garbage reclamation thread */
-	SLMTHRT_JRNL,			/* journal distill thread */
+	SLMTHRT_JRNL,			/* journal distill/commit threads */
 	SLMTHRT_LNETAC,			/* lustre net accept thr */
 	SLMTHRT_NBRQ,			/* non-blocking RPC reply handler */
 	SLMTHRT_RCM,			/* CLI <- MDS msg issuer */
@@ -111,6 +115,7 @@ PSCTHR_MKCAST(slmrmmthr, slmrmm_thread, SLMTHRT_RMM)
 PSCTHR_MKCAST(slmdbwkthr, slmdbwk_thread, SLMTHRT_DBWORKER)
 
 struct site_mds_info {
+	struct slm_bws_sched	 *smi_bws_link;		/* repl_link_bw */
 };
 
 static __inline struct site_mds_info *
@@ -158,7 +163,7 @@ struct rpmi_mds {
 
 	int			  sp_send_count;	/* # of updates in the batch */
 	uint64_t		  sp_send_seqno;	/* next log sequence number to send */
-	uint64_t		  sp_recv_seqno;	/* last received log sequence number */
+	uint64_t		  sp_recv_seqno;	/* xid of last update applied from peer */
 
 	struct slm_nsstats	  sp_stats;
 };
@@ -191,6 +196,10 @@ struct rpmi_ios {
 	int64_t			  si_repl_egress_pending;
 	int64_t			  si_repl_ingress_aggr;
 	int64_t			  si_repl_egress_aggr;
+
+	struct slm_upsch_resq	 *si_upschq;		/* replication work queue */
+	struct slm_bwshape	 *si_bws_egress;	/* replication rate limits */
+	struct slm_bwshape	 *si_bws_ingress;
 };
 #define sl_mds_iosinfo rpmi_ios
 
@@ -268,6 +277,7 @@ struct slm_wkdata_upsch_purge {
 struct slm_wkdata_upschq {
 	slfid_t			 fid;
 	sl_bmapno_t		 bno;
+	struct slm_upsch_resq	*upq;			/* NULL if not from the pager */
 };
 
 struct slm_wkdata_rmdir_ino {
@@ -293,6 +303,8 @@ struct mio_rootnames {
 #define SLM_NWORKER_THREADS	6
 #define SLM_NUPSCHED_THREADS	4
 
+#define SLM_REPLICA_MAXLAG	60		/* secs a read replica may lag */
+
 enum {
 	SLM_OPSTATE_INIT = 0,
 	SLM_OPSTATE_REPLAY,
@@ -308,6 +320,8 @@ int	mds_lease_reassign(struct fidc_membh *, struct srt_bmapdesc *,
 
 int	mds_sliod_alive(void *);
 
+int	slm_replica_lag(void);
+
 void	slmbkdbthr_main(struct psc_thread *);
 void	slmbmaptimeothr_spawn(void);
 void	slmctlthr_spawn(const char *);
@@ -331,12 +345,17 @@ int	slm_wkcb_wr_brepl(void *);
 int	 _dbdo(const struct pfl_callerinfo *,
 	    int (*)(sqlite3_stmt *, void *), void *, const char *,
 	    ...);
+void	 slm_db_init(void);
+void	 slm_db_commit(void);
+void	 slmdbcommitthr_main(struct psc_thread *);
 
 extern struct slash_creds	 rootcreds;
 extern struct pfl_odt		*slm_bia_odt;
 extern struct slm_nsstats	 slm_nsstats_aggr;	/* aggregate namespace stats */
 extern struct psc_listcache	 slm_db_hipri_workq;
 extern struct psc_listcache	 slm_db_lopri_workq;
+extern int			 slm_db_commit_rows;
+extern int			 slm_db_commit_msecs;
 
 extern struct psc_thread	*slmconnthr;
 
@@ -349,6 +368,9 @@ extern int			 slm_force_dio;
 extern int			 slm_crc_check;
 extern int			 slm_conn_debug;
 extern int			 slm_global_mount;
+extern int			 slm_replica;
+extern int			 slm_replica_maxlag;
+extern time_t			 slm_replica_synced;
 extern int			 slm_max_ios;
 extern int			 slm_ptrunc_enabled;
 extern int			 slm_preclaim_enabled;
@@ -360,6 +382,7 @@ extern struct psc_hashtbl	 slm_roots;
 extern int			 debug_ondisk_inode;
 
 extern int	mds_update_boot_file(void);
+extern int	mds_record_update_recv_prog(void);
 
 extern int	mds_open_file(char *, int, void **);
 extern int	mds_read_file(void *, void *, uint64_t, size_t *, off_t);
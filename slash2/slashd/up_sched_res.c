@@ -31,10 +31,12 @@
 #include <sys/param.h>
 
 #include <dirent.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include <sqlite3.h>
 
+#include "pfl/alloc.h"
 #include "pfl/cdefs.h"
 #include "pfl/ctlsvr.h"
 #include "pfl/dynarray.h"
@@ -47,11 +49,13 @@
 #include "pfl/rpclog.h"
 #include "pfl/rsx.h"
 #include "pfl/thread.h"
+#include "pfl/time.h"
 #include "pfl/treeutil.h"
 #include "pfl/workthr.h"
 
 #include "bmap_mds.h"
 #include "batchrpc.h"
+#include "bwshape_mds.h"
 #include "mdsio.h"
 #include "pathnames.h"
 #include "repl_mds.h"
@@ -74,7 +78,7 @@
 #define IP_SRCRESM	2
 #define IP_BMAP		3
 
-psc_spinlock_t           slm_upsch_lock;
+struct pfl_mutex	 slm_upsch_lock;	/* serializes SQLite access */
 struct psc_waitq	 slm_upsch_waitq;
 
 struct psc_waitq	 slm_pager_workq = PSC_WAITQ_INIT("pager");
@@ -86,6 +90,8 @@ int	slm_upsch_repl_expire = 3;
 int	slm_upsch_preclaim_expire = 20;
 int	slm_upsch_page_interval = 300;
 int	slm_upsch_batch_size = 64;
+int	slm_upsch_cache_max = UPSCH_CACHE_MAX;
+int	slm_upsch_window = UPSCH_WINDOW;
 
 extern struct slrpc_batch_rep_handler slm_batch_rep_preclaim;
 extern struct slrpc_batch_rep_handler slm_batch_rep_repl;
@@ -205,7 +211,7 @@ slm_batch_repl_cb(void *req, void *rep, void *scratch, int rc)
 	if (f)
 		fcmh_op_done(f);
 
-	resmpair_bw_adj(src_resm, dst_resm, -bsr->bsr_amt, rc);
+	resmpair_bw_adj(src_resm, dst_resm, -bsr->bsr_amt, rc, NULL);
 }
 
 /*
@@ -213,11 +219,14 @@ slm_batch_repl_cb(void *req, void *rep, void *scratch, int rc)
  * pair.  We estimate the data to reserve bandwidth then add the entry
  * to a batch RPC for the destination.  We mark the bmap residency table
  * and update the upsch database to avoid reprocessing until we receive
- * success or failure status from the destination IOS.
+ * success or failure status from the destination IOS.  If bandwidth
+ * could not be reserved, @throttled is set and @bwsp tells which rate
+ * limit was hit.
  */
 int
 slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
-    struct sl_resource *dst_res)
+    struct sl_resource *dst_res, int *throttled,
+    struct slm_bwshape **bwsp)
 {
 	int chg = 0, tract[NBREPLST], retifset[NBREPLST], rc;
 	struct slrpc_cservice *csvc = NULL;
@@ -244,8 +253,9 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 		return (1);
 	}
 
-	if (!resmpair_bw_adj(src_resm, dst_resm, amt, 0)) {
+	if (!resmpair_bw_adj(src_resm, dst_resm, amt, 0, bwsp)) {
 		OPSTAT_INCR("repl-throttle");
+		*throttled = 1;
 		return (0);
 	}
 
@@ -356,7 +366,7 @@ slm_upsch_tryrepl(struct bmap *b, int off, struct sl_resm *src_resm,
 		mds_repl_bmap_apply(b, tract, NULL, off);
 	}
 
-	resmpair_bw_adj(src_resm, dst_resm, -bsr->bsr_amt, rc);
+	resmpair_bw_adj(src_resm, dst_resm, -bsr->bsr_amt, rc, NULL);
 
 	PSCFREE(bsr);
 
@@ -645,7 +655,8 @@ slm_upsch_trypreclaim(struct sl_resource *r, struct bmap *b, int off)
 int
 slm_upsch_sched_repl(struct bmap_mds_info *bmi,  int dst_idx)
 {
-	int off, valid_exists = 0;
+	int off, valid_exists = 0, throttled = 0;
+	struct slm_bwshape *bws = NULL;
 	struct sl_resource *dst_res;
 	struct sl_resm *m;
 	struct fidc_membh *f;
@@ -712,10 +723,17 @@ slm_upsch_sched_repl(struct bmap_mds_info *bmi,  int dst_idx)
 		sl_csvc_decref(csvc);
 
 		/* bail if success */
-		if (slm_upsch_tryrepl(b, off, m, dst_res))
+		if (slm_upsch_tryrepl(b, off, m, dst_res, &throttled,
+		    &bws))
 			goto out;
 	}
 
+	/* retry as soon as there is bandwidth instead of next scan */
+	if (throttled) {
+		slm_bwshape_defer(fcmh_2_fid(f), b->bcm_bmapno, bws);
+		return (0);
+	}
+
 	if (!valid_exists) {
 		int tract[NBREPLST], retifset[NBREPLST];
 
@@ -952,95 +970,383 @@ upd_pagein_wk(void *p)
 		bmap_op_done(b);
 	if (f) 
 		fcmh_op_done(f);
+
+	/* let the pager know there is room for more */
+	if (wk->upq && psc_atomic32_dec_getnew(&wk->upq->upq_inflight) ==
+	    slm_upsch_window / 2)
+		psc_waitq_wakeall(&slm_pager_workq);
 	return (0);
 }
 
 int
-upd_proc_pagein_cb(sqlite3_stmt *sth, void *p)
+slm_upsch_flow_cmpid(const void *a, const void *b)
 {
-	struct slm_wkdata_upschq *wk;
-	struct psc_dynarray *da = p;
+	const struct slm_upsch_flow * const *pa = a, * const *pb = b;
+	const struct slm_upsch_flow *x = *pa, *y = *pb;
+	int rc;
 
-	/*
- 	 * Accumulate work items here and submit them in a batch later
- 	 * so that we know when the paging is really done.
- 	 */
+	rc = CMP(x->upf_gid, y->upf_gid);
+	if (rc)
+		return (rc);
+	return (CMP(x->upf_uid, y->upf_uid));
+}
 
-	/* pfl_workrq_pool */
-	wk = pfl_workq_getitem(upd_pagein_wk, struct slm_wkdata_upschq);
-	wk->fid = sqlite3_column_int64(sth, 0);
-	wk->bno = sqlite3_column_int(sth, 1);
-	psc_dynarray_add(da, wk);
-	return (0);
+/*
+ * Order flows for service: administrative priority first, then fair
+ * share.
+ */
+int
+slm_upsch_flow_cmp(const void *a, const void *b)
+{
+	const struct slm_upsch_flow *x = a, *y = b;
+	int rc;
+
+	rc = CMP(y->upf_prio, x->upf_prio);
+	if (rc)
+		return (rc);
+	rc = CMP(x->upf_vtag, y->upf_vtag);
+	if (rc)
+		return (rc);
+	return (slm_upsch_flow_cmpid(&x, &y));
 }
 
 /*
- * Page in some work for the update scheduler to do.  This consults the
- * upsch database, potentially restricting to a single resource for work
- * to schedule.
+ * Order the rows of a flow: system then user priority, then by file so
+ * bmaps of the same file stay together.
  */
+int
+slm_upsch_row_cmp(const void *a, const void *b)
+{
+	const struct slm_upsch_row *x = a, *y = b;
+	int rc;
+
+	rc = CMP(y->upr_sys_prio, x->upr_sys_prio);
+	if (rc)
+		return (rc);
+	rc = CMP(y->upr_usr_prio, x->upr_usr_prio);
+	if (rc)
+		return (rc);
+	rc = CMP(x->upr_fid, y->upr_fid);
+	if (rc)
+		return (rc);
+	return (CMP(x->upr_bno, y->upr_bno));
+}
+
 void
-slm_page_work(struct sl_resource *r, struct psc_dynarray *da)
+slm_upsch_resq_init(struct slm_upsch_resq *q)
 {
-	int i, len;
-	struct slm_wkdata_upschq *wk;
+	pfl_heap_init(&q->upq_heap, struct slm_upsch_flow, upf_hentry,
+	    slm_upsch_flow_cmp);
+	psc_dynarray_init(&q->upq_flows);
+}
 
-	/*
-	 * Page some work in.  We make a heuristic here to avoid a large
-	 * number of operations inside the database callback.
-	 *
-	 * This algorithm suffers because each piece of work pulled in
-	 * is not technically fair.  But each invocation of this routine
-	 * selects a different user at random, so over time, no users
-	 * will starve.
-	 */
-    	r->res_offset = 0;
-	while (1) {
-		dbdo(upd_proc_pagein_cb, da,
-		    " SELECT    fid,"
-		    "           bno"
-		    "		nonce"
-		    " FROM      upsch"
-		    " WHERE     resid = IFNULL(?, resid)"
-		    " LIMIT     ?"   
-		    " OFFSET    ?",  
-		    SQLITE_INTEGER, r->res_id, 
-		    SQLITE_INTEGER, UPSCH_PAGEIN_BATCH,
-		    SQLITE_INTEGER, r->res_offset);
-		DYNARRAY_FOREACH(wk, i, da) {
-			OPSTAT_INCR("upsch-pagein-work");
-			pfl_workq_putitem(wk);
+int
+slm_upsch_scan_cb(sqlite3_stmt *sth, void *p)
+{
+	struct psc_dynarray *da = p;
+	struct slm_upsch_flow *f;
+
+	f = PSCALLOC(sizeof(*f));
+	pfl_heap_init(&f->upf_rows, struct slm_upsch_row, upr_hentry,
+	    slm_upsch_row_cmp);
+	f->upf_gid = sqlite3_column_int(sth, 0);
+	f->upf_uid = sqlite3_column_int(sth, 1);
+	f->upf_ndb = sqlite3_column_int(sth, 2);
+	UPF_REWIND(f);
+	psc_dynarray_add(da, f);
+	return (0);
+}
+
+/*
+ * Count the rows queued for an IOS by (uid, gid) and merge the result
+ * into the flows we already know about.  Flows that have drained are
+ * rewound so rows the upsch threads could not schedule last time
+ * around are retried.  This is one pass over the IOS's rows and is
+ * only done every slm_upsch_page_interval seconds.
+ */
+__static void
+slm_upsch_scan(struct sl_resource *r, struct slm_upsch_resq *q,
+    struct psc_dynarray *da)
+{
+	struct psc_dynarray merged = DYNARRAY_INIT;
+	struct slm_upsch_flow *o, *n, *f;
+	int i, j, k, rc;
+
+	dbdo(slm_upsch_scan_cb, da,
+	    " SELECT	gid,"
+	    "		uid,"
+	    "		COUNT(*)"
+	    " FROM	upsch"
+	    " WHERE	resid = ?"
+	    " GROUP BY	gid, uid",
+	    SQLITE_INTEGER, r->res_id);
+	psc_dynarray_sort(da, qsort, slm_upsch_flow_cmpid);
+
+	q->upq_ndb = 0;
+	for (i = j = 0; i < psc_dynarray_len(&q->upq_flows) ||
+	    j < psc_dynarray_len(da); ) {
+		o = i < psc_dynarray_len(&q->upq_flows) ?
+		    psc_dynarray_getpos(&q->upq_flows, i) : NULL;
+		n = j < psc_dynarray_len(da) ?
+		    psc_dynarray_getpos(da, j) : NULL;
+		if (o == NULL)
+			rc = 1;
+		else if (n == NULL)
+			rc = -1;
+		else
+			rc = slm_upsch_flow_cmpid(&o, &n);
+
+		if (rc < 0) {
+			/* gone from the table; keep until drained */
+			i++;
+			if (pfl_heap_nitems(&o->upf_rows)) {
+				o->upf_ndb = 0;
+				o->upf_flags |= UPFF_EOF;
+				psc_dynarray_add(&merged, o);
+			} else
+				PSCFREE(o);
+			continue;
 		}
-		len = psc_dynarray_len(da);
-		if (len) {
-		    	r->res_offset += len;
-			psc_dynarray_reset(da);
+		if (rc > 0) {
+			j++;
+			n->upf_vtag = q->upq_vtime;
+			psc_dynarray_add(&merged, n);
+			q->upq_ndb += n->upf_ndb;
 			continue;
 		}
-		break;
+
+		i++;
+		j++;
+		o->upf_ndb = n->upf_ndb;
+		PSCFREE(n);
+		if (o->upf_flags & UPFF_EOF &&
+		    pfl_heap_nitems(&o->upf_rows) == 0) {
+			o->upf_flags &= ~UPFF_EOF;
+			UPF_REWIND(o);
+		}
+		psc_dynarray_add(&merged, o);
+		q->upq_ndb += o->upf_ndb;
 	}
+	psc_dynarray_reset(da);
+
+	/* split each gid's share evenly among its users */
+	for (i = 0; i < psc_dynarray_len(&merged); i = j) {
+		o = psc_dynarray_getpos(&merged, i);
+		for (j = i + 1; j < psc_dynarray_len(&merged); j++) {
+			n = psc_dynarray_getpos(&merged, j);
+			if (n->upf_gid != o->upf_gid)
+				break;
+		}
+		for (k = i; k < j; k++) {
+			f = psc_dynarray_getpos(&merged, k);
+			f->upf_cost = j - i;
+		}
+	}
+
+	psc_dynarray_reset(&q->upq_flows);
+	psc_dynarray_concat(&q->upq_flows, &merged);
+	psc_dynarray_free(&merged);
 }
 
-#if 0
+int
+slm_upsch_page_cb(sqlite3_stmt *sth, void *p)
+{
+	struct psc_dynarray *da = p;
+	struct slm_upsch_row *upr;
+
+	upr = PSCALLOC(sizeof(*upr));
+	upr->upr_fid = sqlite3_column_int64(sth, 0);
+	upr->upr_bno = sqlite3_column_int(sth, 1);
+	upr->upr_sys_prio = sqlite3_column_int(sth, 2);
+	upr->upr_usr_prio = sqlite3_column_int(sth, 3);
+	psc_dynarray_add(da, upr);
+	return (0);
+}
+
+/*
+ * Page up to @n rows of a flow into memory, picking up after the last
+ * row paged.  Rows come in the order slm_upsch_row_cmp() serves them,
+ * so a page never holds a row while a higher priority one is left in
+ * the table.  The rest of the cursor's priority level is paged by
+ * (fid, bno), then lower levels.  With the (resid, gid, uid, sys_prio
+ * DESC, usr_prio DESC, fid, bno) index the first is a range scan from
+ * the cursor and the second one from the cursor's sys_prio, no matter
+ * how deep into the backlog the cursor is.
+ */
+__static void
+slm_upsch_page_flow(struct sl_resource *r, struct slm_upsch_resq *q,
+    struct slm_upsch_flow *f, int n, struct psc_dynarray *da)
+{
+	struct slm_upsch_row *upr;
+	int i, len, nrows;
 
-	/* Keep this so I don't have to re-learn cryptic SQL syntax */
-	dbdo(upd_proc_pagein_cb, NULL,
+	dbdo(slm_upsch_page_cb, da,
 	    " SELECT	fid,"
 	    "		bno,"
-	    "		nonce"
-	    " FROM	upsch,"
-	    " WHERE	resid = IFNULL(?, resid)"
-	    "   AND	status = 'Q'"
-	    "   AND	gid = (SELECT gid FROM gsort ORDER BY RANDOM())"
-	    " ORDER BY	sys_pri DESC,"
-	    "		usr_pri DESC,"
-	    "		RANDOM()"
-	    " LIMIT	?",
-	    upg->upg_resm ? SQLITE_INTEGER : SQLITE_NULL,
-	    upg->upg_resm ? r->res_id : 0,
-	    SQLITE_INTEGER, UPSCH_PAGEIN_BATCH);
+	    "		sys_prio,"
+	    "		usr_prio"
+	    " FROM	upsch"
+	    " WHERE	resid = ?1"
+	    "   AND	gid = ?2"
+	    "   AND	uid = ?3"
+	    "   AND	sys_prio = ?4"
+	    "   AND	usr_prio = ?5"
+	    "   AND	fid >= ?6"
+	    "   AND	(fid > ?6 OR bno > ?7)"
+	    " ORDER BY	fid,"
+	    "		bno"
+	    " LIMIT	?8",
+	    SQLITE_INTEGER, r->res_id,
+	    SQLITE_INTEGER, f->upf_gid,
+	    SQLITE_INTEGER, f->upf_uid,
+	    SQLITE_INTEGER64, f->upf_cursysprio,
+	    SQLITE_INTEGER64, f->upf_curusrprio,
+	    SQLITE_INTEGER64, f->upf_curfid,
+	    SQLITE_INTEGER, f->upf_curbno,
+	    SQLITE_INTEGER, n);
+
+	len = psc_dynarray_len(da);
+	if (len < n)
+		dbdo(slm_upsch_page_cb, da,
+		    " SELECT	fid,"
+		    "		bno,"
+		    "		sys_prio,"
+		    "		usr_prio"
+		    " FROM	upsch"
+		    " WHERE	resid = ?1"
+		    "   AND	gid = ?2"
+		    "   AND	uid = ?3"
+		    "   AND	sys_prio <= ?4"
+		    "   AND	(sys_prio < ?4 OR usr_prio < ?5)"
+		    " ORDER BY	sys_prio DESC,"
+		    "		usr_prio DESC,"
+		    "		fid,"
+		    "		bno"
+		    " LIMIT	?6",
+		    SQLITE_INTEGER, r->res_id,
+		    SQLITE_INTEGER, f->upf_gid,
+		    SQLITE_INTEGER, f->upf_uid,
+		    SQLITE_INTEGER64, f->upf_cursysprio,
+		    SQLITE_INTEGER64, f->upf_curusrprio,
+		    SQLITE_INTEGER, n - len);
+
+	len = psc_dynarray_len(da);
+	if (len < n)
+		f->upf_flags |= UPFF_EOF;
+	if (len == 0)
+		return;
 
-#endif
+	nrows = pfl_heap_nitems(&f->upf_rows);
+	DYNARRAY_FOREACH(upr, i, da) {
+		pfl_heap_add(&f->upf_rows, upr);
+		f->upf_cursysprio = upr->upr_sys_prio;
+		f->upf_curusrprio = upr->upr_usr_prio;
+		f->upf_curfid = upr->upr_fid;
+		f->upf_curbno = upr->upr_bno;
+	}
+	psc_dynarray_reset(da);
+	q->upq_ncached += len;
+	OPSTAT_ADD("upsch-pagein-rows", len);
+
+	upr = pfl_heap_peek(&f->upf_rows);
+	f->upf_prio = upr->upr_sys_prio;
+	if (nrows)
+		pfl_heap_reseat(&q->upq_heap, f);
+	else {
+		/* no credit for time spent idle */
+		f->upf_vtag = MAX(f->upf_vtag, q->upq_vtime);
+		pfl_heap_add(&q->upq_heap, f);
+	}
+}
+
+/*
+ * Top up the in-memory queue of an IOS once it has fallen to half of
+ * slm_upsch_cache_max, giving each flow that still has rows in the
+ * table an equal part of the room.
+ */
+__static void
+slm_upsch_refill(struct sl_resource *r, struct slm_upsch_resq *q,
+    struct psc_dynarray *da)
+{
+	struct slm_upsch_flow *f;
+	int i, n, nactive = 0, quota;
+
+	if (q->upq_ncached > slm_upsch_cache_max / 2)
+		return;
+
+	DYNARRAY_FOREACH(f, i, &q->upq_flows)
+		if (!(f->upf_flags & UPFF_EOF))
+			nactive++;
+	if (nactive == 0)
+		return;
+
+	quota = MAX(slm_upsch_cache_max / nactive, 1);
+	DYNARRAY_FOREACH(f, i, &q->upq_flows) {
+		if (f->upf_flags & UPFF_EOF)
+			continue;
+		n = quota - pfl_heap_nitems(&f->upf_rows);
+		if (n > quota / 2)
+			slm_upsch_page_flow(r, q, f, n, da);
+	}
+}
+
+/*
+ * Hand rows to upd_pagein_wk() in service order until the IOS has
+ * slm_upsch_window of them outstanding.  Rows stay here while the IOS
+ * is already at its replication bandwidth limit, so that the order is
+ * still ours to decide when it frees up.
+ */
+__static void
+slm_upsch_dispatch(struct sl_resource *r, struct slm_upsch_resq *q)
+{
+	struct resprof_mds_info *rpmi;
+	struct slm_wkdata_upschq *wk;
+	struct slm_upsch_flow *f;
+	struct slm_upsch_row *upr;
+	int64_t pending;
+
+	if (slm_upsch_bandwidth) {
+		rpmi = res2rpmi(r);
+		RPMI_LOCK(rpmi);
+		pending = res2iosinfo(r)->si_repl_ingress_pending;
+		RPMI_ULOCK(rpmi);
+		if (pending >= (int64_t)slm_upsch_bandwidth * BW_UNITSZ) {
+			OPSTAT_INCR("upsch-pagein-throttle");
+			return;
+		}
+	}
+	if (slm_bwshape_blocked(r)) {
+		OPSTAT_INCR("upsch-pagein-shaped");
+		return;
+	}
+
+	while (psc_atomic32_read(&q->upq_inflight) < slm_upsch_window) {
+		f = pfl_heap_peek(&q->upq_heap);
+		if (f == NULL)
+			break;
+
+		upr = pfl_heap_shift(&f->upf_rows);
+		q->upq_ncached--;
+		q->upq_vtime = f->upf_vtag;
+		f->upf_vtag += f->upf_cost;
+		if (pfl_heap_nitems(&f->upf_rows)) {
+			f->upf_prio = ((struct slm_upsch_row *)
+			    pfl_heap_peek(&f->upf_rows))->upr_sys_prio;
+			pfl_heap_reseat(&q->upq_heap, f);
+		} else
+			pfl_heap_remove(&q->upq_heap, f);
+
+		wk = pfl_workq_getitem(upd_pagein_wk,
+		    struct slm_wkdata_upschq);
+		wk->fid = upr->upr_fid;
+		wk->bno = upr->upr_bno;
+		wk->upq = q;
+		PSCFREE(upr);
+		psc_atomic32_inc(&q->upq_inflight);
+		OPSTAT_INCR("upsch-pagein-work");
+		pfl_workq_putitem(wk);
+	}
+}
 
 void
 upd_proc(struct slm_update_data *upd)
@@ -1187,17 +1493,20 @@ slmupschthr_main(struct psc_thread *thr)
 void
 slmpagerthr_main(struct psc_thread *thr)
 {
-	int i, j;
+	int i, j, busy;
 	struct sl_resm *m;
 	struct sl_site *s;
 	struct timeval stall;
+	struct timespec now;
 	struct sl_resource *r;
+	struct slm_upsch_resq *q;
 	struct slrpc_cservice *csvc;
 	struct psc_dynarray da = DYNARRAY_INIT;
 
-	stall.tv_usec = 0;
 	psc_dynarray_ensurelen(&da, UPSCH_PAGEIN_BATCH);
 	while (pscthr_run(thr)) {
+		busy = 0;
+		PFL_GETTIMESPEC_MONO(&now);
 		CONF_FOREACH_RESM(s, r, i, m, j) {
 			if (!RES_ISFS(r))
 				continue;
@@ -1209,7 +1518,8 @@ slmpagerthr_main(struct psc_thread *thr)
 			}
 			sl_csvc_decref(csvc);
 			/*
- 			 * Page work can happen in the following cases: 
+ 			 * Rescanning the table for work can happen in the
+ 			 * following cases: 
  			 *
  			 * (1) definitely at start up (done)
  			 * (2) when an IOS comes online (to do)
@@ -1217,14 +1527,27 @@ slmpagerthr_main(struct psc_thread *thr)
  			 *
  			 * The page interval is chosen so that most likely
  			 * the work has already been done by our shortcut.
+ 			 * In between, we keep paging rows of flows that
+ 			 * still have some left as the IOS works through
+ 			 * them.
  			 */
-			OPSTAT_INCR("upsch-page-work");
-			slm_page_work(r, &da);
-			psc_dynarray_reset(&da);
+			q = res2iosinfo(r)->si_upschq;
+			if (q->upq_lastscan.tv_sec == 0 ||
+			    now.tv_sec - q->upq_lastscan.tv_sec >=
+			    slm_upsch_page_interval) {
+				OPSTAT_INCR("upsch-page-work");
+				slm_upsch_scan(r, q, &da);
+				q->upq_lastscan = now;
+			}
+			slm_upsch_refill(r, q, &da);
+			slm_upsch_dispatch(r, q);
+			if (pfl_heap_nitems(&q->upq_heap))
+				busy = 1;
 		}
-		spinlock(&slm_upsch_lock);
-		stall.tv_sec = slm_upsch_page_interval;
-		psc_waitq_waitrel_tv(&slm_pager_workq, &slm_upsch_lock, &stall);
+		stall.tv_sec = busy ? 1 : slm_upsch_page_interval;
+		stall.tv_usec = 0;
+		slm_bwshape_tick(&stall);
+		psc_waitq_waitrel_tv(&slm_pager_workq, NULL, &stall);
 	}
 	psc_dynarray_free(&da);
 }
@@ -1232,7 +1555,7 @@ slmpagerthr_main(struct psc_thread *thr)
 void
 slm_upsch_init(void)
 {
-	INIT_SPINLOCK(&slm_upsch_lock);
+	psc_mutex_init(&slm_upsch_lock);
 	psc_waitq_init(&slm_upsch_waitq, "upsch");
 	lc_reginit(&slm_upsch_queue, struct slm_update_data,
 	    upd_lentry, "upschq");
@@ -1251,6 +1574,9 @@ slmupschthr_spawn(void)
 	}
 	thr = pscthr_init(SLMTHRT_PAGER, slmpagerthr_main, 0, "slmpagerthr");
 	pscthr_setready(thr);
+	thr = pscthr_init(SLMTHRT_DBCOMMIT, slmdbcommitthr_main, 0,
+	    "slmdbcommitthr");
+	pscthr_setready(thr);
 }
 
 /*
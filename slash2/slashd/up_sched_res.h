@@ -33,15 +33,26 @@
 
 #include <sqlite3.h>
 
+#include "pfl/atomic.h"
+#include "pfl/dynarray.h"
+#include "pfl/heap.h"
+#include "pfl/pthrutil.h"
+
 #define UPSCH_PAGEIN_BATCH	128
 
+#define UPSCH_CACHE_MAX		4096	/* upsch rows held in memory per IOS */
+#define UPSCH_WINDOW		256	/* pagein work queued per IOS */
+
 extern int slm_upsch_batch_size;
 extern int slm_upsch_repl_expire;
 extern int slm_upsch_preclaim_expire;
 extern int slm_upsch_page_interval;
+extern int slm_upsch_cache_max;
+extern int slm_upsch_window;
 
-extern psc_spinlock_t           slm_upsch_lock;
+extern struct pfl_mutex		slm_upsch_lock;
 extern struct psc_waitq		slm_upsch_waitq;
+extern struct psc_waitq		slm_pager_workq;
 extern struct psc_listcache     slm_upsch_queue;
 
 struct slm_update_data {
@@ -62,6 +73,70 @@ struct slm_update_generic {
 	struct psc_listentry		 upg_lentry;
 };
 
+/*
+ * An upsch row paged into memory, waiting to be handed to
+ * upd_pagein_wk().
+ */
+struct slm_upsch_row {
+	struct pfl_heap_entry		 upr_hentry;
+	slfid_t				 upr_fid;
+	sl_bmapno_t			 upr_bno;
+	int				 upr_sys_prio;
+	int				 upr_usr_prio;
+};
+
+/*
+ * All upsch rows of one (uid, gid) pair destined for an IOS.  Rows are
+ * paged in by keyset on (sys_prio DESC, usr_prio DESC, fid, bno), so
+ * pages come in priority order and each starts where the last one
+ * ended instead of rescanning everything before it.
+ */
+struct slm_upsch_flow {
+	struct pfl_heap_entry		 upf_hentry;	/* in upq_heap */
+	struct pfl_heap			 upf_rows;	/* slm_upsch_row by priority */
+	uint32_t			 upf_uid;
+	uint32_t			 upf_gid;
+	int				 upf_flags;
+	int				 upf_ndb;	/* #rows in upsch at last scan */
+	int				 upf_prio;	/* sys_prio of first row */
+	int				 upf_cost;	/* vtime per dispatch */
+	uint64_t			 upf_vtag;	/* vtime of next dispatch */
+	int64_t				 upf_cursysprio;	/* keyset cursor */
+	int64_t				 upf_curusrprio;
+	int64_t				 upf_curfid;
+	int32_t				 upf_curbno;
+};
+
+/* rewind the keyset cursor to before the first row */
+#define UPF_REWIND(f)							\
+	do {								\
+		(f)->upf_cursysprio = INT64_MAX;			\
+		(f)->upf_curusrprio = INT64_MAX;			\
+		/* SQLite compares these as signed */			\
+		(f)->upf_curfid = INT64_MIN;				\
+		(f)->upf_curbno = -1;					\
+	} while (0)
+
+/* upf_flags */
+#define UPFF_EOF			(1 << 0)	/* cursor reached the end */
+
+/*
+ * Replication work queue for one IOS.  Flows are served in order of
+ * their virtual time tag, which advances by the number of flows sharing
+ * the gid on each dispatch, so every gid gets an equal share and every
+ * uid an equal share of its gid.  Only the pager thread touches the
+ * heaps and flows; the counters are also read by slmctl.
+ */
+struct slm_upsch_resq {
+	struct pfl_heap			 upq_heap;	/* flows with rows in memory */
+	struct psc_dynarray		 upq_flows;	/* all flows by (gid, uid) */
+	uint64_t			 upq_vtime;	/* vtag of last dispatch */
+	int				 upq_ndb;	/* #rows in upsch at last scan */
+	int				 upq_ncached;	/* #rows in memory */
+	psc_atomic32_t			 upq_inflight;	/* pagein work not yet run */
+	struct timespec			 upq_lastscan;
+};
+
 #define UPD_LOCK(upd)			spinlock(&(upd)->upd_lock)
 #define UPD_ULOCK(upd)			freelock(&(upd)->upd_lock)
 
@@ -95,8 +170,10 @@ void	 upsch_purge(slfid_t);
 void	 upschq_resm(struct sl_resm *, int);
 
 int	 slm_wk_upsch_purge(void *);
+int	 upd_pagein_wk(void *);
 
 void	 slm_upsch_init(void);
+void	 slm_upsch_resq_init(struct slm_upsch_resq *);
 void	 slmupschthr_spawn(void);
 
 int	 slm_upsch_insert(struct bmap *, sl_ios_id_t, int, int);
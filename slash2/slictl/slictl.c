@@ -62,6 +62,12 @@ packshow_replwkst(__unusedx char *fid)
 	psc_ctlmsg_push(SLICMT_GET_REPLWKST, sizeof(struct slictlmsg_replwkst));
 }
 
+void
+packshow_replst(__unusedx char *fid)
+{
+	psc_ctlmsg_push(SLICMT_GETREPLST, sizeof(struct slictlmsg_replst));
+}
+
 void
 packshow_fcmhs(__unusedx char *fid)
 {
@@ -101,6 +107,35 @@ replwkst_prdat(__unusedx const struct psc_ctlmsghdr *mh, const void *m)
 	printf(" %6s\n", rbuf);
 }
 
+int
+replst_prhdr(__unusedx struct psc_ctlmsghdr *mh, __unusedx const void *m)
+{
+	printf("%-28s %7s %7s %8s %6s %5s %5s\n",
+	    "repl-stream-peer", "xfer", "rate", "rtt-us", "window",
+	    "infl", "wait");
+	return(PSC_CTL_DISPLAY_WIDTH);
+}
+
+void
+replst_prdat(__unusedx const struct psc_ctlmsghdr *mh, const void *m)
+{
+	char totbuf[PSCFMT_HUMAN_BUFSIZ], ratebuf[PSCFMT_HUMAN_BUFSIZ];
+	const struct slictlmsg_replst *srst = m;
+
+	printf("%-28s ", srst->srst_peer_addr);
+	if (psc_ctl_inhuman)
+		printf("%7"PRIu64" %7"PRIu64, srst->srst_nbytes,
+		    srst->srst_rate);
+	else {
+		pfl_fmt_human(totbuf, srst->srst_nbytes);
+		pfl_fmt_human(ratebuf, srst->srst_rate);
+		printf("%7s %7s", totbuf, ratebuf);
+	}
+	printf(" %8"PRIu64" %6d %5d %5d\n", srst->srst_rtt,
+	    srst->srst_window, srst->srst_inflight,
+	    srst->srst_nwaiters);
+}
+
 int
 slvr_prhdr(__unusedx struct psc_ctlmsghdr *mh, __unusedx const void *m)
 {
@@ -227,6 +262,7 @@ struct psc_ctlshow_ent psc_ctlshow_tab[] = {
 	{ "bmaps",		packshow_bmaps },
 	{ "connections",	packshow_conns },
 	{ "fcmhs",		packshow_fcmhs },
+	{ "replstreams",	packshow_replst },
 	{ "replwkst",		packshow_replwkst },
 
 	/* aliases */
@@ -244,7 +280,8 @@ struct psc_ctlmsg_prfmt psc_ctlmsg_prfmts[] = {
 	{ NULL,			NULL,			sizeof(struct slictlmsg_fileop),	NULL },
 	{ NULL,			NULL,			0,					NULL },
 	{ sl_bmap_prhdr,	sl_bmap_prdat,		sizeof(struct slctlmsg_bmap),		NULL },
-	{ slvr_prhdr,		slvr_prdat,		sizeof(struct slictlmsg_slvr),		NULL }
+	{ slvr_prhdr,		slvr_prdat,		sizeof(struct slictlmsg_slvr),		NULL },
+	{ replst_prhdr,		replst_prdat,		sizeof(struct slictlmsg_replst),	NULL }
 };
 
 struct psc_ctlcmd_req psc_ctlcmd_reqs[] = {
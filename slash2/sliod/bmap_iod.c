@@ -200,7 +200,7 @@ sliseqnothr_main(struct psc_thread *thr)
 void
 sli_bmap_sync(struct bmap *b)
 {
-	int rc, error, do_sync = 0;
+	int rc, error, wberr, do_sync = 0;
 	struct timespec ts0, ts1, delta;
 	struct fidc_membh *f;
 
@@ -216,6 +216,18 @@ sli_bmap_sync(struct bmap *b)
 
 	PFL_GETTIMESPEC(&ts0);
 
+	/*
+	 * Absorbed writes must reach the backing file first.  If they
+	 * cannot, they stay dirty and the error stays latched for the
+	 * next write to the file.
+	 */
+	wberr = sli_wb_flush_fcmh(f, 0);
+	if (wberr) {
+		OPSTAT_INCR("rlsbmap-wb-fail");
+		DEBUG_BMAP(PLL_ERROR, b,
+		    "write-back failure at release errno=%d", wberr);
+	}
+
 #ifdef HAVE_SYNC_FILE_RANGE
 	rc = sync_file_range(fcmh_2_fd(f), b->bcm_bmapno *
 	    SLASH_BMAP_SIZE, SLASH_BMAP_SIZE, SYNC_FILE_RANGE_WRITE |
@@ -447,6 +459,7 @@ iod_bmap_init(struct bmap *b)
 
 	memset(bii, 0, sizeof(*bii));
 	INIT_PSC_LISTENTRY(&bii->bii_lentry);
+	INIT_PSC_LISTENTRY(&bii->bii_crcq_lentry);
 	SPLAY_INIT(&bii->bii_slvrs);
 
 	pll_init(&bii->bii_rls, struct bmap_iod_rls, bir_lentry, NULL);
@@ -462,6 +475,7 @@ iod_bmap_finalcleanup(struct bmap *b)
 	psc_assert(pll_empty(&bii->bii_rls));
 	psc_assert(SPLAY_EMPTY(&bii->bii_slvrs));
 	psc_assert(psclist_disjoint(&bii->bii_lentry));
+	psc_assert(psclist_disjoint(&bii->bii_crcq_lentry));
 }
 
 /*
@@ -510,6 +524,9 @@ iod_bmap_retrieve(struct bmap *b, __unusedx int flags)
 
 	BMAP_LOCK(b); /* equivalent to BII_LOCK() */
 	for (i = 0; i < SLASH_SLVRS_PER_BMAP; i++) {
+		/* Our own CRC is newer than what the MDS has. */
+		if (bii->bii_crcstates[i] & BMAP_SLVR_CRCDIRTY)
+			continue;
 		bii->bii_crcstates[i] = mp->crcstates[i];
 		bii->bii_crcs[i] = mp->crcs[i];
 	}
@@ -529,6 +546,36 @@ iod_bmap_retrieve(struct bmap *b, __unusedx int flags)
 	return (rc);
 }
 
+/*
+ * Forget the sliver checksums of cached bmaps beyond a truncation
+ * point, as they no longer describe the data in the backing file.
+ * @f: file being truncated.
+ * @bmapno: bmap containing the new EOF.
+ * @off: offset of the new EOF in that bmap.
+ */
+void
+sli_bmap_truncate_crcs(struct fidc_membh *f, sl_bmapno_t bmapno,
+    int32_t off)
+{
+	struct bmap_iod_info *bii;
+	struct bmap *b;
+	int i;
+
+	pfl_rwlock_rdlock(&f->fcmh_rwlock);
+	RB_FOREACH(b, bmaptree, &f->fcmh_bmaptree) {
+		if (b->bcm_bmapno < bmapno)
+			continue;
+		BMAP_LOCK(b);
+		bii = bmap_2_bii(b);
+		i = b->bcm_bmapno == bmapno ? off / SLASH_SLVR_SIZE : 0;
+		for (; i < SLASH_SLVRS_PER_BMAP; i++)
+			bii->bii_crcstates[i] &=
+			    ~(BMAP_SLVR_CRC | BMAP_SLVR_CRCDIRTY);
+		BMAP_ULOCK(b);
+	}
+	pfl_rwlock_unlock(&f->fcmh_rwlock);
+}
+
 #if PFL_DEBUG > 0
 void
 dump_bmap_flags(uint32_t flags)
@@ -89,6 +89,9 @@ struct bmap_iod_info {
 	uint64_t		 bii_crcs[SLASH_SLVRS_PER_BMAP];
 	struct biod_slvrtree	 bii_slvrs;
 	struct psc_listentry	 bii_lentry;
+	struct psc_listentry	 bii_crcq_lentry;	/* CRC update queue */
+	time_t			 bii_crcq_age;	/* when first queued */
+	uint64_t		 bii_seq;	/* newest write lease seen */
 	struct psc_lockedlist	 bii_rls;	/* leases */
 };
 
@@ -106,6 +109,7 @@ struct bmap_iod_info {
 #define bmap_2_crcs(b)		bmap_2_bii(b)->bii_crcs
 
 #define BMAP_SLVR_WANTREPL	_BMAP_SLVR_FLSHFT	/* Queued for replication */
+#define BMAP_SLVR_CRCDIRTY	(_BMAP_SLVR_FLSHFT << 1)	/* CRC not yet sent to MDS */
 
 #define BII_LOCK(bii)		BMAP_LOCK(bii_2_bmap(bii))
 #define BII_ULOCK(bii)		BMAP_ULOCK(bii_2_bmap(bii))
@@ -122,9 +126,13 @@ void		bim_init(void);
 int		bim_updateseq(uint64_t);
 
 void		slibmaprlsthr_spawn(void);
+void		sli_bmap_truncate_crcs(struct fidc_membh *, sl_bmapno_t,
+		    int32_t);
 
 extern struct bmap_iod_minseq	 sli_bminseq;
 
+extern struct psc_listcache	 sli_bmap_crcq;
+
 extern struct psc_poolmaster	 bmap_rls_poolmaster;
 extern struct psc_poolmgr	*bmap_rls_pool;
 
@@ -22,6 +22,7 @@
 #include "pfl/cdefs.h"
 #include "pfl/alloc.h"
 
+#include "repl_iod.h"
 #include "slconfig.h"
 #include "sliod.h"
 
@@ -36,8 +37,9 @@ slcfg_destroy_res(__unusedx struct sl_resource *res)
 }
 
 void
-slcfg_init_resm(__unusedx struct sl_resm *resm)
+slcfg_init_resm(struct sl_resm *resm)
 {
+	sli_repl_stream_init(&resm2rmii(resm)->rmii_replst);
 }
 
 void
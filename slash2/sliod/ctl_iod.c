@@ -35,6 +35,7 @@
 #include "pfl/str.h"
 #include "pfl/walk.h"
 
+#include "authbuf.h"
 #include "bmap_iod.h"
 #include "ctl.h"
 #include "ctl_iod.h"
@@ -489,6 +490,45 @@ slictlrep_getreplwkst(int fd, struct psc_ctlmsghdr *mh, void *m)
 	return (rc);
 }
 
+int
+slictlrep_getreplst(int fd, struct psc_ctlmsghdr *mh, void *m)
+{
+	struct slictlmsg_replst *srst = m;
+	struct sli_repl_stream *rst;
+	struct sl_resource *r;
+	struct sl_resm *resm;
+	struct sl_site *s;
+	int i, j, rc = 1;
+
+	CONF_LOCK();
+	CONF_FOREACH_RESM(s, r, i, resm, j) {
+		if (resm == nodeResm || !RES_ISFS(r))
+			continue;
+
+		rst = &resm2rmii(resm)->rmii_replst;
+		spinlock(&rst->rst_lock);
+		if (rst->rst_nbytes == 0 && rst->rst_inflight == 0) {
+			freelock(&rst->rst_lock);
+			continue;
+		}
+		srst->srst_nbytes = rst->rst_nbytes;
+		srst->srst_rate = rst->rst_rate;
+		srst->srst_rtt = rst->rst_rtt;
+		srst->srst_window = rst->rst_window;
+		srst->srst_inflight = rst->rst_inflight;
+		srst->srst_nwaiters = rst->rst_nwaiters;
+		freelock(&rst->rst_lock);
+		strlcpy(srst->srst_peer_addr, resm->resm_name,
+		    sizeof(srst->srst_peer_addr));
+
+		rc = psc_ctlmsg_sendv(fd, mh, srst, NULL);
+		if (!rc)
+			break;
+	}
+	CONF_ULOCK();
+	return (rc);
+}
+
 int
 slictlrep_getslvr(int fd, struct psc_ctlmsghdr *mh, void *m)
 {
@@ -598,7 +638,8 @@ struct psc_ctlop slictlops[] = {
 	{ slictlcmd_import,		sizeof(struct slictlmsg_fileop) },
 	{ slictlcmd_stop,		0 },
 	{ slctlrep_getbmap,		sizeof(struct slctlmsg_bmap) },
-	{ slictlrep_getslvr,		sizeof(struct slictlmsg_slvr) }
+	{ slictlrep_getslvr,		sizeof(struct slictlmsg_slvr) },
+	{ slictlrep_getreplst,		sizeof(struct slictlmsg_replst) }
 };
 
 void
@@ -621,6 +662,8 @@ slictlthr_spawn(const char *fn)
 	psc_ctlparam_register("run", psc_ctlparam_run);
 	psc_ctlparam_register("rusage", psc_ctlparam_rusage);
 
+	psc_ctlparam_register_var("sys.lockprof", PFLCTL_PARAMT_INT,
+	    PFLCTL_PARAMF_RDWR, &pfl_lockprof);
 	psc_ctlparam_register_var("sys.nbrq_outstanding",
 	    PFLCTL_PARAMT_INT, 0, &sl_nbrqset->set_remaining);
 	psc_ctlparam_register("sys.resources", slctlparam_resources);
@@ -632,11 +675,15 @@ slictlthr_spawn(const char *fn)
 	    slctlparam_uptime_get, NULL);
 	psc_ctlparam_register_simple("sys.version",
 	    slctlparam_version_get, NULL);
+	psc_ctlparam_register_var("sys.crc_verify",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_crc_verify);
 	psc_ctlparam_register_var("sys.datadir", PFLCTL_PARAMT_STR, 0,
 	    (char *)sl_datadir);
 
 	psc_ctlparam_register_var("sys.bminseqno", PFLCTL_PARAMT_UINT64,
 	    0, &sli_bminseq.bim_minseq);
+	psc_ctlparam_register_var("sys.bulkhash_min",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sl_bulkhash_min);
 	psc_ctlparam_register_var("sys.disable_write",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_disable_write);
 
@@ -644,6 +691,10 @@ slictlthr_spawn(const char *fn)
 	    PFLCTL_PARAMT_UINT64, 0, &sli_current_reclaim_batchno);
 	psc_ctlparam_register_var("sys.reclaim_xid",
 	    PFLCTL_PARAMT_UINT64, 0, &sli_current_reclaim_xid);
+	psc_ctlparam_register_var("sys.repl_readahead",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_repl_readahead);
+	psc_ctlparam_register_var("sys.repl_window_max",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_repl_window_max);
 
 	psc_ctlparam_register_var("sys.self_test_enable",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_selftest_enable);
@@ -667,6 +718,19 @@ slictlthr_spawn(const char *fn)
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
 	    &sli_sync_max_writes);
 
+	psc_ctlparam_register_var("sys.partial_read_min",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
+	    &sli_partial_read_min);
+
+	psc_ctlparam_register_var("sys.wb_enable",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_wb_enable);
+	psc_ctlparam_register_var("sys.wb_hiwat_mb",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_wb_hiwat_mb);
+	psc_ctlparam_register_var("sys.wb_lowat_mb",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_wb_lowat_mb);
+	psc_ctlparam_register_var("sys.wb_max_age",
+	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR, &sli_wb_max_age);
+
 	psc_ctlparam_register_var("sys.max_readahead",
 	    PFLCTL_PARAMT_INT, PFLCTL_PARAMF_RDWR,
 	    &sli_predio_max_slivers);
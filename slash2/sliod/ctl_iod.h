@@ -39,6 +39,17 @@ struct slictlmsg_replwkst {
 	/* XXX #inflight slivers? */
 };
 
+struct slictlmsg_replst {
+	char			srst_peer_addr[RESM_ADDRBUF_SZ];
+	uint64_t		srst_nbytes;		/* lifetime bytes received */
+	uint64_t		srst_rate;		/* bytes/sec */
+	uint64_t		srst_rtt;		/* min sliver RTT (usec) */
+	 int32_t		srst_window;
+	 int32_t		srst_inflight;
+	 int32_t		srst_nwaiters;
+	 int32_t		_srst_pad;
+};
+
 struct slictlmsg_fileop {
 	char			sfop_fn[PATH_MAX];
 	char			sfop_fn2[PATH_MAX];
@@ -70,3 +81,4 @@ struct slictlmsg_slvr {
 #define SLICMT_STOP		(NPCMT + 5)
 #define SLICMT_GETBMAP		(NPCMT + 6)
 #define SLICMT_GETSLVR		(NPCMT + 7)
+#define SLICMT_GETREPLST	(NPCMT + 8)
@@ -215,6 +215,8 @@ sli_fcmh_ctor(struct fidc_membh *f, __unusedx int flags)
 	fii = fcmh_2_fii(f);
 	INIT_PSC_LISTENTRY(&fii->fii_lentry);
 	INIT_PSC_LISTENTRY(&fii->fii_lentry2);
+	INIT_PSC_LISTENTRY(&fii->fii_wb_lentry);
+	INIT_PSCLIST_HEAD(&fii->fii_wb_slvrs);
 
 	psc_assert(f->fcmh_flags & FCMH_INITING);
 	if (f->fcmh_fg.fg_gen == FGEN_ANY) {
@@ -41,9 +41,13 @@ struct fcmh_iod_info {
 	int64_t			fii_nblks;		/* cache fstat() results */ 
 	int			fii_nwrites;		/* total of writes */
 	long			fii_lastwrite;		/* when last write/punch happens */
+	long			fii_wb_age;		/* when first sliver went dirty */
+	int			fii_wb_error;		/* latched write-back errno */
 
 	struct psclist_head	fii_lentry;		/* all fcmhs with dirty contents */
 	struct psclist_head	fii_lentry2;		/* all fcmhs with storage update */
+	struct psclist_head	fii_wb_lentry;		/* all fcmhs with write-back slivers */
+	struct psclist_head	fii_wb_slvrs;		/* slivers awaiting write-back */
 };
 
 /* sliod-specific fcmh_flags */
@@ -51,6 +55,7 @@ struct fcmh_iod_info {
 #define FCMH_IOD_DIRTYFILE	(_FCMH_FLGSHFT << 1)    /* backing file is dirty */
 #define FCMH_IOD_SYNCFILE	(_FCMH_FLGSHFT << 2)    /* flusing backing file */
 #define FCMH_IOD_UPDATEFILE	(_FCMH_FLGSHFT << 3)    /* need to report to MDS */
+#define FCMH_IOD_WBFILE		(_FCMH_FLGSHFT << 4)    /* queued for write-back */
 
 #define fcmh_2_fd(fcmh)		fcmh_2_fii(fcmh)->fii_fd
 
@@ -305,7 +305,7 @@ main(int argc, char *argv[])
 		usage();
 
 	sigemptyset(&signal_set);
-	sigaddset(&signal_set, SIGIO);
+	sigaddset(&signal_set, SLI_AIO_SIGNO);
 	sigprocmask(SIG_BLOCK, &signal_set, NULL);
 
 	pscthr_init(SLITHRT_CTL, NULL, sizeof(struct psc_ctlthr),
@@ -385,6 +385,8 @@ main(int argc, char *argv[])
 	sli_rpc_initsvc();
 	pfl_opstimerthr_spawn(SLITHRT_OPSTIMER, "sliopstimerthr");
 	sl_freapthr_spawn(SLITHRT_FREAP, "slifreapthr");
+	sl_bulkhashthr_spawn(SLITHRT_BULKHASH, AUTHBUF_BULK_NTHR,
+	    "slibhthr%d");
 
 	slrpc_batches_init(SLITHRT_BATCHRPC, SL_SLIOD, "sli");
 
@@ -25,6 +25,10 @@
  * the transfers via work request units and scheduling them.  The
  * MDS(es) are in charge of oversubscription but there are windows when
  * we can get bursty.
+ *
+ * Sliver reads are pipelined: all work pulling from the same source IOS
+ * shares a stream whose window bounds the number of slivers in flight,
+ * and each work item issues as many reads as the window allows.
  */
 
 #include <sys/statvfs.h>
@@ -35,6 +39,7 @@
 #include "pfl/listcache.h"
 #include "pfl/pool.h"
 #include "pfl/rpc.h"
+#include "pfl/time.h"
 #include "pfl/vbitmap.h"
 
 #include "batchrpc.h"
@@ -61,6 +66,9 @@ struct psc_listcache	 sli_replwkq_pending;
 struct psc_lockedlist	 sli_replwkq_active = 
     PLL_INIT(&sli_replwkq_active, struct sli_repl_workrq, srw_active_lentry);
 
+int			 sli_repl_window_max = SLI_REPL_WINDOW_MAX;
+int			 sli_repl_readahead = SLI_REPL_READAHEAD;
+
 struct sli_repl_workrq *
 sli_repl_findwq(const struct sl_fidgen *fgp, sl_bmapno_t bmapno)
 {
@@ -127,11 +135,9 @@ sli_repl_addwk(struct slrpc_batch_rep *bp, void *req, void *rep)
 	if (q->len < 1 || q->len > SLASH_BMAP_SIZE)
 		PFL_GOTOERR(out, rc = EINVAL);
 
-	if (q->src_resid != IOS_ID_ANY) {
-		res = libsl_id2res(q->src_resid);
-		if (res == NULL)
-			PFL_GOTOERR(out, rc = SLERR_ION_UNKNOWN);
-	}
+	res = libsl_id2res(q->src_resid);
+	if (res == NULL)
+		PFL_GOTOERR(out, rc = SLERR_ION_UNKNOWN);
 
 	/*
 	 * Check if this work is already queued e.g. from before the MDS
@@ -164,8 +170,11 @@ sli_repl_addwk(struct slrpc_batch_rep *bp, void *req, void *rep)
 	memset(w, 0, sizeof(*w));
 	INIT_PSC_LISTENTRY(&w->srw_active_lentry);
 	INIT_PSC_LISTENTRY(&w->srw_pending_lentry);
+	INIT_PSC_LISTENTRY(&w->srw_stream_lentry);
 	INIT_SPINLOCK(&w->srw_lock);
 	w->srw_src_res = res;
+	w->srw_stream = &resm2rmii(psc_dynarray_getpos(
+	    &res->res_members, 0))->rmii_replst;
 	w->srw_fg = q->fg;
 	w->srw_bmapno = q->bno;
 	w->srw_bgen = q->bgen;
@@ -261,116 +270,230 @@ sli_replwk_queue(struct sli_repl_workrq *w)
 	return (queued);
 }
 
-/*
- * Try to replicate some data from another IOS.
- */
 void
-sli_repl_try_work(struct sli_repl_workrq *w,
-    struct sli_repl_workrq **last)
+sli_repl_stream_init(struct sli_repl_stream *rst)
 {
-	int rc, slvridx, slvrno;
-	struct slrpc_cservice *csvc;
-	struct bmap_iod_info *bii;
-	struct sl_resm *src_resm;
+	INIT_SPINLOCK(&rst->rst_lock);
+	INIT_PSCLIST_HEAD(&rst->rst_waiters);
+	rst->rst_window = SLI_REPL_WINDOW_MIN;
+	PFL_GETTIMESPEC_MONO(&rst->rst_intv_start);
+}
 
-	spinlock(&w->srw_lock);
-	if (w->srw_status) {
-		freelock(&w->srw_lock);
-		goto out;
+/*
+ * Take a slot in the window of a replication stream.  If the window is
+ * full, the work item is parked on the stream along with the reference
+ * the caller holds, to be requeued by sli_repl_stream_done().
+ */
+__static int
+sli_repl_stream_claim(struct sli_repl_stream *rst,
+    struct sli_repl_workrq *w)
+{
+	spinlock(&rst->rst_lock);
+	if (rst->rst_inflight < rst->rst_window) {
+		rst->rst_inflight++;
+		freelock(&rst->rst_lock);
+		return (1);
 	}
+	psc_assert(psclist_disjoint(&w->srw_stream_lentry));
+	psclist_add_tail(&w->srw_stream_lentry, &rst->rst_waiters);
+	rst->rst_nwaiters++;
+	freelock(&rst->rst_lock);
+	OPSTAT_INCR("repl-window-full");
+	return (0);
+}
 
-	BMAP_LOCK(w->srw_bcm);
-	slvrno = 0;
-	bii = bmap_2_bii(w->srw_bcm);
-	while (slvrno < SLASH_SLVRS_PER_BMAP) {
-		if (bii->bii_crcstates[slvrno] & BMAP_SLVR_WANTREPL)
-			break;
-		slvrno++;
-	}
+/*
+ * Close out the current measurement interval: update the delivery rate
+ * and minimum RTT and resize the window to twice their product.
+ */
+__static void
+sli_repl_stream_update(struct sli_repl_stream *rst,
+    const struct timespec *now)
+{
+	struct timespec d;
+	uint64_t usec, bdp;
+	int window;
 
-	if (slvrno == SLASH_SLVRS_PER_BMAP) {
-		BMAP_ULOCK(w->srw_bcm);
-		/* No work to do; we are done with this bmap. */
-		freelock(&w->srw_lock);
-		goto out;
+	timespecsub(now, &rst->rst_intv_start, &d);
+	if (d.tv_sec < SLI_REPL_STREAM_INTV)
+		return;
+
+	/* an interval spanning an idle period says nothing about the path */
+	if (d.tv_sec < 4 * SLI_REPL_STREAM_INTV &&
+	    rst->rst_intv_nbytes && rst->rst_intv_minrtt) {
+		usec = d.tv_sec * 1000000 + d.tv_nsec / 1000;
+		if (rst->rst_rate)
+			rst->rst_rate = (3 * rst->rst_rate +
+			    rst->rst_intv_nbytes * 1000000 / usec) / 4;
+		else
+			rst->rst_rate = rst->rst_intv_nbytes * 1000000 /
+			    usec;
+		rst->rst_rtt = rst->rst_intv_minrtt;
+
+		bdp = rst->rst_rate * rst->rst_rtt / 1000000;
+		window = howmany(2 * bdp, SLASH_SLVR_SIZE);
+		window = MIN(window, sli_repl_window_max);
+		rst->rst_window = MAX(window, SLI_REPL_WINDOW_MIN);
 	}
 
-	/* Find a free slot we can use to transmit the sliver. */
-	for (slvridx = 0; slvridx < nitems(w->srw_slvr); slvridx++)
-		if (w->srw_slvr[slvridx] == NULL)
+	rst->rst_intv_start = *now;
+	rst->rst_intv_nbytes = 0;
+	rst->rst_intv_minrtt = 0;
+}
+
+/*
+ * Release a window slot of a replication stream and requeue any work
+ * waiting for one.
+ * @rst: stream.
+ * @issued: when the sliver read was issued, or NULL if it never was.
+ * @nbytes: amount of data received.
+ */
+void
+sli_repl_stream_done(struct sli_repl_stream *rst,
+    const struct timespec *issued, int nbytes)
+{
+	struct sli_repl_workrq *w;
+	struct timespec now, d;
+	uint64_t rtt;
+	int n;
+
+	PFL_GETTIMESPEC_MONO(&now);
+
+	spinlock(&rst->rst_lock);
+	psc_assert(rst->rst_inflight > 0);
+	rst->rst_inflight--;
+	if (issued && nbytes > 0) {
+		timespecsub(&now, issued, &d);
+		rtt = d.tv_sec * 1000000 + d.tv_nsec / 1000;
+		if (rst->rst_intv_minrtt == 0 ||
+		    rtt < rst->rst_intv_minrtt)
+			rst->rst_intv_minrtt = rtt;
+		rst->rst_nbytes += nbytes;
+		rst->rst_intv_nbytes += nbytes;
+	}
+	sli_repl_stream_update(rst, &now);
+	n = rst->rst_window - rst->rst_inflight;
+	freelock(&rst->rst_lock);
+
+	for (; n > 0; n--) {
+		spinlock(&rst->rst_lock);
+		w = psc_listhd_first_obj(&rst->rst_waiters,
+		    struct sli_repl_workrq, srw_stream_lentry);
+		if (w) {
+			psclist_del(&w->srw_stream_lentry,
+			    &rst->rst_waiters);
+			rst->rst_nwaiters--;
+		}
+		freelock(&rst->rst_lock);
+		if (w == NULL)
 			break;
 
-	if (slvridx == nitems(w->srw_slvr)) {
-		/* All slots are in use on this work item. */
-		BMAP_ULOCK(w->srw_bcm);
-		freelock(&w->srw_lock);
-		LIST_CACHE_LOCK(&sli_replwkq_pending);
+		/* trade the parked reference for a pending one */
 		sli_replwk_queue(w);
-		if (w == *last)
-			/*
-			 * There is no other work to do.  Wait for a
-			 * slot to open or for other work to arrive.
-			 */
-			psc_waitq_waitrel_us(
-			    &sli_replwkq_pending.plc_wq_empty,
-			    &sli_replwkq_pending.plc_lock, 10);
-		else {
-			if (*last == NULL)
-				*last = w;
-			LIST_CACHE_ULOCK(&sli_replwkq_pending);
-		}
-		goto out;
+		sli_replwkrq_decref(w, 0);
 	}
-	*last = NULL;
-
-	bii->bii_crcstates[slvrno] &= ~BMAP_SLVR_WANTREPL;
-	BMAP_ULOCK(w->srw_bcm);
-
-	/* Mark slot as occupied. */
-	w->srw_slvr[slvridx] = SLI_REPL_SLVR_SCHED;
-	freelock(&w->srw_lock);
+}
 
-	/* Acquire connection to replication source & issue READ. */
-	src_resm = psc_dynarray_getpos(&w->srw_src_res->res_members, 0);
-	csvc = sli_geticsvc(src_resm, 0);
+/*
+ * Try to replicate some data from another IOS.  Reads are issued for
+ * as many of the wanted slivers as the window to the source allows.
+ */
+void
+sli_repl_try_work(struct sli_repl_workrq *w)
+{
+	struct sli_repl_stream *rst = w->srw_stream;
+	struct slrpc_cservice *csvc;
+	struct bmap_iod_info *bii;
+	struct sl_resm *src_resm;
+	int rc, slvridx, slvrno;
 
-	/*
- 	 * We just take the work off the sli_replwkq_pending. Now we
- 	 * are putting it back again?
- 	 */
-	sli_replwk_queue(w);
-
-	if (csvc == NULL)
-		rc = SLERR_ION_OFFLINE;
-	else {
-		rc = sli_rii_issue_repl_read(csvc, slvrno, slvridx, w);
-		sl_csvc_decref(csvc);
-	}
-	if (rc) {
-		OPSTAT_INCR("repl-ignore-error");
+	for (;;) {
 		spinlock(&w->srw_lock);
-		w->srw_slvr[slvridx] = NULL;
+		if (w->srw_status) {
+			freelock(&w->srw_lock);
+			break;
+		}
+
 		BMAP_LOCK(w->srw_bcm);
 		bii = bmap_2_bii(w->srw_bcm);
-		bii->bii_crcstates[slvrno] |= BMAP_SLVR_WANTREPL;
+		for (slvrno = 0; slvrno < SLASH_SLVRS_PER_BMAP; slvrno++)
+			if (bii->bii_crcstates[slvrno] &
+			    BMAP_SLVR_WANTREPL)
+				break;
+
+		if (slvrno == SLASH_SLVRS_PER_BMAP) {
+			/*
+			 * Everything has been issued; the completions
+			 * will finish off this bmap.
+			 */
+			BMAP_ULOCK(w->srw_bcm);
+			freelock(&w->srw_lock);
+			break;
+		}
+
+		/*
+		 * Find a free slot we can use to transmit the sliver.
+		 * There is one per sliver so one is always free.
+		 */
+		for (slvridx = 0; slvridx < nitems(w->srw_slvr);
+		    slvridx++)
+			if (w->srw_slvr[slvridx] == NULL)
+				break;
+		psc_assert(slvridx < nitems(w->srw_slvr));
+
+		if (!sli_repl_stream_claim(rst, w)) {
+			/* our reference now belongs to the stream */
+			BMAP_ULOCK(w->srw_bcm);
+			freelock(&w->srw_lock);
+			return;
+		}
+
+		bii->bii_crcstates[slvrno] &= ~BMAP_SLVR_WANTREPL;
 		BMAP_ULOCK(w->srw_bcm);
+
+		/* Mark slot as occupied. */
+		w->srw_slvr[slvridx] = SLI_REPL_SLVR_SCHED;
+		PFL_GETTIMESPEC_MONO(&w->srw_slvr_ts[slvridx]);
 		freelock(&w->srw_lock);
-	}
 
- out:
+		/* Acquire connection to replication source & issue READ. */
+		src_resm = psc_dynarray_getpos(
+		    &w->srw_src_res->res_members, 0);
+		csvc = sli_geticsvc(src_resm, 0);
+		if (csvc == NULL)
+			rc = SLERR_ION_OFFLINE;
+		else {
+			rc = sli_rii_issue_repl_read(csvc, slvrno,
+			    slvridx, w);
+			sl_csvc_decref(csvc);
+		}
+		if (rc) {
+			OPSTAT_INCR("repl-ignore-error");
+			spinlock(&w->srw_lock);
+			w->srw_slvr[slvridx] = NULL;
+			BMAP_LOCK(w->srw_bcm);
+			bii = bmap_2_bii(w->srw_bcm);
+			bii->bii_crcstates[slvrno] |= BMAP_SLVR_WANTREPL;
+			BMAP_ULOCK(w->srw_bcm);
+			freelock(&w->srw_lock);
+
+			sli_repl_stream_done(rst, NULL, 0);
+			sli_replwk_queue(w);
+			break;
+		}
+	}
 	sli_replwkrq_decref(w, 0);
 }
 
 void
 slireplpndthr_main(struct psc_thread *thr)
 {
-	struct sli_repl_workrq *w, *last;
+	struct sli_repl_workrq *w;
 
-	last = NULL;
 	while (pscthr_run(thr)) {
 		w = lc_getwait(&sli_replwkq_pending);
 		if (w)
-			sli_repl_try_work(w, &last);
+			sli_repl_try_work(w);
 	}
 }
 
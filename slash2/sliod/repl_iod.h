@@ -45,12 +45,42 @@ struct slvr;
 
 #define SLI_REPL_SLVR_SCHED	((void *)0x1)
 
+#define SLI_REPL_WINDOW_MIN	4		/* slivers in flight per source */
+#define SLI_REPL_WINDOW_MAX	32
+#define SLI_REPL_READAHEAD	8		/* source prefetch distance in slivers */
+#define SLI_REPL_STREAM_INTV	1		/* window update interval in seconds */
+
+/*
+ * Replication traffic pulled from one source IOS.  Sliver reads of all
+ * work items with that source share a window, which is sized to twice
+ * the bandwidth-delay product measured over the previous interval.
+ * Work that finds the window full waits on rst_waiters until a read
+ * completes.
+ */
+struct sli_repl_stream {				/* embedded in resm_iod_info */
+	psc_spinlock_t		 rst_lock;
+	int			 rst_window;		/* max slivers in flight */
+	int			 rst_inflight;
+	int			 rst_nwaiters;
+	struct psclist_head	 rst_waiters;		/* sli_repl_workrq */
+
+	uint64_t		 rst_nbytes;		/* lifetime bytes received */
+	uint64_t		 rst_rate;		/* bytes/sec, smoothed */
+	uint64_t		 rst_rtt;		/* min sliver RTT (usec) */
+
+	/* current measurement interval */
+	struct timespec		 rst_intv_start;
+	uint64_t		 rst_intv_nbytes;
+	uint64_t		 rst_intv_minrtt;
+};
+
 struct sli_repl_workrq {				/* sli_replwkrq_pool */
 	struct sl_fidgen	 srw_fg;
 	sl_bmapno_t		 srw_bmapno;
 	sl_bmapgen_t		 srw_bgen;		/* bmap generation */
 	uint32_t		 srw_len;		/* bmap size */
 	struct sl_resource	*srw_src_res;		/* repl source */
+	struct sli_repl_stream	*srw_stream;		/* window to repl source */
 
 	psc_spinlock_t		 srw_lock;
 	int32_t			 srw_status;		/* return code to pass back to MDS */
@@ -65,8 +95,10 @@ struct sli_repl_workrq {				/* sli_replwkrq_pool */
 	struct bmapc_memb	*srw_bcm;
 	struct psclist_head	 srw_active_lentry;	/* entry in the active list */
 	struct psclist_head	 srw_pending_lentry;	/* entry in the pending list */
+	struct psclist_head	 srw_stream_lentry;	/* waiting for stream window */
 
 	struct slvr		*srw_slvr[SLASH_SLVRS_PER_BMAP];
+	struct timespec		 srw_slvr_ts[SLASH_SLVRS_PER_BMAP]; /* issue time */
 };
 
 #define PFLOG_REPLWK(level, srw, fmt, ...)				\
@@ -85,7 +117,14 @@ void	sli_bwqueued_adj(int32_t *, int);
 
 int	sli_replwk_queue(struct sli_repl_workrq *);
 
+void	sli_repl_stream_init(struct sli_repl_stream *);
+void	sli_repl_stream_done(struct sli_repl_stream *,
+	    const struct timespec *, int);
+
 extern struct psc_lockedlist	 sli_replwkq_active;
 extern struct psc_listcache	 sli_replwkq_pending;
 
+extern int			 sli_repl_window_max;
+extern int			 sli_repl_readahead;
+
 #endif /* _REPL_IOD_H_ */
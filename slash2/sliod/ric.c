@@ -196,11 +196,41 @@ sli_enqueue_update(struct fidc_membh *f)
 	fii->fii_lastwrite = now.tv_sec;
 }
 
+/*
+ * Track whether reads of a file arrive back to back.  Out-of-order
+ * arrivals within a few slivers of the expected offset are tolerated.
+ * Must be called with the fcmh locked.
+ */
+__static void
+sli_predio_track(struct fidc_membh *f, off_t off, off_t size)
+{
+	struct fcmh_iod_info *fii = fcmh_2_fii(f);
+	off_t delta = SLASH_SLVR_SIZE * 4;
+
+	FCMH_LOCK_ENSURE(f);
+	if (off == fii->fii_predio_lastoff + fii->fii_predio_lastsize) {
+		fii->fii_predio_nseq++;
+		OPSTAT_INCR("readahead-increase");
+	} else if (off > fii->fii_predio_lastoff +
+	    fii->fii_predio_lastsize + delta ||
+	    off < fii->fii_predio_lastoff + fii->fii_predio_lastsize -
+	    delta) {
+		fii->fii_predio_off = 0;
+		fii->fii_predio_nseq = 0;
+		OPSTAT_INCR("readahead-reset");
+	} else {
+		/* tolerate out-of-order arrivals */
+	}
+
+	fii->fii_predio_lastoff = off;
+	fii->fii_predio_lastsize = size;
+}
+
 __static int
 sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 {
 	sl_bmapno_t bmapno, slvrno;
-	int rc, nslvrs = 0, i, delta, needaio = 0;
+	int rc, error, nslvrs = 0, i, needaio = 0, prepflags = 0;
 	uint32_t tsize, roff, len[RIC_MAX_SLVRS_PER_IO];
 	struct slvr *s, *slvr[RIC_MAX_SLVRS_PER_IO];
 	struct iovec iovs[RIC_MAX_SLVRS_PER_IO];
@@ -332,6 +362,17 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 	if (f->fcmh_sstb.sst_utimgen < mq->utimgen)
 		f->fcmh_sstb.sst_utimgen = mq->utimgen;
 
+	/*
+	 * Random reads only fault in the blocks they touch; once the
+	 * file is being read sequentially, whole slivers pay off.
+	 */
+	if (rw == SL_READ) {
+		sli_predio_track(f, mq->offset +
+		    (off_t)bmapno * SLASH_BMAP_SIZE, mq->size);
+		if (!fcmh_2_fii(f)->fii_predio_nseq)
+			prepflags |= SLVR_PREPF_PARTIAL;
+	}
+
 	/* Paranoid: clear more than necessary. */
 	for (i = 0; i < RIC_MAX_SLVRS_PER_IO; i++) {
 		slvr[i] = NULL;
@@ -374,6 +415,11 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 		PFL_GOTOERR(out1, mp->rc = -rc);
 	}
 
+	/* CRC updates carry it so the MDS can spot stale ones */
+	if (rw == SL_WRITE &&
+	    mq->sbd.sbd_seq > bmap_2_bii(bmap)->bii_seq)
+		bmap_2_bii(bmap)->bii_seq = mq->sbd.sbd_seq;
+
 	DEBUG_FCMH(PLL_DIAG, f, "bmapno=%u size=%u off=%u rw=%s "
 	    "sbd_seq=%"PRId64, bmap->bcm_bmapno, mq->size, mq->offset,
 	    rw == SL_WRITE ? "wr" : "rd", mq->sbd.sbd_seq);
@@ -400,7 +446,7 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 		/* Fault in pages either for read or RBW. */
 		len[i] = MIN(tsize, SLASH_SLVR_SIZE - roff);
 
-		rv = slvr_io_prep(slvr[i], roff, len[i], rw, 0);
+		rv = slvr_io_prep(slvr[i], roff, len[i], rw, prepflags);
 
 		DEBUG_SLVR(rv && rv != -SLERR_AIOWAIT ?
 		    PLL_WARN : PLL_DIAG, slvr[i],
@@ -505,8 +551,19 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 	 * Write the sliver back to the filesystem.
 	 */
 	if (rw == SL_WRITE) {
-		mp->rc = sli_ric_write_sliver(mq->offset, mq->size, slvr,
-		    nslvrs);
+		if (!sli_wb_absorb(f, mq->offset, mq->size, slvr,
+		    nslvrs))
+			mp->rc = sli_ric_write_sliver(mq->offset,
+			    mq->size, slvr, nslvrs);
+		/*
+		 * Report an earlier write-back failure of data already
+		 * acknowledged.  That data is still being retried.
+		 */
+		if (!mp->rc) {
+			error = sli_wb_error(f);
+			if (error)
+				mp->rc = -error;
+		}
 		goto out1;
 	}
 
@@ -517,26 +574,7 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 
 	fii = fcmh_2_fii(f);
 #if 0
-	delta = SLASH_SLVR_SIZE * 4;
-	off = mq->offset + bmapno * SLASH_BMAP_SIZE;
-	if (off == fii->fii_predio_lastoff + fii->fii_predio_lastsize) {
-
-		fii->fii_predio_nseq++;
-		OPSTAT_INCR("readahead-increase");
-
-	} else if (off > fii->fii_predio_lastoff + fii->fii_predio_lastsize + delta ||
-	      off < fii->fii_predio_lastoff + fii->fii_predio_lastsize - delta) {
-
-	    	fii->fii_predio_off = 0;
-		fii->fii_predio_nseq = 0;
-		OPSTAT_INCR("readahead-reset");
-	} else {
-		/* tolerate out-of-order arrivals */
-	}
-
-	fii->fii_predio_lastoff = off;
-	fii->fii_predio_lastsize = mq->size;
-
+	/* sequential tracking is done by sli_predio_track() above */
 	if (!fii->fii_predio_nseq) {
 		FCMH_ULOCK(f);
 		goto out1;
@@ -567,8 +605,7 @@ sli_ric_handle_io(struct pscrpc_request *rq, enum rw rw)
 	readahead_enqueue(f, raoff, rasize);
 	fii->fii_predio_off = raoff;
 #else
-	delta = 0;	/* make gcc happy */
-	off = mq->offset + bmapno * SLASH_BMAP_SIZE + delta;
+	off = mq->offset + bmapno * SLASH_BMAP_SIZE;
 	raoff = off + mq->size;
 	if (raoff >= (off_t)f->fcmh_sstb.sst_size) {
 		FCMH_ULOCK(f);
@@ -59,7 +59,7 @@ sli_rii_replread_release_sliver(struct sli_repl_workrq *w, int slvridx,
     int rc)
 {
 	struct slvr *s;
-	int slvrsiz;
+	int slvrsiz = 0;
 	struct fidc_membh *f;
 
 	s = w->srw_slvr[slvridx];
@@ -103,12 +103,52 @@ sli_rii_replread_release_sliver(struct sli_repl_workrq *w, int slvridx,
 	w->srw_slvr[slvridx] = NULL;
 	freelock(&w->srw_lock);
 
-	sli_replwk_queue(w);
+	/* open the window for the next sliver from this source */
+	sli_repl_stream_done(w->srw_stream, &w->srw_slvr_ts[slvridx],
+	    rc ? 0 : slvrsiz);
 	sli_replwkrq_decref(w, rc);
 
 	return (rc);
 }
 
+/*
+ * Prefetch slivers ahead of a replication stream at the source.  The
+ * destination pulls a bmap in sliver order with several reads in
+ * flight, so reading sli_repl_readahead slivers ahead of each request
+ * (and the whole distance on the first one) keeps the disk read out of
+ * the round trip.
+ */
+__static void
+sli_rii_repl_readahead(struct fidc_membh *f, sl_bmapno_t bmapno,
+    int slvrno)
+{
+	off_t off, end;
+	int first, last;
+
+	if (sli_repl_readahead <= 0)
+		return;
+
+	last = MIN(slvrno + sli_repl_readahead,
+	    SLASH_SLVRS_PER_BMAP - 1);
+	first = slvrno ? last : 1;
+	if (first <= slvrno)
+		return;
+
+	off = (off_t)bmapno * SLASH_BMAP_SIZE +
+	    (off_t)first * SLASH_SLVR_SIZE;
+	end = (off_t)bmapno * SLASH_BMAP_SIZE +
+	    (off_t)(last + 1) * SLASH_SLVR_SIZE;
+
+	FCMH_LOCK(f);
+	end = MIN(end, (off_t)f->fcmh_sstb.sst_size);
+	FCMH_ULOCK(f);
+	if (end <= off)
+		return;
+
+	OPSTAT_INCR("repl-readahead");
+	readahead_enqueue(f, off, end - off);
+}
+
 /*
  * Handler for sliver replication read request.  This runs at the source
  * IOS of a replication request.
@@ -155,6 +195,9 @@ sli_rii_handle_repl_read(struct pscrpc_request *rq)
 	rv = slvr_io_prep(s, 0, mq->len, SL_READ, 0);
 	BMAP_ULOCK(b);
 
+	if (rv == 0 || rv == -SLERR_AIOWAIT)
+		sli_rii_repl_readahead(f, mq->bmapno, mq->slvrno);
+
 	iov.iov_base = s->slvr_slab;
 	iov.iov_len = mq->len;
 
@@ -291,6 +334,9 @@ sli_rii_handle_repl_read_aio(struct pscrpc_request *rq)
 	psc_assert(!rc);
 	BMAP_ULOCK(b);
 
+	/* the last sliver of a bmap is only partially transferred */
+	slvr_zero_tail(s, mq->len);
+
 	iov.iov_base = s->slvr_slab;
 	iov.iov_len = mq->len;
 
@@ -390,6 +436,9 @@ sli_rii_issue_repl_read(struct slrpc_cservice *csvc, int slvrno,
 	if (rc)
 		goto out;
 
+	/* the last sliver of a bmap is only partially transferred */
+	slvr_zero_tail(s, mq->len);
+
 	iov.iov_base = s->slvr_slab;
 	iov.iov_len = mq->len;
 
@@ -158,6 +158,7 @@ sli_rim_handle_bmap_ptrunc(struct pscrpc_request *rq)
 		/* (gdb) p *((struct pfl_opstat *)pfl_opstats.pda_items[546]) */
 		OPSTAT_INCR("ptrunc-success");
 	}
+	sli_bmap_truncate_crcs(f, mq->bmapno, mq->offset);
 
 	FCMH_LOCK(f);
 	sli_enqueue_update(f);
@@ -31,9 +31,11 @@
 #include "slconfig.h"
 #include "sltypes.h"
 #include "bmap_iod.h"
+#include "repl_iod.h"
 
 struct bmapc_memb;
 struct fidc_membh;
+struct slvr;
 
 /* sliod thread types */
 enum {
@@ -42,7 +44,10 @@ enum {
 	SLITHRT_BMAPLEASE_PROC,		/* bmap lease relinquish processor */
 	SLITHRT_BREAP,			/* bmap reaper */
 	SLITHRT_BATCHRPC,		/* batch RPC sender */
+	SLITHRT_BULKHASH,		/* bulk payload hash helper */
 	SLITHRT_CONN,			/* connection monitor */
+	SLITHRT_CRCUP,			/* sliver CRC updates to MDS */
+	SLITHRT_CRCVERIFY,		/* sliver CRC checks of io_uring reads */
 	SLITHRT_CTL,			/* control processor */
 	SLITHRT_CTLAC,			/* control acceptor */
 	SLITHRT_FREAP,			/* file reaper */
@@ -65,6 +70,14 @@ enum {
 
 #define NSLVR_READAHEAD_THRS	8
 
+#define NSLIAIO_THRS		4	/* POSIX AIO completion handlers */
+
+/*
+ * Realtime signal used for POSIX AIO completion.  Unlike SIGIO these
+ * are queued, one per request, and carry the iocb.
+ */
+#define SLI_AIO_SIGNO		(SIGRTMIN + 1)
+
 #define NSLVRCRC_THRS		4	/* perhaps default to ncores + configurable? */
 
 #define NSLVRSYNC_THRS		2	/* perhaps default to ncores + configurable? */
@@ -84,11 +97,17 @@ struct slirii_thread {
 	int			 sirit_st_nread;
 };
 
+struct sliaio_thread {
+	int			 siat_id;
+};
+
 PSCTHR_MKCAST(sliricthr, sliric_thread, SLITHRT_RIC)
 PSCTHR_MKCAST(slirimthr, slirim_thread, SLITHRT_RIM)
 PSCTHR_MKCAST(sliriithr, slirii_thread, SLITHRT_RII)
+PSCTHR_MKCAST(sliaiothr, sliaio_thread, SLITHRT_AIO)
 
 struct resm_iod_info {
+	struct sli_repl_stream	 rmii_replst;	/* replication from this IOS */
 };
 
 static __inline struct resm_iod_info *
@@ -118,9 +137,16 @@ extern struct timespec		 sli_ssfb_send;
 extern struct psc_listcache	 sli_fcmh_dirty;
 extern struct psc_listcache	 sli_fcmh_update;
 extern int			 sli_sync_max_writes;
+extern int			 sli_crc_verify;
+extern int			 sli_partial_read_min;
 extern int			 sli_min_space_reserve_gb;
 extern int			 sli_min_space_reserve_pct;
 extern int			 sli_predio_max_slivers;
+extern int			 sli_wb_enable;
+extern int			 sli_wb_hiwat_mb;
+extern int			 sli_wb_lowat_mb;
+extern int			 sli_wb_max_age;
+extern struct psc_listcache	 sli_wb_files;
 extern struct psc_thread	*sliconnthr;
 
 extern uint64_t			 sli_current_reclaim_xid;
@@ -138,8 +164,16 @@ void	slictlthr_spawn(const char *);
 
 void	sliupdthr_main(struct psc_thread *);
 void	slisyncthr_main(struct psc_thread *);
+void	slicrcthr_main(struct psc_thread *);
+void	slicrcvthr_main(struct psc_thread *);
 void	sliseqnothr_main(struct psc_thread *);
 
 void	sli_enqueue_update(struct fidc_membh *);
+void	readahead_enqueue(struct fidc_membh *, off_t, off_t);
+
+int	sli_wb_absorb(struct fidc_membh *, uint32_t, uint32_t,
+	    struct slvr **, int);
+int	sli_wb_error(struct fidc_membh *);
+int	sli_wb_flush_fcmh(struct fidc_membh *, int);
 
 #endif /* _SLIOD_H_ */
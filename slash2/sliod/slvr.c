@@ -27,12 +27,23 @@
 #define PSC_SUBSYS SLISS_SLVR
 #include "subsys_iod.h"
 
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <sched.h>
+
+#ifdef HAVE_NUMA
+#  include <numa.h>
+#endif
+
 #include "pfl/atomic.h"
+#include "pfl/crc.h"
 #include "pfl/ctlsvr.h"
 #include "pfl/fault.h"
 #include "pfl/listcache.h"
 #include "pfl/lock.h"
 #include "pfl/pthrutil.h"
+#include "pfl/rlimit.h"
 #include "pfl/rpc.h"
 #include "pfl/rsx.h"
 #include "pfl/treeutil.h"
@@ -43,6 +54,7 @@
 #include "rpc_iod.h"
 #include "slab.h"
 #include "slerr.h"
+#include "sliod.h"
 #include "sltypes.h"
 #include "slvr.h"
 
@@ -58,6 +70,7 @@ struct psc_poolmgr	*sli_readaheadrq_pool;
 
 struct psc_listcache	 sli_readaheadq;
 struct psc_listcache	 sli_iocb_pndg;
+struct psc_listcache	 sli_crc_verifyq;	/* io_uring reads to check */
 
 psc_atomic64_t		 sli_aio_id = PSC_ATOMIC64_INIT(0);
 
@@ -73,7 +86,8 @@ SPLAY_GENERATE(biod_slvrtree, slvr, slvr_tentry, slvr_cmp)
 #define                  MIN_FREE_SLABS		 16
 #define			 SLAB_RECLAIM_BATCH      1
 
-struct psc_listcache     slab_buffers;
+#define			 SLI_AIO_LOST_SECS	 30	/* AIO notification given up on */
+
 int                      slab_buffers_count;    /* total, including free */
 
 struct slab_buffer_entry {
@@ -83,32 +97,273 @@ struct slab_buffer_entry {
 	};
 };
 
+/*
+ * Slab buffers are carved out of one mapping per NUMA node and kept on
+ * that node's free list so a sliver's data ends up in memory local to
+ * the service thread that faulted it in.
+ */
+struct sli_slab_node {
+	struct psc_listcache	 ssn_buffers;
+	char			*ssn_base;
+	size_t			 ssn_len;
+};
+
+struct sli_slab_node	*sli_slab_nodes;
+int			 sli_slab_nnodes = 1;
+
 int			 use_slab_buffers = 1;
 
+int			 sli_crc_verify = 1;	/* check data CRC on fault-in */
+int			 sli_partial_read_min = 64 * 1024; /* 0: whole slivers only */
+
+__static int
+sli_slab_curnode(void)
+{
+#ifdef HAVE_NUMA
+	int cpu, node;
+
+	if (sli_slab_nnodes == 1)
+		return (0);
+	cpu = sched_getcpu();
+	if (cpu == -1)
+		return (0);
+	node = numa_node_of_cpu(cpu);
+	if (node < 0 || node >= sli_slab_nnodes)
+		return (0);
+	return (node);
+#else
+	return (0);
+#endif
+}
+
 void *
 sli_slab_alloc(void)
 {
+	int i, node;
 	void *p;
 
-	if (use_slab_buffers) {
-		p = lc_getnb(&slab_buffers);
-		psc_assert(p);
-	} else
-		p = PSCALLOC(SLASH_SLVR_SIZE);
-
-	return (p);
+	if (!use_slab_buffers)
+		return (PSCALLOC(SLASH_SLVR_SIZE));
+
+	node = sli_slab_curnode();
+	p = lc_getnb(&sli_slab_nodes[node].ssn_buffers);
+	if (p)
+		return (p);
+
+	/* Our node ran dry, borrow from the others. */
+	for (i = 1; i < sli_slab_nnodes; i++) {
+		p = lc_getnb(&sli_slab_nodes[(node + i) %
+		    sli_slab_nnodes].ssn_buffers);
+		if (p) {
+			OPSTAT_INCR("slab-alloc-remote");
+			return (p);
+		}
+	}
+	psc_fatalx("out of slab buffers");
 }
 
 void
 sli_slab_free(void *p)
 {
-	if (use_slab_buffers) {
-		INIT_PSC_LISTENTRY((struct psc_listentry *)p);
-		lc_add(&slab_buffers, p);
-	} else
+	struct sli_slab_node *sn;
+	int i;
+
+	if (!use_slab_buffers) {
 		PSCFREE(p);
+		return;
+	}
+
+	for (i = 0, sn = sli_slab_nodes; i < sli_slab_nnodes; i++, sn++)
+		if ((char *)p >= sn->ssn_base &&
+		    (char *)p < sn->ssn_base + sn->ssn_len) {
+			INIT_PSC_LISTENTRY((struct psc_listentry *)p);
+			lc_add(&sn->ssn_buffers, p);
+			return;
+		}
+	psc_fatalx("slab %p does not belong to any node", p);
 }
 
+/*
+ * Slab buffers are not cleared when a sliver is instantiated.  Once
+ * the sliver has been filled, zero whatever part of it the disk or
+ * network did not supply so nothing stale is ever served or CRC'd.
+ * @s: the sliver.
+ * @len: number of bytes from the start of the sliver that are valid.
+ */
+void
+slvr_zero_tail(struct slvr *s, uint32_t len)
+{
+	if (len >= SLASH_SLVR_SIZE)
+		return;
+	memset((char *)slvr_2_buf(s, 0) + len, 0,
+	    SLASH_SLVR_SIZE - len);
+	OPSTAT_ADD("slab-zero-bytes", SLASH_SLVR_SIZE - len);
+}
+
+/*
+ * Determine whether sliver data read from the backing file must be
+ * checked against a CRC from the MDS.  That can only be done against
+ * the entire sliver, so such slivers must not be read partially.  The
+ * bmap must be locked.
+ */
+__static int
+slvr_crc_wanted(struct slvr *s)
+{
+	BII_LOCK_ENSURE(slvr_2_bii(s));
+	return (sli_crc_verify &&
+	    (slvr_2_crcbits(s) & BMAP_SLVR_CRC));
+}
+
+/*
+ * Narrow the fault-in of a sliver for a read of [off, off + len) to
+ * the blocks it touches, rounded out to sli_partial_read_min and
+ * trimmed of blocks an earlier partial read already loaded.  The caller
+ * must own the sliver through SLVRF_FAULTING and have ruled out a CRC
+ * check with slvr_crc_wanted().
+ */
+__static void
+slvr_partial_range(struct slvr *s, uint32_t off, uint32_t len,
+    uint32_t *roffp, uint32_t *rlenp)
+{
+	uint32_t minsz, start, end, valid;
+
+	if (sli_partial_read_min <= 0 ||
+	    sli_partial_read_min >= SLASH_SLVR_SIZE)
+		return;
+
+	minsz = PSC_ALIGN(sli_partial_read_min, SLASH_SLVR_BLKSZ);
+	start = off / minsz * minsz;
+	end = MIN(PSC_ALIGN(off + len, minsz), SLASH_SLVR_SIZE);
+
+	valid = s->slvr_flags & SLVRF_PARTIAL ? s->slvr_validblks : 0;
+	while (start < end &&
+	    valid & (1U << (start / SLASH_SLVR_BLKSZ)))
+		start += SLASH_SLVR_BLKSZ;
+	while (end > start &&
+	    valid & (1U << ((end - 1) / SLASH_SLVR_BLKSZ)))
+		end -= SLASH_SLVR_BLKSZ;
+	psc_assert(start < end);
+
+	*roffp = start;
+	*rlenp = end - start;
+}
+
+/*
+ * Recompute the CRCs of the given blocks from the slab contents.
+ */
+void
+slvr_blkcrc_update(struct slvr *s, int sblk, int nblks)
+{
+	int i;
+
+	for (i = sblk; i < sblk + nblks; i++) {
+		psc_crc64_calc(&s->slvr_blkcrcs[i], slvr_2_buf(s, i),
+		    SLASH_SLVR_BLKSZ);
+		s->slvr_crcblks |= 1U << i;
+	}
+	OPSTAT2_ADD("crc-bytes", nblks * SLASH_SLVR_BLKSZ);
+}
+
+/*
+ * Compute the CRC of the entire sliver by combining its per-block
+ * CRCs, filling in any which are missing.  The caller must own the
+ * sliver through SLVRF_FAULTING.
+ */
+int
+slvr_do_crc(struct slvr *s, uint64_t *crcp)
+{
+	uint64_t crc;
+	int i;
+
+	for (i = 0; i < SLASH_BLKS_PER_SLVR; i++)
+		if (!(s->slvr_crcblks & (1U << i)))
+			slvr_blkcrc_update(s, i, 1);
+
+	crc = s->slvr_blkcrcs[0];
+	for (i = 1; i < SLASH_BLKS_PER_SLVR; i++)
+		crc = psc_crc64_combine(crc, s->slvr_blkcrcs[i],
+		    SLASH_SLVR_BLKSZ);
+	*crcp = crc;
+	return (0);
+}
+
+/*
+ * Check a sliver just read from the backing file against the CRC the
+ * MDS handed out for it, if there is one.
+ */
+__static int
+slvr_verify_crc(struct slvr *s)
+{
+	struct bmap_iod_info *bii = slvr_2_bii(s);
+	uint64_t crc, expect;
+	int check;
+
+	s->slvr_crcblks = 0;
+	if (!sli_crc_verify)
+		return (0);
+
+	BII_LOCK(bii);
+	check = slvr_2_crcbits(s) & BMAP_SLVR_CRC;
+	expect = slvr_2_crc(s);
+	BII_ULOCK(bii);
+	if (!check)
+		return (0);
+
+	slvr_do_crc(s, &crc);
+	if (crc == expect)
+		return (0);
+
+	OPSTAT_INCR("crc-verify-fail");
+	DEBUG_SLVR(PLL_ERROR, s, "CRC mismatch: want=%"PRIx64" "
+	    "got=%"PRIx64, expect, crc);
+	return (-PFLERR_BADCRC);
+}
+
+/*
+ * Record the CRC of a sliver after it has been written to the backing
+ * file and queue its bmap so the new CRC gets sent to the MDS.
+ */
+void
+slvr_schedule_crc(struct slvr *s)
+{
+	struct bmap_iod_info *bii = slvr_2_bii(s);
+	struct bmap *b = bii_2_bmap(bii);
+	struct timespec now;
+	uint64_t crc;
+
+	slvr_do_crc(s, &crc);
+
+	BII_LOCK(bii);
+	slvr_2_crc(s) = crc;
+	slvr_2_crcbits(s) |= BMAP_SLVR_DATA | BMAP_SLVR_CRC |
+	    BMAP_SLVR_CRCDIRTY;
+	if (!(b->bcm_flags & BMAPF_CRUD_INFLIGHT)) {
+		b->bcm_flags |= BMAPF_CRUD_INFLIGHT;
+		PFL_GETTIMESPEC(&now);
+		bii->bii_crcq_age = now.tv_sec;
+		bmap_op_start_type(b, BMAP_OPCNT_BCRSCHED);
+		lc_add(&sli_bmap_crcq, bii);
+	}
+	BII_ULOCK(bii);
+}
+
+/*
+ * Forget the CRCs of a sliver after a write to the backing file that
+ * did not complete, as they describe data the file may no longer hold.
+ * The next complete write of the sliver schedules a fresh CRC.
+ */
+__static void
+slvr_forget_crc(struct slvr *s)
+{
+	struct bmap_iod_info *bii = slvr_2_bii(s);
+
+	s->slvr_crcblks = 0;
+
+	BII_LOCK(bii);
+	slvr_2_crcbits(s) &= ~(BMAP_SLVR_CRC | BMAP_SLVR_CRCDIRTY);
+	BII_ULOCK(bii);
+	OPSTAT_INCR("crc-forget");
+}
 
 void
 sli_aio_aiocbr_release(struct sli_aiocb_reply *a)
@@ -272,15 +527,18 @@ slvr_iocb_release(struct sli_iocb *iocb)
 	psc_pool_return(sli_iocb_pool, iocb);
 }
 
+/*
+ * Settle the state of a sliver whose asynchronous read has finished,
+ * and reply to the requests waiting on it.
+ */
 __static void
-slvr_fsaio_done(struct sli_iocb *iocb)
+slvr_fsaio_finish(struct sli_iocb *iocb, int rc)
 {
 	struct sli_aiocb_reply *a;
 	struct slvr *s;
-	int rc;
+	int raref;
 
 	s = iocb->iocb_slvr;
-	rc = iocb->iocb_rc;
 
 	SLVR_LOCK(s);
 	psc_assert(iocb == s->slvr_iocb);
@@ -302,6 +560,7 @@ slvr_fsaio_done(struct sli_iocb *iocb)
 		DEBUG_SLVR(PLL_ERROR, s, "error, rc=%d", rc);
 		s->slvr_err = rc;
 	} else {
+		s->slvr_flags &= ~SLVRF_PARTIAL;
 		s->slvr_flags |= SLVRF_DATARDY;
 		DEBUG_SLVR(PLL_DIAG, s, "FAULTING -> DATARDY");
 	}
@@ -309,11 +568,78 @@ slvr_fsaio_done(struct sli_iocb *iocb)
 	a = s->slvr_aioreply;
 	s->slvr_aioreply = NULL;
 
+	raref = s->slvr_flags & SLVRF_RAWAIT;
+	if (raref) {
+		s->slvr_flags &= ~SLVRF_RAWAIT;
+		if (!rc)
+			s->slvr_flags |= SLVRF_READAHEAD;
+	}
+
 	SLVR_WAKEUP(s);
 	SLVR_ULOCK(s);
 
 	if (a)
 		slvr_aio_tryreply(a);
+	if (raref)
+		slvr_rio_done(s);
+}
+
+__static void
+slvr_fsaio_done(struct sli_iocb *iocb)
+{
+	struct timespec ts;
+	struct slvr *s;
+	int rc, crc;
+
+	s = iocb->iocb_slvr;
+	rc = iocb->iocb_rc;
+	if (iocb->iocb_len > 0) {
+		pfl_opstat_add(sli_backingstore_iostats.rd, iocb->iocb_len);
+		OPSTAT_ADD("sliver-read-disk-bytes", iocb->iocb_len);
+	}
+	if (iocb->iocb_start.tv_sec) {
+		PFL_GETTIMESPEC(&ts);
+		timespecsub(&ts, &iocb->iocb_start, &ts);
+		OPSTAT_HIST("read-wait-usecs",
+		    ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+	}
+	if (!rc) {
+		slvr_zero_tail(s, iocb->iocb_len);
+
+		/*
+		 * An io_uring ring has a single completion thread, so
+		 * leave CRC checks to slicrcvthr instead of holding up
+		 * every other completion on the ring behind them.
+		 */
+		if (sli_nurings) {
+			BII_LOCK(slvr_2_bii(s));
+			crc = slvr_crc_wanted(s);
+			BII_ULOCK(slvr_2_bii(s));
+			if (crc) {
+				OPSTAT_INCR("crc-verify-defer");
+				lc_add(&sli_crc_verifyq, iocb);
+				return;
+			}
+		}
+		rc = -slvr_verify_crc(s);
+	}
+	slvr_fsaio_finish(iocb, rc);
+}
+
+/*
+ * Check the CRCs of slivers read through io_uring and finish their
+ * reads.
+ */
+void
+slicrcvthr_main(struct psc_thread *thr)
+{
+	struct sli_iocb *iocb;
+
+	while (pscthr_run(thr)) {
+		iocb = lc_getwait(&sli_crc_verifyq);
+		slvr_fsaio_finish(iocb,
+		    -slvr_verify_crc(iocb->iocb_slvr));
+	}
 }
 
 __static struct sli_iocb *
@@ -430,6 +756,11 @@ sli_aio_register(struct slvr *s)
 	SLVR_WAKEUP(s);
 	SLVR_ULOCK(s);
 
+	if (sli_nurings)
+		return (sli_uring_read(iocb, slvr_2_fd(s),
+		    slvr_2_buf(s, 0), SLASH_SLVR_SIZE,
+		    slvr_2_fileoff(s, 0)));
+
 	aio = &iocb->iocb_aiocb;
 	aio->aio_fildes = slvr_2_fd(s);
 
@@ -439,9 +770,10 @@ sli_aio_register(struct slvr *s)
 	aio->aio_nbytes = SLASH_SLVR_SIZE;
 
 	aio->aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-	aio->aio_sigevent.sigev_signo = SIGIO;
-	aio->aio_sigevent.sigev_value.sival_ptr = (void *)aio;
+	aio->aio_sigevent.sigev_signo = SLI_AIO_SIGNO;
+	aio->aio_sigevent.sigev_value.sival_ptr = iocb;
 
+	PFL_GETTIMESPEC(&iocb->iocb_start);
 	lc_add(&sli_iocb_pndg, iocb);
 	error = aio_read(aio);
 	if (error == 0) {
@@ -461,9 +793,11 @@ sli_aio_register(struct slvr *s)
 __static ssize_t
 slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 {
-	int sblk, nblks, save_errno = 0;
+	struct bmap_iod_info *bii = slvr_2_bii(s);
+	int sblk, nblks, partial, save_errno = 0;
 	struct timespec ts0, ts1, tsd;
 	struct fidc_membh *f;
+	uint32_t mask;
 	uint64_t *v8;
 	ssize_t	rc;
 	size_t foff;
@@ -484,10 +818,24 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 			return (sli_aio_register(s));
 
 		/*
-		 * Do full sliver read, ignoring specific off and len.
+		 * Read the whole sliver unless slvr_io_prep() narrowed
+		 * the fault-in to a block range.  A CRC may have arrived
+		 * since then, in which case the sliver must be read and
+		 * verified in its entirety after all.
 		 */
-		sblk = 0;
-		size = SLASH_SLVR_SIZE;
+		partial = size < SLASH_SLVR_SIZE;
+		if (partial) {
+			BII_LOCK(bii);
+			if (slvr_crc_wanted(s)) {
+				OPSTAT_INCR("partial-read-crc");
+				off = 0;
+				size = SLASH_SLVR_SIZE;
+				partial = 0;
+			}
+			BII_ULOCK(bii);
+		}
+		sblk = off / SLASH_SLVR_BLKSZ;
+		psc_assert((off % SLASH_SLVR_BLKSZ) == 0);
 		foff = slvr_2_fileoff(s, sblk);
 		nblks = (size + SLASH_SLVR_BLKSZ - 1) / SLASH_SLVR_BLKSZ;
 
@@ -506,12 +854,46 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 		if (rc == -1) {
 			save_errno = errno;
 			OPSTAT_INCR("fsio-read-fail");
-		} else
+		} else {
 			pfl_opstat_add(sli_backingstore_iostats.rd, rc);
+			OPSTAT_ADD("sliver-read-disk-bytes", rc);
+		}
+		if (rc != -1 && partial) {
+			if ((uint32_t)rc < size)
+				memset((char *)slvr_2_buf(s, sblk) + rc,
+				    0, size - rc);
+			mask = slvr_blkmask(off, size);
+			SLVR_LOCK(s);
+			if (!(s->slvr_flags & SLVRF_PARTIAL)) {
+				s->slvr_flags |= SLVRF_PARTIAL;
+				s->slvr_validblks = 0;
+				s->slvr_crcblks = 0;
+			}
+			s->slvr_validblks |= mask;
+			SLVR_ULOCK(s);
+			/*
+			 * Nothing to verify against, but keep the block
+			 * CRCs so a later write need not recompute them.
+			 */
+			slvr_blkcrc_update(s, sblk, nblks);
+			OPSTAT_INCR("partial-read");
+		} else if (rc != -1) {
+			slvr_zero_tail(s, rc);
+			save_errno = -slvr_verify_crc(s);
+			if (save_errno) {
+				/* report as a failed read below */
+				errno = save_errno;
+				rc = -1;
+			} else {
+				SLVR_LOCK(s);
+				s->slvr_flags &= ~SLVRF_PARTIAL;
+				SLVR_ULOCK(s);
+			}
+		}
 
 		PFL_GETTIMESPEC(&ts1);
 		timespecsub(&ts1, &ts0, &tsd);
-		OPSTAT_ADD("read-wait-usecs",
+		OPSTAT_HIST("read-wait-usecs",
 		    tsd.tv_sec * 1000000 + tsd.tv_nsec / 1000);
 	} else {
 		OPSTAT_INCR("fsio-write");
@@ -526,13 +908,23 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 		 * wait for this counter to reach zero.
 		 */
 
-		rc = pwrite(slvr_2_fd(s), slvr_2_buf(s, sblk), size,
-		    foff);
+		slvr_blkcrc_update(s, sblk, nblks);
+
+		if (sli_nurings)
+			rc = sli_uring_pwrite(slvr_2_fd(s),
+			    slvr_2_buf(s, sblk), size, foff);
+		else
+			rc = pwrite(slvr_2_fd(s), slvr_2_buf(s, sblk),
+			    size, foff);
 		if (rc == -1) {
 			save_errno = errno;
 			OPSTAT_INCR("fsio-write-fail");
 		} else
 			pfl_opstat_add(sli_backingstore_iostats.wr, rc);
+		if (rc != -1 && (uint32_t)rc == size)
+			slvr_schedule_crc(s);
+		else
+			slvr_forget_crc(s);
 	}
 
 	if (rc < 0) {
@@ -574,6 +966,9 @@ slvr_fsio(struct slvr *s, uint32_t off, uint32_t size, enum rw rw)
 /*
  * Read in a sliver or a portion of it.
  * @s: the sliver.
+ * @off: block aligned offset into the sliver.
+ * @size: length to read; anything short of the whole sliver only
+ *	loads those blocks and leaves the sliver SLVRF_PARTIAL.
  */
 ssize_t
 slvr_fsbytes_rio(struct slvr *s, uint32_t off, uint32_t size)
@@ -605,15 +1000,19 @@ slvr_fsbytes_wio(struct slvr *s, uint32_t sblk, uint32_t size)
  * @off: offset into the slvr (not bmap or file object)
  * @len: len relative to the slvr
  * @rw: read or write op
- * @flags: operational flags.
+ * @flags: operational flags (SLVR_PREPF_*).
  */
 ssize_t
 slvr_io_prep(struct slvr *s, uint32_t off, uint32_t len, enum rw rw, 
-    int readahead)
+    int flags)
 {
 	struct bmap *b = slvr_2_bmap(s);
+	uint32_t roff, rlen, mask;
 	ssize_t rc = 0;
+	int crc;
 
+	/* blocks loaded by a partial read were never verified */
+	crc = slvr_crc_wanted(s);
 	BMAP_ULOCK(b);
 
 	SLVR_LOCK(s);
@@ -638,14 +1037,25 @@ slvr_io_prep(struct slvr *s, uint32_t off, uint32_t len, enum rw rw,
 	 */
 	s->slvr_flags |= SLVRF_FAULTING;
 
+	if (rw == SL_READ && !(flags & SLVR_PREPF_READAHEAD))
+		OPSTAT_ADD("sliver-read-req-bytes", len);
+
 	if (s->slvr_flags & SLVRF_DATARDY) {
-		if (!readahead && (s->slvr_flags & SLVRF_READAHEAD)) {
+		if (!(flags & SLVR_PREPF_READAHEAD) &&
+		    (s->slvr_flags & SLVRF_READAHEAD)) {
 			s->slvr_flags &= ~SLVRF_READAHEAD;
 			OPSTAT_INCR("readahead-hit");
 		}
 		goto out1;
 	}
-	if (!readahead && rw == SL_READ)
+	if (rw == SL_READ && !crc && (s->slvr_flags & SLVRF_PARTIAL)) {
+		mask = slvr_blkmask(off, len);
+		if ((s->slvr_validblks & mask) == mask) {
+			OPSTAT_INCR("partial-read-hit");
+			goto out1;
+		}
+	}
+	if (!(flags & SLVR_PREPF_READAHEAD) && rw == SL_READ)
 		OPSTAT_INCR("readahead-miss");
 
 	if (rw == SL_WRITE && !off && len == SLASH_SLVR_SIZE) {
@@ -654,16 +1064,24 @@ slvr_io_prep(struct slvr *s, uint32_t off, uint32_t len, enum rw rw,
 		 * All blocks will be dirtied by the incoming network
 		 * IO.
 		 */
+		s->slvr_flags &= ~SLVRF_PARTIAL;
 		goto out1;
 	}
 	SLVR_ULOCK(s);
 
 	/*
 	 * Execute read to fault in needed blocks after dropping the
-	 * lock.  All should be protected by the FAULTING bit.
+	 * lock.  All should be protected by the FAULTING bit.  Writes
+	 * need the whole sliver to compute its CRC afterwards.  The
+	 * AIO completion path only knows how to finish whole slivers.
 	 */
-	rc = slvr_fsbytes_rio(s, off, len);
-	if (!rc && readahead)
+	roff = 0;
+	rlen = SLASH_SLVR_SIZE;
+	if (rw == SL_READ && (flags & SLVR_PREPF_PARTIAL) && !crc &&
+	    !slcfg_local->cfg_async_io)
+		slvr_partial_range(s, off, len, &roff, &rlen);
+	rc = slvr_fsbytes_rio(s, roff, rlen);
+	if (!rc && (flags & SLVR_PREPF_READAHEAD))
 		s->slvr_flags |= SLVRF_READAHEAD;
 	goto out2;
 
@@ -725,6 +1143,14 @@ slvr_remove_all(struct fidc_membh *f)
 
  restart:
 
+	/*
+	 * Dirty slivers hold a reference until written back.  Once the
+	 * backing file is closed there is nowhere to write them to, and
+	 * data that cannot be written back is obsolete now anyway.
+	 */
+	if (sli_wb_flush_fcmh(f, !(f->fcmh_flags & FCMH_IOD_BACKFILE)))
+		sli_wb_flush_fcmh(f, 1);
+
 	pfl_rwlock_rdlock(&f->fcmh_rwlock);
 	RB_FOREACH(b, bmaptree, &f->fcmh_bmaptree) {
 		BMAP_LOCK(b);
@@ -869,6 +1295,9 @@ slvr_io_done(struct slvr *s, int rc)
 		s->slvr_err = rc;
 		s->slvr_flags |= SLVRF_DATAERR;
 		DEBUG_SLVR(PLL_DIAG, s, "FAULTING --> DATAERR");
+	} else if (s->slvr_flags & SLVRF_PARTIAL) {
+		DEBUG_SLVR(PLL_DIAG, s, "FAULTING --> PARTIAL %#x",
+		    s->slvr_validblks);
 	} else {
 		s->slvr_flags |= SLVRF_DATARDY;
 		DEBUG_SLVR(PLL_DIAG, s, "FAULTING --> DATARDY");
@@ -966,9 +1395,15 @@ slvr_lookup(uint32_t num, struct bmap_iod_info *bii)
 		s->slvr_num = num;
 		s->slvr_bii = bii;
 		INIT_PSC_LISTENTRY(&s->slvr_lentry);
+		INIT_PSC_LISTENTRY(&s->slvr_wb_lentry);
 		INIT_SPINLOCK(&s->slvr_lock);
 
-		memset(tmp2, 0, SLASH_SLVR_SIZE);
+		/*
+		 * The slab is not zeroed here: the fault-in or the
+		 * incoming write fills it and slvr_zero_tail() clears
+		 * any remainder.
+		 */
+		OPSTAT_ADD("slab-zero-avoided-bytes", SLASH_SLVR_SIZE);
 		s->slvr_slab = tmp2;
 		s->slvr_refcnt = 1;
 
@@ -1055,39 +1490,108 @@ again:
 	return (nitems);
 }
 
-void
-sliaiothr_main(__unusedx struct psc_thread *thr)
+/*
+ * Take a finished POSIX AIO request off the pending list.  A request
+ * can be found both through its completion signal and by the sweep for
+ * lost notifications; whoever removes it from the list owns it.
+ * Returns 1 if the caller should run the completion.
+ */
+__static int
+sli_aio_claim(struct sli_iocb *iocb)
 {
-	struct sli_iocb *iocb, *next;
-	sigset_t signal_set;
-	int signo;
+	ssize_t len;
+	int rc;
 
-	sigemptyset(&signal_set);
-	sigaddset(&signal_set, SIGIO);
+	LIST_CACHE_LOCK_ENSURE(&sli_iocb_pndg);
+	if (!lc_conjoint(&sli_iocb_pndg, iocb))
+		return (0);
+	rc = aio_error(&iocb->iocb_aiocb);
+	if (rc == EINVAL || rc == EINPROGRESS)
+		return (0);
+	psc_assert(rc != ECANCELED);
+
+	lc_remove(&sli_iocb_pndg, iocb);
+	len = aio_return(&iocb->iocb_aiocb);
+	iocb->iocb_rc = rc;
+	pfl_fault_here_rc(&iocb->iocb_rc, EIO, "sliod/aio_fail");
+	if (iocb->iocb_rc == 0)
+		iocb->iocb_len = len;
+	return (1);
+}
 
-	for (;;) {
-		sigwait(&signal_set, &signo);
-		psc_assert(signo == SIGIO);
+/*
+ * Complete requests whose notification never showed up, e.g. because
+ * the realtime signal queue overflowed.  Only requests that have been
+ * outstanding for a long time are considered so a merely slow signal
+ * is never beaten to the request.
+ */
+__static void
+sli_aio_sweep(void)
+{
+	struct sli_iocb *iocb, *next;
+	struct timespec now;
 
+	PFL_GETTIMESPEC(&now);
+	LIST_CACHE_LOCK(&sli_iocb_pndg);
+	LIST_CACHE_FOREACH_SAFE(iocb, next, &sli_iocb_pndg) {
+		if (now.tv_sec - iocb->iocb_start.tv_sec <
+		    SLI_AIO_LOST_SECS)
+			continue;
+		if (!sli_aio_claim(iocb))
+			continue;
+		OPSTAT_INCR("aio-lost-notify");
+		LIST_CACHE_ULOCK(&sli_iocb_pndg);
+		iocb->iocb_cbf(iocb);	/* slvr_fsaio_done() */
 		LIST_CACHE_LOCK(&sli_iocb_pndg);
-		LIST_CACHE_FOREACH_SAFE(iocb, next, &sli_iocb_pndg) {
-			iocb->iocb_rc = aio_error(&iocb->iocb_aiocb);
-			if (iocb->iocb_rc == EINVAL)
-				continue;
-			if (iocb->iocb_rc == EINPROGRESS)
-				continue;
-			psc_assert(iocb->iocb_rc != ECANCELED);
+	}
+	LIST_CACHE_ULOCK(&sli_iocb_pndg);
+}
+
+/*
+ * POSIX AIO completion handler.  Each request raises its own queued
+ * realtime signal carrying the iocb, so a completion costs O(1)
+ * regardless of how many reads are in flight, and several of these
+ * threads can run CRC checks and replies in parallel.
+ */
+void
+sliaiothr_main(struct psc_thread *thr)
+{
+	struct sli_iocb *iocb;
+	struct timespec ts, now, lastsweep;
+	sigset_t signal_set;
+	siginfo_t si;
+	int claimed, signo;
 
-			pfl_fault_here_rc(&iocb->iocb_rc, EIO,
-			    "sliod/aio_fail");
+	sigemptyset(&signal_set);
+	sigaddset(&signal_set, SLI_AIO_SIGNO);
 
-			psclog_diag("got signal: iocb=%p", iocb);
-			lc_remove(&sli_iocb_pndg, iocb);
-			LIST_CACHE_ULOCK(&sli_iocb_pndg);
-			iocb->iocb_cbf(iocb);	/* slvr_fsaio_done() */
+	ts.tv_sec = 1;
+	ts.tv_nsec = 0;
+	PFL_GETTIMESPEC(&lastsweep);
+
+	while (pscthr_run(thr)) {
+		signo = sigtimedwait(&signal_set, &si, &ts);
+		if (signo == SLI_AIO_SIGNO) {
+			iocb = si.si_value.sival_ptr;
 			LIST_CACHE_LOCK(&sli_iocb_pndg);
+			claimed = sli_aio_claim(iocb);
+			LIST_CACHE_ULOCK(&sli_iocb_pndg);
+			if (claimed) {
+				psclog_diag("aio done: iocb=%p", iocb);
+				iocb->iocb_cbf(iocb);	/* slvr_fsaio_done() */
+			} else
+				OPSTAT_INCR("aio-stale-notify");
+		} else if (signo == -1 && errno != EAGAIN &&
+		    errno != EINTR)
+			psc_fatal("sigtimedwait");
+
+		if (sliaiothr(thr)->siat_id)
+			continue;
+		PFL_GETTIMESPEC(&now);
+		if (now.tv_sec - lastsweep.tv_sec >= SLI_AIO_LOST_SECS) {
+			sli_aio_sweep();
+			lastsweep = now;
 		}
-		LIST_CACHE_ULOCK(&sli_iocb_pndg);
 	}
 }
 
@@ -1105,9 +1609,6 @@ slirathr_main(struct psc_thread *thr)
 		f = NULL;
 		b = NULL;
 
-		if (slcfg_local->cfg_async_io)
-			break;
-
 		rarq = lc_getwait(&sli_readaheadq);
 		if (sli_fcmh_peek(&rarq->rarq_fg, &f))
 			goto next;
@@ -1132,16 +1633,26 @@ slirathr_main(struct psc_thread *thr)
 					goto next;
 			}
 			s = slvr_lookup(slvrno + i, bmap_2_bii(b));
-			rc = slvr_io_prep(s, 0, SLASH_SLVR_SIZE, SL_READ, 1);
-			/*
-			 * FixMe: This cause asserts on flags when we
-			 * encounter AIOWAIT. We need a unified way to
-			 * perform I/O done on each sliver instead of
-			 * sprinkling them all over the place.
-			 *
-			 * 09/24/2017, rc = -511, we have't release bmap
-			 * lock, so we deadlock.
-			 */
+			rc = slvr_io_prep(s, 0, SLASH_SLVR_SIZE, SL_READ,
+			    SLVR_PREPF_READAHEAD);
+			if (rc == -SLERR_AIOWAIT) {
+				/*
+				 * Let the completion drop our reference
+				 * unless it has already run.
+				 */
+				SLVR_LOCK(s);
+				if (s->slvr_flags & SLVRF_FAULTING) {
+					s->slvr_flags |= SLVRF_RAWAIT;
+					SLVR_ULOCK(s);
+					OPSTAT_INCR("readahead-aio");
+					continue;
+				}
+				if (s->slvr_flags & SLVRF_DATARDY)
+					s->slvr_flags |= SLVRF_READAHEAD;
+				SLVR_ULOCK(s);
+				slvr_rio_done(s);
+				continue;
+			}
 			slvr_io_done(s, rc);
 			slvr_rio_done(s);
 		}
@@ -1158,8 +1669,11 @@ slirathr_main(struct psc_thread *thr)
 void
 slvr_cache_init(void)
 {
-	void *p;
-	int i, nbuf;
+	struct psc_dynarray bufs = DYNARRAY_INIT;
+	struct sli_slab_node *sn;
+	struct psc_thread *thr;
+	int i, n, cnt, nbuf;
+	char *p;
 
 	psc_assert(SLASH_SLVR_SIZE <= LNET_MTU);
 
@@ -1177,21 +1691,47 @@ slvr_cache_init(void)
 	if (!use_slab_buffers)
 		goto next;
 
-	lc_reginit(&slab_buffers, struct slab_buffer_entry,
-		slab_lentry, "slabbuffers"); 
-
-	for (i = 0; i < nbuf; i++) {
-		p = mmap(NULL, SLASH_SLVR_SIZE, PROT_READ|PROT_WRITE,
-			MAP_ANONYMOUS|MAP_SHARED, -1, 0); 
-
-		if (p == MAP_FAILED)
-			psc_fatalx("Please raise vm.max_map_count limit");
+#ifdef HAVE_NUMA
+	if (numa_available() != -1)
+		sli_slab_nnodes = numa_max_node() + 1;
+#endif
+	sli_slab_nodes = PSCALLOC(sli_slab_nnodes *
+	    sizeof(*sli_slab_nodes));
+
+	for (n = 0, sn = sli_slab_nodes; n < sli_slab_nnodes; n++,
+	    sn++) {
+		cnt = nbuf / sli_slab_nnodes;
+		if (n == 0)
+			cnt += nbuf % sli_slab_nnodes;
+
+		lc_reginit(&sn->ssn_buffers, struct slab_buffer_entry,
+		    slab_lentry, "slabbuffers%d", n);
+		if (cnt == 0)
+			continue;
 
+		sn->ssn_len = (size_t)cnt * SLASH_SLVR_SIZE;
+		sn->ssn_base = mmap(NULL, sn->ssn_len,
+		    PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED, -1, 0);
+		if (sn->ssn_base == MAP_FAILED)
+			psc_fatal("mmap %zu bytes of slab buffers",
+			    sn->ssn_len);
 		OPSTAT_INCR("mmap-success");
-		slab_buffers_count++;
-		INIT_PSC_LISTENTRY((struct psc_listentry *)p);
-		lc_add(&slab_buffers, p);
-	}   
+#ifdef HAVE_NUMA
+		/* must happen before the pages are first touched */
+		if (sli_slab_nnodes > 1)
+			numa_tonode_memory(sn->ssn_base, sn->ssn_len, n);
+#endif
+
+		for (i = 0; i < cnt; i++) {
+			p = sn->ssn_base + (size_t)i * SLASH_SLVR_SIZE;
+			slab_buffers_count++;
+			INIT_PSC_LISTENTRY((struct psc_listentry *)p);
+			lc_add(&sn->ssn_buffers, p);
+			psc_dynarray_add(&bufs, p);
+		}
+	}
+	psclogs_info(SLISS_INFO, "slab buffers spread over %d NUMA "
+	    "node(s)", sli_slab_nnodes);
 
  next:
 	psc_poolmaster_init(&sli_readaheadrq_poolmaster,
@@ -1211,6 +1751,15 @@ slvr_cache_init(void)
 	lc_reginit(&sli_fcmh_update, struct fcmh_iod_info, fii_lentry2,
 	    "fcmhupdate");
 
+	/*
+	 * io_uring carries writes and sync-ahead when it can be set up,
+	 * and replaces POSIX AIO for reads if those are asynchronous.
+	 */
+	if (slcfg_local->cfg_io_uring)
+		sli_uring_init(psc_dynarray_get(&bufs),
+		    psc_dynarray_len(&bufs));
+	psc_dynarray_free(&bufs);
+
 	if (slcfg_local->cfg_async_io) {
 		psc_poolmaster_init(&sli_iocb_poolmaster,
 		    struct sli_iocb, iocb_lentry, PPMF_AUTO, 64, 64,
@@ -1225,17 +1774,62 @@ slvr_cache_init(void)
 		lc_reginit(&sli_iocb_pndg, struct sli_iocb, iocb_lentry,
 		    "iocbpndg");
 
-		pscthr_init(SLITHRT_AIO, sliaiothr_main, 0, "sliaiothr");
+		if (sli_nurings) {
+			lc_reginit(&sli_crc_verifyq, struct sli_iocb,
+			    iocb_lentry, "crcverifyq");
+			for (i = 0; i < NSLVRCRC_THRS; i++)
+				pscthr_init(SLITHRT_CRCVERIFY,
+				    slicrcvthr_main, 0, "slicrcvthr%d",
+				    i);
+		} else {
+			rlim_t soft, hard, want;
+
+			/*
+			 * Each in-flight read, at most one per slab, may
+			 * have a completion signal queued.
+			 */
+			want = slab_buffers_count + 1024;
+			if (psc_getrlimit(RLIMIT_SIGPENDING, &soft,
+			    &hard) == 0 && soft < want &&
+			    psc_setrlimit(RLIMIT_SIGPENDING,
+			    MIN(want, hard), hard) == -1)
+				psclog_warn("setrlimit SIGPENDING");
+
+			for (i = 0; i < NSLIAIO_THRS; i++) {
+				thr = pscthr_init(SLITHRT_AIO,
+				    sliaiothr_main,
+				    sizeof(struct sliaio_thread),
+				    "sliaiothr%d", i);
+				sliaiothr(thr)->siat_id = i;
+				pscthr_setready(thr);
+			}
+		}
 	}
 
 	for (i = 0; i < NSLVR_READAHEAD_THRS; i++)
 		pscthr_init(SLITHRT_READAHEAD, slirathr_main, 0,
 		    "slirathr%d", i);
 
+	lc_reginit(&sli_wb_files, struct fcmh_iod_info, fii_wb_lentry,
+	    "wbfiles");
+
+	/* by default, let dirty slivers take up to a quarter of slabs */
+	if (!sli_wb_hiwat_mb)
+		sli_wb_hiwat_mb = MAX(1, slab_buffers_count / 4);
+	if (!sli_wb_lowat_mb)
+		sli_wb_lowat_mb = sli_wb_hiwat_mb / 2;
+
 	for (i = 0; i < NSLVRSYNC_THRS; i++)
 		pscthr_init(SLITHRT_SLVR_SYNC, slisyncthr_main, 0,
 		    "slisyncthr%d", i);
 
+	lc_reginit(&sli_bmap_crcq, struct bmap_iod_info,
+	    bii_crcq_lentry, "bmapcrcq");
+
+	for (i = 0; i < NSLVRCRC_THRS; i++)
+		pscthr_init(SLITHRT_CRCUP, slicrcthr_main, 0,
+		    "slicrcthr%d", i);
+
 	slab_cache_init(nbuf);
 
 	_psc_poolmaster_init(&sli_upd_poolmaster,
@@ -1263,6 +1857,9 @@ dump_sliver_flags(int fl)
 	PFL_PRFLAG(SLVRF_LRU, &fl, &seq);
 	PFL_PRFLAG(SLVRF_FREEING, &fl, &seq);
 	PFL_PRFLAG(SLVRF_ACCESSED, &fl, &seq);
+	PFL_PRFLAG(SLVRF_READAHEAD, &fl, &seq);
+	PFL_PRFLAG(SLVRF_RAWAIT, &fl, &seq);
+	PFL_PRFLAG(SLVRF_PARTIAL, &fl, &seq);
 	if (fl)
 		printf(" unknown: %x", fl);
 	printf("\n");
@@ -65,6 +65,21 @@ struct slvr {
 	struct sli_aiocb_reply  *slvr_aioreply;
 	struct psclist_head	 slvr_lentry;	/* dirty queue */
 	SPLAY_ENTRY(slvr)	 slvr_tentry;	/* bmap tree entry */
+	/*
+	 * CRC of each block of the slab, combined into the sliver CRC
+	 * so that a partial write only rescans the blocks it touched.
+	 */
+	uint32_t		 slvr_crcblks;	/* bitmap of valid slvr_blkcrcs */
+	uint64_t		 slvr_blkcrcs[SLASH_BLKS_PER_SLVR];
+	uint32_t		 slvr_validblks; /* loaded blocks if SLVRF_PARTIAL */
+	/*
+	 * Write-back: blocks written by clients but not yet to the
+	 * backing file.  A dirty sliver holds a reference and sits on
+	 * its file's fii_wb_slvrs list until it is flushed.
+	 */
+	uint32_t		 slvr_dirtyblks;
+	uint32_t		 slvr_dirtyend;	/* end of last dirty byte */
+	struct psclist_head	 slvr_wb_lentry;
 };
 
 /* slvr_flags */
@@ -80,6 +95,12 @@ struct slvr {
 #define SLVRF_FREEING		(1 <<  4)	/* sliver is being reaped */
 #define SLVRF_ACCESSED		(1 <<  5)	/* actually used by a client */
 #define SLVRF_READAHEAD		(1 <<  6)	/* loaded via readahead logic */
+#define SLVRF_RAWAIT		(1 <<  7)	/* AIO completion drops readahead ref */
+#define SLVRF_PARTIAL		(1 <<  8)	/* only slvr_validblks are loaded */
+
+/* slvr_io_prep() flags */
+#define SLVR_PREPF_READAHEAD	(1 << 0)	/* fill for readahead */
+#define SLVR_PREPF_PARTIAL	(1 << 1)	/* may fault in only needed blocks */
 
 #define SLVR_LOCK(s)		spinlock(&(s)->slvr_lock)
 #define SLVR_ULOCK(s)		freelock(&(s)->slvr_lock)
@@ -169,17 +190,23 @@ struct sli_aiocb_reply {
 #define SLI_AIOCBSF_REPL	(1 << 0)
 #define SLI_AIOCBSF_DIO		(1 << 1)
 
+struct sli_uring_wait;
+
 struct sli_iocb {
 	struct psc_listentry	  iocb_lentry;
 	struct slvr		 *iocb_slvr;
 	struct aiocb		  iocb_aiocb;
 	void			(*iocb_cbf)(struct sli_iocb *);
 	int			  iocb_rc;
+	ssize_t			  iocb_len;	/* io_uring: bytes moved */
+	struct timespec		  iocb_start;	/* submit time */
+	struct sli_uring_wait	 *iocb_wait;	/* io_uring: sync waiter */
 };
 
 struct slvr *
 	slvr_lookup(uint32_t, struct bmap_iod_info *);
 void	slvr_cache_init(void);
+void	slvr_blkcrc_update(struct slvr *, int, int);
 int	slvr_do_crc(struct slvr *, uint64_t *);
 ssize_t	slvr_fsbytes_wio(struct slvr *, uint32_t, uint32_t);
 ssize_t	slvr_io_prep(struct slvr *, uint32_t, uint32_t, enum rw, int);
@@ -187,6 +214,7 @@ ssize_t	slvr_io_prep(struct slvr *, uint32_t, uint32_t, enum rw, int);
 void	slvr_io_done(struct slvr *, int);
 void	slvr_rio_done(struct slvr *);
 void	slvr_wio_done(struct slvr *);
+void	slvr_zero_tail(struct slvr *, uint32_t);
 
 void	slvr_remove(struct slvr *);
 void	slvr_remove_all(struct fidc_membh *);
@@ -203,6 +231,13 @@ struct sli_aiocb_reply *
 
 void	sli_aio_aiocbr_release(struct sli_aiocb_reply *);
 
+void	sli_uring_init(void * const *, int);
+int	sli_uring_read(struct sli_iocb *, int, void *, size_t, off_t);
+ssize_t	sli_uring_pwrite(int, const void *, size_t, off_t);
+void	sli_uring_fsync(const int *, int);
+
+extern int			 sli_nurings;
+
 
 struct sli_readaheadrq {
 	struct sl_fidgen	rarq_fg;
@@ -213,10 +248,26 @@ struct sli_readaheadrq {
 
 extern struct psc_poolmgr	*sli_readaheadrq_pool;
 extern struct psc_listcache	 sli_lruslvrs;
-extern struct psc_listcache	 sli_crcqslvrs;
 extern struct psc_listcache	 sli_readaheadq;
 
 
+/*
+ * Return the bitmap of sliver blocks covering [off, off + len).
+ */
+static __inline uint32_t
+slvr_blkmask(uint32_t off, uint32_t len)
+{
+	int sblk, nblks;
+
+	if (len == 0)
+		return (0);
+	sblk = off / SLASH_SLVR_BLKSZ;
+	nblks = (off + len - 1) / SLASH_SLVR_BLKSZ - sblk + 1;
+	if (nblks >= 32)
+		return (UINT32_MAX);
+	return (((1U << nblks) - 1) << sblk);
+}
+
 static __inline int
 slvr_cmp(const void *x, const void *y)
 {
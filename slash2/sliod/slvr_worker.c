@@ -22,6 +22,9 @@
 #define PSC_SUBSYS SLISS_SLVR
 #include "subsys_iod.h"
 
+#include <sys/uio.h>
+
+#include <fcntl.h>
 #include <time.h>
 
 #include "pfl/alloc.h"
@@ -49,23 +52,452 @@
 struct psc_poolmaster		 sli_upd_poolmaster;
 struct psc_poolmgr		*sli_upd_pool;
 
+struct psc_listcache		 sli_bmap_crcq;		/* bmaps with CRCs for MDS */
+
+
+/*
+ * Write-back of client writes.
+ *
+ * Instead of going to the backing file right away, a client write is
+ * absorbed into its sliver's slab, which stays pinned and is marked
+ * dirty block by block.  The sync threads flush a file's dirty
+ * slivers in file offset order once the oldest of them reaches
+ * sli_wb_max_age, or oldest file first whenever dirty bytes exceed the
+ * high watermark until they drop below the low one.  Adjacent dirty
+ * ranges are written with a single pwritev(2), and kernel writeback of
+ * the range is then started with sync_file_range(2) so data trickles
+ * to disk instead of piling up for a whole-file fsync(2).
+ *
+ * Above the high watermark, writes bypass write-back and go straight
+ * to the backing file, so dirty slivers can never tie up the slab
+ * cache.
+ *
+ * Absorbed writes have already been acknowledged, so a failed flush
+ * must not lose them: the slivers go back on the dirty list to be
+ * retried, and the errno is latched on the file to be reported to the
+ * next write and at bmap release.
+ */
+
+int				 sli_wb_enable = 1;
+int				 sli_wb_hiwat_mb;	/* 0: set from slab count */
+int				 sli_wb_lowat_mb;	/* 0: half of hiwat */
+int				 sli_wb_max_age = 5;	/* seconds */
+
+psc_atomic64_t			 sli_wb_dirty = PSC_ATOMIC64_INIT(0);
+struct psc_listcache		 sli_wb_files;		/* files with dirty slivers */
+struct psc_waitq		 sli_wb_waitq = PSC_WAITQ_INIT("wb");
+
+#define SLI_WB_MAXIOV		64	/* slivers per write-back pwritev(2) */
+
+struct sli_wb_batch {
+	struct iovec		 wbb_iovs[SLI_WB_MAXIOV];
+	struct slvr		*wbb_slvrs[SLI_WB_MAXIOV];
+	uint32_t		 wbb_masks[SLI_WB_MAXIOV];
+	uint32_t		 wbb_ends[SLI_WB_MAXIOV];
+	int			 wbb_n;
+	off_t			 wbb_off;	/* file offset of wbb_iovs[0] */
+	size_t			 wbb_len;
+};
+
+#define sli_wb_bytes(mb)	((uint64_t)(mb) * 1024 * 1024)
+
+/*
+ * Mark blocks of a sliver dirty and queue it on its file for flushing.
+ * A sliver going dirty takes a reference that is held until it is
+ * written back.  Returns whether the sliver was already dirty.
+ * @f: file of the sliver.
+ * @s: the sliver, owned by the caller through SLVRF_FAULTING.
+ * @mask: blocks to mark dirty.
+ * @end: sliver offset just past the last dirty byte.
+ */
+__static int
+sli_wb_mark(struct fidc_membh *f, struct slvr *s, uint32_t mask,
+    uint32_t end)
+{
+	struct fcmh_iod_info *fii = fcmh_2_fii(f);
+	struct timespec now;
+	int64_t added;
+	uint32_t old;
+
+	SLVR_LOCK(s);
+	old = s->slvr_dirtyblks;
+	s->slvr_dirtyblks |= mask;
+	if (!old) {
+		s->slvr_refcnt++;
+		s->slvr_dirtyend = end;
+	} else
+		s->slvr_dirtyend = MAX(s->slvr_dirtyend, end);
+	SLVR_ULOCK(s);
+
+	added = __builtin_popcount(mask & ~old) * SLASH_SLVR_BLKSZ;
+	psc_atomic64_add(&sli_wb_dirty, added);
+	OPSTAT_ADD("wb-dirty-bytes", added);
+	if (old)
+		return (1);
+
+	FCMH_LOCK(f);
+	psc_assert(psclist_disjoint(&s->slvr_wb_lentry));
+	psclist_add_tail(&s->slvr_wb_lentry, &fii->fii_wb_slvrs);
+	if (!(f->fcmh_flags & FCMH_IOD_WBFILE)) {
+		f->fcmh_flags |= FCMH_IOD_WBFILE;
+		PFL_GETTIMESPEC(&now);
+		fii->fii_wb_age = now.tv_sec;
+		fcmh_op_start_type(f, FCMH_OPCNT_WRITEBACK);
+		lc_add(&sli_wb_files, fii);
+	}
+	FCMH_ULOCK(f);
+	return (0);
+}
+
+/*
+ * Return and clear the errno latched by a failed write-back of the
+ * file, if any.
+ */
+int
+sli_wb_error(struct fidc_membh *f)
+{
+	struct fcmh_iod_info *fii = fcmh_2_fii(f);
+	int error;
+
+	FCMH_LOCK(f);
+	error = fii->fii_wb_error;
+	fii->fii_wb_error = 0;
+	FCMH_ULOCK(f);
+	return (error);
+}
+
+/*
+ * Absorb a client write, already received into the slab(s) of the
+ * given slivers, into write-back.  The caller owns the slivers through
+ * SLVRF_FAULTING.  Returns 0 if the write should go to the backing
+ * file directly instead.
+ * @f: file being written.
+ * @off: offset of the write into the bmap.
+ * @size: length of the write.
+ * @slvrs: slivers covering the write.
+ * @nslvrs: number of slivers.
+ */
+int
+sli_wb_absorb(struct fidc_membh *f, uint32_t off, uint32_t size,
+    struct slvr **slvrs, int nslvrs)
+{
+	uint32_t roff, sblk, tsize, tsz, mask, end;
+	int i;
+
+	if (!sli_wb_enable)
+		return (0);
+	if ((uint64_t)psc_atomic64_read(&sli_wb_dirty) >=
+	    sli_wb_bytes(sli_wb_hiwat_mb)) {
+		OPSTAT_INCR("wb-bypass");
+		psc_waitq_wakeall(&sli_wb_waitq);
+		return (0);
+	}
 
+	roff = off % SLASH_SLVR_SIZE;
+	sblk = roff / SLASH_SLVR_BLKSZ;
+	tsize = size + (roff & SLASH_SLVR_BLKMASK);
+
+	for (i = 0; i < nslvrs; i++) {
+		tsz = MIN((SLASH_BLKS_PER_SLVR - sblk) *
+		    SLASH_SLVR_BLKSZ, tsize);
+		tsize -= tsz;
+		mask = slvr_blkmask(sblk * SLASH_SLVR_BLKSZ, tsz);
+		end = MIN(SLASH_SLVR_SIZE, roff + size -
+		    i * SLASH_SLVR_SIZE);
+
+		/* Only the first sliver may use a blk offset. */
+		sblk = 0;
+
+		if (sli_wb_mark(f, slvrs[i], mask, end))
+			OPSTAT_INCR("wb-coalesce");
+	}
+	psc_assert(!tsize);
+	OPSTAT_ADD("wb-absorb-bytes", size);
+	return (1);
+}
+
+/*
+ * Take over a dirty sliver for flushing once nobody else is doing I/O
+ * on it.  Returns the blocks that were dirty and where the dirty bytes
+ * end in @endp.
+ */
+__static uint32_t
+sli_wb_claim(struct slvr *s, uint32_t *endp)
+{
+	int64_t len;
+	uint32_t mask;
+
+	SLVR_LOCK(s);
+	SLVR_WAIT(s, s->slvr_flags & SLVRF_FAULTING);
+	s->slvr_flags |= SLVRF_FAULTING;
+	mask = s->slvr_dirtyblks;
+	*endp = s->slvr_dirtyend;
+	s->slvr_dirtyblks = 0;
+	s->slvr_dirtyend = 0;
+	SLVR_ULOCK(s);
+
+	psc_assert(mask);
+	len = __builtin_popcount(mask) * SLASH_SLVR_BLKSZ;
+	psc_atomic64_sub(&sli_wb_dirty, len);
+	OPSTAT_SUB("wb-dirty-bytes", len);
+	return (mask);
+}
+
+/*
+ * Finish with a sliver taken by sli_wb_claim(): end our I/O and drop
+ * the reference it held while dirty.
+ */
+__static void
+sli_wb_release(struct slvr *s, int rc)
+{
+	slvr_io_done(s, rc);
+	slvr_wio_done(s);
+}
+
+/*
+ * Write out a batch of claimed slivers.  On failure, the slivers are
+ * made dirty again so the data is retried later, and the errno is
+ * latched on the file.  Returns the errno.
+ */
+__static int
+sli_wb_write(struct fidc_membh *f, struct sli_wb_batch *wbb)
+{
+	struct timespec ts0, ts1, tsd;
+	struct slvr *s;
+	int i, error = 0;
+	ssize_t rc = -1;
+
+	if (!wbb->wbb_n)
+		return (0);
+
+	PFL_GETTIMESPEC(&ts0);
+	if (f->fcmh_flags & FCMH_IOD_BACKFILE)
+		rc = pwritev(fcmh_2_fd(f), wbb->wbb_iovs, wbb->wbb_n,
+		    wbb->wbb_off);
+	else
+		errno = EBADF;
+	if (rc == -1)
+		error = errno;
+	else if ((size_t)rc != wbb->wbb_len)
+		error = EIO;
+	PFL_GETTIMESPEC(&ts1);
+	timespecsub(&ts1, &ts0, &tsd);
+
+	OPSTAT_HIST("wb-flush-usecs",
+	    tsd.tv_sec * 1000000 + tsd.tv_nsec / 1000);
+	OPSTAT_HIST("wb-batch-kb", wbb->wbb_len / 1024);
+	if (error) {
+		OPSTAT_INCR("wb-write-error");
+		DEBUG_FCMH(PLL_ERROR, f, "write-back failed, will retry: "
+		    "off=%"PRId64" len=%zu rc=%zd errno=%d",
+		    wbb->wbb_off, wbb->wbb_len, rc, error);
+		FCMH_LOCK(f);
+		fcmh_2_fii(f)->fii_wb_error = error;
+		FCMH_ULOCK(f);
+	} else {
+		pfl_opstat_add(sli_backingstore_iostats.wr, rc);
+		OPSTAT_ADD("wb-flush-bytes", rc);
+	}
+
+	for (i = 0; i < wbb->wbb_n; i++) {
+		s = wbb->wbb_slvrs[i];
+		if (error)
+			/* the dirty reference is taken anew */
+			sli_wb_mark(f, s, wbb->wbb_masks[i],
+			    wbb->wbb_ends[i]);
+		else
+			slvr_schedule_crc(s);
+		sli_wb_release(s, 0);
+	}
+	wbb->wbb_n = 0;
+	wbb->wbb_len = 0;
+	return (error);
+}
+
+__static int
+sli_wb_cmp(const void *a, const void *b)
+{
+	struct slvr * const *x = a, * const *y = b;
+
+	return (CMP(slvr_2_fileoff(*x, 0), slvr_2_fileoff(*y, 0)));
+}
+
+/*
+ * Write back all dirty slivers of a file in file offset order,
+ * coalescing adjacent dirty ranges into as few pwritev(2) calls as
+ * possible, and start kernel writeback of what was written.  Each
+ * sliver is written from its first dirty block up to the end of the
+ * last byte written to it, so the backing file never grows past what
+ * clients wrote.  Returns the errno of a failed write; the slivers
+ * affected stay dirty.
+ * @f: the file.
+ * @discard: drop the dirty data instead, e.g. because the backing
+ *	file is gone.
+ */
+int
+sli_wb_flush_fcmh(struct fidc_membh *f, int discard)
+{
+	struct psc_dynarray a = DYNARRAY_INIT;
+	struct fcmh_iod_info *fii = fcmh_2_fii(f);
+	struct sli_wb_batch wbb;
+	struct slvr *s, *tmp;
+	off_t off, lo = 0, hi = 0;
+	int i, sblk, nblks, rc, error = 0;
+	uint32_t mask, end;
+	size_t len;
+
+	FCMH_LOCK(f);
+	psclist_for_each_entry_safe(s, tmp, &fii->fii_wb_slvrs,
+	    slvr_wb_lentry) {
+		psclist_del(&s->slvr_wb_lentry, &fii->fii_wb_slvrs);
+		psc_dynarray_add(&a, s);
+	}
+	FCMH_ULOCK(f);
+
+	if (!psc_dynarray_len(&a)) {
+		psc_dynarray_free(&a);
+		return (0);
+	}
+	psc_dynarray_sort(&a, qsort, sli_wb_cmp);
+
+	wbb.wbb_n = 0;
+	wbb.wbb_len = 0;
+	DYNARRAY_FOREACH(s, i, &a) {
+		mask = sli_wb_claim(s, &end);
+		sblk = __builtin_ctz(mask);
+		nblks = 32 - __builtin_clz(mask) - sblk;
+		if (discard) {
+			OPSTAT_ADD("wb-discard-bytes",
+			    __builtin_popcount(mask) * SLASH_SLVR_BLKSZ);
+			sli_wb_release(s, 0);
+			continue;
+		}
+
+		slvr_blkcrc_update(s, sblk, nblks);
+		off = slvr_2_fileoff(s, sblk);
+		len = end - sblk * SLASH_SLVR_BLKSZ;
+		if (wbb.wbb_n && (wbb.wbb_n == SLI_WB_MAXIOV ||
+		    off != wbb.wbb_off + (off_t)wbb.wbb_len)) {
+			rc = sli_wb_write(f, &wbb);
+			if (rc)
+				error = rc;
+		}
+		if (!wbb.wbb_n)
+			wbb.wbb_off = off;
+		if (i == 0)
+			lo = off;
+		wbb.wbb_iovs[wbb.wbb_n].iov_base = slvr_2_buf(s, sblk);
+		wbb.wbb_iovs[wbb.wbb_n].iov_len = len;
+		wbb.wbb_masks[wbb.wbb_n] = mask;
+		wbb.wbb_ends[wbb.wbb_n] = end;
+		wbb.wbb_slvrs[wbb.wbb_n++] = s;
+		wbb.wbb_len += len;
+		hi = off + len;
+	}
+	rc = sli_wb_write(f, &wbb);
+	if (rc)
+		error = rc;
+	psc_dynarray_free(&a);
+
+	if (discard)
+		return (0);
+	OPSTAT_INCR("wb-flush-file");
+#ifdef HAVE_SYNC_FILE_RANGE
+	if (f->fcmh_flags & FCMH_IOD_BACKFILE &&
+	    sync_file_range(fcmh_2_fd(f), lo, hi - lo,
+	    SYNC_FILE_RANGE_WRITE) == -1)
+		DEBUG_FCMH(PLL_WARN, f, "sync_file_range errno=%d",
+		    errno);
+#else
+	(void)lo;
+	(void)hi;
+#endif
+	return (error);
+}
+
+/*
+ * Flush a file taken off sli_wb_files.  Writes arriving meanwhile, or
+ * a failed write-back, requeue the file.  Returns the errno of a failed
+ * write-back.
+ */
+__static int
+sli_wb_flush_file(struct fcmh_iod_info *fii)
+{
+	struct fidc_membh *f = fii_2_fcmh(fii);
+	int rc;
+
+	FCMH_LOCK(f);
+	f->fcmh_flags &= ~FCMH_IOD_WBFILE;
+	FCMH_ULOCK(f);
+
+	rc = sli_wb_flush_fcmh(f, !(f->fcmh_flags & FCMH_IOD_BACKFILE));
+	fcmh_op_done_type(f, FCMH_OPCNT_WRITEBACK);
+	return (rc);
+}
+
+/*
+ * Flush files that have been dirty for too long, or oldest first while
+ * dirty bytes are above the high watermark until they drop below the
+ * low one.  A failed write-back ends the pass so that requeued data is
+ * not retried in a tight loop.
+ */
+__static void
+sli_wb_flush(void)
+{
+	struct fcmh_iod_info *fii;
+	struct timespec now;
+	int pressure = 0;
+	uint64_t dirty;
+
+	for (;;) {
+		dirty = psc_atomic64_read(&sli_wb_dirty);
+		if (dirty >= sli_wb_bytes(sli_wb_hiwat_mb))
+			pressure = 1;
+		else if (dirty <= sli_wb_bytes(sli_wb_lowat_mb))
+			pressure = 0;
+
+		PFL_GETTIMESPEC(&now);
+		LIST_CACHE_LOCK(&sli_wb_files);
+		fii = lc_peekhead(&sli_wb_files);
+		if (fii && (pressure ||
+		    fii->fii_wb_age + sli_wb_max_age <= now.tv_sec))
+			lc_remove(&sli_wb_files, fii);
+		else
+			fii = NULL;
+		LIST_CACHE_ULOCK(&sli_wb_files);
+		if (fii == NULL)
+			break;
+
+		if (pressure)
+			OPSTAT_INCR("wb-flush-pressure");
+		else
+			OPSTAT_INCR("wb-flush-age");
+		if (sli_wb_flush_file(fii))
+			break;
+	}
+}
+
+/*
+ * Start writeback of files that have seen many direct writes so their
+ * dirty pages do not all land on the final fsync(2) at bmap release.
+ * Files that are busy are left for the next pass.
+ */
 void
 sli_sync_ahead(struct psc_dynarray *a)
 {
-	int i, skip;
+	int i;
 	struct fidc_membh *f;
 	struct fcmh_iod_info *fii;
+#ifndef HAVE_SYNC_FILE_RANGE
+	int *fds;
+#endif
 
- restart:
-
-	skip = 0;
 	LIST_CACHE_LOCK(&sli_fcmh_dirty);
 	LIST_CACHE_FOREACH(fii, &sli_fcmh_dirty) {
 		f = fii_2_fcmh(fii);
 
 		if (!FCMH_TRYLOCK(f)) {
-			skip++;
+			OPSTAT_INCR("sync-ahead-busy");
 			continue;
 		}
 		if (f->fcmh_flags & FCMH_IOD_SYNCFILE) {
@@ -80,9 +512,27 @@ sli_sync_ahead(struct psc_dynarray *a)
 	}
 	LIST_CACHE_ULOCK(&sli_fcmh_dirty);
 
-	DYNARRAY_FOREACH(f, i, a) {
+#ifdef HAVE_SYNC_FILE_RANGE
+	/* only start writeback; bmap release waits for it */
+	DYNARRAY_FOREACH(f, i, a)
+		if (sync_file_range(fcmh_2_fd(f), 0, 0,
+		    SYNC_FILE_RANGE_WRITE) == -1)
+			DEBUG_FCMH(PLL_WARN, f,
+			    "sync_file_range errno=%d", errno);
+#else
+	/* issue the whole batch at once if io_uring is up */
+	if (sli_nurings && psc_dynarray_len(a)) {
+		fds = PSCALLOC(psc_dynarray_len(a) * sizeof(*fds));
+		DYNARRAY_FOREACH(f, i, a)
+			fds[i] = fcmh_2_fd(f);
+		sli_uring_fsync(fds, psc_dynarray_len(a));
+		PSCFREE(fds);
+	} else
+		DYNARRAY_FOREACH(f, i, a)
+			fsync(fcmh_2_fd(f));
+#endif
 
-		fsync(fcmh_2_fd(f));
+	DYNARRAY_FOREACH(f, i, a) {
 		OPSTAT_INCR("sync-ahead");
 
 		DEBUG_FCMH(PLL_DIAG, f, "sync ahead");
@@ -98,10 +548,6 @@ sli_sync_ahead(struct psc_dynarray *a)
 		fcmh_op_done_type(f, FCMH_OPCNT_SYNC_AHEAD);
 	}
 	psc_dynarray_reset(a);
-	if (skip) {
-		sleep(5);
-		goto restart;
-	}
 }
 
 void
@@ -111,8 +557,9 @@ slisyncthr_main(struct psc_thread *thr)
 
 	psc_dynarray_ensurelen(&a, SLI_SYNC_AHEAD_BATCH);
 	while (pscthr_run(thr)) {
-		lc_peekheadwait(&sli_fcmh_dirty);
+		sli_wb_flush();
 		sli_sync_ahead(&a);
+		psc_waitq_waitrel_s(&sli_wb_waitq, NULL, 1);
 	}
 	psc_dynarray_free(&a);
 }
@@ -171,6 +618,145 @@ sli_rmi_update_cb(struct pscrpc_request *rq,
 }
 
 
+/*
+ * Check whether a bmap has sliver CRCs not yet sent to the MDS.
+ */
+__static int
+sli_bmap_crcdirty(struct bmap_iod_info *bii)
+{
+	int i;
+
+	BII_LOCK_ENSURE(bii);
+	for (i = 0; i < SLASH_SLVRS_PER_BMAP; i++)
+		if (bii->bii_crcstates[i] & BMAP_SLVR_CRCDIRTY)
+			return (1);
+	return (0);
+}
+
+/*
+ * Send the CRCs of slivers in a bmap written since its last update to
+ * the MDS, at most MAX_BMAP_NCRC_UPDATES per RPC.  On communication
+ * failure, the CRCs are marked dirty again so they will be resent.
+ */
+__static int
+sli_rmi_bmap_crcwrt(struct slrpc_cservice *csvc, struct bmap *b)
+{
+	struct bmap_iod_info *bii = bmap_2_bii(b);
+	struct pscrpc_request *rq = NULL;
+	struct srm_bmap_crcwrt_req *mq;
+	struct srm_bmap_crcwrt_rep *mp;
+	uint32_t i, slot;
+	int rc;
+
+	rc = SL_RSX_NEWREQ(csvc, SRMT_BMAPCRCWRT, rq, mq, mp);
+	if (rc)
+		return (rc);
+
+	mq->fg = b->bcm_fcmh->fcmh_fg;
+	mq->bmapno = b->bcm_bmapno;
+
+	BMAP_LOCK(b);
+	mq->seq = bii->bii_seq;
+	for (i = 0; i < SLASH_SLVRS_PER_BMAP &&
+	    mq->ncrcs < MAX_BMAP_NCRC_UPDATES; i++) {
+		if (!(bii->bii_crcstates[i] & BMAP_SLVR_CRCDIRTY))
+			continue;
+		bii->bii_crcstates[i] &= ~BMAP_SLVR_CRCDIRTY;
+		mq->crcs[mq->ncrcs].slot = i;
+		mq->crcs[mq->ncrcs].crc = bii->bii_crcs[i];
+		mq->ncrcs++;
+	}
+	BMAP_ULOCK(b);
+
+	if (!mq->ncrcs)
+		goto out;
+
+	/* handled by slm_rmi_handle_bmap_crcwrt() */
+	rc = SL_RSX_WAITREP(csvc, rq, mp);
+	if (rc) {
+		OPSTAT_INCR("crc-update-failure");
+		BMAP_LOCK(b);
+		for (i = 0; i < mq->ncrcs; i++)
+			bii->bii_crcstates[mq->crcs[i].slot] |=
+			    BMAP_SLVR_CRCDIRTY;
+		BMAP_ULOCK(b);
+	} else if (mp->rc) {
+		/*
+		 * The MDS refused them, so nobody else will check
+		 * these slivers; stop doing so ourselves unless they
+		 * have been rewritten meanwhile.
+		 */
+		OPSTAT_INCR("crc-update-reject");
+		BMAP_LOCK(b);
+		for (i = 0; i < mq->ncrcs; i++) {
+			slot = mq->crcs[i].slot;
+			if (!(bii->bii_crcstates[slot] &
+			    BMAP_SLVR_CRCDIRTY))
+				bii->bii_crcstates[slot] &=
+				    ~BMAP_SLVR_CRC;
+		}
+		BMAP_ULOCK(b);
+	} else
+		OPSTAT_ADD("crc-update", mq->ncrcs);
+	DEBUG_BMAP(rc || mp->rc ? PLL_WARN : PLL_DIAG, b,
+	    "ncrcs=%u rc=%d", mq->ncrcs, rc ? rc : mp->rc);
+
+ out:
+	pscrpc_req_finished(rq);
+	return (rc);
+}
+
+/*
+ * Drain the queue of bmaps whose sliver CRCs have changed.  A bmap is
+ * only queued once while it has dirty CRCs (BMAPF_CRUD_INFLIGHT), so
+ * waiting CRC_QUEUE_AGE lets more writes to it pile into one RPC.
+ */
+void
+slicrcthr_main(struct psc_thread *thr)
+{
+	struct slrpc_cservice *csvc;
+	struct bmap_iod_info *bii;
+	struct timespec now;
+	struct bmap *b;
+	int rc;
+
+	while (pscthr_run(thr)) {
+		bii = lc_getwait(&sli_bmap_crcq);
+		b = bii_2_bmap(bii);
+
+		PFL_GETTIMESPEC(&now);
+		if (bii->bii_crcq_age + CRC_QUEUE_AGE > now.tv_sec)
+			sleep(bii->bii_crcq_age + CRC_QUEUE_AGE -
+			    now.tv_sec);
+
+		rc = 0;
+		csvc = NULL;
+		BMAP_LOCK(b);
+		while (sli_bmap_crcdirty(bii)) {
+			BMAP_ULOCK(b);
+			if (csvc == NULL)
+				rc = sli_rmi_getcsvc(&csvc);
+			if (!rc)
+				rc = sli_rmi_bmap_crcwrt(csvc, b);
+			BMAP_LOCK(b);
+			if (rc)
+				break;
+		}
+		if (rc) {
+			/* MDS unreachable; try again later */
+			PFL_GETTIMESPEC(&now);
+			bii->bii_crcq_age = now.tv_sec;
+			BMAP_ULOCK(b);
+			lc_add(&sli_bmap_crcq, bii);
+		} else {
+			b->bcm_flags &= ~BMAPF_CRUD_INFLIGHT;
+			bmap_op_done_type(b, BMAP_OPCNT_BCRSCHED);
+		}
+		if (csvc)
+			sl_csvc_decref(csvc);
+	}
+}
+
 /*
  * We used to do bulk RPC in non-blocking mode.  See how SRMT_BMAPCRCWRT
  * was implemented in the git history.
@@ -0,0 +1,375 @@
+/* $Id$ */
+/*
+ * %GPL_START_LICENSE%
+ * ---------------------------------------------------------------------
+ * Copyright 2008-2018, Pittsburgh Supercomputing Center
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed WITHOUT ANY WARRANTY; without even the
+ * implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License contained in the file
+ * `COPYING-GPL' at the top of this distribution or at
+ * https://www.gnu.org/licenses/gpl-2.0.html for more details.
+ * ---------------------------------------------------------------------
+ * %END_LICENSE%
+ */
+
+/*
+ * io_uring(7) backend for backing-store I/O.  Sliver reads complete
+ * asynchronously through slvr_fsaio_done() like POSIX AIO; writes and
+ * sync-ahead fsync(2)s are submitted through the rings and waited for.
+ *
+ * Submitters are spread over a few rings by thread ID.  Whoever finds
+ * a ring idle enters the kernel on behalf of everyone who queued
+ * entries in the meantime, so concurrent service threads share
+ * io_uring_enter(2) calls.  Each ring has its own completion thread.
+ */
+
+#define PSC_SUBSYS SLISS_SLVR
+#include "subsys_iod.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "pfl/alloc.h"
+#include "pfl/iouring.h"
+#include "pfl/lock.h"
+#include "pfl/log.h"
+#include "pfl/opstats.h"
+#include "pfl/thread.h"
+#include "pfl/time.h"
+#include "pfl/waitq.h"
+
+#include "slerr.h"
+#include "sliod.h"
+#include "slvr.h"
+
+int			 sli_nurings;
+
+#ifdef HAVE_IO_URING
+
+#define SLI_URING_NRINGS	4
+#define SLI_URING_DEPTH		256
+#define SLI_URING_NREAP		32
+
+struct sli_uring {
+	struct pfl_iouring	 su_ring;
+	psc_spinlock_t		 su_lock;	/* submission side */
+	int			 su_submitting;
+};
+
+/* synchronous callers wait here for a batch of their requests */
+struct sli_uring_wait {
+	psc_spinlock_t		 suw_lock;
+	struct psc_waitq	 suw_waitq;
+	int			 suw_npending;
+};
+
+struct sliuring_thread {
+	struct sli_uring	*sut_ring;
+};
+
+PSCTHR_MKCAST(sliuringthr, sliuring_thread, SLITHRT_AIO)
+
+struct sli_uring	 sli_urings[SLI_URING_NRINGS];
+
+/* registered slab buffers, sorted by address */
+void			**sli_uring_bufs;
+int			 sli_uring_nbufs;
+
+extern struct psc_poolmgr *sli_iocb_pool;
+extern struct pfl_iostats_rw sli_backingstore_iostats;
+
+__static int
+sli_uring_bufcmp(const void *a, const void *b)
+{
+	void * const *x = a, * const *y = b;
+
+	return (CMP((uintptr_t)*x, (uintptr_t)*y));
+}
+
+/*
+ * Find the registered buffer index of a slab, or -1.
+ */
+__static int
+sli_uring_bufidx(const void *buf)
+{
+	void **p;
+
+	if (sli_uring_nbufs == 0)
+		return (-1);
+	p = bsearch(&buf, sli_uring_bufs, sli_uring_nbufs,
+	    sizeof(*sli_uring_bufs), sli_uring_bufcmp);
+	return (p ? p - sli_uring_bufs : -1);
+}
+
+/*
+ * Queue one request and make sure it gets submitted, either by us or
+ * by a thread already inside io_uring_enter(2) on this ring.
+ */
+__static void
+sli_uring_queue(int op, int fd, const void *buf, size_t len, off_t off,
+    struct sli_iocb *iocb)
+{
+	struct sli_uring *su;
+	struct io_uring_sqe *sqe;
+	int idx, rc;
+
+	su = &sli_urings[pscthr_gettid() % sli_nurings];
+	spinlock(&su->su_lock);
+	while ((sqe = pfl_iouring_get_sqe(&su->su_ring)) == NULL) {
+		OPSTAT_INCR("uring-sq-full");
+		pfl_iouring_submit(&su->su_ring);
+		freelock(&su->su_lock);
+		sched_yield();
+		spinlock(&su->su_lock);
+	}
+
+	pfl_iouring_prep_rw(sqe, op, fd, buf, len, off, iocb);
+	if (op == IORING_OP_READ || op == IORING_OP_WRITE) {
+		idx = sli_uring_bufidx(buf);
+		if (idx != -1) {
+			sqe->opcode = op == IORING_OP_READ ?
+			    IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+			sqe->buf_index = idx;
+		}
+	}
+
+	if (su->su_submitting) {
+		OPSTAT_INCR("uring-submit-batched");
+		freelock(&su->su_lock);
+		return;
+	}
+	su->su_submitting = 1;
+	do {
+		rc = pfl_iouring_submit(&su->su_ring);
+		freelock(&su->su_lock);
+		if (rc > 0)
+			OPSTAT_ADD("uring-submit", rc);
+		else if (rc < 0) {
+			/* e.g. completion queue overflow; let it drain */
+			OPSTAT_INCR("uring-submit-err");
+			sched_yield();
+		}
+		spinlock(&su->su_lock);
+	} while (pfl_iouring_sq_ready(&su->su_ring));
+	su->su_submitting = 0;
+	freelock(&su->su_lock);
+}
+
+__static void
+sli_uring_wakeup(struct sli_iocb *iocb)
+{
+	struct sli_uring_wait *suw = iocb->iocb_wait;
+
+	spinlock(&suw->suw_lock);
+	if (--suw->suw_npending == 0)
+		psc_waitq_wakeall(&suw->suw_waitq);
+	freelock(&suw->suw_lock);
+}
+
+__static void
+sli_uring_wait(struct sli_uring_wait *suw)
+{
+	spinlock(&suw->suw_lock);
+	while (suw->suw_npending) {
+		psc_waitq_wait(&suw->suw_waitq, &suw->suw_lock);
+		spinlock(&suw->suw_lock);
+	}
+	freelock(&suw->suw_lock);
+}
+
+void
+sliuringthr_main(struct psc_thread *thr)
+{
+	struct io_uring_cqe cqes[SLI_URING_NREAP];
+	struct sli_uring *su = sliuringthr(thr)->sut_ring;
+	struct sli_iocb *iocb;
+	int i, n;
+
+	while (pscthr_run(thr)) {
+		n = pfl_iouring_reap(&su->su_ring, cqes, nitems(cqes), 1);
+		if (n < 0) {
+			psclog_errorx("io_uring wait: %s", strerror(-n));
+			sleep(1);
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			iocb = (void *)(uintptr_t)cqes[i].user_data;
+			iocb->iocb_len = cqes[i].res;
+			iocb->iocb_rc = cqes[i].res < 0 ? -cqes[i].res : 0;
+			iocb->iocb_cbf(iocb);
+		}
+	}
+}
+
+/*
+ * Read a sliver asynchronously.  On success, -SLERR_AIOWAIT is returned
+ * and the iocb callback runs when the data are in.
+ */
+int
+sli_uring_read(struct sli_iocb *iocb, int fd, void *buf, size_t len,
+    off_t off)
+{
+	PFL_GETTIMESPEC(&iocb->iocb_start);
+	sli_uring_queue(IORING_OP_READ, fd, buf, len, off, iocb);
+	return (-SLERR_AIOWAIT);
+}
+
+/*
+ * pwrite(2) equivalent going through a ring.
+ */
+ssize_t
+sli_uring_pwrite(int fd, const void *buf, size_t len, off_t off)
+{
+	struct sli_uring_wait suw;
+	struct sli_iocb iocb;
+
+	memset(&iocb, 0, sizeof(iocb));
+	INIT_SPINLOCK(&suw.suw_lock);
+	psc_waitq_init(&suw.suw_waitq, "uring-write");
+	suw.suw_npending = 1;
+	iocb.iocb_wait = &suw;
+	iocb.iocb_cbf = sli_uring_wakeup;
+
+	sli_uring_queue(IORING_OP_WRITE, fd, buf, len, off, &iocb);
+	sli_uring_wait(&suw);
+	psc_waitq_destroy(&suw.suw_waitq);
+
+	if (iocb.iocb_rc) {
+		errno = iocb.iocb_rc;
+		return (-1);
+	}
+	return (iocb.iocb_len);
+}
+
+/*
+ * fsync(2) a batch of files at once and wait for all of them.
+ */
+void
+sli_uring_fsync(const int *fds, int n)
+{
+	struct sli_uring_wait suw;
+	struct sli_iocb *iocbs;
+	int i;
+
+	iocbs = PSCALLOC(n * sizeof(*iocbs));
+	INIT_SPINLOCK(&suw.suw_lock);
+	psc_waitq_init(&suw.suw_waitq, "uring-fsync");
+	suw.suw_npending = n;
+	for (i = 0; i < n; i++) {
+		iocbs[i].iocb_wait = &suw;
+		iocbs[i].iocb_cbf = sli_uring_wakeup;
+		sli_uring_queue(IORING_OP_FSYNC, fds[i], NULL, 0, 0,
+		    &iocbs[i]);
+	}
+	sli_uring_wait(&suw);
+	psc_waitq_destroy(&suw.suw_waitq);
+
+	for (i = 0; i < n; i++)
+		if (iocbs[i].iocb_rc)
+			psclog_warnx("fsync fd=%d: %s", fds[i],
+			    strerror(iocbs[i].iocb_rc));
+	PSCFREE(iocbs);
+}
+
+/*
+ * Set up the rings and register the slab buffers with them.  On any
+ * failure, sli_nurings stays zero and the caller falls back to the
+ * other I/O paths.
+ */
+void
+sli_uring_init(void * const *bufs, int nbufs)
+{
+	struct psc_thread *thr;
+	struct sli_uring *su;
+	struct iovec *iov;
+	int i, j, rc;
+
+	for (i = 0; i < SLI_URING_NRINGS; i++) {
+		su = &sli_urings[i];
+		rc = pfl_iouring_init(&su->su_ring, SLI_URING_DEPTH);
+		if (rc) {
+			psclog_warnx("io_uring setup: %s; falling back",
+			    strerror(-rc));
+			for (j = 0; j < i; j++)
+				pfl_iouring_destroy(&sli_urings[j].su_ring);
+			return;
+		}
+		INIT_SPINLOCK(&su->su_lock);
+	}
+
+	if (nbufs) {
+		sli_uring_bufs = PSCALLOC(nbufs * sizeof(*bufs));
+		memcpy(sli_uring_bufs, bufs, nbufs * sizeof(*bufs));
+		qsort(sli_uring_bufs, nbufs, sizeof(*sli_uring_bufs),
+		    sli_uring_bufcmp);
+
+		iov = PSCALLOC(nbufs * sizeof(*iov));
+		for (i = 0; i < nbufs; i++) {
+			iov[i].iov_base = sli_uring_bufs[i];
+			iov[i].iov_len = SLASH_SLVR_SIZE;
+		}
+		for (i = 0; i < SLI_URING_NRINGS; i++) {
+			rc = pfl_iouring_register_buffers(
+			    &sli_urings[i].su_ring, iov, nbufs);
+			if (rc)
+				break;
+		}
+		PSCFREE(iov);
+		if (rc) {
+			/* plain reads/writes still work without them */
+			psclog_warnx("io_uring buffer registration: %s",
+			    strerror(-rc));
+			PSCFREE(sli_uring_bufs);
+		} else
+			sli_uring_nbufs = nbufs;
+	}
+
+	sli_nurings = SLI_URING_NRINGS;
+	for (i = 0; i < SLI_URING_NRINGS; i++) {
+		thr = pscthr_init(SLITHRT_AIO, sliuringthr_main,
+		    sizeof(struct sliuring_thread), "sliuringthr%d", i);
+		sliuringthr(thr)->sut_ring = &sli_urings[i];
+		pscthr_setready(thr);
+	}
+	psclogs_info(SLISS_INFO, "io_uring enabled: %d rings, "
+	    "%d registered buffers", sli_nurings, sli_uring_nbufs);
+}
+
+#else
+
+int
+sli_uring_read(__unusedx struct sli_iocb *iocb, __unusedx int fd,
+    __unusedx void *buf, __unusedx size_t len, __unusedx off_t off)
+{
+	psc_fatalx("io_uring not supported");
+}
+
+ssize_t
+sli_uring_pwrite(__unusedx int fd, __unusedx const void *buf,
+    __unusedx size_t len, __unusedx off_t off)
+{
+	psc_fatalx("io_uring not supported");
+}
+
+void
+sli_uring_fsync(__unusedx const int *fds, __unusedx int n)
+{
+	psc_fatalx("io_uring not supported");
+}
+
+void
+sli_uring_init(__unusedx void * const *bufs, __unusedx int nbufs)
+{
+	psclog_warnx("io_uring not supported on this platform; "
+	    "falling back");
+}
+
+#endif /* HAVE_IO_URING */
@@ -39,6 +39,7 @@
 #include "slashrpc.h"
 
 #include "slashd/bmap_mds.h"
+#include "slashd/bwshape_mds.h"
 #include "slashd/ctl_mds.h"
 #include "slashd/repl_mds.h"
 
@@ -92,6 +93,68 @@ packshow_bml(__unusedx char *s)
 	psc_ctlmsg_push(SLMCMT_GETBML, sizeof(struct slmctlmsg_bml));
 }
 
+void
+packshow_bwshape(__unusedx char *s)
+{
+	psc_ctlmsg_push(SLMCMT_GETBWSHAPE,
+	    sizeof(struct slmctlmsg_bwshape));
+}
+
+int
+slm_bwshape_prhdr(__unusedx struct psc_ctlmsghdr *mh,
+    __unusedx const void *m)
+{
+	printf("%-32s %-7s %7s %8s %7s %7s %8s %5s\n",
+	    "bucket", "type", "rate", "tokens", "xrate", "total",
+	    "refused", "defer");
+	return(PSC_CTL_DISPLAY_WIDTH+16);
+}
+
+void
+slm_bwshape_prdat(__unusedx const struct psc_ctlmsghdr *mh,
+    const void *m)
+{
+	char ratebuf[PSCFMT_HUMAN_BUFSIZ], tokbuf[PSCFMT_HUMAN_BUFSIZ];
+	char xratebuf[PSCFMT_HUMAN_BUFSIZ], totbuf[PSCFMT_HUMAN_BUFSIZ];
+	const struct slmctlmsg_bwshape *scbw = m;
+	const char *type;
+
+	switch (scbw->scbw_type) {
+	case BWST_EGRESS:
+		type = "egress";
+		break;
+	case BWST_INGRESS:
+		type = "ingress";
+		break;
+	default:
+		type = "link";
+		break;
+	}
+	printf("%-32s %-7s ", scbw->scbw_name, type);
+	if (scbw->scbw_rate == SLM_BWS_UNLIMITED)
+		printf("%7s %8s", "-", "-");
+	else if (psc_ctl_inhuman)
+		printf("%7"PRId64" %8"PRId64, scbw->scbw_rate,
+		    scbw->scbw_tokens);
+	else {
+		pfl_fmt_human(ratebuf, scbw->scbw_rate);
+		pfl_fmt_human(tokbuf, scbw->scbw_tokens < 0 ?
+		    -scbw->scbw_tokens : scbw->scbw_tokens);
+		printf("%7s %c%7s", ratebuf,
+		    scbw->scbw_tokens < 0 ? '-' : ' ', tokbuf);
+	}
+	if (psc_ctl_inhuman)
+		printf(" %7"PRId64" %7"PRIu64, scbw->scbw_xrate,
+		    scbw->scbw_nbytes);
+	else {
+		pfl_fmt_human(xratebuf, scbw->scbw_xrate);
+		pfl_fmt_human(totbuf, scbw->scbw_nbytes);
+		printf(" %7s %7s", xratebuf, totbuf);
+	}
+	printf(" %8"PRIu64" %5d\n", scbw->scbw_nrefused,
+	    scbw->scbw_ndeferred);
+}
+
 int
 slm_replqueued_prhdr(__unusedx struct psc_ctlmsghdr *mh,
     __unusedx const void *m)
@@ -260,6 +323,7 @@ struct psc_ctlshow_ent psc_ctlshow_tab[] = {
 	PSC_CTLSHOW_DEFS,
 	{ "bmaps",		packshow_bmaps },
 	{ "bml",		packshow_bml },
+	{ "bwshape",		packshow_bwshape },
 	{ "connections",	packshow_conns },
 	{ "fcmhs",		packshow_fcmhs },
 	{ "replqueued",		packshow_replqueued },
@@ -279,7 +343,9 @@ struct psc_ctlmsg_prfmt psc_ctlmsg_prfmts[] = {
 	{ slm_replqueued_prhdr,	slm_replqueued_prdat,	sizeof(struct slmctlmsg_replqueued),	NULL },
 	{ slm_statfs_prhdr,	slm_statfs_prdat,	sizeof(struct slmctlmsg_statfs),	NULL },
 	{ NULL,			NULL,			0,					NULL },
-	{ slm_bml_prhdr,	slm_bml_prdat,		sizeof(struct slmctlmsg_bml),		NULL }
+	{ slm_bml_prhdr,	slm_bml_prdat,		sizeof(struct slmctlmsg_bml),		NULL },
+	{ NULL,			NULL,			0,					NULL },
+	{ slm_bwshape_prhdr,	slm_bwshape_prdat,	sizeof(struct slmctlmsg_bwshape),	NULL }
 };
 
 struct psc_ctlcmd_req psc_ctlcmd_reqs[] = {
@@ -197,6 +197,7 @@ slnewfs_create(const char *fsroot, uint32_t depth)
 	/* more journals */
 	slnewfs_touchfile("%s/%s.%d", metadir, SL_FN_UPDATELOG, 0);
 	slnewfs_touchfile("%s/%s", metadir, SL_FN_UPDATEPROG);
+	slnewfs_touchfile("%s/%s", metadir, SL_FN_UPDATERECVPROG);
 	slnewfs_touchfile("%s/%s.%d", metadir, SL_FN_RECLAIMLOG, 0);
 	slnewfs_touchfile("%s/%s", metadir, SL_FN_RECLAIMPROG);
 
@@ -65,12 +65,15 @@ print qq{# 1 "$fn"\n};
 
 if (!$opts{f} and (
     basename($fn) eq "alloc.c" or
+    basename($fn) eq "crc.c" or
     basename($fn) eq "dynarray.c" or
     basename($fn) eq "hashtbl.c" or
     basename($fn) eq "init.c" or
     basename($fn) eq "lib-move.c" or
+    basename($fn) eq "lock.c" or
     basename($fn) eq "lockedlist.c" or
     basename($fn) eq "log.c" or
+    basename($fn) eq "logasync.c" or
     basename($fn) eq "subsys.c" or
     basename($fn) eq "thread.c" or
     basename($fn) eq "typedump.c" or